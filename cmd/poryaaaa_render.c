@@ -16,6 +16,7 @@
 #include "miniaudio.h"
 
 #include <stdio.h>
+#include <ctype.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdint.h>
@@ -23,6 +24,24 @@
 #include <math.h>
 #ifdef __linux__
 #include <dlfcn.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#endif
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
+#include <pthread.h>
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <unistd.h>
+#include <errno.h>
+#include <limits.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <sys/un.h>
 #endif
 #include "m4a_engine.h"
 #include "m4a_reverb.h"
@@ -45,12 +64,72 @@ static void write_u32_le(FILE *f, uint32_t val)
     fwrite(buf, 1, 4, f);
 }
 
-static int write_wav(const char *path, const float *left, const float *right,
-                     uint64_t numSamples, int sampleRate)
+/* Bytes buffered by WavWriter between fwrite calls. */
+#define WAV_WRITE_BUFFER (1 << 20)
+
+/*
+ * Convert float frames to interleaved 16-bit little-endian PCM.  Samples are
+ * scaled by 32767, clamped to the int16 range and truncated toward zero.
+ */
+static void convert_s16le(const float *left, const float *right, uint8_t *out, size_t count)
 {
-    FILE *f = fopen(path, "wb");
-    if (!f) {
-        fprintf(stderr, "Cannot open %s for writing\n", path);
+    size_t i = 0;
+#if defined(__SSE2__) || defined(_M_X64)
+    const __m128 scale = _mm_set1_ps(32767.0f);
+    const __m128 lo = _mm_set1_ps(-32768.0f);
+    const __m128 hi = _mm_set1_ps(32767.0f);
+    for (; i + 4 <= count; i += 4) {
+        __m128 l = _mm_mul_ps(_mm_loadu_ps(left + i), scale);
+        __m128 r = _mm_mul_ps(_mm_loadu_ps(right + i), scale);
+        __m128i li = _mm_cvttps_epi32(_mm_min_ps(_mm_max_ps(l, lo), hi));
+        __m128i ri = _mm_cvttps_epi32(_mm_min_ps(_mm_max_ps(r, lo), hi));
+        /* L0 R0 L1 R1 | L2 R2 L3 R3, then pack both halves to int16 */
+        __m128i lr = _mm_packs_epi32(_mm_unpacklo_epi32(li, ri), _mm_unpackhi_epi32(li, ri));
+        _mm_storeu_si128((__m128i *)(out + i * 4), lr);
+    }
+#endif
+    for (; i < count; i++) {
+        float l = left[i] * 32767.0f;
+        float r = right[i] * 32767.0f;
+        l = l > -32768.0f ? l : -32768.0f;
+        l = l < 32767.0f ? l : 32767.0f;
+        r = r > -32768.0f ? r : -32768.0f;
+        r = r < 32767.0f ? r : 32767.0f;
+        uint16_t ul = (uint16_t)(int16_t)l;
+        uint16_t ur = (uint16_t)(int16_t)r;
+        out[i * 4 + 0] = ul & 0xFF;
+        out[i * 4 + 1] = (ul >> 8) & 0xFF;
+        out[i * 4 + 2] = ur & 0xFF;
+        out[i * 4 + 3] = (ur >> 8) & 0xFF;
+    }
+}
+
+/*
+ * Streaming 16-bit stereo WAV writer.  The header is written up front with
+ * placeholder sizes, frames are converted into a large buffer and flushed
+ * with one fwrite per buffer, and wav_close patches the RIFF sizes (or, for
+ * wav_open_stream, the sizes are known in advance).
+ */
+typedef struct {
+    FILE    *f;
+    uint8_t *buf;
+    size_t   used;
+    uint64_t frames;
+    bool     failed;
+    bool     streaming;  /* sizes written up front; nothing to patch */
+} WavWriter;
+
+/* Start a WAV on `f`: allocate the buffer and write the header with the
+ * given data size (0 when wav_close is to patch it). */
+static int wav_start(WavWriter *w, FILE *f, int sampleRate, uint32_t dataSize)
+{
+    memset(w, 0, sizeof(*w));
+    w->f = f;
+    w->buf = malloc(WAV_WRITE_BUFFER);
+    if (!w->buf) {
+        fprintf(stderr, "Out of memory allocating WAV write buffer\n");
+        fclose(w->f);
+        w->f = NULL;
         return -1;
     }
 
@@ -58,42 +137,103 @@ static int write_wav(const char *path, const float *left, const float *right,
     uint16_t bitsPerSample = 16;
     uint32_t byteRate   = (uint32_t)sampleRate * numChannels * bitsPerSample / 8;
     uint16_t blockAlign = numChannels * bitsPerSample / 8;
-    uint32_t dataSize   = (uint32_t)(numSamples * numChannels * bitsPerSample / 8);
 
     /* RIFF header */
-    fwrite("RIFF", 1, 4, f);
-    write_u32_le(f, 36 + dataSize);
-    fwrite("WAVE", 1, 4, f);
+    fwrite("RIFF", 1, 4, w->f);
+    write_u32_le(w->f, dataSize ? 36 + dataSize : 0);
+    fwrite("WAVE", 1, 4, w->f);
 
     /* fmt chunk */
-    fwrite("fmt ", 1, 4, f);
-    write_u32_le(f, 16);
-    write_u16_le(f, 1);              /* PCM */
-    write_u16_le(f, numChannels);
-    write_u32_le(f, (uint32_t)sampleRate);
-    write_u32_le(f, byteRate);
-    write_u16_le(f, blockAlign);
-    write_u16_le(f, bitsPerSample);
+    fwrite("fmt ", 1, 4, w->f);
+    write_u32_le(w->f, 16);
+    write_u16_le(w->f, 1);              /* PCM */
+    write_u16_le(w->f, numChannels);
+    write_u32_le(w->f, (uint32_t)sampleRate);
+    write_u32_le(w->f, byteRate);
+    write_u16_le(w->f, blockAlign);
+    write_u16_le(w->f, bitsPerSample);
 
     /* data chunk */
-    fwrite("data", 1, 4, f);
-    write_u32_le(f, dataSize);
+    fwrite("data", 1, 4, w->f);
+    write_u32_le(w->f, dataSize);
+    return 0;
+}
 
-    for (uint64_t i = 0; i < numSamples; i++) {
-        int32_t l = (int32_t)(left[i]  * 32767.0f);
-        int32_t r = (int32_t)(right[i] * 32767.0f);
-        if (l >  32767)  l =  32767;
-        if (l < -32768)  l = -32768;
-        if (r >  32767)  r =  32767;
-        if (r < -32768)  r = -32768;
-        write_u16_le(f, (uint16_t)(int16_t)l);
-        write_u16_le(f, (uint16_t)(int16_t)r);
+static int wav_open(WavWriter *w, const char *path, int sampleRate)
+{
+    FILE *f = fopen(path, "wb");
+    if (!f) {
+        fprintf(stderr, "Cannot open %s for writing\n", path);
+        return -1;
     }
+    return wav_start(w, f, sampleRate, 0);
+}
 
-    fclose(f);
+/* Write a WAV of exactly `frames` frames to a stream that cannot seek (a
+ * socket or pipe): the header carries the final sizes up front. */
+static int wav_open_stream(WavWriter *w, FILE *f, int sampleRate, uint64_t frames)
+{
+    uint64_t dataSize = frames * 4;
+    if (dataSize > 0xFFFFFFFFull - 36)
+        dataSize = 0xFFFFFFFFull - 36;
+    if (wav_start(w, f, sampleRate, (uint32_t)dataSize) != 0)
+        return -1;
+    w->streaming = true;
     return 0;
 }
 
+static void wav_flush(WavWriter *w)
+{
+    if (w->used > 0 && fwrite(w->buf, 1, w->used, w->f) != w->used)
+        w->failed = true;
+    w->used = 0;
+}
+
+static void wav_write(WavWriter *w, const float *left, const float *right, size_t count)
+{
+    while (count > 0) {
+        size_t room = (WAV_WRITE_BUFFER - w->used) / 4;
+        if (room == 0) {
+            wav_flush(w);
+            continue;
+        }
+        size_t n = count < room ? count : room;
+        convert_s16le(left, right, w->buf + w->used, n);
+        w->used   += n * 4;
+        w->frames += n;
+        left  += n;
+        right += n;
+        count -= n;
+    }
+}
+
+/* Flush, patch the RIFF/data sizes and close.  Returns -1 on any write error. */
+static int wav_close(WavWriter *w)
+{
+    wav_flush(w);
+    uint64_t dataSize = w->frames * 4;
+    if (dataSize > 0xFFFFFFFFull - 36) {
+        fprintf(stderr, "Warning: audio exceeds the 4 GB WAV limit; header sizes are clamped\n");
+        dataSize = 0xFFFFFFFFull - 36;
+    }
+    if (!w->streaming) {
+        if (fseek(w->f, 4, SEEK_SET) == 0)
+            write_u32_le(w->f, (uint32_t)(36 + dataSize));
+        else
+            w->failed = true;
+        if (fseek(w->f, 40, SEEK_SET) == 0)
+            write_u32_le(w->f, (uint32_t)dataSize);
+        else
+            w->failed = true;
+    }
+    if (fclose(w->f) != 0)
+        w->failed = true;
+    free(w->buf);
+    w->f   = NULL;
+    w->buf = NULL;
+    return w->failed ? -1 : 0;
+}
+
 /* ========================================================================
  * MIDI Parser (SMF Type 0 and Type 1)
  * ======================================================================== */
@@ -432,7 +572,7 @@ typedef struct {
 } RenderEventArray;
 
 /*
- * Load and parse a Standard MIDI File.
+ * Parse a Standard MIDI File held in memory; `name` is used in messages.
  *
  * On success returns a heap-allocated RenderEventArray (caller must free
  * both ->events and the struct itself).  Writes the sample index of the last
@@ -442,36 +582,22 @@ typedef struct {
  *
  * Returns NULL on error.
  */
-static RenderEventArray *parse_midi(const char *path, double sampleRate,
-                                     uint64_t *totalMidiSamples,
-                                     uint64_t *loopStartSampleOut,
-                                     uint64_t *loopEndSampleOut,
-                                     uint16_t *midiFormatOut)
+static RenderEventArray *parse_midi_data(const uint8_t *data, size_t size, const char *name,
+                                          double sampleRate,
+                                          uint64_t *totalMidiSamples,
+                                          uint64_t *loopStartSampleOut,
+                                          uint64_t *loopEndSampleOut,
+                                          uint16_t *midiFormatOut)
 {
     *loopStartSampleOut = UINT64_MAX;
     *loopEndSampleOut   = UINT64_MAX;
 
-    /* ---- Load file into memory ---- */
-    FILE *f = fopen(path, "rb");
-    if (!f) { fprintf(stderr, "Cannot open MIDI file: %s\n", path); return NULL; }
-    fseek(f, 0, SEEK_END);
-    long fsize = ftell(f);
-    rewind(f);
-    if (fsize <= 0) { fprintf(stderr, "Empty MIDI file\n"); fclose(f); return NULL; }
-    uint8_t *buf = malloc((size_t)fsize);
-    if (!buf) { fclose(f); return NULL; }
-    if (fread(buf, 1, (size_t)fsize, f) != (size_t)fsize) {
-        fprintf(stderr, "Failed to read MIDI file: %s\n", path);
-        free(buf); fclose(f); return NULL;
-    }
-    fclose(f);
-
-    MidiReader r = { buf, (size_t)fsize, 0 };
+    MidiReader r = { data, size, 0 };
 
     /* ---- MThd header ---- */
     if (r.size < 14 || memcmp(r.data, "MThd", 4) != 0) {
-        fprintf(stderr, "Not a Standard MIDI File: %s\n", path);
-        free(buf); return NULL;
+        fprintf(stderr, "Not a Standard MIDI File: %s\n", name);
+        return NULL;
     }
     r.pos = 4;
 
@@ -482,18 +608,18 @@ static RenderEventArray *parse_midi(const char *path, double sampleRate,
         mr_read_u16_be(&r, &numTracks) < 0 ||
         mr_read_u16_be(&r, &division)  < 0) {
         fprintf(stderr, "Invalid MIDI header\n");
-        free(buf); return NULL;
+        return NULL;
     }
     /* Skip any extra header bytes */
     if (hdrLen > 6) r.pos += hdrLen - 6;
 
     if (format > 1) {
         fprintf(stderr, "Unsupported MIDI format %u (only 0 and 1 supported)\n", format);
-        free(buf); return NULL;
+        return NULL;
     }
     if (division & 0x8000) {
         fprintf(stderr, "SMPTE time codes not supported\n");
-        free(buf); return NULL;
+        return NULL;
     }
 
     *midiFormatOut = format;
@@ -519,8 +645,6 @@ static RenderEventArray *parse_midi(const char *path, double sampleRate,
         r.pos = trackEnd;
     }
 
-    free(buf);
-
     /* ---- Sort ---- */
     if (rawEvents.count > 0)
         qsort(rawEvents.events, (size_t)rawEvents.count,
@@ -631,6 +755,34 @@ static RenderEventArray *parse_midi(const char *path, double sampleRate,
     return result;
 }
 
+/* Load and parse a Standard MIDI File (see parse_midi_data). */
+static RenderEventArray *parse_midi(const char *path, double sampleRate,
+                                     uint64_t *totalMidiSamples,
+                                     uint64_t *loopStartSampleOut,
+                                     uint64_t *loopEndSampleOut,
+                                     uint16_t *midiFormatOut)
+{
+    FILE *f = fopen(path, "rb");
+    if (!f) { fprintf(stderr, "Cannot open MIDI file: %s\n", path); return NULL; }
+    fseek(f, 0, SEEK_END);
+    long fsize = ftell(f);
+    rewind(f);
+    if (fsize <= 0) { fprintf(stderr, "Empty MIDI file\n"); fclose(f); return NULL; }
+    uint8_t *buf = malloc((size_t)fsize);
+    if (!buf) { fclose(f); return NULL; }
+    if (fread(buf, 1, (size_t)fsize, f) != (size_t)fsize) {
+        fprintf(stderr, "Failed to read MIDI file: %s\n", path);
+        free(buf); fclose(f); return NULL;
+    }
+    fclose(f);
+
+    RenderEventArray *result = parse_midi_data(buf, (size_t)fsize, path, sampleRate,
+                                               totalMidiSamples, loopStartSampleOut,
+                                               loopEndSampleOut, midiFormatOut);
+    free(buf);
+    return result;
+}
+
 /* ========================================================================
  * Miniaudio playback
  * ======================================================================== */
@@ -666,11 +818,26 @@ static void suppress_alsa_errors(void)
 }
 #endif /* __linux__ */
 
+/* Playback ring buffer: the render loop keeps up to this much audio queued
+ * ahead of the device, and starts the device once PLAYBACK_PREFILL_FRAMES
+ * are queued. */
+#define PLAYBACK_RING_SECONDS   0.5
+#define PLAYBACK_PREFILL_FRAMES 2048
+
+/*
+ * Streaming playback.  The render loop (producer) writes interleaved frames
+ * into a lock-free single-producer/single-consumer ring buffer and the
+ * miniaudio callback (consumer) drains it, so playback starts as soon as the
+ * first blocks are rendered and memory stays bounded however long the song.
+ */
 typedef struct {
-    const float *bufL;
-    const float *bufR;
-    uint64_t     total;
-    uint64_t     pos;
+    ma_pcm_rb  rb;
+    ma_device  device;
+#ifdef __linux__
+    ma_context context;
+    bool       hasContext;
+#endif
+    bool       started;
 } PlaybackCtx;
 
 static void playback_callback(ma_device *dev, void *out,
@@ -679,16 +846,125 @@ static void playback_callback(ma_device *dev, void *out,
     (void)in;
     PlaybackCtx *ctx = (PlaybackCtx *)dev->pUserData;
     float *dst = (float *)out;
-    for (ma_uint32 i = 0; i < frameCount; i++) {
-        if (ctx->pos >= ctx->total) {
-            dst[i * 2]     = 0.0f;
-            dst[i * 2 + 1] = 0.0f;
-        } else {
-            dst[i * 2]     = ctx->bufL[ctx->pos];
-            dst[i * 2 + 1] = ctx->bufR[ctx->pos];
-            ctx->pos++;
+    while (frameCount > 0) {
+        ma_uint32 frames = frameCount;
+        void *src;
+        if (ma_pcm_rb_acquire_read(&ctx->rb, &frames, &src) != MA_SUCCESS || frames == 0)
+            break;
+        memcpy(dst, src, (size_t)frames * 2 * sizeof(float));
+        ma_pcm_rb_commit_read(&ctx->rb, frames);
+        dst        += frames * 2;
+        frameCount -= frames;
+    }
+    /* Underrun (render fell behind) or end of song: pad with silence. */
+    memset(dst, 0, (size_t)frameCount * 2 * sizeof(float));
+}
+
+static int playback_open(PlaybackCtx *ctx, int sampleRate)
+{
+    memset(ctx, 0, sizeof(*ctx));
+    ma_uint32 ringFrames = (ma_uint32)(PLAYBACK_RING_SECONDS * sampleRate);
+    if (ringFrames < 2 * PLAYBACK_PREFILL_FRAMES)
+        ringFrames = 2 * PLAYBACK_PREFILL_FRAMES;
+    if (ma_pcm_rb_init(ma_format_f32, 2, ringFrames, NULL, NULL, &ctx->rb) != MA_SUCCESS) {
+        fprintf(stderr, "Out of memory allocating playback buffer\n");
+        return -1;
+    }
+
+#ifdef __linux__
+    /* Suppress ALSA's verbose "cannot find card" error spam.  On WSL
+     * there is no ALSA hardware, so miniaudio will fall back to
+     * PulseAudio (provided by WSLg on Windows 11). */
+    suppress_alsa_errors();
+
+    /* Try PulseAudio before ALSA so that WSLg's PulseAudio server is
+     * found without probing ALSA at all. */
+    ma_backend linuxBackends[] = { ma_backend_pulseaudio, ma_backend_alsa };
+    ctx->hasContext = (ma_context_init(linuxBackends, 2, NULL, &ctx->context) == MA_SUCCESS);
+#endif
+
+    ma_device_config cfg  = ma_device_config_init(ma_device_type_playback);
+    cfg.playback.format   = ma_format_f32;
+    cfg.playback.channels = 2;
+    cfg.sampleRate        = (ma_uint32)sampleRate;
+    cfg.dataCallback      = playback_callback;
+    cfg.pUserData         = ctx;
+
+#ifdef __linux__
+    ma_result initResult = ma_device_init(ctx->hasContext ? &ctx->context : NULL, &cfg, &ctx->device);
+#else
+    ma_result initResult = ma_device_init(NULL, &cfg, &ctx->device);
+#endif
+    if (initResult != MA_SUCCESS) {
+        fprintf(stderr, "Failed to initialize audio playback device.\n");
+#ifdef __linux__
+        fprintf(stderr, "On WSL, audio requires PulseAudio (WSLg on Windows 11 provides this).\n");
+        if (ctx->hasContext)
+            ma_context_uninit(&ctx->context);
+#endif
+        ma_pcm_rb_uninit(&ctx->rb);
+        return -1;
+    }
+    return 0;
+}
+
+static int playback_start(PlaybackCtx *ctx)
+{
+    if (ctx->started)
+        return 0;
+    if (ma_device_start(&ctx->device) != MA_SUCCESS) {
+        fprintf(stderr, "Failed to start audio playback device\n");
+        return -1;
+    }
+    ctx->started = true;
+    printf("Playing audio...\n");
+    fflush(stdout);
+    return 0;
+}
+
+/* Queue `count` frames, waiting while the ring is full (the render runs at
+ * most PLAYBACK_RING_SECONDS ahead of playback).  Returns -1 if the device
+ * could not be started. */
+static int playback_write(PlaybackCtx *ctx, const float *left, const float *right, int count)
+{
+    while (count > 0) {
+        ma_uint32 frames = (ma_uint32)count;
+        void *dst;
+        if (ma_pcm_rb_acquire_write(&ctx->rb, &frames, &dst) != MA_SUCCESS)
+            return -1;
+        float *out = (float *)dst;
+        for (ma_uint32 i = 0; i < frames; i++) {
+            out[i * 2]     = left[i];
+            out[i * 2 + 1] = right[i];
         }
+        ma_pcm_rb_commit_write(&ctx->rb, frames);
+        left  += frames;
+        right += frames;
+        count -= (int)frames;
+
+        if (!ctx->started && ma_pcm_rb_available_read(&ctx->rb) >= PLAYBACK_PREFILL_FRAMES &&
+            playback_start(ctx) != 0)
+            return -1;
+        if (frames == 0)
+            ma_sleep(5);
+    }
+    return 0;
+}
+
+/* Play out whatever is still queued, then close the device. */
+static void playback_close(PlaybackCtx *ctx)
+{
+    if (ctx->started || playback_start(ctx) == 0) {
+        while (ma_pcm_rb_available_read(&ctx->rb) > 0)
+            ma_sleep(10);
     }
+    ma_device_uninit(&ctx->device);
+#ifdef __linux__
+    if (ctx->hasContext)
+        ma_context_uninit(&ctx->context);
+#endif
+    ma_pcm_rb_uninit(&ctx->rb);
+    printf("Playback complete.\n");
 }
 
 /* ========================================================================
@@ -699,13 +975,15 @@ static void print_usage(const char *prog)
 {
     fprintf(stderr,
         "Usage: %s <project_root> <voicegroup> --midi <file.mid> [options]\n"
+        "       %s <project_root> --batch <manifest> [options]\n"
+        "       %s --serve <socket>\n"
         "\n"
         "Required:\n"
         "  <project_root>              Path to pokeemerald/pokefirered project root\n"
         "  <voicegroup>                Voicegroup name (e.g. petalburg)\n"
         "  --midi <file.mid>           MIDI input file\n"
         "\n"
-        "Output (at least one required):\n"
+        "Output (at least one of --output, --play, --stems required):\n"
         "  --output <file.wav>         Write rendered audio to WAV file\n"
         "  --play                      Play audio through computer speakers\n"
         "\n"
@@ -721,12 +999,43 @@ static void print_usage(const char *prog)
         "  --pcm-mix-rate <hz>         DirectSound (PCM) mix rate; 0 means same as sample-rate (default: 13379)\n"
         "  --tail <seconds>            Silence after last event, no loop markers (default: 3.0)\n"
         "\n"
+        "Range options:\n"
+        "  --start <seconds>           Render from this point; earlier events are fast-forwarded (default: 0)\n"
+        "  --end <seconds>             Stop rendering at this point (default: end of song)\n"
+        "  --checkpoints               Keep playback checkpoints in <output>.ckpt so later renders of\n"
+        "                                the same song and options resume near --start\n"
+        "\n"
+        "Stems:\n"
+        "  --stems <dir>               Also write one WAV per track to <dir>/trackNN.wav (SMF track\n"
+        "                                for Type 1 files, MIDI channel for Type 0)\n"
+        "                                With --reverb above 0 each stem carries only its own\n"
+        "                                track's reverb, so the stems no longer sum to the mix\n"
+        "  --jobs <n>                  Worker threads for --stems and --batch (default: number of CPUs)\n"
+        "\n"
+        "Batch:\n"
+        "  --batch <manifest>          Render every job in <manifest>, one per line:\n"
+        "                                <file.mid> <voicegroup> <output.wav> [options]\n"
+        "                                ('#' starts a comment; relative paths are relative to\n"
+        "                                the working directory).  Options given on the command\n"
+        "                                line apply to every job; a line's options override them.\n"
+        "\n"
+        "Render server (not on Windows):\n"
+        "  --serve <socket>            Run a server on a Unix socket that keeps projects and\n"
+        "                                voicegroups loaded between renders\n"
+        "  --connect <socket>          Render through a running server (needs --output; the\n"
+        "                                server ignores --checkpoints)\n"
+        "  --reload                    With --connect: reload the project and voicegroups first\n"
+        "\n"
+        "Watch mode (Linux only):\n"
+        "  --watch                     After rendering, watch the MIDI file and the voicegroup's\n"
+        "                                files and render again whenever one of them is saved\n"
+        "\n"
         "Loop options (when MIDI contains '[' / ']' text events):\n"
         "  --loop-count <n>            Number of loop body repetitions (default: 2)\n"
         "  --fadeout <seconds>         Fadeout duration after final loop (default: 5.0)\n"
         "  --total-duration-seconds <s>  Override loop-count; set exact total duration\n"
         "                                (fadeout occupies the final --fadeout seconds)\n",
-        prog);
+        prog, prog, prog);
 }
 
 /* Dispatch one RenderEvent to the engine */
@@ -764,174 +1073,588 @@ static void dispatch_event(M4AEngine *engine, const RenderEvent *ev,
     }
 }
 
-/* Render a block of frames, chunked to fit in int */
-static void render_frames(M4AEngine *engine, float *outL, float *outR,
-                           uint64_t startSample, uint64_t frameCount)
+/* Advance the engine without mixing, chunked to fit in int */
+static void skip_frames(M4AEngine *engine, uint64_t frameCount)
 {
-    uint64_t remaining = frameCount;
-    uint64_t pos = startSample;
-    while (remaining > 0) {
-        int chunk = (remaining > 0x7FFFFFFF) ? 0x7FFFFFFF : (int)remaining;
-        m4a_engine_process(engine, outL + pos, outR + pos, chunk);
-        pos       += (uint64_t)chunk;
-        remaining -= (uint64_t)chunk;
+    while (frameCount > 0) {
+        int chunk = (frameCount > 0x7FFFFFFF) ? 0x7FFFFFFF : (int)frameCount;
+        m4a_engine_skip(engine, chunk);
+        frameCount -= (uint64_t)chunk;
     }
 }
 
-int main(int argc, char *argv[])
+/* ========================================================================
+ * Partial rendering (--start / --end) and checkpoints
+ * ======================================================================== */
+
+/* Audio rendered (and discarded) before --start so the resampler and analog
+ * filter have settled when output begins; the reverb tail is added to it. */
+#define PREROLL_SECONDS             1.0
+/* Frames rendered per m4a_engine_process call for output and pre-roll. */
+#define RENDER_BLOCK                4096
+/* Spacing of the playback-state snapshots kept by --checkpoints. */
+#define CHECKPOINT_INTERVAL_SECONDS 10.0
+#define CHECKPOINT_MAGIC            0x4B435250u /* "PRCK" */
+#define CHECKPOINT_VERSION          2
+/* Written as a host-order uint32: reads back differently on a host with the
+ * other byte order, whose struct dumps are not interchangeable with ours. */
+#define CHECKPOINT_BYTE_ORDER       0x01020304u
+
+/* The .ckpt header.  Counts, positions and snapshot blobs are written in host
+ * order with host struct layouts, so besides the format version a file
+ * records the byte order, pointer size and engine layout it was made with and
+ * is only read back by a matching build. */
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t byteOrder;
+    uint32_t pointerSize;
+    uint32_t engineSize;   /* sizeof(M4AEngine) */
+} CheckpointHeader;
+
+static CheckpointHeader checkpoint_header(void)
 {
-    if (argc < 4) {
-        print_usage(argv[0]);
-        return 1;
+    CheckpointHeader hdr = { CHECKPOINT_MAGIC, CHECKPOINT_VERSION, CHECKPOINT_BYTE_ORDER,
+                             (uint32_t)sizeof(void *), (uint32_t)sizeof(M4AEngine) };
+    return hdr;
+}
+
+typedef struct {
+    uint64_t samplePos;   /* engine position the snapshot was taken at */
+    uint32_t eventIndex;  /* first render event not yet dispatched */
+    uint32_t size;
+    uint8_t *data;        /* m4a_engine_snapshot blob */
+} Checkpoint;
+
+/* Checkpoints for one render configuration, sorted by samplePos.  `key`
+ * hashes everything that determines playback state (events, voicegroup
+ * contents, engine options), so a stale file is simply ignored. */
+typedef struct {
+    uint64_t    key;
+    Checkpoint *items;
+    int         count, capacity;
+    bool        dirty;
+} CheckpointSet;
+
+static uint64_t fnv1a(uint64_t h, const void *data, size_t len)
+{
+    const uint8_t *p = (const uint8_t *)data;
+    for (size_t i = 0; i < len; i++) {
+        h ^= p[i];
+        h *= 0x100000001B3ull;
     }
+    return h;
+}
 
-    const char *projectRoot   = argv[1];
-    const char *vgName        = argv[2];
-    const char *midiPath      = NULL;
-    const char *outputPath    = NULL;
-    bool        doPlay        = false;
-    int         songVolume    = 127;
-    int         reverbAmount  = 0;
-    bool        analogFilter  = false;
-    bool        respectBaseMidiKey = false;
-    bool        portamento    = false;
-    bool        pwm           = false;
-    int         maxChannels   = 5;
-    int         sampleRateHz  = 44100;
-    float       pcmMixRate    = 13379.0f; /* GBA-accurate DirectSound mix rate; 0 = host rate */
-    double      tailSeconds   = 3.0;
-    int         loopCount     = 2;
-    double      fadeoutSeconds = 5.0;
-    double      totalDurSeconds = -1.0; /* -1 = not set */
+/* Hash a voicegroup's contents (not its addresses), including samples,
+ * programmable waves and one level of keysplit/drumset subgroups. */
+static uint64_t hash_voices(uint64_t h, const ToneData *voices, bool allowSubGroups)
+{
+    for (int i = 0; i < VOICEGROUP_SIZE; i++) {
+        const ToneData *td = &voices[i];
+        uint8_t fields[8] = { td->type, td->key, td->length, td->panSweep,
+                              td->attack, td->decay, td->sustain, td->release };
+        h = fnv1a(h, fields, sizeof(fields));
+
+        if (td->type & (VOICE_KEYSPLIT | VOICE_KEYSPLIT_ALL)) {
+            if (td->subGroup && allowSubGroups)
+                h = hash_voices(h, (const ToneData *)td->subGroup, false);
+            if ((td->type & VOICE_KEYSPLIT) && td->keySplitTable)
+                h = fnv1a(h, td->keySplitTable, 128);
+        } else if ((td->type & VOICE_TYPE_CGB_MASK) == VOICE_PROGRAMMABLE_WAVE) {
+            if (td->wavePointer)
+                h = fnv1a(h, td->wavePointer, 16);
+        } else if (td->type & VOICE_TYPE_CGB_MASK) {
+            uint64_t raw = (uint64_t)(uintptr_t)td->wavePointer; /* duty / period bits */
+            h = fnv1a(h, &raw, sizeof(raw));
+        } else if (td->wav) {
+            const WaveData *wav = td->wav;
+            uint32_t hdr[4] = { wav->status, wav->freq, wav->loopStart, wav->size };
+            h = fnv1a(h, hdr, sizeof(hdr));
+            h = fnv1a(h, wav->data, wav->size);
+        }
+    }
+    return h;
+}
 
-    for (int i = 3; i < argc; i++) {
-        if (strcmp(argv[i], "--midi") == 0 && i + 1 < argc) {
-            midiPath = argv[++i];
-        } else if (strcmp(argv[i], "--output") == 0 && i + 1 < argc) {
-            outputPath = argv[++i];
-        } else if (strcmp(argv[i], "--play") == 0) {
-            doPlay = true;
-        } else if (strcmp(argv[i], "--song-volume") == 0 && i + 1 < argc) {
-            songVolume = atoi(argv[++i]);
-            if (songVolume < 0)   songVolume = 0;
-            if (songVolume > 127) songVolume = 127;
-        } else if (strcmp(argv[i], "--reverb") == 0 && i + 1 < argc) {
-            reverbAmount = atoi(argv[++i]);
-            if (reverbAmount < 0)   reverbAmount = 0;
-            if (reverbAmount > 127) reverbAmount = 127;
-        } else if (strcmp(argv[i], "--analog-filter") == 0) {
-            analogFilter = true;
-        } else if (strcmp(argv[i], "--respect-base-midi-key") == 0) {
-            respectBaseMidiKey = true;
-        } else if (strcmp(argv[i], "--portamento") == 0) {
-            portamento = true;
-        } else if (strcmp(argv[i], "--pwm") == 0) {
-            pwm = true;
-        } else if (strcmp(argv[i], "--polyphony") == 0 && i + 1 < argc) {
-            maxChannels = atoi(argv[++i]);
-            if (maxChannels < 1) maxChannels = 1;
-            if (maxChannels > MAX_PCM_CHANNELS) maxChannels = MAX_PCM_CHANNELS;
-        } else if (strcmp(argv[i], "--sample-rate") == 0 && i + 1 < argc) {
-            sampleRateHz = atoi(argv[++i]);
-            if (sampleRateHz < 8000) sampleRateHz = 8000;
-        } else if (strcmp(argv[i], "--pcm-mix-rate") == 0 && i + 1 < argc) {
-            pcmMixRate = (float)atof(argv[++i]);
-            if (pcmMixRate < 0.0f) pcmMixRate = 0.0f;
-        } else if (strcmp(argv[i], "--tail") == 0 && i + 1 < argc) {
-            tailSeconds = atof(argv[++i]);
-            if (tailSeconds < 0.0) tailSeconds = 0.0;
-        } else if (strcmp(argv[i], "--loop-count") == 0 && i + 1 < argc) {
-            loopCount = atoi(argv[++i]);
-            if (loopCount < 1) loopCount = 1;
-        } else if (strcmp(argv[i], "--fadeout") == 0 && i + 1 < argc) {
-            fadeoutSeconds = atof(argv[++i]);
-            if (fadeoutSeconds < 0.0) fadeoutSeconds = 0.0;
-        } else if (strcmp(argv[i], "--total-duration-seconds") == 0 && i + 1 < argc) {
-            totalDurSeconds = atof(argv[++i]);
-            if (totalDurSeconds < 0.0) totalDurSeconds = 0.0;
-        } else {
-            fprintf(stderr, "Unknown option: %s\n", argv[i]);
-            print_usage(argv[0]);
-            return 1;
+static void checkpoints_free(CheckpointSet *set)
+{
+    for (int i = 0; i < set->count; i++)
+        free(set->items[i].data);
+    free(set->items);
+    set->items = NULL;
+    set->count = set->capacity = 0;
+}
+
+/* Insert a checkpoint, keeping the set sorted; takes ownership of data. */
+static int checkpoints_insert(CheckpointSet *set, uint64_t samplePos,
+                              uint32_t eventIndex, uint8_t *data, uint32_t size)
+{
+    int at = set->count;
+    while (at > 0 && set->items[at - 1].samplePos >= samplePos) {
+        if (set->items[at - 1].samplePos == samplePos) {
+            free(data);
+            return 0;
         }
+        at--;
     }
+    if (set->count >= set->capacity) {
+        int cap = set->capacity * 2 + 16;
+        Checkpoint *p = realloc(set->items, (size_t)cap * sizeof(Checkpoint));
+        if (!p) { free(data); return -1; }
+        set->items    = p;
+        set->capacity = cap;
+    }
+    memmove(&set->items[at + 1], &set->items[at],
+            (size_t)(set->count - at) * sizeof(Checkpoint));
+    set->items[at] = (Checkpoint){ samplePos, eventIndex, size, data };
+    set->count++;
+    return 0;
+}
 
-    if (!midiPath) {
-        fprintf(stderr, "Error: --midi is required\n\n");
-        print_usage(argv[0]);
-        return 1;
+static void checkpoints_record(CheckpointSet *set, const M4AEngine *engine,
+                               uint64_t samplePos, uint32_t eventIndex)
+{
+    size_t size = m4a_engine_snapshot(engine, NULL, 0);
+    if (size == 0 || size > UINT32_MAX) return;
+    uint8_t *data = malloc(size);
+    if (!data) return;
+    if (m4a_engine_snapshot(engine, data, size) != size) {
+        free(data);
+        return;
     }
-    if (!outputPath && !doPlay) {
-        fprintf(stderr, "Error: at least one of --output or --play is required\n\n");
-        print_usage(argv[0]);
-        return 1;
+    int before = set->count;
+    checkpoints_insert(set, samplePos, eventIndex, data, (uint32_t)size);
+    if (set->count != before)
+        set->dirty = true;
+}
+
+/* Load the checkpoints in `path` if they were made by a matching build with
+ * set->key.  A missing, stale, foreign or damaged file just leaves the set
+ * empty. */
+static void checkpoints_load(CheckpointSet *set, const char *path)
+{
+    FILE *f = fopen(path, "rb");
+    if (!f) return;
+
+    CheckpointHeader expect = checkpoint_header();
+    CheckpointHeader hdr;
+    uint64_t key;
+    uint32_t count;
+    if (fread(&hdr, sizeof(hdr), 1, f) != 1 || memcmp(&hdr, &expect, sizeof(hdr)) != 0 ||
+        fread(&key, sizeof(key), 1, f) != 1 || key != set->key ||
+        fread(&count, sizeof(count), 1, f) != 1) {
+        fclose(f);
+        return;
     }
+    for (uint32_t i = 0; i < count; i++) {
+        uint64_t samplePos;
+        uint32_t meta[2]; /* eventIndex, size */
+        if (fread(&samplePos, sizeof(samplePos), 1, f) != 1 ||
+            fread(meta, sizeof(meta), 1, f) != 1 || meta[1] == 0)
+            break;
+        uint8_t *data = malloc(meta[1]);
+        if (!data) break;
+        if (fread(data, 1, meta[1], f) != meta[1]) {
+            free(data);
+            break;
+        }
+        if (checkpoints_insert(set, samplePos, meta[0], data, meta[1]) != 0)
+            break;
+    }
+    fclose(f);
+}
 
-    double sampleRate = (double)sampleRateHz;
+static int checkpoints_save(const CheckpointSet *set, const char *path)
+{
+    FILE *f = fopen(path, "wb");
+    if (!f) {
+        fprintf(stderr, "Cannot open %s for writing\n", path);
+        return -1;
+    }
+    CheckpointHeader hdr = checkpoint_header();
+    uint32_t count = (uint32_t)set->count;
+    fwrite(&hdr, sizeof(hdr), 1, f);
+    fwrite(&set->key, sizeof(set->key), 1, f);
+    fwrite(&count, sizeof(count), 1, f);
+    for (int i = 0; i < set->count; i++) {
+        const Checkpoint *c = &set->items[i];
+        uint32_t meta[2] = { c->eventIndex, c->size };
+        fwrite(&c->samplePos, sizeof(c->samplePos), 1, f);
+        fwrite(meta, sizeof(meta), 1, f);
+        fwrite(c->data, 1, c->size, f);
+    }
+    if (fclose(f) != 0) {
+        fprintf(stderr, "Failed to write %s\n", path);
+        return -1;
+    }
+    return 0;
+}
 
-    /* ---- Parse MIDI ---- */
-    printf("Parsing MIDI file: %s\n", midiPath);
-    fflush(stdout);
+/*
+ * Render position within a (possibly partial) render.  Before prerollStart
+ * the engine is only fast-forwarded (m4a_engine_skip); from there to
+ * startSample it renders blocks that are thrown away; from startSample to
+ * endSample it renders blocks, applies the fadeout and hands them to the
+ * outputs.
+ */
+typedef struct {
+    M4AEngine     *engine;
+    uint64_t       pos;
+    uint64_t       prerollStart;
+    uint64_t       startSample;
+    uint64_t       endSample;
+    uint64_t       fadeStartSample;  /* UINT64_MAX = no fadeout */
+    uint64_t       totalSamples;     /* fadeout reaches silence here */
+    float          blockL[RENDER_BLOCK], blockR[RENDER_BLOCK];
+    WavWriter     *wav;              /* NULL = no WAV output */
+    PlaybackCtx   *play;             /* NULL = no playback */
+    CheckpointSet *checkpoints;      /* NULL = not recording */
+    uint64_t       checkpointInterval;
+    bool         (*interrupt)(void *ctx);  /* polled after each output block; NULL = never */
+    void          *interruptCtx;
+    bool           interrupted;      /* the render was stopped early */
+} RenderCursor;
+
+/* Fade and output the `count` frames in the block buffers, which start at
+ * song position `pos`. */
+static void emit_block(RenderCursor *cur, uint64_t pos, int count)
+{
+    float *l = cur->blockL, *r = cur->blockR;
+    uint64_t end = pos + (uint64_t)count;
+
+    if (cur->fadeStartSample < end) {
+        uint64_t fadeSamps = cur->totalSamples - cur->fadeStartSample;
+        uint64_t from = cur->fadeStartSample > pos ? cur->fadeStartSample : pos;
+        for (uint64_t p = from; p < end; p++) {
+            float gain = 1.0f - (float)(p - cur->fadeStartSample) / (float)fadeSamps;
+            l[p - pos] *= gain;
+            r[p - pos] *= gain;
+        }
+    }
 
-    uint64_t totalMidiSamples = 0;
-    uint64_t loopStartSample  = UINT64_MAX;
-    uint64_t loopEndSample    = UINT64_MAX;
-    uint16_t midiFormat       = 0;
-    RenderEventArray *events = parse_midi(midiPath, sampleRate, &totalMidiSamples,
-                                           &loopStartSample, &loopEndSample,
-                                           &midiFormat);
-    if (!events) return 1;
+    if (cur->wav)
+        wav_write(cur->wav, l, r, (size_t)count);
+    if (cur->play && playback_write(cur->play, l, r, count) != 0)
+        cur->play = NULL;  /* keep rendering the WAV without playback */
+}
 
-    /* For Type 1 MIDI files, use SMF track numbers as engine track indices.
-     * This handles files where multiple tracks share the same MIDI channel
-     * (each track gets its own program/voice in the M4A engine). */
-    int useTrackIndex = (midiFormat == 1);
+/* Advance the render to `target`; eventIndex is the next event to dispatch,
+ * recorded with any checkpoint taken on the way. */
+static void advance_to(RenderCursor *cur, uint64_t target, int eventIndex)
+{
+    while (cur->pos < target) {
+        uint64_t stop = target;
+        if (cur->checkpoints) {
+            uint64_t next = (cur->pos / cur->checkpointInterval + 1) * cur->checkpointInterval;
+            if (next < stop)
+                stop = next;
+        }
 
-    printf("  %d MIDI events, raw duration: %.2f s\n",
-           events->count, (double)totalMidiSamples / sampleRate);
+        if (cur->pos < cur->prerollStart) {
+            if (stop > cur->prerollStart)
+                stop = cur->prerollStart;
+            skip_frames(cur->engine, stop - cur->pos);
+        } else {
+            bool preroll = cur->pos < cur->startSample;
+            if (preroll && stop > cur->startSample)
+                stop = cur->startSample;
+            for (uint64_t p = cur->pos; p < stop; ) {
+                int chunk = (stop - p > RENDER_BLOCK) ? RENDER_BLOCK : (int)(stop - p);
+                m4a_engine_process(cur->engine, cur->blockL, cur->blockR, chunk);
+                if (!preroll)
+                    emit_block(cur, p, chunk);
+                p += (uint64_t)chunk;
+                if (!preroll && cur->interrupt && cur->interrupt(cur->interruptCtx)) {
+                    cur->interrupted = true;
+                    cur->pos = p;
+                    return;
+                }
+            }
+        }
+        cur->pos = stop;
 
-    /* ---- Determine render plan ---- */
-    bool hasLoop = (loopStartSample != UINT64_MAX &&
-                    loopEndSample   != UINT64_MAX &&
-                    loopEndSample   >  loopStartSample);
+        if (cur->checkpoints && cur->pos % cur->checkpointInterval == 0)
+            checkpoints_record(cur->checkpoints, cur->engine, cur->pos,
+                               (uint32_t)eventIndex);
+    }
+}
 
-    if (!hasLoop && (loopStartSample != UINT64_MAX || loopEndSample != UINT64_MAX))
-        fprintf(stderr, "Warning: incomplete loop markers (need both '[' and ']' "
-                        "text events with loop end > loop start)\n");
+/* Dispatch events from firstEvent on, rendering (or fast-forwarding) the
+ * engine between them, through to the end of the cursor's range. */
+static void render_events(RenderCursor *cur, const RenderEvent *evts, int evtCount,
+                          int firstEvent, int useTrackIndex)
+{
+    int i;
+    for (i = firstEvent; i < evtCount; i++) {
+        const RenderEvent *ev = &evts[i];
 
-    uint64_t      totalSamples;
-    uint64_t      fadeStartSample = UINT64_MAX; /* UINT64_MAX = no fadeout */
-    const RenderEvent *renderEvts;
-    int            renderEvtCount;
-    RenderEvent   *extEvts = NULL; /* allocated when loop is active */
+        if (ev->samplePos >= cur->endSample) break; /* nothing left to hear */
 
-    if (hasLoop) {
-        uint64_t loopDuration  = loopEndSample - loopStartSample;
-        uint64_t fadeoutSamps  = (uint64_t)(fadeoutSeconds * sampleRate + 0.5);
+        /* Render (or fast-forward) up to this event */
+        advance_to(cur, ev->samplePos, i);
+        if (cur->interrupted)
+            return;
+        dispatch_event(cur->engine, ev, useTrackIndex);
+    }
 
-        if (totalDurSeconds >= 0.0) {
-            totalSamples    = (uint64_t)(totalDurSeconds * sampleRate + 0.5);
-            fadeStartSample = totalSamples > fadeoutSamps
-                              ? totalSamples - fadeoutSamps : 0;
-        } else {
-            fadeStartSample = loopStartSample + (uint64_t)loopCount * loopDuration;
-            totalSamples    = fadeStartSample + fadeoutSamps;
-        }
+    /* Render remaining frames (tail / fadeout section) */
+    advance_to(cur, cur->endSample, i);
+}
 
-        printf("  Loop region: [%.3f s, %.3f s] (%.3f s body)\n",
-               (double)loopStartSample / sampleRate,
-               (double)loopEndSample   / sampleRate,
-               (double)loopDuration    / sampleRate);
-        printf("  Fadeout: starts %.3f s, duration %.2f s\n",
-               (double)fadeStartSample / sampleRate, fadeoutSeconds);
+/* Engine configuration from the command line */
+typedef struct {
+    int   sampleRateHz;
+    int   songVolume;
+    int   reverbAmount;
+    bool  analogFilter;
+    int   maxChannels;
+    bool  respectBaseMidiKey;
+    bool  portamento;
+    bool  pwm;
+    float pcmMixRate;
+} EngineSettings;
+
+static void engine_setup(M4AEngine *engine, const EngineSettings *es, LoadedVoiceGroup *vg)
+{
+    m4a_engine_init(engine, (float)es->sampleRateHz);
+    m4a_engine_set_voicegroup(engine, vg->voices);
+    m4a_engine_set_song_volume(engine, (uint8_t)es->songVolume);
+    m4a_reverb_set_amount(&engine->reverb, (uint8_t)es->reverbAmount);
+    engine->analogFilter = es->analogFilter;
+    engine->maxPcmChannels = (uint8_t)es->maxChannels;
+    engine->respectBaseMidiKey = es->respectBaseMidiKey;
+    m4a_engine_set_portamento_enabled(engine, es->portamento);
+    m4a_engine_set_pwm_enabled(engine, es->pwm);
+    m4a_engine_set_pcm_mix_rate(engine, es->pcmMixRate);
+}
 
-        /* Build extended event list:
-         *   1. Pre-loop events (samplePos < loopStartSample) — played once.
-         *   2. Loop body events (loopStartSample <= samplePos <= loopEndSample),
-         *      repeated with increasing sample offsets until totalSamples.
-         *
-         * Iteration k has offset = k * loopDuration:
-         *   iter 0 starts at loopStartSample  (original positions)
+/* Everything that shapes one render: engine settings plus length, loop and
+ * range options.  Shared by the command line and --batch manifest lines. */
+typedef struct {
+    EngineSettings es;
+    double tailSeconds;
+    int    loopCount;
+    double fadeoutSeconds;
+    double totalDurSeconds;  /* -1 = not set */
+    double startSeconds;
+    double endSeconds;       /* -1 = end of song */
+    bool   useCheckpoints;
+} RenderOptions;
+
+static const RenderOptions s_defaultRenderOptions = {
+    .es = {
+        .sampleRateHz = 44100,
+        .songVolume   = 127,
+        .maxChannels  = 5,
+        .pcmMixRate   = 13379.0f,  /* GBA-accurate DirectSound mix rate; 0 = host rate */
+    },
+    .tailSeconds     = 3.0,
+    .loopCount       = 2,
+    .fadeoutSeconds  = 5.0,
+    .totalDurSeconds = -1.0,
+    .startSeconds    = 0.0,
+    .endSeconds      = -1.0,
+};
+
+/* If argv[*i] is a render option, apply it (consuming its value, if any)
+ * and return true. */
+static bool parse_render_option(int argc, char **argv, int *i, RenderOptions *o)
+{
+    const char *arg = argv[*i];
+    bool hasValue = *i + 1 < argc;
+
+    if (strcmp(arg, "--song-volume") == 0 && hasValue) {
+        o->es.songVolume = atoi(argv[++*i]);
+        if (o->es.songVolume < 0)   o->es.songVolume = 0;
+        if (o->es.songVolume > 127) o->es.songVolume = 127;
+    } else if (strcmp(arg, "--reverb") == 0 && hasValue) {
+        o->es.reverbAmount = atoi(argv[++*i]);
+        if (o->es.reverbAmount < 0)   o->es.reverbAmount = 0;
+        if (o->es.reverbAmount > 127) o->es.reverbAmount = 127;
+    } else if (strcmp(arg, "--analog-filter") == 0) {
+        o->es.analogFilter = true;
+    } else if (strcmp(arg, "--respect-base-midi-key") == 0) {
+        o->es.respectBaseMidiKey = true;
+    } else if (strcmp(arg, "--portamento") == 0) {
+        o->es.portamento = true;
+    } else if (strcmp(arg, "--pwm") == 0) {
+        o->es.pwm = true;
+    } else if (strcmp(arg, "--polyphony") == 0 && hasValue) {
+        o->es.maxChannels = atoi(argv[++*i]);
+        if (o->es.maxChannels < 1) o->es.maxChannels = 1;
+        if (o->es.maxChannels > MAX_PCM_CHANNELS) o->es.maxChannels = MAX_PCM_CHANNELS;
+    } else if (strcmp(arg, "--sample-rate") == 0 && hasValue) {
+        o->es.sampleRateHz = atoi(argv[++*i]);
+        if (o->es.sampleRateHz < 8000) o->es.sampleRateHz = 8000;
+    } else if (strcmp(arg, "--pcm-mix-rate") == 0 && hasValue) {
+        o->es.pcmMixRate = (float)atof(argv[++*i]);
+        if (o->es.pcmMixRate < 0.0f) o->es.pcmMixRate = 0.0f;
+    } else if (strcmp(arg, "--tail") == 0 && hasValue) {
+        o->tailSeconds = atof(argv[++*i]);
+        if (o->tailSeconds < 0.0) o->tailSeconds = 0.0;
+    } else if (strcmp(arg, "--loop-count") == 0 && hasValue) {
+        o->loopCount = atoi(argv[++*i]);
+        if (o->loopCount < 1) o->loopCount = 1;
+    } else if (strcmp(arg, "--fadeout") == 0 && hasValue) {
+        o->fadeoutSeconds = atof(argv[++*i]);
+        if (o->fadeoutSeconds < 0.0) o->fadeoutSeconds = 0.0;
+    } else if (strcmp(arg, "--total-duration-seconds") == 0 && hasValue) {
+        o->totalDurSeconds = atof(argv[++*i]);
+        if (o->totalDurSeconds < 0.0) o->totalDurSeconds = 0.0;
+    } else if (strcmp(arg, "--start") == 0 && hasValue) {
+        o->startSeconds = atof(argv[++*i]);
+        if (o->startSeconds < 0.0) o->startSeconds = 0.0;
+    } else if (strcmp(arg, "--end") == 0 && hasValue) {
+        o->endSeconds = atof(argv[++*i]);
+        if (o->endSeconds < 0.0) o->endSeconds = 0.0;
+    } else if (strcmp(arg, "--checkpoints") == 0) {
+        o->useCheckpoints = true;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+/* ========================================================================
+ * Render plan: the event list and sample positions of one render
+ * ======================================================================== */
+
+typedef struct {
+    RenderEventArray  *midi;
+    RenderEvent       *extEvts;          /* looped event list; NULL without a loop */
+    const RenderEvent *events;
+    int                eventCount;
+    int                useTrackIndex;
+    uint64_t           totalSamples;
+    uint64_t           fadeStartSample;  /* UINT64_MAX = no fadeout */
+    uint64_t           startSample;
+    uint64_t           endSample;
+} RenderPlan;
+
+static void plan_free(RenderPlan *plan)
+{
+    free(plan->extEvts);
+    if (plan->midi) {
+        free(plan->midi->events);
+        free(plan->midi);
+    }
+    memset(plan, 0, sizeof(*plan));
+}
+
+/*
+ * The programs the render plays and the keys it plays on each, so only
+ * their samples are loaded.  A track sounds nothing before its first
+ * program change, so notes there need no sample.
+ */
+static void plan_usage(const RenderPlan *plan, VoicegroupUsage *usage)
+{
+    int program[MAX_TRACKS];
+    for (int t = 0; t < MAX_TRACKS; t++)
+        program[t] = -1;
+    memset(usage, 0, sizeof(*usage));
+    for (int i = 0; i < plan->eventCount; i++) {
+        const RenderEvent *ev = &plan->events[i];
+        int trackIdx = plan->useTrackIndex ? ev->track : ev->channel;
+        if (trackIdx >= MAX_TRACKS)
+            continue;
+        if (ev->type == 0xC) {
+            program[trackIdx] = ev->data0 & 0x7F;
+        } else if (ev->type == 0x9 && program[trackIdx] >= 0) {
+            uint8_t key = ev->data0 & 0x7F;
+            usage->keys[program[trackIdx]][key >> 3] |= (uint8_t)(1u << (key & 7));
+        }
+    }
+}
+
+static int ext_push(RenderEvent **evts, int *count, int *cap, RenderEvent ev)
+{
+    if (*count >= *cap) {
+        int newCap = *cap * 2 + 16;
+        RenderEvent *p = realloc(*evts, (size_t)newCap * sizeof(RenderEvent));
+        if (!p) return -1;
+        *evts = p;
+        *cap  = newCap;
+    }
+    (*evts)[(*count)++] = ev;
+    return 0;
+}
+
+/*
+ * Parse the MIDI file and lay out the render: the event list (with the loop
+ * body repeated when the file has loop markers), its length and fadeout,
+ * and the output range.  The file is read from midiPath unless midiData is
+ * given, in which case midiPath only names it in messages.  `verbose` prints
+ * the plan to stdout; errors always go to stderr.  Returns 0 on success; on
+ * failure the plan is left empty.
+ */
+static int plan_render(RenderPlan *plan, const char *midiPath,
+                       const uint8_t *midiData, size_t midiSize,
+                       const RenderOptions *o, bool verbose)
+{
+    memset(plan, 0, sizeof(*plan));
+    double sampleRate = (double)o->es.sampleRateHz;
+
+    uint64_t totalMidiSamples = 0;
+    uint64_t loopStartSample  = UINT64_MAX;
+    uint64_t loopEndSample    = UINT64_MAX;
+    uint16_t midiFormat       = 0;
+    RenderEventArray *events = midiData
+        ? parse_midi_data(midiData, midiSize, midiPath, sampleRate, &totalMidiSamples,
+                          &loopStartSample, &loopEndSample, &midiFormat)
+        : parse_midi(midiPath, sampleRate, &totalMidiSamples,
+                     &loopStartSample, &loopEndSample, &midiFormat);
+    if (!events) return -1;
+    plan->midi = events;
+
+    /* For Type 1 MIDI files, use SMF track numbers as engine track indices.
+     * This handles files where multiple tracks share the same MIDI channel
+     * (each track gets its own program/voice in the M4A engine). */
+    plan->useTrackIndex = (midiFormat == 1);
+
+    if (verbose)
+        printf("  %d MIDI events, raw duration: %.2f s\n",
+               events->count, (double)totalMidiSamples / sampleRate);
+
+    bool hasLoop = (loopStartSample != UINT64_MAX &&
+                    loopEndSample   != UINT64_MAX &&
+                    loopEndSample   >  loopStartSample);
+
+    if (!hasLoop && (loopStartSample != UINT64_MAX || loopEndSample != UINT64_MAX))
+        fprintf(stderr, "Warning: %s: incomplete loop markers (need both '[' and ']' "
+                        "text events with loop end > loop start)\n", midiPath);
+
+    plan->fadeStartSample = UINT64_MAX;
+
+    if (hasLoop) {
+        uint64_t loopDuration  = loopEndSample - loopStartSample;
+        uint64_t fadeoutSamps  = (uint64_t)(o->fadeoutSeconds * sampleRate + 0.5);
+
+        if (o->totalDurSeconds >= 0.0) {
+            plan->totalSamples    = (uint64_t)(o->totalDurSeconds * sampleRate + 0.5);
+            plan->fadeStartSample = plan->totalSamples > fadeoutSamps
+                                    ? plan->totalSamples - fadeoutSamps : 0;
+        } else {
+            plan->fadeStartSample = loopStartSample + (uint64_t)o->loopCount * loopDuration;
+            plan->totalSamples    = plan->fadeStartSample + fadeoutSamps;
+        }
+
+        if (verbose) {
+            printf("  Loop region: [%.3f s, %.3f s] (%.3f s body)\n",
+                   (double)loopStartSample / sampleRate,
+                   (double)loopEndSample   / sampleRate,
+                   (double)loopDuration    / sampleRate);
+            printf("  Fadeout: starts %.3f s, duration %.2f s\n",
+                   (double)plan->fadeStartSample / sampleRate, o->fadeoutSeconds);
+        }
+
+        /* Build extended event list:
+         *   1. Pre-loop events (samplePos < loopStartSample) — played once.
+         *   2. Loop body events (loopStartSample <= samplePos <= loopEndSample),
+         *      repeated with increasing sample offsets until totalSamples.
+         *
+         * Iteration k has offset = k * loopDuration:
+         *   iter 0 starts at loopStartSample  (original positions)
          *   iter 1 starts at loopEndSample     (seamless continuation)
          *   etc.
          *
@@ -941,216 +1664,1664 @@ int main(int argc, char *argv[])
          */
         int extCap   = events->count + 256;
         int extCount = 0;
-        extEvts = malloc((size_t)extCap * sizeof(RenderEvent));
-        if (!extEvts) {
-            fprintf(stderr, "Out of memory building event list\n");
-            free(events->events); free(events);
-            return 1;
-        }
+        RenderEvent *extEvts = malloc((size_t)extCap * sizeof(RenderEvent));
+        if (!extEvts)
+            goto oom;
 
         /* Pre-loop */
         for (int i = 0; i < events->count; i++) {
-            if (events->events[i].samplePos < loopStartSample) {
-                if (extCount >= extCap) {
-                    extCap = extCap * 2 + 16;
-                    RenderEvent *p = realloc(extEvts, (size_t)extCap * sizeof(RenderEvent));
-                    if (!p) { free(extEvts); extEvts = NULL; goto oom; }
-                    extEvts = p;
-                }
-                extEvts[extCount++] = events->events[i];
-            }
+            if (events->events[i].samplePos < loopStartSample &&
+                ext_push(&extEvts, &extCount, &extCap, events->events[i]) != 0)
+                goto oom;
         }
 
         /* Loop body iterations */
         if (loopDuration > 0) {
-            for (uint64_t off = 0; loopStartSample + off < totalSamples; off += loopDuration) {
+            for (uint64_t off = 0; loopStartSample + off < plan->totalSamples; off += loopDuration) {
                 for (int i = 0; i < events->count; i++) {
                     uint64_t op = events->events[i].samplePos;
                     if (op < loopStartSample || op > loopEndSample) continue;
                     uint64_t sp = op + off;
-                    if (sp >= totalSamples) continue;
-                    if (extCount >= extCap) {
-                        extCap = extCap * 2 + 16;
-                        RenderEvent *p = realloc(extEvts, (size_t)extCap * sizeof(RenderEvent));
-                        if (!p) { free(extEvts); extEvts = NULL; goto oom; }
-                        extEvts = p;
-                    }
+                    if (sp >= plan->totalSamples) continue;
                     RenderEvent ev = events->events[i];
                     ev.samplePos = sp;
-                    extEvts[extCount++] = ev;
+                    if (ext_push(&extEvts, &extCount, &extCap, ev) != 0)
+                        goto oom;
                 }
             }
         }
 
-        renderEvts      = extEvts;
-        renderEvtCount  = extCount;
+        plan->extEvts    = extEvts;
+        plan->events     = extEvts;
+        plan->eventCount = extCount;
+
+        if (0) {
+oom:
+            fprintf(stderr, "Out of memory building event list\n");
+            free(extEvts);
+            plan_free(plan);
+            return -1;
+        }
     } else {
         /* No loop: use original events + tail silence */
-        uint64_t tailSamps = (uint64_t)(tailSeconds * sampleRate + 0.5);
-        totalSamples       = totalMidiSamples + tailSamps;
-        renderEvts         = events->events;
-        renderEvtCount     = events->count;
+        uint64_t tailSamps = (uint64_t)(o->tailSeconds * sampleRate + 0.5);
+        plan->totalSamples = totalMidiSamples + tailSamps;
+        plan->events       = events->events;
+        plan->eventCount   = events->count;
     }
 
-    printf("  Total render: %.2f s (%llu samples)\n",
-           (double)totalSamples / sampleRate,
-           (unsigned long long)totalSamples);
+    if (verbose)
+        printf("  Total render: %.2f s (%llu samples)\n",
+               (double)plan->totalSamples / sampleRate,
+               (unsigned long long)plan->totalSamples);
+
+    /* Output range.  Everything before it is fast-forwarded, apart from the
+     * pre-roll worked out once the engine is set up. */
+    plan->startSample = (uint64_t)(o->startSeconds * sampleRate + 0.5);
+    plan->endSample   = o->endSeconds >= 0.0
+                        ? (uint64_t)(o->endSeconds * sampleRate + 0.5) : plan->totalSamples;
+    if (plan->endSample > plan->totalSamples)
+        plan->endSample = plan->totalSamples;
+    if (plan->startSample >= plan->endSample) {
+        fprintf(stderr, "Error: --start must be before --end and the end of the song\n");
+        plan_free(plan);
+        return -1;
+    }
+    if (verbose && (plan->startSample > 0 || plan->endSample < plan->totalSamples))
+        printf("  Output range: [%.3f s, %.3f s]\n",
+               (double)plan->startSample / sampleRate, (double)plan->endSample / sampleRate);
+    return 0;
+}
 
-    if (0) {
-oom:
-        fprintf(stderr, "Out of memory building event list\n");
-        free(events->events); free(events);
-        return 1;
+/*
+ * Point a cursor at a plan.  The pre-roll before the output range is long
+ * enough for the resampler, analog filter and reverb tail to settle, so
+ * output matches a full render (bar a reverb DC offset at high reverb
+ * amounts, which depends on the whole song before it).
+ */
+static void cursor_init(RenderCursor *cur, M4AEngine *engine, const RenderPlan *plan,
+                        const EngineSettings *es)
+{
+    double sampleRate = (double)es->sampleRateHz;
+    double mixRate = es->pcmMixRate > 0.0f ? (double)es->pcmMixRate : sampleRate;
+    double prerollSeconds = PREROLL_SECONDS
+                            + (double)m4a_reverb_tail_length(&engine->reverb) / mixRate;
+    uint64_t prerollSamples = (uint64_t)(prerollSeconds * sampleRate + 0.5);
+
+    cur->engine          = engine;
+    cur->pos             = 0;
+    cur->prerollStart    = plan->startSample > prerollSamples
+                           ? plan->startSample - prerollSamples : 0;
+    cur->startSample     = plan->startSample;
+    cur->endSample       = plan->endSample;
+    cur->fadeStartSample = plan->fadeStartSample;
+    cur->totalSamples    = plan->totalSamples;
+}
+
+/*
+ * Load the checkpoints for `path`, start recording into `set`, and resume
+ * the cursor from the latest usable one.  The set is keyed on everything
+ * that affects playback, so a stale file is ignored.  Returns the index of
+ * the first event still to dispatch.
+ */
+static int checkpoints_begin(RenderCursor *cur, CheckpointSet *set, const char *path,
+                             const RenderPlan *plan, const EngineSettings *es,
+                             const LoadedVoiceGroup *vg, bool verbose)
+{
+    uint64_t h = 0xCBF29CE484222325ull;
+    int32_t opts[8] = { es->sampleRateHz, es->songVolume, es->reverbAmount, es->analogFilter,
+                        es->maxChannels, es->respectBaseMidiKey, es->portamento | (es->pwm << 1),
+                        plan->useTrackIndex };
+    h = fnv1a(h, opts, sizeof(opts));
+    h = fnv1a(h, &es->pcmMixRate, sizeof(es->pcmMixRate));
+    for (int i = 0; i < plan->eventCount; i++) {
+        const RenderEvent *ev = &plan->events[i];
+        uint8_t bytes[5] = { ev->channel, ev->track, ev->type, ev->data0, ev->data1 };
+        h = fnv1a(h, &ev->samplePos, sizeof(ev->samplePos));
+        h = fnv1a(h, bytes, sizeof(bytes));
+    }
+    set->key = hash_voices(h, vg->voices, true);
+    checkpoints_load(set, path);
+
+    cur->checkpoints        = set;
+    cur->checkpointInterval = (uint64_t)(CHECKPOINT_INTERVAL_SECONDS * es->sampleRateHz + 0.5);
+
+    /* Resume from the latest checkpoint that is not past the pre-roll. */
+    for (int i = set->count - 1; i >= 0; i--) {
+        const Checkpoint *c = &set->items[i];
+        if (c->samplePos > cur->prerollStart || c->eventIndex > (uint32_t)plan->eventCount)
+            continue;
+        if (!m4a_engine_restore(cur->engine, c->data, c->size))
+            break;
+        cur->pos = c->samplePos;
+        /* Start the output path from silence, exactly as if the whole
+         * stretch before the pre-roll had been skipped. */
+        m4a_engine_skip(cur->engine, 0);
+        if (verbose)
+            printf("Resuming from checkpoint at %.2f s\n",
+                   (double)c->samplePos / es->sampleRateHz);
+        return (int)c->eventIndex;
     }
+    return 0;
+}
 
-    /* ---- Load voicegroup ---- */
-    printf("Loading voicegroup '%s' from %s...\n", vgName, projectRoot);
+/* Everything one render needs besides its plan, for renders that run off
+ * the main thread; heap-allocated, as the cursor's block buffers alone are
+ * 32 KB. */
+typedef struct {
+    M4AEngine     engine;
+    RenderCursor  cursor;
+    WavWriter     wav;
+    CheckpointSet checkpoints;
+} RenderState;
+
+static int cpu_count(void)
+{
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwNumberOfProcessors > 0 ? (int)info.dwNumberOfProcessors : 1;
+#else
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? (int)n : 1;
+#endif
+}
+
+/* Run fn(ctx, index) for every index in [0, count) on up to `threads`
+ * threads, the calling thread included. */
+typedef struct {
+    void           (*fn)(void *ctx, int index);
+    void            *ctx;
+    int              count;
+    int              next;   /* next index to take, under lock */
+    pthread_mutex_t  lock;
+} ParallelFor;
+
+static void *parallel_for_worker(void *arg)
+{
+    ParallelFor *pf = (ParallelFor *)arg;
+    for (;;) {
+        pthread_mutex_lock(&pf->lock);
+        int i = pf->next < pf->count ? pf->next++ : -1;
+        pthread_mutex_unlock(&pf->lock);
+        if (i < 0)
+            return NULL;
+        pf->fn(pf->ctx, i);
+    }
+}
+
+static void parallel_for(int count, int threads, void (*fn)(void *ctx, int index), void *ctx)
+{
+    ParallelFor pf = { .fn = fn, .ctx = ctx, .count = count };
+    pthread_mutex_init(&pf.lock, NULL);
+
+    if (threads > count)
+        threads = count;
+    int started = 0;
+    pthread_t *workers = threads > 1 ? calloc((size_t)threads - 1, sizeof(pthread_t)) : NULL;
+    for (int w = 0; workers && w < threads - 1; w++) {
+        if (pthread_create(&workers[w], NULL, parallel_for_worker, &pf) != 0)
+            break;
+        started++;
+    }
+    parallel_for_worker(&pf);
+    for (int w = 0; w < started; w++)
+        pthread_join(workers[w], NULL);
+    free(workers);
+    pthread_mutex_destroy(&pf.lock);
+}
+
+/* ========================================================================
+ * Stems (--stems)
+ * ======================================================================== */
+
+/*
+ * One stem: a full engine that plays every track -- so voice allocation and
+ * stealing are exactly those of the full mix -- with all tracks but one
+ * muted (M4AEngine.mutedTracks).  Without reverb the stems sum to the full
+ * mix up to rounding: the output's, and below the host rate the PCM
+ * upsampler's, up to one PCM mix step (1/256 of full scale) per stem.  The
+ * GBA reverb works on the whole DirectSound mix, so with reverb each stem
+ * carries the tail of its own track only.
+ */
+typedef struct {
+    int           track;
+    char          path[1024];
+    M4AEngine     engine;
+    WavWriter     wav;
+    RenderCursor  cursor;
+    int           result;
+} StemJob;
+
+typedef struct {
+    StemJob           *jobs;
+    int                count;
+    int                threads;
+    const RenderEvent *events;
+    int                eventCount;
+    int                useTrackIndex;
+} StemPool;
+
+static void stem_render(void *ctx, int index)
+{
+    StemPool *pool = (StemPool *)ctx;
+    StemJob *job = &pool->jobs[index];
+    render_events(&job->cursor, pool->events, pool->eventCount, 0, pool->useTrackIndex);
+    job->result = wav_close(&job->wav);
+}
+
+/* Render every stem; run on a thread of its own beside the full mix. */
+static void *stems_run(void *arg)
+{
+    StemPool *pool = (StemPool *)arg;
+    parallel_for(pool->count, pool->threads, stem_render, pool);
+    return NULL;
+}
+
+static int make_dir(const char *path)
+{
+#ifdef _WIN32
+    int rc = _mkdir(path);
+#else
+    int rc = mkdir(path, 0777);
+#endif
+    struct stat st;
+    if (rc != 0 && (stat(path, &st) != 0 || !S_ISDIR(st.st_mode))) {
+        fprintf(stderr, "Cannot create directory %s\n", path);
+        return -1;
+    }
+    return 0;
+}
+
+/* ========================================================================
+ * Batch rendering (--batch)
+ * ======================================================================== */
+
+/*
+ * A manifest holds one job per line:
+ *
+ *   <file.mid> <voicegroup> <output.wav> [render options]
+ *
+ * Tokens are separated by whitespace and may be double-quoted; '#' starts a
+ * comment.  Paths are used as written, so relative ones are relative to the
+ * working directory, not to the manifest.  Options on the command line apply
+ * to every job, and a line's own options are applied on top of them.
+ *
+ * The project is discovered once and each distinct voicegroup is loaded once
+ * (in parallel), then the jobs are rendered on a worker pool.  Each job has
+ * its own engine; the loaded voicegroups are only read while rendering.
+ */
+typedef struct {
+    char             *midiPath;
+    char             *outputPath;
+    int               voicegroup;  /* index into BatchRun.vgNames */
+    RenderOptions     opts;
+    int               line;
+    int               result;
+} BatchJob;
+
+typedef struct {
+    BatchJob                *jobs;
+    int                      jobCount;
+    char                   **vgNames;
+    LoadedVoiceGroup       **vgs;
+    int                      vgCount;
+    const VoicegroupProject *project;
+} BatchRun;
+
+/*
+ * Split a manifest line into tokens in place.  Whitespace separates tokens,
+ * double quotes group them and '#' outside quotes ends the line.  Returns
+ * the token count, or -1 on an unterminated quote.
+ */
+static int tokenize_line(char *line, char **tokens, int maxTokens)
+{
+    int count = 0;
+    char *p = line;
+    for (;;) {
+        while (*p && isspace((unsigned char)*p)) p++;
+        if (!*p || *p == '#')
+            return count;
+        if (count >= maxTokens)
+            return count;
+
+        char *out = p;
+        tokens[count++] = out;
+        bool quoted = false;
+        while (*p && (quoted || !isspace((unsigned char)*p))) {
+            if (*p == '"')
+                quoted = !quoted;
+            else
+                *out++ = *p;
+            p++;
+        }
+        if (quoted)
+            return -1;
+        if (*p) p++;
+        *out = '\0';
+    }
+}
+
+static int batch_find_vg(BatchRun *run, const char *name)
+{
+    for (int i = 0; i < run->vgCount; i++)
+        if (strcmp(run->vgNames[i], name) == 0)
+            return i;
+    return -1;
+}
+
+static void batch_free(BatchRun *run)
+{
+    for (int i = 0; i < run->jobCount; i++) {
+        free(run->jobs[i].midiPath);
+        free(run->jobs[i].outputPath);
+    }
+    free(run->jobs);
+    for (int i = 0; i < run->vgCount; i++) {
+        free(run->vgNames[i]);
+        if (run->vgs)
+            voicegroup_free(run->vgs[i]);
+    }
+    free(run->vgNames);
+    free(run->vgs);
+}
+
+static char *str_dup(const char *s)
+{
+    size_t n = strlen(s) + 1;
+    char *d = malloc(n);
+    if (d) memcpy(d, s, n);
+    return d;
+}
+
+#define MANIFEST_MAX_TOKENS 64
+
+/* Read the manifest into run->jobs, collecting the distinct voicegroups. */
+static int batch_read_manifest(BatchRun *run, const char *path, const RenderOptions *defaults)
+{
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        fprintf(stderr, "Cannot open manifest %s\n", path);
+        return -1;
+    }
+
+    int jobCap = 0, vgCap = 0;
+    char line[4096];
+    int lineNo = 0;
+    int rc = 0;
+    while (rc == 0 && fgets(line, sizeof(line), f)) {
+        lineNo++;
+        char *tokens[MANIFEST_MAX_TOKENS];
+        int n = tokenize_line(line, tokens, MANIFEST_MAX_TOKENS);
+        if (n == 0)
+            continue;
+        if (n < 3) {
+            fprintf(stderr, "%s:%d: expected <file.mid> <voicegroup> <output.wav> [options]\n",
+                    path, lineNo);
+            rc = -1;
+            break;
+        }
+
+        BatchJob job = { 0 };
+        job.opts = *defaults;
+        job.line = lineNo;
+        for (int i = 3; i < n; i++) {
+            if (!parse_render_option(n, tokens, &i, &job.opts)) {
+                fprintf(stderr, "%s:%d: unknown or incomplete option: %s\n",
+                        path, lineNo, tokens[i]);
+                rc = -1;
+                break;
+            }
+        }
+        if (rc != 0)
+            break;
+
+        job.voicegroup = batch_find_vg(run, tokens[1]);
+        if (job.voicegroup < 0) {
+            if (run->vgCount >= vgCap) {
+                vgCap = vgCap * 2 + 8;
+                char **p = realloc(run->vgNames, (size_t)vgCap * sizeof(char *));
+                if (!p) { rc = -1; break; }
+                run->vgNames = p;
+            }
+            if (!(run->vgNames[run->vgCount] = str_dup(tokens[1]))) { rc = -1; break; }
+            job.voicegroup = run->vgCount++;
+        }
+
+        if (run->jobCount >= jobCap) {
+            jobCap = jobCap * 2 + 16;
+            BatchJob *p = realloc(run->jobs, (size_t)jobCap * sizeof(BatchJob));
+            if (!p) { rc = -1; break; }
+            run->jobs = p;
+        }
+        job.midiPath   = str_dup(tokens[0]);
+        job.outputPath = str_dup(tokens[2]);
+        run->jobs[run->jobCount++] = job;
+        if (!job.midiPath || !job.outputPath) { rc = -1; break; }
+    }
+    fclose(f);
+    return rc;
+}
+
+static void batch_load_vg(void *ctx, int index)
+{
+    BatchRun *run = (BatchRun *)ctx;
+    run->vgs[index] = voicegroup_project_load(run->project, run->vgNames[index]);
+    if (!run->vgs[index])
+        fprintf(stderr, "Failed to load voicegroup '%s'\n", run->vgNames[index]);
+}
+
+static int batch_render_job(BatchJob *job, LoadedVoiceGroup *vg)
+{
+    RenderPlan plan;
+    if (plan_render(&plan, job->midiPath, NULL, 0, &job->opts, false) != 0)
+        return -1;
+
+    RenderState *r = calloc(1, sizeof(RenderState));
+    if (!r) {
+        fprintf(stderr, "Out of memory rendering %s\n", job->midiPath);
+        plan_free(&plan);
+        return -1;
+    }
+    int rc = -1;
+    if (wav_open(&r->wav, job->outputPath, job->opts.es.sampleRateHz) == 0) {
+        engine_setup(&r->engine, &job->opts.es, vg);
+        cursor_init(&r->cursor, &r->engine, &plan, &job->opts.es);
+        r->cursor.wav = &r->wav;
+
+        char checkpointPath[1024];
+        int firstEvent = 0;
+        if (job->opts.useCheckpoints) {
+            snprintf(checkpointPath, sizeof(checkpointPath), "%s.ckpt", job->outputPath);
+            firstEvent = checkpoints_begin(&r->cursor, &r->checkpoints, checkpointPath,
+                                           &plan, &job->opts.es, vg, false);
+        }
+
+        render_events(&r->cursor, plan.events, plan.eventCount, firstEvent, plan.useTrackIndex);
+
+        if (job->opts.useCheckpoints && r->checkpoints.dirty)
+            checkpoints_save(&r->checkpoints, checkpointPath);
+        checkpoints_free(&r->checkpoints);
+        m4a_engine_destroy(&r->engine);
+        rc = wav_close(&r->wav);
+    }
+    free(r);
+    plan_free(&plan);
+    return rc;
+}
+
+static void batch_render(void *ctx, int index)
+{
+    BatchRun *run = (BatchRun *)ctx;
+    BatchJob *job = &run->jobs[index];
+    LoadedVoiceGroup *vg = run->vgs[job->voicegroup];
+
+    job->result = vg ? batch_render_job(job, vg) : -1;
+    if (job->result == 0)
+        printf("Done: %s\n", job->outputPath);
+    else
+        fprintf(stderr, "Failed: %s (manifest line %d)\n", job->outputPath, job->line);
     fflush(stdout);
+}
 
-    LoadedVoiceGroup *vg = voicegroup_load(projectRoot, vgName, NULL);
-    if (!vg) {
-        fprintf(stderr, "Failed to load voicegroup '%s'\n", vgName);
-        free(extEvts);
-        free(events->events);
-        free(events);
+static int run_batch(const char *projectRoot, const char *manifestPath,
+                     int argc, char **argv, const char *prog)
+{
+    RenderOptions defaults = s_defaultRenderOptions;
+    int jobCount = 0;  /* 0 = one per CPU */
+    for (int i = 0; i < argc; i++) {
+        if (strcmp(argv[i], "--jobs") == 0 && i + 1 < argc) {
+            jobCount = atoi(argv[++i]);
+            if (jobCount < 1) jobCount = 1;
+        } else if (!parse_render_option(argc, argv, &i, &defaults)) {
+            fprintf(stderr, "Unknown option for --batch: %s\n", argv[i]);
+            print_usage(prog);
+            return 1;
+        }
+    }
+    int threads = jobCount > 0 ? jobCount : cpu_count();
+
+    BatchRun run = { 0 };
+    if (batch_read_manifest(&run, manifestPath, &defaults) != 0) {
+        batch_free(&run);
         return 1;
     }
-    printf("Voicegroup loaded successfully.\n");
+    printf("Batch: %d jobs, %d voicegroups\n", run.jobCount, run.vgCount);
 
-    /* ---- Initialize engine ---- */
-    M4AEngine engine;
-    m4a_engine_init(&engine, (float)sampleRate);
-    m4a_engine_set_voicegroup(&engine, vg->voices);
-    m4a_engine_set_song_volume(&engine, (uint8_t)songVolume);
-    m4a_reverb_set_amount(&engine.reverb, (uint8_t)reverbAmount);
-    engine.analogFilter = analogFilter;
-    engine.maxPcmChannels = (uint8_t)maxChannels;
-    engine.respectBaseMidiKey = respectBaseMidiKey;
-    m4a_engine_set_portamento_enabled(&engine, portamento);
-    m4a_engine_set_pwm_enabled(&engine, pwm);
-    m4a_engine_set_pcm_mix_rate(&engine, pcmMixRate);
-
-    /* ---- Allocate output buffers ---- */
-    float *outL = calloc(totalSamples, sizeof(float));
-    float *outR = calloc(totalSamples, sizeof(float));
-    if (!outL || !outR) {
-        fprintf(stderr, "Out of memory allocating audio buffers (%llu samples)\n",
-                (unsigned long long)totalSamples);
-        free(outL); free(outR);
-        m4a_engine_destroy(&engine);
-        voicegroup_free(vg);
-        free(extEvts);
-        free(events->events);
-        free(events);
+    printf("Loading project %s...\n", projectRoot);
+    fflush(stdout);
+    /* One pass and done: no sample can be rebuilt under the voicegroups. */
+    static const VoicegroupLoaderConfig loaderConfig = { .mapSamples = true };
+    VoicegroupProject *project = voicegroup_project_open(projectRoot, &loaderConfig);
+    run.vgs = calloc(run.vgCount > 0 ? (size_t)run.vgCount : 1, sizeof(LoadedVoiceGroup *));
+    if (!project || !run.vgs) {
+        fprintf(stderr, "Failed to load project %s\n", projectRoot);
+        voicegroup_project_close(project);
+        batch_free(&run);
         return 1;
     }
+    run.project = project;
+    parallel_for(run.vgCount, threads, batch_load_vg, &run);
+    voicegroup_project_close(project);
+    run.project = NULL;
 
-    /* ---- Rendering loop ---- */
-    printf("Rendering...\n");
+    printf("Rendering on %d threads...\n", threads < run.jobCount ? threads : run.jobCount);
     fflush(stdout);
+    parallel_for(run.jobCount, threads, batch_render, &run);
+
+    int failed = 0;
+    for (int i = 0; i < run.jobCount; i++)
+        if (run.jobs[i].result != 0)
+            failed++;
+    printf("Batch complete: %d rendered, %d failed\n", run.jobCount - failed, failed);
+
+    batch_free(&run);
+    return failed ? 1 : 0;
+}
 
-    uint64_t samplePos = 0;
-    for (int i = 0; i < renderEvtCount; i++) {
-        const RenderEvent *ev = &renderEvts[i];
+/* ========================================================================
+ * Render server (--serve) and client (--connect)
+ * ======================================================================== */
 
-        if (ev->samplePos >= totalSamples) break; /* safety: don't write past buffer */
+#ifndef _WIN32
+
+/*
+ * A long-running server keeps every project it has been asked about --
+ * discovery results, symbol maps and loaded voicegroups -- in memory, so a
+ * request only pays for parsing the MIDI file and rendering it.
+ *
+ * One request per connection on a Unix-domain stream socket.  The client
+ * sends text lines, then the MIDI file:
+ *
+ *   poryaaaa-render 1
+ *   project <absolute project root>
+ *   voicegroup <name>
+ *   option <token>          one per command-line token of the render options
+ *   reload                  optional: drop the cached project first
+ *   midi <byte count>
+ *   <Standard MIDI File bytes>
+ *
+ * The server answers "ok\n" followed by the WAV file as it is rendered, or
+ * "error <message>\n".  Requests are served concurrently, one thread each.
+ */
+#define SERVE_PROTOCOL    "poryaaaa-render 1"
+#define SERVE_MAX_MIDI    (16 << 20)
+#define SERVE_MAX_OPTIONS 64
+#define SERVE_LINE_MAX    2048
+
+/* An entry is inserted as SERVE_LOADING before its load starts and filled in
+ * by the thread loading it; others asking for it meanwhile wait on
+ * s_serveCond instead of loading it again. */
+enum { SERVE_LOADING, SERVE_READY, SERVE_FAILED };
+
+typedef struct ServedVoicegroup {
+    struct ServedVoicegroup *next;
+    char                    *name;
+    LoadedVoiceGroup        *vg;
+    int                      state;
+    int                      refs;  /* renders using it, plus one while cached */
+} ServedVoicegroup;
+
+typedef struct ServedProject {
+    struct ServedProject *next;
+    char                 *root;
+    VoicegroupProject    *project;
+    ServedVoicegroup     *vgs;
+    int                   state;
+    int                   refs;  /* requests looking it up, plus one while cached */
+} ServedProject;
+
+static pthread_mutex_t s_serveLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  s_serveCond = PTHREAD_COND_INITIALIZER;
+static ServedProject  *s_servedProjects;
+
+/* Drop one reference, under s_serveLock. */
+static void served_vg_unref(ServedVoicegroup *sv)
+{
+    if (--sv->refs > 0)
+        return;
+    voicegroup_free(sv->vg);
+    free(sv->name);
+    free(sv);
+}
 
-        /* Render audio up to this event */
-        if (ev->samplePos > samplePos)
-            render_frames(&engine, outL, outR, samplePos,
-                          ev->samplePos - samplePos);
+/* Drop one reference, under s_serveLock. */
+static void served_project_unref(ServedProject *sp)
+{
+    if (--sp->refs > 0)
+        return;
+    voicegroup_project_close(sp->project);
+    free(sp->root);
+    free(sp);
+}
 
-        samplePos = ev->samplePos;
-        dispatch_event(&engine, ev, useTrackIndex);
+/* Unlink a project from the cache, under s_serveLock.  Voicegroups still in
+ * use by a render are freed when it releases them, and a project still being
+ * looked up when the request using it is done. */
+static void served_project_drop(ServedProject **link)
+{
+    ServedProject *sp = *link;
+    *link = sp->next;
+    for (ServedVoicegroup *sv = sp->vgs, *next; sv; sv = next) {
+        next = sv->next;
+        served_vg_unref(sv);
     }
+    sp->vgs = NULL;
+    served_project_unref(sp);
+}
 
-    /* Render remaining frames (tail / fadeout section) */
-    if (samplePos < totalSamples)
-        render_frames(&engine, outL, outR, samplePos, totalSamples - samplePos);
-
-    /* ---- Apply fadeout envelope ---- */
-    if (fadeStartSample != UINT64_MAX && fadeStartSample < totalSamples) {
-        uint64_t fadeSamps = totalSamples - fadeStartSample;
-        for (uint64_t i = 0; i < fadeSamps; i++) {
-            float gain = 1.0f - (float)i / (float)fadeSamps;
-            outL[fadeStartSample + i] *= gain;
-            outR[fadeStartSample + i] *= gain;
+/* Take a failed entry out of the cache (if a reload has not already), under
+ * s_serveLock, so the next request tries again. */
+static void served_vg_uncache(ServedProject *sp, ServedVoicegroup *sv)
+{
+    for (ServedVoicegroup **link = &sp->vgs; *link; link = &(*link)->next) {
+        if (*link == sv) {
+            *link = sv->next;
+            served_vg_unref(sv);
+            return;
         }
     }
+}
 
-    printf("Rendering complete.\n");
+static void served_project_uncache(ServedProject *sp)
+{
+    for (ServedProject **link = &s_servedProjects; *link; link = &(*link)->next) {
+        if (*link == sp) {
+            served_project_drop(link);
+            return;
+        }
+    }
+}
 
-    /* ---- WAV output ---- */
-    if (outputPath) {
-        printf("Writing %s...\n", outputPath);
-        if (write_wav(outputPath, outL, outR, totalSamples, sampleRateHz) == 0)
-            printf("Done: %s\n", outputPath);
+/* Look up (or open and cache) a project and take a reference to it, under
+ * s_serveLock; the lock is released while the project is opened. */
+static ServedProject *serve_find_project(const char *root, bool reload)
+{
+    ServedProject **link = &s_servedProjects;
+    while (*link && strcmp((*link)->root, root) != 0)
+        link = &(*link)->next;
+    if (*link && reload && (*link)->state != SERVE_LOADING) {
+        printf("Reloading project %s\n", root);
+        fflush(stdout);
+        served_project_drop(link);
     }
 
-    /* ---- Speaker playback via miniaudio ---- */
-    if (doPlay) {
-        printf("Playing audio...\n");
+    ServedProject *sp = *link;
+    if (sp) {
+        sp->refs++;
+        while (sp->state == SERVE_LOADING)
+            pthread_cond_wait(&s_serveCond, &s_serveLock);
+    } else {
+        sp = calloc(1, sizeof(ServedProject));
+        if (sp && !(sp->root = str_dup(root))) {
+            free(sp);
+            sp = NULL;
+        }
+        if (!sp)
+            return NULL;
+        sp->state = SERVE_LOADING;
+        sp->refs = 2;
+        sp->next = s_servedProjects;
+        s_servedProjects = sp;
+
+        pthread_mutex_unlock(&s_serveLock);
+        printf("Loading project %s\n", root);
         fflush(stdout);
+        VoicegroupProject *project = voicegroup_project_open(root, NULL);
+        pthread_mutex_lock(&s_serveLock);
+
+        sp->project = project;
+        sp->state = project ? SERVE_READY : SERVE_FAILED;
+        if (!project)
+            served_project_uncache(sp);
+        pthread_cond_broadcast(&s_serveCond);
+    }
 
-#ifdef __linux__
-        /* Suppress ALSA's verbose "cannot find card" error spam.  On WSL
-         * there is no ALSA hardware, so miniaudio will fall back to
-         * PulseAudio (provided by WSLg on Windows 11). */
-        suppress_alsa_errors();
-
-        /* Try PulseAudio before ALSA so that WSLg's PulseAudio server is
-         * found without probing ALSA at all. */
-        ma_backend linuxBackends[] = { ma_backend_pulseaudio, ma_backend_alsa };
-        ma_context context;
-        bool hasContext = (ma_context_init(linuxBackends, 2, NULL, &context) == MA_SUCCESS);
-#endif
+    if (sp->state == SERVE_FAILED) {
+        served_project_unref(sp);
+        return NULL;
+    }
+    return sp;
+}
 
-        PlaybackCtx ctx = { outL, outR, totalSamples, 0 };
+/*
+ * Find (or load and cache) a voicegroup and take a reference to it.  Loads
+ * run outside the cache lock, so requests for other projects and voicegroups
+ * carry on meanwhile; concurrent first requests for the same project or
+ * voicegroup wait for one load instead of each doing it.
+ */
+static ServedVoicegroup *serve_acquire(const char *root, const char *name, bool reload)
+{
+    pthread_mutex_lock(&s_serveLock);
 
-        ma_device_config cfg  = ma_device_config_init(ma_device_type_playback);
-        cfg.playback.format   = ma_format_f32;
-        cfg.playback.channels = 2;
-        cfg.sampleRate        = (ma_uint32)sampleRateHz;
-        cfg.dataCallback      = playback_callback;
-        cfg.pUserData         = &ctx;
+    ServedProject *sp = serve_find_project(root, reload);
+    if (!sp) {
+        pthread_mutex_unlock(&s_serveLock);
+        return NULL;
+    }
+
+    ServedVoicegroup *sv = sp->vgs;
+    while (sv && strcmp(sv->name, name) != 0)
+        sv = sv->next;
+    if (sv) {
+        sv->refs++;
+        while (sv->state == SERVE_LOADING)
+            pthread_cond_wait(&s_serveCond, &s_serveLock);
+    } else {
+        sv = calloc(1, sizeof(ServedVoicegroup));
+        if (sv && !(sv->name = str_dup(name))) {
+            free(sv);
+            sv = NULL;
+        }
+        if (!sv) {
+            served_project_unref(sp);
+            pthread_mutex_unlock(&s_serveLock);
+            return NULL;
+        }
+        sv->state = SERVE_LOADING;
+        sv->refs = 2;
+        sv->next = sp->vgs;
+        sp->vgs = sv;
+
+        pthread_mutex_unlock(&s_serveLock);
+        printf("Loading voicegroup '%s'\n", name);
+        fflush(stdout);
+        LoadedVoiceGroup *vg = voicegroup_project_load(sp->project, name);
+        pthread_mutex_lock(&s_serveLock);
+
+        sv->vg = vg;
+        sv->state = vg ? SERVE_READY : SERVE_FAILED;
+        if (!vg)
+            served_vg_uncache(sp, sv);
+        pthread_cond_broadcast(&s_serveCond);
+    }
+
+    if (sv->state == SERVE_FAILED) {
+        served_vg_unref(sv);
+        sv = NULL;
+    }
+    served_project_unref(sp);
+    pthread_mutex_unlock(&s_serveLock);
+    return sv;
+}
+
+static void serve_release(ServedVoicegroup *sv)
+{
+    pthread_mutex_lock(&s_serveLock);
+    served_vg_unref(sv);
+    pthread_mutex_unlock(&s_serveLock);
+}
+
+/* Read one '\n'-terminated line without the terminator; false at EOF or if
+ * the line does not fit. */
+static bool read_line(FILE *in, char *line, size_t size)
+{
+    if (!fgets(line, (int)size, in))
+        return false;
+    size_t len = strlen(line);
+    if (len == 0 || line[len - 1] != '\n')
+        return false;
+    line[len - 1] = '\0';
+    return true;
+}
+
+static double now_seconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+/* Serve one request.  Always closes `out`. */
+static void serve_request(FILE *in, FILE *out)
+{
+    double t0 = now_seconds();
+    char line[SERVE_LINE_MAX];
+    char root[SERVE_LINE_MAX] = "";
+    char vgName[SERVE_LINE_MAX] = "";
+    char *optTokens[SERVE_MAX_OPTIONS];
+    int optCount = 0;
+    bool reload = false;
+    long midiSize = -1;
+    uint8_t *midi = NULL;
+    const char *err = NULL;
+    RenderPlan plan = { 0 };
+    ServedVoicegroup *sv = NULL;
+    RenderOptions opts = s_defaultRenderOptions;
+
+    if (!read_line(in, line, sizeof(line)) || strcmp(line, SERVE_PROTOCOL) != 0)
+        err = "unsupported protocol";
+    while (!err && midiSize < 0) {
+        if (!read_line(in, line, sizeof(line))) {
+            err = "truncated request";
+        } else if (strncmp(line, "project ", 8) == 0) {
+            snprintf(root, sizeof(root), "%s", line + 8);
+        } else if (strncmp(line, "voicegroup ", 11) == 0) {
+            snprintf(vgName, sizeof(vgName), "%s", line + 11);
+        } else if (strncmp(line, "option ", 7) == 0) {
+            if (optCount >= SERVE_MAX_OPTIONS || !(optTokens[optCount] = str_dup(line + 7)))
+                err = "too many options";
+            else
+                optCount++;
+        } else if (strcmp(line, "reload") == 0) {
+            reload = true;
+        } else if (strncmp(line, "midi ", 5) == 0) {
+            midiSize = strtol(line + 5, NULL, 10);
+            if (midiSize <= 0 || midiSize > SERVE_MAX_MIDI) {
+                err = "bad MIDI size";
+                midiSize = 0;
+            }
+        } else {
+            err = "unknown request line";
+        }
+    }
+    if (!err && (!root[0] || !vgName[0]))
+        err = "request needs a project and a voicegroup";
+    if (!err) {
+        midi = malloc((size_t)midiSize);
+        if (!midi || fread(midi, 1, (size_t)midiSize, in) != (size_t)midiSize)
+            err = "truncated MIDI data";
+    }
+    for (int i = 0; !err && i < optCount; i++) {
+        if (!parse_render_option(optCount, optTokens, &i, &opts))
+            err = "unknown or incomplete option";
+    }
+    opts.useCheckpoints = false;  /* the server has no output path to keep them next to */
+    if (!err && plan_render(&plan, "request", midi, (size_t)midiSize, &opts, false) != 0)
+        err = "cannot parse the MIDI file or render range";
+    if (!err && !(sv = serve_acquire(root, vgName, reload)))
+        err = "cannot load the voicegroup";
+
+    if (err) {
+        fprintf(out, "error %s\n", err);
+        fclose(out);
+    } else {
+        fputs("ok\n", out);
+        RenderState *r = calloc(1, sizeof(RenderState));
+        uint64_t frames = plan.endSample - plan.startSample;
+        if (!r || wav_open_stream(&r->wav, out, opts.es.sampleRateHz, frames) != 0) {
+            if (!r)
+                fclose(out);
+        } else {
+            engine_setup(&r->engine, &opts.es, sv->vg);
+            cursor_init(&r->cursor, &r->engine, &plan, &opts.es);
+            r->cursor.wav = &r->wav;
+            render_events(&r->cursor, plan.events, plan.eventCount, 0, plan.useTrackIndex);
+            m4a_engine_destroy(&r->engine);
+            if (wav_close(&r->wav) != 0)
+                err = "client went away";
+        }
+        free(r);
+        printf("%s %s '%s': %.2f s of audio in %.0f ms\n", err ? "Failed" : "Rendered",
+               root, vgName, (double)frames / opts.es.sampleRateHz,
+               (now_seconds() - t0) * 1000.0);
+        fflush(stdout);
+    }
+
+    if (sv)
+        serve_release(sv);
+    plan_free(&plan);
+    free(midi);
+    for (int i = 0; i < optCount; i++)
+        free(optTokens[i]);
+}
+
+static void *serve_connection(void *arg)
+{
+    int fd = (int)(intptr_t)arg;
+    int outFd = dup(fd);
+    FILE *in  = fdopen(fd, "rb");
+    FILE *out = outFd >= 0 ? fdopen(outFd, "wb") : NULL;
+    if (in && out) {
+        serve_request(in, out);
+    } else if (out) {
+        fclose(out);
+    } else if (outFd >= 0) {
+        close(outFd);
+    }
+    if (in)
+        fclose(in);
+    else
+        close(fd);
+    return NULL;
+}
+
+static int run_server(const char *socketPath)
+{
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    if (strlen(socketPath) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "Socket path too long: %s\n", socketPath);
+        return 1;
+    }
+    strcpy(addr.sun_path, socketPath);
+
+    /* A client that disconnects mid-render must not kill the server. */
+    signal(SIGPIPE, SIG_IGN);
+
+    int lfd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (lfd < 0) {
+        perror("socket");
+        return 1;
+    }
+    unlink(socketPath);
+    if (bind(lfd, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(lfd, 16) != 0) {
+        perror(socketPath);
+        close(lfd);
+        return 1;
+    }
+    printf("Listening on %s\n", socketPath);
+    fflush(stdout);
+
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    for (;;) {
+        int fd = accept(lfd, NULL, NULL);
+        if (fd < 0) {
+            if (errno == EINTR)
+                continue;
+            perror("accept");
+            break;
+        }
+        pthread_t thread;
+        if (pthread_create(&thread, &attr, serve_connection, (void *)(intptr_t)fd) != 0)
+            close(fd);
+    }
+    pthread_attr_destroy(&attr);
+    close(lfd);
+    unlink(socketPath);
+    return 1;
+}
+
+/* Send a render request to a server and write the WAV it streams back. */
+static int run_client(const char *socketPath, const char *projectRoot, const char *vgName,
+                      const char *midiPath, const char *outputPath,
+                      char **optTokens, int optCount, bool reload)
+{
+    char root[PATH_MAX];
+    if (!realpath(projectRoot, root)) {
+        fprintf(stderr, "Cannot find project root %s\n", projectRoot);
+        return 1;
+    }
+
+    FILE *mf = fopen(midiPath, "rb");
+    if (!mf) {
+        fprintf(stderr, "Cannot open MIDI file: %s\n", midiPath);
+        return 1;
+    }
+    fseek(mf, 0, SEEK_END);
+    long midiSize = ftell(mf);
+    rewind(mf);
+    uint8_t *midi = midiSize > 0 ? malloc((size_t)midiSize) : NULL;
+    if (!midi || fread(midi, 1, (size_t)midiSize, mf) != (size_t)midiSize) {
+        fprintf(stderr, "Failed to read MIDI file: %s\n", midiPath);
+        free(midi);
+        fclose(mf);
+        return 1;
+    }
+    fclose(mf);
+
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", socketPath);
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        fprintf(stderr, "Cannot connect to render server at %s\n", socketPath);
+        if (fd >= 0)
+            close(fd);
+        free(midi);
+        return 1;
+    }
+    /* Separate streams for each direction; a socket cannot be repositioned,
+     * which a single read/write stream would need between the two. */
+    signal(SIGPIPE, SIG_IGN);
+    int inFd = dup(fd);
+    FILE *out = fdopen(fd, "wb");
+    FILE *in  = inFd >= 0 ? fdopen(inFd, "rb") : NULL;
+    if (!in || !out) {
+        if (out) fclose(out); else close(fd);
+        if (in) fclose(in); else if (inFd >= 0) close(inFd);
+        free(midi);
+        return 1;
+    }
+
+    fprintf(out, "%s\nproject %s\nvoicegroup %s\n", SERVE_PROTOCOL, root, vgName);
+    for (int i = 0; i < optCount; i++)
+        fprintf(out, "option %s\n", optTokens[i]);
+    if (reload)
+        fputs("reload\n", out);
+    fprintf(out, "midi %ld\n", midiSize);
+    fwrite(midi, 1, (size_t)midiSize, out);
+    fflush(out);
+    free(midi);
+
+    int rc = 1;
+    char line[SERVE_LINE_MAX];
+    if (!read_line(in, line, sizeof(line))) {
+        fprintf(stderr, "Render server closed the connection\n");
+    } else if (strcmp(line, "ok") != 0) {
+        fprintf(stderr, "Render server: %s\n",
+                strncmp(line, "error ", 6) == 0 ? line + 6 : line);
+    } else {
+        /* Copy the WAV through, checking it against the size in its header
+         * to catch a render that failed part way. */
+        FILE *of = fopen(outputPath, "wb");
+        if (!of) {
+            fprintf(stderr, "Cannot open %s for writing\n", outputPath);
+        } else {
+            static uint8_t buf[1 << 16];
+            uint64_t total = 0, expected = UINT64_MAX;
+            bool failed = false;
+            size_t n;
+            while ((n = fread(buf, 1, sizeof(buf), in)) > 0) {
+                if (total == 0 && n >= 8)
+                    expected = 8 + (uint64_t)(buf[4] | buf[5] << 8 | buf[6] << 16 |
+                                              (uint32_t)buf[7] << 24);
+                total += n;
+                if (fwrite(buf, 1, n, of) != n)
+                    failed = true;
+            }
+            if (fclose(of) != 0 || failed)
+                fprintf(stderr, "Failed to write %s\n", outputPath);
+            else if (total != expected)
+                fprintf(stderr, "Render server stopped part way through %s\n", outputPath);
+            else
+                rc = 0;
+        }
+    }
+    fclose(in);
+    fclose(out);
+    if (rc == 0)
+        printf("Done: %s\n", outputPath);
+    return rc;
+}
+
+#endif /* !_WIN32 */
+
+/* ========================================================================
+ * Watch mode (--watch)
+ * ======================================================================== */
 
-        ma_device device;
-#ifdef __linux__
-        ma_result initResult = ma_device_init(hasContext ? &context : NULL, &cfg, &device);
-#else
-        ma_result initResult = ma_device_init(NULL, &cfg, &device);
-#endif
-        if (initResult != MA_SUCCESS) {
-            fprintf(stderr, "Failed to initialize audio playback device.\n");
 #ifdef __linux__
-            fprintf(stderr, "On WSL, audio requires PulseAudio (WSLg on Windows 11 provides this).\n");
-#endif
+
+/*
+ * Render, then watch the MIDI file, the project's symbol files and every
+ * file the voicegroup was built from, and render again when one is saved.
+ * The directories holding them are watched rather than the files, so
+ * editors that save by writing a new file and renaming it over the old one
+ * are caught too.  A save while a render (or its playback) is still
+ * going stops it and starts over.
+ *
+ * Only what changed is reloaded: an edited MIDI file is re-parsed; an edited
+ * voicegroup or sample reloads the voicegroup, re-reading only the samples
+ * whose files changed (voicegroup_project_reload); an edited symbol file
+ * re-opens the project.  The engine is set up again in place.
+ */
+#define WATCH_SETTLE_MS 150
+
+enum {
+    WATCH_MIDI       = 1,
+    WATCH_PROJECT    = 2,
+    WATCH_VOICEGROUP = 4,
+};
+
+typedef struct {
+    char        path[1024];
+    const char *name;   /* last component of path */
+    int         dirWd;  /* inotify watch on the containing directory */
+    int64_t     mtime;  /* when it was last read */
+    int         kind;
+} WatchedFile;
+
+typedef struct {
+    int          fd;       /* inotify instance, -1 = none */
+    WatchedFile *files;
+    int          count;
+    int          capacity;
+    bool         pending;  /* a watched file was touched */
+} Watcher;
+
+static void watcher_add(Watcher *w, const char *path, int64_t mtime, int kind)
+{
+    for (int i = 0; i < w->count; i++)
+        if (strcmp(w->files[i].path, path) == 0)
+            return;
+    if (w->count >= w->capacity) {
+        int cap = w->capacity * 2 + 64;
+        WatchedFile *p = realloc(w->files, (size_t)cap * sizeof(WatchedFile));
+        if (!p) return;
+        w->files    = p;
+        w->capacity = cap;
+    }
+    WatchedFile *f = &w->files[w->count++];
+    snprintf(f->path, sizeof(f->path), "%s", path);
+    const char *slash = strrchr(f->path, '/');
+    f->name  = slash ? slash + 1 : f->path;
+    f->dirWd = -1;
+    f->mtime = mtime;
+    f->kind  = kind;
+}
+
+/* (Re)build the watch list from the current MIDI file, project and
+ * voicegroup. */
+static int watcher_build(Watcher *w, const char *midiPath, int64_t midiMtime,
+                         const VoicegroupProject *project, const LoadedVoiceGroup *vg)
+{
+    if (w->fd >= 0)
+        close(w->fd);
+    w->count   = 0;
+    w->pending = false;
+    w->fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (w->fd < 0) {
+        perror("inotify_init1");
+        return -1;
+    }
+
+    watcher_add(w, midiPath, midiMtime, WATCH_MIDI);
+    for (int i = 0; i < voicegroup_project_file_count(project); i++) {
+        const VgSourceFile *src = voicegroup_project_file(project, i);
+        watcher_add(w, src->path, src->mtime, WATCH_PROJECT);
+    }
+    for (int i = 0; i < vg->sourceFileCount; i++)
+        watcher_add(w, vg->sourceFiles[i].path, vg->sourceFiles[i].mtime, WATCH_VOICEGROUP);
+
+    for (int i = 0; i < w->count; i++) {
+        WatchedFile *f = &w->files[i];
+        char dir[1024];
+        if (f->name == f->path) {
+            strcpy(dir, ".");
         } else {
-            if (ma_device_start(&device) != MA_SUCCESS) {
-                fprintf(stderr, "Failed to start audio playback device\n");
+            size_t len = (size_t)(f->name - 1 - f->path);
+            memcpy(dir, f->path, len ? len : 1);
+            dir[len ? len : 1] = '\0';
+        }
+        /* Adding the same directory again returns its existing watch. */
+        f->dirWd = inotify_add_watch(w->fd, dir, IN_CLOSE_WRITE | IN_MOVED_TO |
+                                                 IN_DELETE | IN_ATTRIB);
+    }
+    return 0;
+}
+
+/* Drain pending events; returns true once any of them concerned a watched
+ * file.  Also the render cursor's interrupt callback. */
+static bool watcher_poll(void *ctx)
+{
+    Watcher *w = (Watcher *)ctx;
+    char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    ssize_t len;
+    while ((len = read(w->fd, buf, sizeof(buf))) > 0) {
+        for (char *p = buf; p < buf + len; ) {
+            const struct inotify_event *ev = (const struct inotify_event *)p;
+            for (int i = 0; ev->len > 0 && i < w->count; i++) {
+                if (w->files[i].dirWd == ev->wd && strcmp(w->files[i].name, ev->name) == 0) {
+                    w->pending = true;
+                    break;
+                }
+            }
+            p += sizeof(struct inotify_event) + ev->len;
+        }
+    }
+    return w->pending;
+}
+
+/* Block until a watched file is touched (unless one already was), then
+ * until the saves settle. */
+static void watcher_wait(Watcher *w, bool touched)
+{
+    struct pollfd pfd = { .fd = w->fd, .events = POLLIN };
+    while (!touched && !watcher_poll(w))
+        poll(&pfd, 1, -1);
+    while (poll(&pfd, 1, WATCH_SETTLE_MS) > 0)
+        watcher_poll(w);
+    w->pending = false;
+}
+
+/* Which kinds of file have a different modification time than when read. */
+static int watcher_changes(const Watcher *w)
+{
+    int changes = 0;
+    for (int i = 0; i < w->count; i++)
+        if (voicegroup_file_mtime(w->files[i].path) != w->files[i].mtime)
+            changes |= w->files[i].kind;
+    return changes;
+}
+
+/* Stop the device and drop whatever is queued; the next playback_write
+ * starts it again. */
+static void playback_stop(PlaybackCtx *ctx)
+{
+    if (ctx->started) {
+        ma_device_stop(&ctx->device);
+        ctx->started = false;
+    }
+    ma_pcm_rb_reset(&ctx->rb);
+}
+
+/* What the watch loop renders, and with what. */
+typedef struct {
+    const char        *projectRoot;
+    const char        *vgName;
+    const char        *midiPath;
+    const char        *outputPath;  /* NULL = no WAV output */
+    PlaybackCtx       *play;        /* NULL = no playback */
+    RenderOptions      opts;
+    VoicegroupProject *project;
+    LoadedVoiceGroup  *vg;
+    RenderPlan         plan;
+    int64_t            midiMtime;
+    M4AEngine         *engine;
+    RenderCursor      *cursor;
+} WatchSession;
+
+static void watch_render(WatchSession *ws, Watcher *w)
+{
+    if (ws->play)
+        playback_stop(ws->play);
+    m4a_engine_destroy(ws->engine);
+    engine_setup(ws->engine, &ws->opts.es, ws->vg);
+    cursor_init(ws->cursor, ws->engine, &ws->plan, &ws->opts.es);
+
+    WavWriter wav;
+    bool wavOpen = ws->outputPath && wav_open(&wav, ws->outputPath, ws->opts.es.sampleRateHz) == 0;
+    ws->cursor->wav          = wavOpen ? &wav : NULL;
+    ws->cursor->play         = ws->play;
+    ws->cursor->interrupt    = watcher_poll;
+    ws->cursor->interruptCtx = w;
+    ws->cursor->interrupted  = false;
+
+    double t0 = now_seconds();
+    render_events(ws->cursor, ws->plan.events, ws->plan.eventCount, 0, ws->plan.useTrackIndex);
+    bool ok = !wavOpen || wav_close(&wav) == 0;
+    if (ws->cursor->interrupted)
+        printf("Render interrupted by a change.\n");
+    else if (ok)
+        printf("Rendered %s in %.0f ms.\n", ws->outputPath ? ws->outputPath : "song",
+               (now_seconds() - t0) * 1000.0);
+    else
+        fprintf(stderr, "Failed to write %s\n", ws->outputPath);
+    fflush(stdout);
+}
+
+static void watch_loop(WatchSession *ws)
+{
+    Watcher w = { .fd = -1 };
+    if (watcher_build(&w, ws->midiPath, ws->midiMtime, ws->project, ws->vg) != 0)
+        return;
+    watch_render(ws, &w);
+
+    bool touched = ws->cursor->interrupted;  /* the last render was stopped by a save */
+    for (;;) {
+        if (!touched) {
+            printf("Watching for changes (Ctrl+C to stop)...\n");
+            fflush(stdout);
+        }
+        watcher_wait(&w, touched);
+
+        int changes = watcher_changes(&w);
+        if (!changes && !touched)
+            continue;
+
+        if (changes & WATCH_MIDI) {
+            printf("MIDI file changed; re-parsing.\n");
+            int64_t mtime = voicegroup_file_mtime(ws->midiPath);
+            RenderPlan plan;
+            if (plan_render(&plan, ws->midiPath, NULL, 0, &ws->opts, false) == 0) {
+                plan_free(&ws->plan);
+                ws->plan = plan;
+            }
+            ws->midiMtime = mtime;
+        }
+        if (changes & WATCH_PROJECT) {
+            printf("Project sound data changed; re-opening the project.\n");
+            VoicegroupProject *project = voicegroup_project_open(ws->projectRoot, NULL);
+            LoadedVoiceGroup *vg = project ? voicegroup_project_reload(project, ws->vgName, ws->vg)
+                                           : NULL;
+            if (vg) {
+                voicegroup_project_close(ws->project);
+                ws->project = project;
+                ws->vg = vg;
             } else {
-                while (ctx.pos < ctx.total)
-                    ma_sleep(100);
+                fprintf(stderr, "Failed to reload voicegroup '%s'; keeping the old one\n", ws->vgName);
+                voicegroup_project_close(project);
             }
-            ma_device_uninit(&device);
+        } else if (changes & WATCH_VOICEGROUP) {
+            printf("Voicegroup files changed; reloading '%s'.\n", ws->vgName);
+            LoadedVoiceGroup *vg = voicegroup_project_reload(ws->project, ws->vgName, ws->vg);
+            if (vg)
+                ws->vg = vg;
+            else
+                fprintf(stderr, "Failed to reload voicegroup '%s'; keeping the old one\n", ws->vgName);
+        }
+        fflush(stdout);
+
+        /* Watch the new set of files before rendering, so a save during the
+         * render interrupts it. */
+        if (watcher_build(&w, ws->midiPath, ws->midiMtime, ws->project, ws->vg) != 0)
+            break;
+        watch_render(ws, &w);
+        touched = ws->cursor->interrupted;
+    }
+    if (w.fd >= 0)
+        close(w.fd);
+    free(w.files);
+}
+
+static int run_watch(const char *projectRoot, const char *vgName, const char *midiPath,
+                     const char *outputPath, bool doPlay, const RenderOptions *opts)
+{
+    static WatchSession ws;
+    ws.projectRoot = projectRoot;
+    ws.vgName      = vgName;
+    ws.midiPath    = midiPath;
+    ws.outputPath  = outputPath;
+    ws.opts        = *opts;
+    ws.midiMtime   = voicegroup_file_mtime(midiPath);
+
+    printf("Parsing MIDI file: %s\n", midiPath);
+    fflush(stdout);
+    if (plan_render(&ws.plan, midiPath, NULL, 0, &ws.opts, true) != 0)
+        return 1;
+
+    printf("Loading voicegroup '%s' from %s...\n", vgName, projectRoot);
+    fflush(stdout);
+    ws.project = voicegroup_project_open(projectRoot, NULL);
+    ws.vg = ws.project ? voicegroup_project_load(ws.project, vgName) : NULL;
+    if (!ws.vg) {
+        fprintf(stderr, "Failed to load voicegroup '%s'\n", vgName);
+        voicegroup_project_close(ws.project);
+        plan_free(&ws.plan);
+        return 1;
+    }
+    printf("Voicegroup loaded successfully.\n");
+
+    static PlaybackCtx playback;
+    static M4AEngine engine;
+    static RenderCursor cursor;
+    ws.play   = doPlay && playback_open(&playback, ws.opts.es.sampleRateHz) == 0 ? &playback : NULL;
+    ws.engine = &engine;
+    ws.cursor = &cursor;
+    engine_setup(&engine, &ws.opts.es, ws.vg);
+
+    watch_loop(&ws);
+
+    if (ws.play)
+        playback_close(ws.play);
+    m4a_engine_destroy(&engine);
+    voicegroup_free(ws.vg);
+    voicegroup_project_close(ws.project);
+    plan_free(&ws.plan);
+    return 1;
+}
+
+#endif /* __linux__ */
+
+int main(int argc, char *argv[])
+{
+    if (argc >= 4 && strcmp(argv[2], "--batch") == 0)
+        return run_batch(argv[1], argv[3], argc - 4, argv + 4, argv[0]);
+    if (argc == 3 && strcmp(argv[1], "--serve") == 0) {
+#ifdef _WIN32
+        fprintf(stderr, "Error: --serve is not supported on Windows\n");
+        return 1;
+#else
+        return run_server(argv[2]);
+#endif
+    }
+
+    if (argc < 4) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    const char *projectRoot   = argv[1];
+    const char *vgName        = argv[2];
+    const char *midiPath      = NULL;
+    const char *outputPath    = NULL;
+    bool        doPlay        = false;
+    RenderOptions opts        = s_defaultRenderOptions;
+    const char *stemsDir      = NULL;
+    int         jobCount      = 0;     /* 0 = one per CPU */
+    const char *connectPath   = NULL;
+    bool        reload        = false;
+    bool        watch         = false;
+    char       *optTokens[64];         /* render options, as forwarded by --connect */
+    int         optTokenCount = 0;
+
+    for (int i = 3; i < argc; i++) {
+        int first = i;
+        if (strcmp(argv[i], "--midi") == 0 && i + 1 < argc) {
+            midiPath = argv[++i];
+        } else if (strcmp(argv[i], "--output") == 0 && i + 1 < argc) {
+            outputPath = argv[++i];
+        } else if (strcmp(argv[i], "--play") == 0) {
+            doPlay = true;
+        } else if (strcmp(argv[i], "--stems") == 0 && i + 1 < argc) {
+            stemsDir = argv[++i];
+        } else if (strcmp(argv[i], "--jobs") == 0 && i + 1 < argc) {
+            jobCount = atoi(argv[++i]);
+            if (jobCount < 1) jobCount = 1;
+        } else if (strcmp(argv[i], "--connect") == 0 && i + 1 < argc) {
+            connectPath = argv[++i];
+        } else if (strcmp(argv[i], "--reload") == 0) {
+            reload = true;
+        } else if (strcmp(argv[i], "--watch") == 0) {
+            watch = true;
+        } else if (parse_render_option(argc, argv, &i, &opts)) {
+            for (int k = first; k <= i && optTokenCount < 64; k++)
+                optTokens[optTokenCount++] = argv[k];
+        } else {
+            fprintf(stderr, "Unknown option: %s\n", argv[i]);
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (connectPath) {
+        if (!midiPath || !outputPath || doPlay || stemsDir || watch) {
+            fprintf(stderr, "Error: --connect needs --midi and --output, and renders no --play, --stems or --watch\n\n");
+            print_usage(argv[0]);
+            return 1;
         }
+#ifdef _WIN32
+        fprintf(stderr, "Error: --connect is not supported on Windows\n");
+        return 1;
+#else
+        return run_client(connectPath, projectRoot, vgName, midiPath, outputPath,
+                          optTokens, optTokenCount, reload);
+#endif
+    }
 
+    if (!midiPath) {
+        fprintf(stderr, "Error: --midi is required\n\n");
+        print_usage(argv[0]);
+        return 1;
+    }
+    if (!outputPath && !doPlay && !stemsDir) {
+        fprintf(stderr, "Error: at least one of --output, --play or --stems is required\n\n");
+        print_usage(argv[0]);
+        return 1;
+    }
+    if (opts.useCheckpoints && !outputPath) {
+        fprintf(stderr, "Warning: --checkpoints needs --output; ignoring it\n");
+        opts.useCheckpoints = false;
+    }
+    if (watch) {
+        if (stemsDir) {
+            fprintf(stderr, "Error: --watch renders no --stems\n\n");
+            print_usage(argv[0]);
+            return 1;
+        }
+        if (opts.useCheckpoints) {
+            fprintf(stderr, "Warning: --checkpoints is not used with --watch; ignoring it\n");
+            opts.useCheckpoints = false;
+        }
 #ifdef __linux__
-        if (hasContext)
-            ma_context_uninit(&context);
+        return run_watch(projectRoot, vgName, midiPath, outputPath, doPlay, &opts);
+#else
+        fprintf(stderr, "Error: --watch is only supported on Linux\n");
+        return 1;
 #endif
+    }
+
+    const EngineSettings *settings = &opts.es;
+    int sampleRateHz = settings->sampleRateHz;
+
+    /* ---- Parse MIDI and lay out the render ---- */
+    printf("Parsing MIDI file: %s\n", midiPath);
+    fflush(stdout);
+
+    RenderPlan plan;
+    if (plan_render(&plan, midiPath, NULL, 0, &opts, true) != 0)
+        return 1;
+    const RenderEvent *renderEvts = plan.events;
+    int renderEvtCount = plan.eventCount;
+    int useTrackIndex  = plan.useTrackIndex;
+
+    /* ---- Load voicegroup ---- */
+    printf("Loading voicegroup '%s' from %s...\n", vgName, projectRoot);
+    fflush(stdout);
+
+    /* One render and done: no sample can be rebuilt under the voicegroup. */
+    static const VoicegroupLoaderConfig loaderConfig = { .mapSamples = true };
+    VoicegroupUsage usage;
+    plan_usage(&plan, &usage);
+    LoadedVoiceGroup *vg = voicegroup_load_used(projectRoot, vgName, &loaderConfig, &usage);
+    if (!vg) {
+        fprintf(stderr, "Failed to load voicegroup '%s'\n", vgName);
+        plan_free(&plan);
+        return 1;
+    }
+    printf("Voicegroup loaded successfully.\n");
+
+    /* ---- Initialize engine ---- */
+    M4AEngine engine;
+    engine_setup(&engine, settings, vg);
+
+    /* ---- Outputs ----
+     * Both are fed block by block as the render proceeds. */
+    WavWriter wav;
+    bool wavOpen = outputPath && wav_open(&wav, outputPath, sampleRateHz) == 0;
+    if (outputPath && !wavOpen) {
+        m4a_engine_destroy(&engine);
+        voicegroup_free(vg);
+        plan_free(&plan);
+        return 1;
+    }
+    static PlaybackCtx playback;
+    bool playOpen = doPlay && playback_open(&playback, sampleRateHz) == 0;
+
+    static RenderCursor cursor;
+    cursor_init(&cursor, &engine, &plan, settings);
+    cursor.wav  = wavOpen ? &wav : NULL;
+    cursor.play = playOpen ? &playback : NULL;
+
+    /* ---- Checkpoints ---- */
+    CheckpointSet checkpoints = { 0 };
+    char checkpointPath[1024] = "";
+    int firstEvent = 0;
+    if (opts.useCheckpoints) {
+        snprintf(checkpointPath, sizeof(checkpointPath), "%s.ckpt", outputPath);
+        firstEvent = checkpoints_begin(&cursor, &checkpoints, checkpointPath,
+                                       &plan, settings, vg, true);
+    }
+
+    /* ---- Stems ----
+     * One job per engine track that plays notes, run on a worker pool while
+     * the main thread renders the full mix (if requested). */
+    StemPool stemPool = { 0 };
+    pthread_t stemsThread;
+    bool stemsStarted = false;
+    if (stemsDir && make_dir(stemsDir) == 0) {
+        if (settings->reverbAmount > 0)
+            fprintf(stderr, "Warning: with --reverb %d each stem carries only its own track's "
+                    "reverb; the stems will not sum to the full mix\n", settings->reverbAmount);
+
+        uint16_t usedTracks = 0;
+        for (int i = 0; i < renderEvtCount; i++) {
+            const RenderEvent *ev = &renderEvts[i];
+            int trackIdx = useTrackIndex ? ev->track : ev->channel;
+            if (ev->type == 0x9 && ev->data1 > 0 && trackIdx < MAX_TRACKS)
+                usedTracks |= (uint16_t)(1u << trackIdx);
+        }
 
-        printf("Playback complete.\n");
+        stemPool.jobs = calloc(MAX_TRACKS, sizeof(StemJob));
+        if (!stemPool.jobs)
+            fprintf(stderr, "Out of memory allocating stems\n");
+        for (int t = 0; stemPool.jobs && t < MAX_TRACKS; t++) {
+            if (!(usedTracks & (1u << t)))
+                continue;
+            StemJob *job = &stemPool.jobs[stemPool.count];
+            job->track = t;
+            snprintf(job->path, sizeof(job->path), "%s/track%02d.wav", stemsDir, t);
+            if (wav_open(&job->wav, job->path, sampleRateHz) != 0)
+                continue;
+            engine_setup(&job->engine, settings, vg);
+            job->engine.mutedTracks = (uint16_t)~(1u << t);
+            cursor_init(&job->cursor, &job->engine, &plan, settings);
+            job->cursor.wav = &job->wav;
+            stemPool.count++;
+        }
+        stemPool.events        = renderEvts;
+        stemPool.eventCount    = renderEvtCount;
+        stemPool.useTrackIndex = useTrackIndex;
+        stemPool.threads       = jobCount > 0 ? jobCount : cpu_count();
+        if (stemPool.threads > stemPool.count)
+            stemPool.threads = stemPool.count;
+
+        stemsStarted = pthread_create(&stemsThread, NULL, stems_run, &stemPool) == 0;
+        printf("Rendering %d stems to %s on %d threads...\n",
+               stemPool.count, stemsDir, stemPool.threads > 0 ? stemPool.threads : 1);
+        fflush(stdout);
+    }
+
+    /* ---- Rendering loop ---- */
+    if (outputPath || doPlay) {
+        if (outputPath)
+            printf("Rendering to %s...\n", outputPath);
+        else
+            printf("Rendering...\n");
+        fflush(stdout);
+
+        render_events(&cursor, renderEvts, renderEvtCount, firstEvent, useTrackIndex);
+
+        if (opts.useCheckpoints && checkpoints.dirty)
+            checkpoints_save(&checkpoints, checkpointPath);
+        printf("Rendering complete.\n");
     }
+    checkpoints_free(&checkpoints);
+
+    /* Finish the stems (on this thread if their own could not start). */
+    if (stemPool.jobs) {
+        if (stemsStarted)
+            pthread_join(stemsThread, NULL);
+        else
+            stems_run(&stemPool);
+        for (int j = 0; j < stemPool.count; j++) {
+            StemJob *job = &stemPool.jobs[j];
+            if (job->result == 0)
+                printf("Done: %s\n", job->path);
+            else
+                fprintf(stderr, "Failed to write %s\n", job->path);
+            m4a_engine_destroy(&job->engine);
+        }
+        free(stemPool.jobs);
+    }
+
+    /* ---- WAV output ---- */
+    if (wavOpen) {
+        if (wav_close(&wav) == 0)
+            printf("Done: %s\n", outputPath);
+        else
+            fprintf(stderr, "Failed to write %s\n", outputPath);
+    }
+
+    /* ---- Speaker playback via miniaudio ---- */
+    if (playOpen)
+        playback_close(&playback);
 
     /* ---- Cleanup ---- */
-    free(outL);
-    free(outR);
     m4a_engine_destroy(&engine);
     voicegroup_free(vg);
-    free(extEvts);
-    free(events->events);
-    free(events);
+    plan_free(&plan);
 
     return 0;
 }
@@ -1,5 +1,6 @@
 #include "m4a_channel.h"
 #include "m4a_tables.h"
+#include "m4a_mix.h"
 #include <string.h>
 
 /* Number of samples over which the wave channel (type 3) fades to zero on
@@ -140,56 +141,73 @@ void m4a_pcm_channel_tick(M4APCMChannel *ch, uint8_t masterVolume)
 }
 
 /*
- * PCM channel render - generates one output sample
+ * PCM channel span render - mixes up to `count` consecutive output samples
+ * into the mixL/mixR buffers (accumulating, not overwriting).
  * Matches the interpolating mixer in SoundMainRAM (m4a_1.s)
  *
  * The GBA mixer uses a 23-bit fractional sample position (fw field).
  * For non-fixed-frequency voices, it does linear interpolation between
  * adjacent samples. For fixed-frequency voices (type & 0x08), it just
  * reads one sample per output sample (no interpolation).
+ *
+ * Like SoundMainRAM, each channel is mixed for a whole span with its
+ * playback state held in locals, rather than being re-dispatched for every
+ * output sample.  The span is split into runs at sample/loop end boundaries;
+ * each run is mixed by a (possibly vectorized) kernel from m4a_mix.c.
+ * Stops early if the sample ends.
  */
-void m4a_pcm_channel_render(M4APCMChannel *ch, int32_t *mixL, int32_t *mixR)
+void m4a_pcm_channel_render_span(M4APCMChannel *ch, int32_t *mixL, int32_t *mixR,
+                                 int count)
 {
     if (!(ch->status & CHN_ON) || (ch->status & CHN_START))
         return;
 
     int8_t *ptr = ch->currentPointer;
     uint32_t fw = ch->fw;
-    int32_t count = ch->count;
-    int32_t sample;
-
-    if (ch->type & VOICE_TYPE_FIX) {
-        // Fixed-frequency (no resample): no interpolation.
-        sample = ptr[0];
-    } else {
-        // Interpolating mixer
-        int8_t s0 = ptr[0];
-        int8_t s1 = ptr[1];
-        int32_t diff = s1 - s0;
-
-        /* Linear interpolation using top bits of fw as fraction */
-        sample = s0 + (int32_t)(((int64_t)diff * (int32_t)fw) >> 23);
-    }
+    int32_t remaining = ch->count;
+    const uint32_t frequency = ch->frequency;
+    const bool fixed = (ch->type & VOICE_TYPE_FIX) != 0;
+
+    int done = 0;
+    while (done < count) {
+        /* Length of the run until the position reaches the end of the sample
+         * (or loop), i.e. the first step after which `remaining` drops to 0.
+         * ptr + remaining is always the end of the sample data. */
+        int run = count - done;
+        if (frequency != 0) {
+            int32_t end = remaining > 0 ? remaining : 1;
+            uint64_t steps = (((uint64_t)end << 23) - fw + frequency - 1) / frequency;
+            if (steps < (uint64_t)run)
+                run = (int)steps;
+        }
 
-    int32_t ampR = sample * ch->envelopeVolumeRight;
-    int32_t ampL = sample * ch->envelopeVolumeLeft;
-    *mixR += ampR >> 8;
-    *mixL += ampL >> 8;
-
-    /* Advance position */
-    fw += ch->frequency;
-    uint32_t advance = fw >> 23;
-    if (advance) {
-        fw &= 0x7FFFFF;  /* keep fractional part */
-        count -= advance;
-        if (count <= 0) {
+        /* +1 for the guard sample after the end of the data */
+        m4a_mix_pcm_run(ptr, fw, frequency, fixed,
+                        ch->envelopeVolumeLeft, ch->envelopeVolumeRight,
+                        mixL + done, mixR + done, run,
+                        remaining > 0 ? remaining + 1 : 0);
+        done += run;
+
+        /* Advance position */
+        uint32_t runStartFw = fw;
+        uint64_t pos = fw + (uint64_t)run * frequency;
+        uint32_t advance = (uint32_t)(pos >> 23);
+        fw = (uint32_t)(pos & 0x7FFFFF);  /* keep fractional part */
+        if (advance == 0)
+            continue;
+        remaining -= advance;
+        if (remaining <= 0) {
             if (ch->isLoop && ch->loopLen > 0) {
                 /* Wrap around loop */
-                while (count <= 0)
-                    count += ch->loopLen;
-                ptr = ch->loopStart + (ch->loopLen - count);
+                while (remaining <= 0)
+                    remaining += ch->loopLen;
+                ptr = ch->loopStart + (ch->loopLen - remaining);
             } else {
+                /* Leave the pointer where the final step started from, as
+                 * the sample-by-sample mixer does. */
+                ptr += (runStartFw + (uint64_t)(run - 1) * frequency) >> 23;
                 ch->status = 0;
+                break;
             }
         } else {
             ptr += advance;
@@ -198,7 +216,61 @@ void m4a_pcm_channel_render(M4APCMChannel *ch, int32_t *mixL, int32_t *mixR)
 
     ch->currentPointer = ptr;
     ch->fw = fw;
-    ch->count = count;
+    ch->count = remaining;
+}
+
+/*
+ * PCM channel skip - advances the playback state exactly as rendering `count`
+ * samples would (including loop wraps and the one-shot end), without mixing.
+ * Used for channels that are muted but must keep time.  O(1).
+ */
+void m4a_pcm_channel_skip(M4APCMChannel *ch, int count)
+{
+    if (!(ch->status & CHN_ON) || (ch->status & CHN_START) || count <= 0)
+        return;
+
+    const uint32_t frequency = ch->frequency;
+    int32_t remaining = ch->count;
+    uint64_t pos = ch->fw + (uint64_t)count * frequency;
+
+    /* Steps until the position reaches the end of the sample (or loop); see
+     * m4a_pcm_channel_render_span. */
+    uint64_t steps = UINT64_MAX;
+    if (frequency != 0) {
+        int32_t end = remaining > 0 ? remaining : 1;
+        steps = (((uint64_t)end << 23) - ch->fw + frequency - 1) / frequency;
+    }
+
+    if (steps > (uint64_t)count) {
+        ch->currentPointer += pos >> 23;
+        ch->count = remaining - (int32_t)(pos >> 23);
+        ch->fw = (uint32_t)(pos & 0x7FFFFF);
+        return;
+    }
+
+    if (ch->isLoop && ch->loopLen > 0) {
+        /* Wrap around the loop as many times as needed in one step. */
+        int64_t over = (int64_t)(pos >> 23) - remaining;  /* >= 0 */
+        remaining = ch->loopLen - (int32_t)(over % ch->loopLen);
+        ch->currentPointer = ch->loopStart + (ch->loopLen - remaining);
+        ch->count = remaining;
+        ch->fw = (uint32_t)(pos & 0x7FFFFF);
+    } else {
+        /* Stop where the final step started from, as rendering does. */
+        uint64_t endPos = ch->fw + steps * frequency;
+        ch->currentPointer += (ch->fw + (steps - 1) * frequency) >> 23;
+        ch->count = remaining - (int32_t)(endPos >> 23);
+        ch->fw = (uint32_t)(endPos & 0x7FFFFF);
+        ch->status = 0;
+    }
+}
+
+/*
+ * PCM channel render - generates one output sample
+ */
+void m4a_pcm_channel_render(M4APCMChannel *ch, int32_t *mixL, int32_t *mixR)
+{
+    m4a_pcm_channel_render_span(ch, mixL, mixR, 1);
 }
 
 /*
@@ -212,11 +284,11 @@ void m4a_cgb_channel_start(M4ACGBChannel *ch)
     ch->modify = 0x03; /* pitch + vol */
     ch->phase = 0;
 
-    /* Invalidate the cached phase increment / wave DC sum so the first
+    /* Invalidate the cached phase increment / wave table so the first
      * rendered sample of this note recomputes them from the current
-     * frequency and wave table. */
+     * frequency and wave data. */
     ch->phaseIncFreq = 0xFFFFFFFFu;
-    ch->waveSumPointer = NULL;
+    ch->waveTablePointer = NULL;
     ch->envelopeCounter = ch->attack;
     if (ch->attack == 0) {
         /* Skip attack if instantaneous */
@@ -313,6 +385,11 @@ void m4a_cgb_channel_tick(M4ACGBChannel *ch, uint8_t c15)
     if (!(ch->status & CHN_ON))
         return;
 
+    /* Captured before any of the gotos below (like prevC15 in CgbSound), so
+     * every path into step_complete sees a defined double-step state. */
+    int doubleStep = (c15 == 0) ? 1 : 0;
+    int steps = 0;
+
     if (ch->status & CHN_START) {
         if (ch->status & CHN_STOP) {
             if (ch->type == 3)
@@ -365,9 +442,6 @@ void m4a_cgb_channel_tick(M4ACGBChannel *ch, uint8_t c15)
     }
 
     {
-        int doubleStep = (c15 == 0) ? 1 : 0;
-        int steps = 0;
-
 step_repeat:
         if (ch->envelopeCounter == 0) {
             m4a_cgb_mod_vol(ch);
@@ -445,169 +519,308 @@ envelope_complete:
 }
 
 /*
- * CGB channel render - generates one output sample by software synthesis
+ * Recompute the cached per-sample phase increment when `frequency` has
+ * changed since it was last computed (i.e. at most once per tick).
  */
-void m4a_cgb_channel_render(M4ACGBChannel *ch, int32_t *mixL, int32_t *mixR,
-                            float sampleRate)
+static void cgb_update_phase_inc(M4ACGBChannel *ch, float sampleRate)
+{
+    if (ch->frequency == ch->phaseIncFreq)
+        return;
+
+    float freqHz;
+    if (ch->type == 4) {
+        /* Noise: LFSR clock rate from NR43 divisor ratio and shift. */
+        uint8_t noiseParams = ch->frequency & 0xFF;
+        uint8_t divRatio = noiseParams & 0x07;
+        uint8_t shiftFreq = (noiseParams >> 4) & 0x0F;
+        /* bool shortMode = (noiseParams >> 3) & 1; */
+
+        float baseFreq = 524288.0f;
+        float divisor = (divRatio == 0) ? 0.5f : (float)divRatio;
+        freqHz = baseFreq / divisor / (float)(1 << (shiftFreq + 1));
+    } else {
+        /* CGB frequency register value is used to compute the actual frequency.
+         * The CGB freq register value = 2048 - (131072 / freq_hz).
+         * So freq_hz = 131072 / (2048 - reg_value).
+         * We convert to a phase increment for our 32-bit accumulator. */
+        int32_t freqReg = ch->frequency;
+        if (freqReg >= 2048) freqReg = 2047;
+        if (ch->type == 3) {
+            freqHz = 2097152.0f / (float)(2048 - freqReg);
+            /* Wave channel plays 32 samples per period */
+            freqHz /= 32.0f;
+        } else {
+            freqHz = 131072.0f / (float)(2048 - freqReg);
+        }
+    }
+    ch->phaseInc = (uint32_t)(freqHz / sampleRate * 4294967296.0f);
+    ch->phaseIncFreq = ch->frequency;
+}
+
+/*
+ * Build the programmable-wave output table for the current wave data and
+ * envelope volume: each of the 32 steps is volume-shifted, centered on the
+ * waveform's mean and scaled exactly as it is mixed.
+ */
+static void cgb_build_wave_table(M4ACGBChannel *ch)
+{
+    /* 32 4-bit samples packed into 16 bytes (4 uint32_t) */
+    const uint8_t *waveData = (const uint8_t *)ch->wavePointer;
+
+    /* Sum of all 32 raw nibbles for DC offset removal.  The wave mean varies
+     * per waveform, so using a fixed midpoint of 8 leaves a DC offset that
+     * causes clicks at note start/end. */
+    int32_t waveSum = 0;
+    for (int i = 0; i < 16; i++) {
+        waveSum += (waveData[i] >> 4) & 0x0F;
+        waveSum += waveData[i] & 0x0F;
+    }
+
+    /* Volume control: apply shift to raw 4-bit nibble to match
+     * GBA hardware quantization (NR32 register).
+     * On real hardware, the right-shift is lossy on the small
+     * 4-bit value, creating quantized "plateaus" in the output.
+     * Apply the same volume logic to the mean for accurate DC removal. */
+    int nr32 = gCgb3Vol[ch->envelopeVolume];
+    int32_t meanShifted;
+    if (nr32 == 0)
+        meanShifted = 0;
+    else if (nr32 & 0x80)
+        meanShifted = (waveSum * 3) >> 7;  /* GBA 75% mode */
+    else
+        meanShifted = waveSum >> (5 + ((nr32 >> 5) & 3) - 1);
+
+    for (int pos = 0; pos < 32; pos++) {
+        int32_t shifted;
+        if (pos & 1)
+            shifted = waveData[pos >> 1] & 0x0F;
+        else
+            shifted = (waveData[pos >> 1] >> 4) & 0x0F;
+        if (nr32 == 0)
+            shifted = 0;
+        else if (nr32 & 0x80)
+            shifted = (shifted + (shifted << 1)) >> 2;  /* (nibble * 3) >> 2 */
+        else
+            shifted >>= ((nr32 >> 5) & 3) - 1;
+        /* Center around the waveform's actual mean to remove DC offset, then
+         * apply the common CGB output scale (see cgb_output_level). */
+        ch->waveTable[pos] = (int8_t)(((shifted - meanShifted) * 8) >> 1);
+    }
+
+    ch->waveTablePointer = ch->wavePointer;
+    ch->waveTableVolume = ch->envelopeVolume;
+}
+
+/*
+ * Mixed level of a square/noise channel output bit.
+ * envelopeVolume is the 4-bit GBA hardware volume (0-15), matching what
+ * CgbSound writes to NR12/NR22/NR42.
+ *
+ * The final >> 1 scales CGB to match the GBA hardware mixing ratio.
+ * SOUNDCNT_H is initialised with SOUND_ALL_MIX_FULL (volume bits = 2), so
+ * mGBA applies psgShift = 4 - 2 = 2 (CGB >> 2) while PCM is << 2.
+ * That is a 16:1 ratio; >> 2 here keeps us in the same integer domain as
+ * the PCM mixer which already incorporates the << 2 implicitly through its
+ * larger sample values (~±127 vs CGB's ~±60).
+ */
+static inline int32_t cgb_output_level(const M4ACGBChannel *ch, bool high)
+{
+    return (((high ? 64 : -64) * (int32_t)ch->envelopeVolume) >> 4) >> 1;
+}
+
+/*
+ * Number of samples (at least 1, at most `limit`) until the phase
+ * accumulator crosses the next multiple of 2^shift, i.e. the next waveform
+ * edge, wave step or LFSR clock.  The sample at the crossing is included.
+ */
+static inline int cgb_run_length(uint32_t phase, uint32_t inc, int shift, int limit)
+{
+    if (inc == 0)
+        return limit;
+    uint64_t dist = ((((uint64_t)phase >> shift) + 1) << shift) - phase;
+    uint64_t n = (dist + inc - 1) / inc;
+    return n < (uint64_t)limit ? (int)n : limit;
+}
+
+/*
+ * Add a constant run of `count` samples to the mix.  Panning is binary on
+ * the GBA (NR51 enable bits in ch->pan), not a level multiplier.
+ */
+static inline void cgb_fill(int32_t *mixL, int32_t *mixR, int count,
+                            int32_t sample, uint8_t pan)
+{
+    if (sample == 0)
+        return;
+    if (pan & 0x0F)
+        for (int i = 0; i < count; i++)
+            mixR[i] += sample;
+    if (pan & 0xF0)
+        for (int i = 0; i < count; i++)
+            mixL[i] += sample;
+}
+
+/*
+ * CGB channel span render - synthesizes `count` consecutive output samples
+ * into the mixL/mixR buffers (accumulating, not overwriting).
+ *
+ * All four CGB outputs are piecewise constant: a square channel only changes
+ * level at a duty-pattern edge, the wave channel at each of its 32 steps and
+ * the noise channel when the LFSR clocks.  Instead of synthesizing sample by
+ * sample, the span is split at those points (computed from the phase
+ * accumulator) and each run is filled with a constant.  The programmable
+ * wave's per-step levels come from a table cached per (wavePointer,
+ * envelopeVolume).  Output is identical to rendering one sample at a time.
+ */
+void m4a_cgb_channel_render_span(M4ACGBChannel *ch, int32_t *mixL, int32_t *mixR,
+                                 int count, float sampleRate)
 {
     if (!(ch->status & CHN_ON)) {
         /* Wave channel declick: linearly fade the last sample to zero over
          * DECLICK_SAMPLES frames to prevent a pop caused by the DC offset. */
-        if (ch->type == 3 && ch->declickSamplesRemaining > 0) {
-            ch->declickSamplesRemaining--;
-            int32_t faded = (ch->declickSample * (int32_t)ch->declickSamplesRemaining) / DECLICK_SAMPLES;
-            if (ch->pan & 0x0F) *mixR += faded;
-            if (ch->pan & 0xF0) *mixL += faded;
+        if (ch->type == 3) {
+            for (int i = 0; i < count && ch->declickSamplesRemaining > 0; i++) {
+                ch->declickSamplesRemaining--;
+                int32_t faded = (ch->declickSample * (int32_t)ch->declickSamplesRemaining) / DECLICK_SAMPLES;
+                if (ch->pan & 0x0F) mixR[i] += faded;
+                if (ch->pan & 0xF0) mixL[i] += faded;
+            }
         }
         return;
     }
     if (ch->status & CHN_START)
         return;
 
-    int32_t sample = 0;
     uint8_t cgbType = ch->type;
+    if (cgbType < 1 || cgbType > 4)
+        return;
+    if (cgbType == 3 && !ch->wavePointer) {
+        ch->declickSample = 0;
+        return;
+    }
+
+    cgb_update_phase_inc(ch, sampleRate);
+    uint32_t phase = ch->phase;
+    uint32_t inc = ch->phaseInc;
+    uint8_t pan = ch->pan;
+    int done = 0;
 
     if (cgbType == 1 || cgbType == 2) {
-        /* Square wave synthesis */
+        /* Square wave: output bit is the duty pattern bit selected by the
+         * top 3 phase bits. */
         static const uint8_t dutyPatterns[4] = { 0x01, 0x81, 0xE1, 0x7E };
         uint8_t pattern = dutyPatterns[ch->dutyCycle & 3];
-        int bit = (ch->phase >> 29) & 7;
-        sample = (pattern & (1 << bit)) ? 64 : -64;
-
-        /* Advance phase.
-         * CGB frequency register value is used to compute the actual frequency.
-         * The CGB freq register value = 2048 - (131072 / freq_hz).
-         * So freq_hz = 131072 / (2048 - reg_value).
-         * We convert to a phase increment for our 32-bit accumulator.  The
-         * increment is constant between (tick-rate) frequency changes, so it is
-         * cached and only recomputed when ch->frequency changes. */
-        if (ch->frequency != ch->phaseIncFreq) {
-            int32_t freqReg = ch->frequency;
-            if (freqReg >= 2048) freqReg = 2047;
-            float freqHz = 131072.0f / (float)(2048 - freqReg);
-            ch->phaseInc = (uint32_t)(freqHz / sampleRate * 4294967296.0f);
-            ch->phaseIncFreq = ch->frequency;
+        int32_t high = cgb_output_level(ch, true);
+        int32_t low = cgb_output_level(ch, false);
+        while (done < count) {
+            int n = cgb_run_length(phase, inc, 29, count - done);
+            cgb_fill(mixL + done, mixR + done, n,
+                     (pattern & (1 << (phase >> 29))) ? high : low, pan);
+            phase += (uint32_t)n * inc;
+            done += n;
         }
-        ch->phase += ch->phaseInc;
     } else if (cgbType == 3) {
-        /* Programmable wave channel */
-        if (ch->wavePointer) {
-            /* 32 4-bit samples packed into 16 bytes (4 uint32_t) */
-            uint8_t *waveData = (uint8_t *)ch->wavePointer;
-            int pos = (ch->phase >> 27) & 0x1F;  /* 5 bits = 0-31 */
-            uint8_t nibble;
-            if (pos & 1)
-                nibble = waveData[pos >> 1] & 0x0F;
-            else
-                nibble = (waveData[pos >> 1] >> 4) & 0x0F;
-            /* Sum of all 32 raw nibbles for DC offset removal.  The wave mean
-             * varies per waveform, so using a fixed midpoint of 8 leaves a DC
-             * offset that causes clicks at note start/end.  The sum depends
-             * only on the wave table contents, so it is cached and recomputed
-             * only when wavePointer changes. */
-            if (ch->wavePointer != ch->waveSumPointer) {
-                int32_t waveSum = 0;
-                for (int i = 0; i < 16; i++) {
-                    waveSum += (waveData[i] >> 4) & 0x0F;
-                    waveSum += waveData[i] & 0x0F;
-                }
-                ch->waveSum = waveSum;
-                ch->waveSumPointer = ch->wavePointer;
-            }
-            int32_t waveSum = ch->waveSum;
-
-            /* Volume control: apply shift to raw 4-bit nibble to match
-             * GBA hardware quantization (NR32 register).
-             * On real hardware, the right-shift is lossy on the small
-             * 4-bit value, creating quantized "plateaus" in the output.
-             * Apply the same volume logic to the mean for accurate DC removal. */
-            int32_t shifted = (int32_t)nibble;
-            int nr32 = gCgb3Vol[ch->envelopeVolume];
-            int32_t meanShifted;
-            if (nr32 == 0) {
-                shifted = 0;
-                meanShifted = 0;
-            } else if (nr32 & 0x80) {
-                /* GBA 75% mode: (nibble * 3) >> 2; mean = (waveSum * 3) >> 7 */
-                shifted = (shifted + (shifted << 1)) >> 2;
-                meanShifted = (waveSum * 3) >> 7;
-            } else {
-                int shift = ((nr32 >> 5) & 3) - 1;
-                shifted >>= shift;
-                meanShifted = waveSum >> (5 + shift);
-            }
-            /* Center around the waveform's actual mean to remove DC offset */
-            sample = (shifted - meanShifted) * 8;
-
-            /* Advance phase (cached; recomputed only on frequency change). */
-            if (ch->frequency != ch->phaseIncFreq) {
-                int32_t freqReg = ch->frequency;
-                if (freqReg >= 2048) freqReg = 2047;
-                float freqHz = 2097152.0f / (float)(2048 - freqReg);
-                /* Wave channel plays 32 samples per period */
-                freqHz /= 32.0f;
-                ch->phaseInc = (uint32_t)(freqHz / sampleRate * 4294967296.0f);
-                ch->phaseIncFreq = ch->frequency;
+        /* Programmable wave: step selected by the top 5 phase bits. */
+        if (ch->waveTablePointer != ch->wavePointer
+            || ch->waveTableVolume != ch->envelopeVolume)
+            cgb_build_wave_table(ch);
+        int32_t sample = 0;
+        while (done < count) {
+            int n = cgb_run_length(phase, inc, 27, count - done);
+            sample = ch->waveTable[phase >> 27];
+            cgb_fill(mixL + done, mixR + done, n, sample, pan);
+            phase += (uint32_t)n * inc;
+            done += n;
+        }
+        /* Track last sample for wave channel declick on note-off. */
+        ch->declickSample = sample;
+    } else {
+        /* Noise: output bit is LFSR bit 0; the LFSR clocks each time the
+         * phase accumulator wraps.
+         * Bit 3 of frequency = period mode: 0 = 15-bit LFSR, 1 = 7-bit LFSR. */
+        bool shortMode = (ch->frequency & 0x08) != 0;
+        int32_t high = cgb_output_level(ch, true);
+        int32_t low = cgb_output_level(ch, false);
+        uint16_t lfsr = ch->lfsr;
+        while (done < count) {
+            int n = cgb_run_length(phase, inc, 32, count - done);
+            cgb_fill(mixL + done, mixR + done, n, (lfsr & 1) ? high : low, pan);
+            uint64_t end = (uint64_t)phase + (uint64_t)n * inc;
+            if (end >> 32) {
+                uint16_t bit = ((lfsr >> 1) ^ lfsr) & 1;
+                if (shortMode)
+                    lfsr = (lfsr >> 1) | (bit << 6);   /* 7-bit */
+                else
+                    lfsr = (lfsr >> 1) | (bit << 14);  /* 15-bit */
             }
-            ch->phase += ch->phaseInc;
+            phase = (uint32_t)end;
+            done += n;
         }
-    } else if (cgbType == 4) {
-        /* Noise channel using LFSR */
-        sample = (ch->lfsr & 1) ? 64 : -64;
+        ch->lfsr = lfsr;
+    }
 
-        /* Advance LFSR at noise frequency rate */
-        uint8_t noiseParams = ch->frequency & 0xFF;
+    ch->phase = phase;
+}
 
-        /* Phase increment is constant between frequency changes; cache it. */
-        if (ch->frequency != ch->phaseIncFreq) {
-            uint8_t divRatio = noiseParams & 0x07;
-            uint8_t shiftFreq = (noiseParams >> 4) & 0x0F;
-            /* bool shortMode = (noiseParams >> 3) & 1; */
+/*
+ * CGB channel skip - advances the oscillator state (phase, LFSR, wave declick)
+ * exactly as rendering `count` samples would, without synthesizing anything.
+ * Used for channels that are muted but must keep time.  O(1) for square and
+ * wave, O(LFSR clocks) for noise.
+ */
+void m4a_cgb_channel_skip(M4ACGBChannel *ch, int count, float sampleRate)
+{
+    if (count <= 0)
+        return;
+    if (!(ch->status & CHN_ON)) {
+        if (ch->type == 3) {
+            ch->declickSamplesRemaining -= (count < ch->declickSamplesRemaining)
+                                           ? count : ch->declickSamplesRemaining;
+        }
+        return;
+    }
+    if (ch->status & CHN_START)
+        return;
 
-            float baseFreq = 524288.0f;
-            float divisor = (divRatio == 0) ? 0.5f : (float)divRatio;
-            float noiseFreq = baseFreq / divisor / (float)(1 << (shiftFreq + 1));
+    uint8_t cgbType = ch->type;
+    if (cgbType < 1 || cgbType > 4)
+        return;
+    if (cgbType == 3 && !ch->wavePointer) {
+        ch->declickSample = 0;
+        return;
+    }
 
-            ch->phaseInc = (uint32_t)(noiseFreq / sampleRate * 4294967296.0f);
-            ch->phaseIncFreq = ch->frequency;
-        }
-        uint32_t oldPhase = ch->phase;
-        ch->phase += ch->phaseInc;
+    cgb_update_phase_inc(ch, sampleRate);
+    uint32_t phase = ch->phase;
+    uint32_t inc = ch->phaseInc;
 
-        /* Clock LFSR on phase wrap.
-         * Bit 3 of frequency = period mode: 0 = 15-bit LFSR, 1 = 7-bit LFSR. */
-        if (ch->phase < oldPhase) {
-            uint16_t bit = ((ch->lfsr >> 1) ^ ch->lfsr) & 1;
-            if (noiseParams & 0x08)
-                ch->lfsr = (ch->lfsr >> 1) | (bit << 6);   /* 7-bit */
+    if (cgbType == 3) {
+        if (ch->waveTablePointer != ch->wavePointer
+            || ch->waveTableVolume != ch->envelopeVolume)
+            cgb_build_wave_table(ch);
+        ch->declickSample = ch->waveTable[(phase + (uint32_t)(count - 1) * inc) >> 27];
+    } else if (cgbType == 4) {
+        /* One LFSR clock per phase wrap (at most one per sample). */
+        uint64_t wraps = ((uint64_t)phase + (uint64_t)count * inc) >> 32;
+        bool shortMode = (ch->frequency & 0x08) != 0;
+        uint16_t lfsr = ch->lfsr;
+        for (uint64_t w = 0; w < wraps; w++) {
+            uint16_t bit = ((lfsr >> 1) ^ lfsr) & 1;
+            if (shortMode)
+                lfsr = (lfsr >> 1) | (bit << 6);
             else
-                ch->lfsr = (ch->lfsr >> 1) | (bit << 14);  /* 15-bit */
+                lfsr = (lfsr >> 1) | (bit << 14);
         }
+        ch->lfsr = lfsr;
     }
 
-    /* Apply envelope volume (for non-wave channels).
-     * envelopeVolume is the 4-bit GBA hardware volume (0-15), matching what
-     * CgbSound writes to NR12/NR22/NR42. */
-    if (cgbType != 3) {
-        sample = (sample * ch->envelopeVolume) >> 4;
-    }
-
-    /* Scale CGB to match the GBA hardware mixing ratio.
-     * SOUNDCNT_H is initialised with SOUND_ALL_MIX_FULL (volume bits = 2), so
-     * mGBA applies psgShift = 4 - 2 = 2 (CGB >> 2) while PCM is << 2.
-     * That is a 16:1 ratio; >> 2 here keeps us in the same integer domain as
-     * the PCM mixer which already incorporates the << 2 implicitly through its
-     * larger sample values (~±127 vs CGB's ~±60). */
-    sample >>= 1;
-
-    /* Track last sample for wave channel declick on note-off. */
-    if (cgbType == 3)
-        ch->declickSample = sample;
+    ch->phase = phase + (uint32_t)count * inc;
+}
 
-    /* Route to left/right using NR51-style pan bits in ch->pan.
-     * Panning is binary on the GBA (NR51 enable bits), not a level multiplier. */
-    if (ch->pan & 0x0F)
-        *mixR += sample;
-    if (ch->pan & 0xF0)
-        *mixL += sample;
+/*
+ * CGB channel render - generates one output sample by software synthesis
+ */
+void m4a_cgb_channel_render(M4ACGBChannel *ch, int32_t *mixL, int32_t *mixR,
+                            float sampleRate)
+{
+    m4a_cgb_channel_render_span(ch, mixL, mixR, 1, sampleRate);
 }
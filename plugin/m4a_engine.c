@@ -2,8 +2,10 @@
 #include "m4a_channel.h"
 #include "m4a_reverb.h"
 #include "m4a_tables.h"
+#include "m4a_mix.h"
 #include <string.h>
 #include <stdlib.h>
+#include <math.h>
 
 /* Duty cycle patterns for the pulse-width modulation effect (PWMC command).
  * They loop from start to end while the effect is running.  Hardware duty-cycle
@@ -24,6 +26,12 @@ const PulseWidthModPattern gPulseWidthModPatterns[] =
 const uint8_t gNumPulseWidthModPatterns =
     sizeof(gPulseWidthModPatterns) / sizeof(gPulseWidthModPatterns[0]);
 
+/* Convert a rate in Hz to the engine's exact integer clock units. */
+static inline uint64_t m4a_rate_scaled(float rate)
+{
+    return (uint64_t)((double)rate * M4A_RATE_SCALE + 0.5);
+}
+
 /* Resolve the effective PCM mixing rate: the configured pcmMixRate, or the host
  * sample rate when pcmMixRate is 0 ("follow host"). */
 static inline float m4a_pcm_mix_rate(const M4AEngine *engine)
@@ -206,13 +214,16 @@ void m4a_engine_init(M4AEngine *engine, float sampleRate)
 {
     memset(engine, 0, sizeof(M4AEngine));
 
+    /* Pick the fastest DirectSound mixing kernel this CPU supports. */
+    m4a_mix_init();
+
     engine->sampleRate = sampleRate;
     engine->samplesPerTick = sampleRate / VBLANK_RATE;
-    engine->tickAccumulator = 0.0f;
+    engine->tickPhase = 0;
     /* Default to the GBA's hardware DirectSound mix rate so high notes alias
      * the way they do in-game.  Set to 0 (follow host rate) for clean mixing. */
     engine->pcmMixRate = 13379.0f;
-    engine->pcmResampleAccum = 0.0f;
+    engine->pcmPhase = 0;
     engine->pcmPrevL = engine->pcmPrevR = 0;
     engine->pcmCurL = engine->pcmCurR = 0;
     engine->masterVolume = 15;
@@ -274,7 +285,7 @@ void m4a_engine_set_pcm_mix_rate(M4AEngine *engine, float rate)
     m4a_reverb_destroy(&engine->reverb);
     m4a_reverb_init(&engine->reverb, m4a_pcm_mix_rate(engine), amount);
 
-    engine->pcmResampleAccum = 0.0f;
+    engine->pcmPhase = 0;
     engine->pcmPrevL = engine->pcmPrevR = 0;
     engine->pcmCurL = engine->pcmCurR = 0;
 }
@@ -1339,101 +1350,603 @@ void m4a_engine_tick(M4AEngine *engine)
     m4a_pwm_tick(engine);
 }
 
+/* Maximum number of PCM-rate samples mixed per block.  A block never spans an
+ * engine tick, so at 13379 Hz a whole VBlank frame (~224 samples) fits. */
+#define PCM_MIX_BLOCK 512
+
+/* Whether a track is muted in engine->mutedTracks. */
+static inline bool track_muted(const M4AEngine *engine, int trackIndex)
+{
+    return trackIndex >= 0 && trackIndex < MAX_TRACKS && ((engine->mutedTracks >> trackIndex) & 1);
+}
+
+/*
+ * Mix `count` PCM-rate samples of all DirectSound channels into bufL/bufR
+ * (overwritten), then run them through the reverb.
+ *
+ * Each channel is rendered for the whole block at once (see
+ * m4a_pcm_channel_render_span); envelopes only change on engine ticks, which
+ * never fall inside a block.
+ */
+static void mix_pcm_block(M4AEngine *engine, int32_t *bufL, int32_t *bufR, int count)
+{
+    /* Polyphony-overflow debug: when inverted, the real channels are
+     * fast-forwarded without rendering (so sample positions, loop ends, and
+     * oscillator phases advance exactly as in normal playback) and only the
+     * shadow channels -- the sounds lost to the polyphony limit -- are heard. */
+    bool invert = engine->polyDebugInvert;
+
+    memset(bufL, 0, (size_t)count * sizeof(int32_t));
+    memset(bufR, 0, (size_t)count * sizeof(int32_t));
+
+    for (int ch = 0; ch < TOTAL_PCM_CHANNELS; ch++) {
+        if (!(engine->pcmChannels[ch].status & CHN_ON))
+            continue;
+        if ((ch >= MAX_PCM_CHANNELS) == invert &&
+            !track_muted(engine, engine->pcmChannels[ch].trackIndex))
+            m4a_pcm_channel_render_span(&engine->pcmChannels[ch], bufL, bufR, count);
+        else
+            m4a_pcm_channel_skip(&engine->pcmChannels[ch], count);
+    }
+
+    /* Reverb is a GBA DirectSound-buffer effect: it runs at the PCM mix rate,
+     * before the upsample and before CGB is added. */
+    for (int i = 0; i < count; i++)
+        m4a_reverb_process(&engine->reverb, &bufL[i], &bufR[i]);
+}
+
+/*
+ * Upsample the PCM mix to the host rate: produces `count` host samples into
+ * outL/outR (overwritten).  pcmL/pcmR hold the previous and current PCM-rate
+ * samples at [0] and [1], followed by the new samples mixed for this span;
+ * each host sample is a linear interpolation between the two most recent
+ * PCM samples at its instant.
+ *
+ * The resample clock runs in 32.32 fixed point (integer part: PCM samples
+ * consumed, fraction: interpolation weight), with the remainder of the
+ * exact pcmStep / period ratio carried separately so it never drifts from
+ * the integer PCM clock.  It only produces sample indices and weights; the
+ * interpolation itself is a block kernel (m4a_mix_upsample).  Integer-only,
+ * so renders are bit-identical across compilers and platforms.
+ */
+static void upsample_pcm(M4AEngine *engine, const int32_t *pcmL, const int32_t *pcmR,
+                         int32_t *outL, int32_t *outR, int count,
+                         uint64_t pcmStep, uint64_t period)
+{
+    int32_t index[PCM_MIX_BLOCK], weight[PCM_MIX_BLOCK];
+
+    uint64_t phase = engine->pcmPhase;
+    uint64_t stepFrac = pcmStep % period;
+    uint64_t step32 = ((pcmStep / period) << 32) + (stepFrac << 32) / period;
+    uint64_t stepRem = (stepFrac << 32) % period;
+    uint64_t clock = (phase << 32) / period;
+    uint64_t rem = (phase << 32) % period;
+
+    for (int i = 0; i < count; i++) {
+        clock += step32;
+        rem += stepRem;
+        if (rem >= period) {
+            rem -= period;
+            clock++;
+        }
+        index[i] = (int32_t)(clock >> 32);
+        weight[i] = (int32_t)((clock >> 16) & 0xFFFF);
+    }
+
+    m4a_mix_upsample(pcmL, index, weight, outL, count);
+    m4a_mix_upsample(pcmR, index, weight, outR, count);
+
+    int last = index[count - 1];
+    engine->pcmPrevL = pcmL[last];
+    engine->pcmPrevR = pcmR[last];
+    engine->pcmCurL = pcmL[last + 1];
+    engine->pcmCurR = pcmR[last + 1];
+    engine->pcmPhase = (phase + (uint64_t)count * pcmStep) % period;
+}
+
+/* Analog filter state within this distance of its input is far under one
+ * output LSB (1/256) and is treated as settled.  Without a cutoff the filter
+ * would never settle exactly: 0.6 * the smallest denormal rounds back up to
+ * itself. */
+#define ANALOG_FILTER_SETTLED (1.0f / 16777216.0f)
+
+/*
+ * True when the engine is idle: no channel is sounding and every piece of
+ * output state (PCM upsampler, reverb delay line, analog filter) has settled,
+ * so until the next note-on each output sample is the constant *level.  That
+ * is 0 unless the reverb has settled on its DC residue (see
+ * m4a_reverb_is_steady).
+ */
+static bool engine_idle_level(const M4AEngine *engine, float *level)
+{
+    for (int i = 0; i < TOTAL_PCM_CHANNELS; i++)
+        if (engine->pcmChannels[i].status & CHN_ON)
+            return false;
+    for (int i = 0; i < TOTAL_CGB_CHANNELS; i++) {
+        const M4ACGBChannel *ch = &engine->cgbChannels[i];
+        if ((ch->status & CHN_ON) || ch->declickSamplesRemaining > 0)
+            return false;
+    }
+
+    int32_t pcmLevel;
+    if (!m4a_reverb_is_steady(&engine->reverb, &pcmLevel))
+        return false;
+    if (engine->pcmPrevL != pcmLevel || engine->pcmPrevR != pcmLevel
+        || engine->pcmCurL != pcmLevel || engine->pcmCurR != pcmLevel)
+        return false;
+
+    *level = (float)pcmLevel / 256.0f;
+    if (engine->analogFilter
+        && (fabsf(engine->lowPassLeft - *level) >= ANALOG_FILTER_SETTLED
+            || fabsf(engine->lowPassRight - *level) >= ANALOG_FILTER_SETTLED))
+        return false;
+    return true;
+}
+
+bool m4a_engine_is_silent(const M4AEngine *engine)
+{
+    float level;
+    return engine_idle_level(engine, &level) && level == 0.0f;
+}
+
 /*
  * Main audio processing function.
  * Generates numSamples of stereo float output.
+ *
+ * The output is rendered in spans that end just before the next engine tick.
+ * Both the tick clock and the PCM resample clock are exact integers, so each
+ * span's length and the number of PCM-rate samples it needs are computed up
+ * front; the DirectSound and CGB channels are then rendered for the whole
+ * span at once.
+ *
+ * With outL == NULL (m4a_engine_skip) the same spans and ticks run, but every
+ * channel is fast-forwarded instead of rendered and nothing is mixed.
  */
-void m4a_engine_process(M4AEngine *engine, float *outL, float *outR, int numSamples)
+static void engine_run(M4AEngine *engine, float *outL, float *outR, int numSamples)
 {
-    /* Number of PCM-rate samples that elapse per host output sample.  When the
-     * mix rate is below the host rate (the GBA-accurate case, e.g. 13379 vs
-     * 44100), pcmStep < 1: each PCM sample spans several host samples and we
-     * linearly interpolate between the two most recent PCM samples.  This
-     * reproduces the hardware mixer's low-rate resampling -- including the
-     * aliasing that high notes produce in-game.  A mix rate equal to the host
-     * rate (pcmMixRate == 0) collapses to one PCM sample per host sample. */
-    float pcmStep = m4a_pcm_mix_rate(engine) / engine->sampleRate;
-
-    /* Polyphony-overflow debug: when inverted, the real channels still render
-     * (into a discarded accumulator, so sample positions, loop ends, and
-     * oscillator phases advance exactly as in normal playback) but only the
-     * shadow channels -- the sounds lost to the polyphony limit -- are heard. */
+    /* Clock periods in M4A_RATE_SCALE units.  pcmStep / period is the number of
+     * PCM-rate samples that elapse per host output sample.  When the mix rate
+     * is below the host rate (the GBA-accurate case, e.g. 13379 vs 44100),
+     * each PCM sample spans several host samples and we linearly interpolate
+     * between the two most recent PCM samples.  This reproduces the hardware
+     * mixer's low-rate resampling -- including the aliasing that high notes
+     * produce in-game.  A mix rate equal to the host rate (pcmMixRate == 0)
+     * collapses to one PCM sample per host sample. */
+    uint64_t period = m4a_rate_scaled(engine->sampleRate);
+    uint64_t pcmStep = m4a_rate_scaled(m4a_pcm_mix_rate(engine));
+    if (period == 0)
+        period = 1;
+    /* A single host sample never needs more than one block of PCM samples. */
+    if (pcmStep > (uint64_t)PCM_MIX_BLOCK * period)
+        pcmStep = (uint64_t)PCM_MIX_BLOCK * period;
     bool invert = engine->polyDebugInvert;
 
-    for (int i = 0; i < numSamples; i++) {
-        /* Check for engine tick (~60Hz) */
-        engine->tickAccumulator += 1.0f;
-        if (engine->tickAccumulator >= engine->samplesPerTick) {
-            engine->tickAccumulator -= engine->samplesPerTick;
+    /* [0] and [1] carry the previous/current PCM samples into each block. */
+    int32_t pcmBufL[PCM_MIX_BLOCK + 2], pcmBufR[PCM_MIX_BLOCK + 2];
+    int32_t mixL[PCM_MIX_BLOCK], mixR[PCM_MIX_BLOCK];
+    bool idle = true;
+
+    int i = 0;
+    while (i < numSamples) {
+        /* Check for engine tick (~60Hz) at the start of the span */
+        engine->tickPhase += VBLANK_RATE_SCALED;
+        if (engine->tickPhase >= period) {
+            engine->tickPhase -= period;
             m4a_engine_tick(engine);
         }
 
-        /* Advance the PCM resample clock, generating a new PCM-rate sample
-         * (all DirectSound channels mixed + reverb) each time it crosses a
-         * whole sample boundary. */
-        engine->pcmResampleAccum += pcmStep;
-        while (engine->pcmResampleAccum >= 1.0f) {
-            engine->pcmResampleAccum -= 1.0f;
-            engine->pcmPrevL = engine->pcmCurL;
-            engine->pcmPrevR = engine->pcmCurR;
-
-            int32_t pcmL = 0, pcmR = 0;
-            int32_t mutedL = 0, mutedR = 0;  /* discarded output of muted channels */
+        /* The span runs until just before the next tick, bounded by the
+         * output and block sizes and by how many PCM samples a block holds. */
+        uint64_t span = 1 + (period - 1 - engine->tickPhase) / VBLANK_RATE_SCALED;
+        if (span > (uint64_t)(numSamples - i))
+            span = (uint64_t)(numSamples - i);
+        if (span > PCM_MIX_BLOCK)
+            span = PCM_MIX_BLOCK;
+        uint64_t pcmSpan = ((uint64_t)(PCM_MIX_BLOCK + 1) * period - 1 - engine->pcmPhase) / pcmStep;
+        if (span > pcmSpan)
+            span = pcmSpan;
+        engine->tickPhase += (span - 1) * VBLANK_RATE_SCALED;
+
+        int n = (int)span;
+        int pcmCount = (int)((engine->pcmPhase + span * pcmStep) / period);
+
+        if (!outL) {
             for (int ch = 0; ch < TOTAL_PCM_CHANNELS; ch++) {
-                if (!(engine->pcmChannels[ch].status & CHN_ON))
-                    continue;
-                bool audible = ((ch >= MAX_PCM_CHANNELS) == invert);
-                m4a_pcm_channel_render(&engine->pcmChannels[ch],
-                                       audible ? &pcmL : &mutedL,
-                                       audible ? &pcmR : &mutedR);
+                if (engine->pcmChannels[ch].status & CHN_ON)
+                    m4a_pcm_channel_skip(&engine->pcmChannels[ch], pcmCount);
             }
-            /* Reverb is a GBA DirectSound-buffer effect: it runs at the PCM mix
-             * rate, before the upsample and before CGB is added. */
-            m4a_reverb_process(&engine->reverb, &pcmL, &pcmR);
-
-            engine->pcmCurL = pcmL;
-            engine->pcmCurR = pcmR;
+            for (int ch = 0; ch < TOTAL_CGB_CHANNELS; ch++)
+                m4a_cgb_channel_skip(&engine->cgbChannels[ch], n, engine->sampleRate);
+            engine->pcmPhase = (engine->pcmPhase + span * pcmStep) % period;
+            i += n;
+            continue;
         }
 
-        /* Linear interpolation of the PCM mix at this host-sample instant. */
-        float frac = engine->pcmResampleAccum;
-        int32_t mixL = engine->pcmPrevL
-                     + (int32_t)((float)(engine->pcmCurL - engine->pcmPrevL) * frac);
-        int32_t mixR = engine->pcmPrevR
-                     + (int32_t)((float)(engine->pcmCurR - engine->pcmPrevR) * frac);
+        /* Idle fast path: nothing is sounding and every tail has settled, so
+         * the span is a constant (normally silence).  Only the clocks advance;
+         * ticks still run above, as LFO/portamento track state evolves without
+         * channels. */
+        float idleLevel;
+        if (engine_idle_level(engine, &idleLevel)) {
+            if (idleLevel == 0.0f) {
+                memset(outL + i, 0, (size_t)n * sizeof(float));
+                memset(outR + i, 0, (size_t)n * sizeof(float));
+            } else {
+                for (int s = 0; s < n; s++)
+                    outL[i + s] = outR[i + s] = idleLevel;
+            }
+            m4a_reverb_skip(&engine->reverb, pcmCount);
+            engine->pcmPhase = (engine->pcmPhase + span * pcmStep) % period;
+            if (engine->analogFilter) {
+                engine->lowPassLeft = idleLevel;
+                engine->lowPassRight = idleLevel;
+            }
+            i += n;
+            continue;
+        }
+        idle = false;
+        pcmBufL[0] = engine->pcmPrevL;
+        pcmBufR[0] = engine->pcmPrevR;
+        pcmBufL[1] = engine->pcmCurL;
+        pcmBufR[1] = engine->pcmCurR;
+        if (pcmCount > 0)
+            mix_pcm_block(engine, pcmBufL + 2, pcmBufR + 2, pcmCount);
+        upsample_pcm(engine, pcmBufL, pcmBufR, mixL, mixR, n, pcmStep, period);
 
         /* CGB channels are oscillators synthesized directly at the host rate,
          * so they are mixed in after the PCM upsample.  They are not reverbed,
          * matching the GBA where reverb only touches the DirectSound buffer. */
-        {
-            int32_t mutedL = 0, mutedR = 0;
-            for (int ch = 0; ch < TOTAL_CGB_CHANNELS; ch++) {
-                bool audible = ((ch >= MAX_CGB_CHANNELS) == invert);
-                m4a_cgb_channel_render(&engine->cgbChannels[ch],
-                                       audible ? &mixL : &mutedL,
-                                       audible ? &mixR : &mutedR,
-                                       engine->sampleRate);
+        for (int ch = 0; ch < TOTAL_CGB_CHANNELS; ch++) {
+            if ((ch >= MAX_CGB_CHANNELS) == invert &&
+                !track_muted(engine, engine->cgbChannels[ch].trackIndex))
+                m4a_cgb_channel_render_span(&engine->cgbChannels[ch], mixL, mixR,
+                                            n, engine->sampleRate);
+            else
+                m4a_cgb_channel_skip(&engine->cgbChannels[ch], n, engine->sampleRate);
+        }
+
+        for (int s = 0; s < n; s++, i++) {
+            /* Normalize to float (-1.0 to 1.0)
+             * The GBA mixer accumulates (int8_sample * uint8_envVol) >> 8 per channel,
+             * giving ~±127 per channel. With maxPcmChannels typically 5-6, the sum
+             * can reach ~±700. We use a divider that gives good headroom while
+             * keeping CGB channels (which are quieter) audible. */
+            outL[i] = (float)mixL[s] / 256.0f;
+            outR[i] = (float)mixR[s] / 256.0f;
+
+            /* GBA analog output emulation: single-pole IIR low-pass filter (6 dB/octave).
+             * The GBA's PWM output circuit has a characteristic frequency rolloff due to
+             * the output capacitor. Adapted from mGBA _audioLowPassFilter (libretro.c).
+             * Coefficient 0.6/0.4 matches mGBA's default audioLowPassRange (60%). */
+            if (engine->analogFilter) {
+                engine->lowPassLeft  = engine->lowPassLeft  * 0.6f + outL[i] * 0.4f;
+                engine->lowPassRight = engine->lowPassRight * 0.6f + outR[i] * 0.4f;
+                outL[i] = engine->lowPassLeft;
+                outR[i] = engine->lowPassRight;
             }
         }
+    }
 
+    if (outL)
+        engine->outputIdle = idle;
+}
+
+void m4a_engine_process(M4AEngine *engine, float *outL, float *outR, int numSamples)
+{
+    engine_run(engine, outL, outR, numSamples);
+}
+
+void m4a_engine_skip(M4AEngine *engine, int numSamples)
+{
+    engine_run(engine, NULL, NULL, numSamples);
+
+    /* Nothing was mixed, so the reverb delay line, resampler history and
+     * analog filter no longer describe the preceding audio.  Start them from
+     * silence rather than leaving stale state behind. */
+    m4a_reverb_reset(&engine->reverb);
+    engine->pcmPrevL = engine->pcmPrevR = 0;
+    engine->pcmCurL = engine->pcmCurR = 0;
+    engine->lowPassLeft = engine->lowPassRight = 0.0f;
+}
+
+/* ---- Playback-state snapshots ---- */
+
+#define SNAPSHOT_MAGIC   0x5341344Du  /* "M4AS" */
+#define SNAPSHOT_VERSION 1
+
+/* References to voice data are stored as positions within the voicegroup
+ * rather than as pointers: slot `field` (0 = the wav/wavePointer/subGroup
+ * union, 1 = keySplitTable) of voiceGroup[top] (sub == 0) or of entry sub - 1
+ * of its keysplit/drumset subgroup, packed as (top * 129 + sub) * 2 + field.
+ * Values that are not pointers into the voicegroup -- the square duty and
+ * noise period bits CGB voices keep in wavePointer -- are stored raw. */
+#define VOICE_REF_NULL    0xFFFFFFFFu
+#define VOICE_REF_RAW     0x80000000u
+#define VOICE_REF_VOICES  128
+#define VOICE_REF_SUBS    (VOICE_REF_VOICES + 1)
+#define VOICE_REF_COUNT   (VOICE_REF_VOICES * VOICE_REF_SUBS * 2)
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t size;          /* sizeof(M4ASnapshot): rejects other builds */
+    uint32_t reverbSize;    /* delay-line length per channel; 0 if none */
+    float sampleRate;
+    float pcmMixRate;
+
+    /* Pointer fields are stored as NULL; see the Refs/Offsets arrays below. */
+    M4ATrack tracks[MAX_TRACKS];
+    M4APCMChannel pcmChannels[TOTAL_PCM_CHANNELS];
+    M4ACGBChannel cgbChannels[TOTAL_CGB_CHANNELS];
+    uint32_t trackVoiceRefs[MAX_TRACKS][2];       /* currentVoice union, keySplitTable */
+    uint32_t pcmWaveRefs[TOTAL_PCM_CHANNELS];
+    int32_t pcmDataOffsets[TOTAL_PCM_CHANNELS][2]; /* currentPointer, loopStart - wav->data */
+    uint32_t cgbWaveRefs[TOTAL_CGB_CHANNELS];
+
+    uint64_t tickPhase;
+    uint64_t pcmPhase;
+    int32_t pcmPrevL, pcmPrevR;
+    int32_t pcmCurL, pcmCurR;
+    float lowPassLeft, lowPassRight;
+    int32_t reverbPos;
+    int32_t reverbSteadyCount;
+    int8_t reverbSteadyValue;
+    uint8_t c15;
+    bool pwmActiveFlag;
+    bool outputIdle;
+    uint16_t tempoD, tempoU, tempoI, tempoC;
+    /* followed by the reverb delay line: reverbSize * 2 bytes */
+} M4ASnapshot;
+
+/* The voice holding the slot addressed by `ref`; NULL if it does not exist. */
+static const ToneData *voice_ref_tone(const ToneData *voiceGroup, uint32_t ref)
+{
+    if (!voiceGroup || ref >= VOICE_REF_COUNT)
+        return NULL;
+    uint32_t sub = (ref / 2) % VOICE_REF_SUBS;
+    const ToneData *td = &voiceGroup[ref / (2 * VOICE_REF_SUBS)];
+    if (sub > 0) {
+        if (!(td->type & (VOICE_KEYSPLIT | VOICE_KEYSPLIT_ALL)) || !td->subGroup)
+            return NULL;
+        td = &((const ToneData *)td->subGroup)[sub - 1];
+    }
+    return td;
+}
+
+/* Read the voicegroup slot addressed by `ref`; false if it does not exist. */
+static bool voice_ref_slot(const ToneData *voiceGroup, uint32_t ref, const void **out)
+{
+    const ToneData *td = voice_ref_tone(voiceGroup, ref);
+    if (!td)
+        return false;
+    *out = ref % 2 ? (const void *)td->keySplitTable : (const void *)td->subGroup;
+    return true;
+}
+
+static bool encode_voice_ref(const ToneData *voiceGroup, const void *p, uint32_t *ref)
+{
+    if (!p) {
+        *ref = VOICE_REF_NULL;
+        return true;
+    }
+    for (uint32_t r = 0; voiceGroup && r < VOICE_REF_COUNT; r++) {
+        const void *slot;
+        if (voice_ref_slot(voiceGroup, r, &slot) && slot == p) {
+            *ref = r;
+            return true;
+        }
+        /* Skip the subgroup slots of voices that have none. */
+        if (r % (2 * VOICE_REF_SUBS) == 1) {
+            const ToneData *td = &voiceGroup[r / (2 * VOICE_REF_SUBS)];
+            if (!(td->type & (VOICE_KEYSPLIT | VOICE_KEYSPLIT_ALL)) || !td->subGroup)
+                r += 2 * (VOICE_REF_SUBS - 1);
+        }
+    }
+    if ((uintptr_t)p < VOICE_REF_RAW) {
+        *ref = VOICE_REF_RAW | (uint32_t)(uintptr_t)p;
+        return true;
+    }
+    return false;
+}
+
+static bool decode_voice_ref(const ToneData *voiceGroup, uint32_t ref, void **p)
+{
+    if (ref == VOICE_REF_NULL) {
+        *p = NULL;
+        return true;
+    }
+    if (ref & VOICE_REF_RAW) {
+        *p = (void *)(uintptr_t)(ref & ~VOICE_REF_RAW);
+        return true;
+    }
+    const void *slot;
+    if (!voice_ref_slot(voiceGroup, ref, &slot))
+        return false;
+    *p = (void *)slot;
+    return true;
+}
+
+/* decode_voice_ref() for a PCM channel's sample: the slot must be the wav of
+ * a DirectSound voice, never a raw value or another kind of voice data. */
+static bool decode_wave_ref(const ToneData *voiceGroup, uint32_t ref, WaveData **wav)
+{
+    if (ref == VOICE_REF_NULL) {
+        *wav = NULL;
+        return true;
+    }
+    if (ref & VOICE_REF_RAW || ref % 2 != 0)
+        return false;
+    const ToneData *td = voice_ref_tone(voiceGroup, ref);
+    if (!td || (td->type & (VOICE_KEYSPLIT | VOICE_KEYSPLIT_ALL | VOICE_TYPE_CGB_MASK)))
+        return false;
+    *wav = td->wav;
+    return true;
+}
+
+size_t m4a_engine_snapshot(const M4AEngine *engine, void *buf, size_t bufSize)
+{
+    const M4AReverb *reverb = &engine->reverb;
+    uint32_t reverbSize = reverb->buffer ? (uint32_t)reverb->bufferSize : 0;
+    size_t total = sizeof(M4ASnapshot) + (size_t)reverbSize * 2;
+    if (!buf || bufSize < total)
+        return total;
+
+    M4ASnapshot *snap = calloc(1, sizeof(M4ASnapshot));
+    if (!snap)
+        return 0;
+    snap->magic = SNAPSHOT_MAGIC;
+    snap->version = SNAPSHOT_VERSION;
+    snap->size = sizeof(M4ASnapshot);
+    snap->reverbSize = reverbSize;
+    snap->sampleRate = engine->sampleRate;
+    snap->pcmMixRate = engine->pcmMixRate;
+
+    const ToneData *vg = engine->voiceGroup;
+    bool ok = true;
+
+    for (int i = 0; i < MAX_TRACKS; i++) {
+        M4ATrack *track = &snap->tracks[i];
+        *track = engine->tracks[i];
+        ok = ok && encode_voice_ref(vg, track->currentVoice.subGroup, &snap->trackVoiceRefs[i][0]);
+        ok = ok && encode_voice_ref(vg, track->currentVoice.keySplitTable, &snap->trackVoiceRefs[i][1]);
+        track->currentVoice.subGroup = NULL;
+        track->currentVoice.keySplitTable = NULL;
+    }
+
+    /* Channels that are off may hold stale pointers (e.g. into a voicegroup
+     * that has since been reloaded); nothing reads them, so store NULL. */
+    for (int i = 0; i < TOTAL_PCM_CHANNELS; i++) {
+        M4APCMChannel *ch = &snap->pcmChannels[i];
+        *ch = engine->pcmChannels[i];
+        snap->pcmWaveRefs[i] = VOICE_REF_NULL;
+        if ((ch->status & CHN_ON) && ch->wav) {
+            ok = ok && encode_voice_ref(vg, ch->wav, &snap->pcmWaveRefs[i]);
+            snap->pcmDataOffsets[i][0] = (int32_t)(ch->currentPointer - ch->wav->data);
+            snap->pcmDataOffsets[i][1] = ch->isLoop ? (int32_t)(ch->loopStart - ch->wav->data) : 0;
+        }
+        ch->wav = NULL;
+        ch->currentPointer = NULL;
+        ch->loopStart = NULL;
+    }
+
+    for (int i = 0; i < TOTAL_CGB_CHANNELS; i++) {
+        M4ACGBChannel *ch = &snap->cgbChannels[i];
+        *ch = engine->cgbChannels[i];
+        snap->cgbWaveRefs[i] = VOICE_REF_NULL;
+        if (ch->status & CHN_ON)
+            ok = ok && encode_voice_ref(vg, ch->wavePointer, &snap->cgbWaveRefs[i]);
+        ch->wavePointer = NULL;
+        ch->waveTablePointer = NULL;  /* cache; rebuilt after restore */
+    }
+
+    snap->tickPhase = engine->tickPhase;
+    snap->pcmPhase = engine->pcmPhase;
+    snap->pcmPrevL = engine->pcmPrevL;
+    snap->pcmPrevR = engine->pcmPrevR;
+    snap->pcmCurL = engine->pcmCurL;
+    snap->pcmCurR = engine->pcmCurR;
+    snap->lowPassLeft = engine->lowPassLeft;
+    snap->lowPassRight = engine->lowPassRight;
+    snap->reverbPos = reverb->pos;
+    snap->reverbSteadyCount = reverb->steadyCount;
+    snap->reverbSteadyValue = reverb->steadyValue;
+    snap->c15 = engine->c15;
+    snap->pwmActiveFlag = engine->pwmActiveFlag;
+    snap->outputIdle = engine->outputIdle;
+    snap->tempoD = engine->tempoD;
+    snap->tempoU = engine->tempoU;
+    snap->tempoI = engine->tempoI;
+    snap->tempoC = engine->tempoC;
+
+    if (ok) {
+        memcpy(buf, snap, sizeof(M4ASnapshot));
+        if (reverbSize)
+            memcpy((uint8_t *)buf + sizeof(M4ASnapshot), reverb->buffer, (size_t)reverbSize * 2);
+    }
+    free(snap);
+    return ok ? total : 0;
+}
+
+bool m4a_engine_restore(M4AEngine *engine, const void *buf, size_t size)
+{
+    if (!buf || size < sizeof(M4ASnapshot))
+        return false;
+    M4ASnapshot *snap = malloc(sizeof(M4ASnapshot));
+    if (!snap)
+        return false;
+    memcpy(snap, buf, sizeof(M4ASnapshot));
+
+    const ToneData *vg = engine->voiceGroup;
+    M4AReverb *reverb = &engine->reverb;
+    uint32_t reverbSize = reverb->buffer ? (uint32_t)reverb->bufferSize : 0;
+    bool ok = snap->magic == SNAPSHOT_MAGIC
+           && snap->version == SNAPSHOT_VERSION
+           && snap->size == sizeof(M4ASnapshot)
+           && snap->reverbSize == reverbSize
+           && size >= sizeof(M4ASnapshot) + (size_t)reverbSize * 2
+           && snap->sampleRate == engine->sampleRate
+           && snap->pcmMixRate == engine->pcmMixRate
+           && (reverbSize == 0 || (snap->reverbPos >= 0 && (uint32_t)snap->reverbPos < reverbSize));
+
+    /* Resolve every reference before touching the engine, so a snapshot
+     * taken against a different voicegroup is rejected cleanly. */
+    for (int i = 0; ok && i < MAX_TRACKS; i++) {
+        ToneData *voice = &snap->tracks[i].currentVoice;
+        void *keySplitTable;
+        ok = decode_voice_ref(vg, snap->trackVoiceRefs[i][0], &voice->subGroup)
+          && decode_voice_ref(vg, snap->trackVoiceRefs[i][1], &keySplitTable);
+        voice->keySplitTable = keySplitTable;
+    }
+    for (int i = 0; ok && i < TOTAL_PCM_CHANNELS; i++) {
+        M4APCMChannel *ch = &snap->pcmChannels[i];
+        ok = decode_wave_ref(vg, snap->pcmWaveRefs[i], &ch->wav);
+        if (!ok || !(ch->status & CHN_ON))
+            continue;
+        /* Mixing reads `count` samples on from the current position and
+         * `loopLen` from the loop start; both must stay inside the sample. */
+        int64_t cur = snap->pcmDataOffsets[i][0];
+        int64_t loop = snap->pcmDataOffsets[i][1];
+        ok = ch->wav && cur >= 0 && ch->count >= 0
+          && cur + ch->count <= (int64_t)ch->wav->size
+          && (!ch->isLoop || (loop >= 0 && ch->loopLen >= 0
+                              && loop + ch->loopLen <= (int64_t)ch->wav->size));
+        if (ok) {
+            ch->currentPointer = ch->wav->data + cur;
+            ch->loopStart = ch->isLoop ? ch->wav->data + loop : NULL;
+        }
+    }
+    for (int i = 0; ok && i < TOTAL_CGB_CHANNELS; i++) {
+        void *wavePointer;
+        ok = decode_voice_ref(vg, snap->cgbWaveRefs[i], &wavePointer);
+        snap->cgbChannels[i].wavePointer = wavePointer;
+    }
 
-        /* Normalize to float (-1.0 to 1.0)
-         * The GBA mixer accumulates (int8_sample * uint8_envVol) >> 8 per channel,
-         * giving ~±127 per channel. With maxPcmChannels typically 5-6, the sum
-         * can reach ~±700. We use a divider that gives good headroom while
-         * keeping CGB channels (which are quieter) audible. */
-        outL[i] = (float)mixL / 256.0f;
-        outR[i] = (float)mixR / 256.0f;
-
-        /* GBA analog output emulation: single-pole IIR low-pass filter (6 dB/octave).
-         * The GBA's PWM output circuit has a characteristic frequency rolloff due to
-         * the output capacitor. Adapted from mGBA _audioLowPassFilter (libretro.c).
-         * Coefficient 0.6/0.4 matches mGBA's default audioLowPassRange (60%). */
-        if (engine->analogFilter) {
-            engine->lowPassLeft  = engine->lowPassLeft  * 0.6f + outL[i] * 0.4f;
-            engine->lowPassRight = engine->lowPassRight * 0.6f + outR[i] * 0.4f;
-            outL[i] = engine->lowPassLeft;
-            outR[i] = engine->lowPassRight;
+    if (ok) {
+        memcpy(engine->tracks, snap->tracks, sizeof(engine->tracks));
+        memcpy(engine->pcmChannels, snap->pcmChannels, sizeof(engine->pcmChannels));
+        memcpy(engine->cgbChannels, snap->cgbChannels, sizeof(engine->cgbChannels));
+        engine->tickPhase = snap->tickPhase;
+        engine->pcmPhase = snap->pcmPhase;
+        engine->pcmPrevL = snap->pcmPrevL;
+        engine->pcmPrevR = snap->pcmPrevR;
+        engine->pcmCurL = snap->pcmCurL;
+        engine->pcmCurR = snap->pcmCurR;
+        engine->lowPassLeft = snap->lowPassLeft;
+        engine->lowPassRight = snap->lowPassRight;
+        engine->c15 = snap->c15;
+        engine->pwmActiveFlag = snap->pwmActiveFlag;
+        engine->outputIdle = snap->outputIdle;
+        engine->tempoD = snap->tempoD;
+        engine->tempoU = snap->tempoU;
+        engine->tempoI = snap->tempoI;
+        engine->tempoC = snap->tempoC;
+        if (reverbSize) {
+            memcpy(reverb->buffer, (const uint8_t *)buf + sizeof(M4ASnapshot), (size_t)reverbSize * 2);
+            reverb->pos = snap->reverbPos;
+            reverb->steadyCount = snap->reverbSteadyCount;
+            reverb->steadyValue = snap->reverbSteadyValue;
         }
     }
+    free(snap);
+    return ok;
 }
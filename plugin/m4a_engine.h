@@ -3,6 +3,7 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include <stddef.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -19,6 +20,10 @@ extern "C" {
 #define TOTAL_CGB_CHANNELS (MAX_CGB_CHANNELS * 2)
 #define MAX_TRACKS 16
 #define VBLANK_RATE 59.7275f
+/* Sample clocks are kept as exact integers in units of 1/M4A_RATE_SCALE Hz,
+ * so tick and PCM-sample boundaries never drift over long renders. */
+#define M4A_RATE_SCALE 10000
+#define VBLANK_RATE_SCALED 597275   /* VBLANK_RATE * M4A_RATE_SCALE */
 #define MAX_SONG_VOLUME 127 // called "mxv" in pokeemerald
 
 /* Voice types (matching GBA ToneData.type) */
@@ -220,11 +225,14 @@ typedef struct {
     uint32_t phaseInc;
     uint32_t phaseIncFreq;
 
-    /* Cached DC-offset sum of the programmable-wave table (sum of all 32 raw
-     * nibbles).  Depends only on wavePointer contents, so it is recomputed
-     * only when wavePointer changes rather than every sample. */
-    int32_t waveSum;
-    uint32_t *waveSumPointer;
+    /* Cached programmable-wave output table: the 32 wave steps already
+     * volume-shifted, DC-corrected and scaled, so rendering is a table read.
+     * Depends only on the wavePointer contents and envelopeVolume, so it is
+     * rebuilt only when either changes.  waveTablePointer is the wavePointer
+     * it was built for (NULL forces a rebuild). */
+    int8_t waveTable[32];
+    uint32_t *waveTablePointer;
+    uint8_t waveTableVolume;
 
     uint16_t lfsr;          /* noise LFSR state */
 
@@ -271,8 +279,10 @@ struct M4AEngine {
     M4AReverb reverb;
 
     float sampleRate;
-    float samplesPerTick;
-    float tickAccumulator;
+    float samplesPerTick;   /* host samples per VBlank tick (informational) */
+    /* Tick clock: advances by VBLANK_RATE_SCALED per host sample; a tick fires
+     * each time it reaches the scaled host rate. */
+    uint64_t tickPhase;
 
     /* DirectSound (PCM) mixing rate.  On real hardware the m4a engine mixes all
      * PCM channels at a fixed low rate (SOUND_MODE_FREQ, 13379 Hz in pokeemerald),
@@ -281,8 +291,11 @@ struct M4AEngine {
      * then linearly upsampled to sampleRate.  0 means "follow sampleRate" (clean,
      * alias-free mixing).  Default 13379 Hz for hardware accuracy. */
     float pcmMixRate;
-    /* Linear-interpolation state for upsampling the PCM mix to the host rate. */
-    float pcmResampleAccum;
+    /* Linear-interpolation state for upsampling the PCM mix to the host rate.
+     * pcmPhase is the PCM clock: it advances by the scaled mix rate per host
+     * sample, and a new PCM-rate sample is due each time it reaches the scaled
+     * host rate.  pcmPhase / (scaled host rate) is the interpolation fraction. */
+    uint64_t pcmPhase;
     int32_t pcmPrevL, pcmPrevR;
     int32_t pcmCurL, pcmCurR;
 
@@ -317,11 +330,22 @@ struct M4AEngine {
     uint32_t polyEventTotal;               /* total events; ring head = total % capacity */
     M4APolyEvent polyEvents[M4A_POLY_EVENT_CAPACITY];
 
+    /* Per-track mute (bit n = track n).  A muted track's channels are
+     * fast-forwarded instead of mixed, so voice allocation -- and therefore
+     * every other track's output -- is exactly as in the full mix.  Used to
+     * render per-track stems. */
+    uint16_t mutedTracks;
+
     /* GBA analog output emulation: IIR low-pass filter */
     bool analogFilter;      /* enable/disable the hardware output filter */
     float lowPassLeft;
     float lowPassRight;
 
+    /* True when the last m4a_engine_process call took only the idle fast path:
+     * nothing was sounding and its output was one constant level (silence,
+     * or the reverb's settled DC residue).  Lets the host skip idle instances. */
+    bool outputIdle;
+
     /* Tempo system (matches GBA MPlayMain tempo accumulator).
      * tempoD = base tempo (ply_tempo param * 2), default 150.
      * tempoU = user tempo multiplier (default 0x100 = 1.0x).
@@ -394,6 +418,32 @@ void m4a_engine_set_tempo_bpm(M4AEngine *engine, double bpm);
 /* Audio processing */
 void m4a_engine_process(M4AEngine *engine, float *outL, float *outR, int numSamples);
 
+/* Advance playback by numSamples without producing audio: ticks run and every
+ * channel moves exactly as it would under m4a_engine_process, but nothing is
+ * mixed.  Afterwards the reverb, resampler and analog filter start from
+ * silence, so render a short pre-roll before using the output if reverb tails
+ * from before the skip matter. */
+void m4a_engine_skip(M4AEngine *engine, int numSamples);
+
+/* True when no channel is sounding and the reverb, resampler and analog filter
+ * have decayed to silence: output stays exactly zero until the next note-on. */
+bool m4a_engine_is_silent(const M4AEngine *engine);
+
+/* Playback-state snapshots, for seeking without re-rendering from the start.
+ * A snapshot holds everything that evolves during playback (tracks, channels,
+ * tick/tempo/resample clocks, reverb delay line, analog filter) but not
+ * configuration (volumes, feature toggles, reverb amount, debug counters).
+ * References to voice data are stored as positions in the voicegroup, so a
+ * snapshot restores into any engine with the same voicegroup contents, sample
+ * rate and PCM mix rate, even if the voice data lives at other addresses.
+ *
+ * m4a_engine_snapshot returns the snapshot size and writes it to buf if it
+ * fits in bufSize (pass NULL to query the size); it returns 0 if the state
+ * references data outside the voicegroup.  m4a_engine_restore returns false,
+ * leaving the engine untouched, if the blob is invalid or incompatible. */
+size_t m4a_engine_snapshot(const M4AEngine *engine, void *buf, size_t bufSize);
+bool m4a_engine_restore(M4AEngine *engine, const void *buf, size_t size);
+
 /* Internal: engine tick (~60Hz) */
 void m4a_engine_tick(M4AEngine *engine);
 
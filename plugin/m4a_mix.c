@@ -0,0 +1,309 @@
+#include "m4a_mix.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#endif
+
+/*
+ * DirectSound mixing kernels (see m4a_mix.h).
+ *
+ * Every kernel computes, for output sample k of a run:
+ *   pos    = fw + k * frequency          (23-bit fractional sample position)
+ *   s0, s1 = ptr[pos >> 23], ptr[(pos >> 23) + 1]
+ *   sample = s0 + (((s1 - s0) * (pos & 0x7FFFFF)) >> 23)   (or s0 if fixed)
+ *   mixR  += (sample * volR) >> 8;  mixL += (sample * volL) >> 8
+ * which is exactly what the sequential fw += frequency loop in SoundMainRAM
+ * produces, since no loop or end boundary falls inside a run.
+ *
+ * (s1 - s0) is within +/-255 and the fraction is below 2^23, so the product
+ * fits in 32 bits and a 32-bit arithmetic shift matches the scalar result.
+ */
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define M4A_MIX_X86 1
+#include <immintrin.h>
+#endif
+
+#define FW_MASK 0x7FFFFFu
+
+/* The vector kernels keep lane positions (fw + lane * frequency) in 32 bits,
+ * so they only handle frequencies below this (~64 source samples per output
+ * sample -- far beyond anything a note produces).  Faster runs use scalar. */
+#define SIMD_MAX_FREQUENCY 0x1FFFFFFFu
+
+static void mix_pcm_scalar(const int8_t *ptr, uint32_t fw, uint32_t frequency, bool fixed,
+                           int32_t volL, int32_t volR, int32_t *mixL, int32_t *mixR,
+                           int count)
+{
+    uint64_t pos = fw;
+    for (int i = 0; i < count; i++, pos += frequency) {
+        const int8_t *p = ptr + (pos >> 23);
+        int32_t sample = p[0];
+        if (!fixed)
+            sample += (int32_t)(((int64_t)(p[1] - p[0]) * (int32_t)(pos & FW_MASK)) >> 23);
+        mixR[i] += (sample * volR) >> 8;
+        mixL[i] += (sample * volL) >> 8;
+    }
+}
+
+static void upsample_scalar(const int32_t *src, const int32_t *index, const int32_t *weight,
+                            int32_t *out, int count)
+{
+    for (int i = 0; i < count; i++) {
+        int32_t a = src[index[i]];
+        int32_t b = src[index[i] + 1];
+        out[i] = a + (((b - a) * weight[i] + 0x8000) >> 16);
+    }
+}
+
+#ifdef M4A_MIX_X86
+
+__attribute__((target("sse4.1")))
+static void mix_pcm_sse41(const int8_t *ptr, uint32_t fw, uint32_t frequency, bool fixed,
+                          int32_t volL, int32_t volR, int32_t *mixL, int32_t *mixR,
+                          int count)
+{
+    const __m128i laneOffsets = _mm_setr_epi32(0, (int)frequency, (int)(2 * frequency),
+                                               (int)(3 * frequency));
+    const __m128i fracMask = _mm_set1_epi32((int)FW_MASK);
+    const __m128i vR = _mm_set1_epi32(volR);
+    const __m128i vL = _mm_set1_epi32(volL);
+    const uint64_t step = (uint64_t)frequency * 4;
+
+    int i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128i pos = _mm_add_epi32(_mm_set1_epi32((int)fw), laneOffsets);
+        __m128i idx = _mm_srli_epi32(pos, 23);
+        const int8_t *p0 = ptr + _mm_cvtsi128_si32(idx);
+        const int8_t *p1 = ptr + _mm_extract_epi32(idx, 1);
+        const int8_t *p2 = ptr + _mm_extract_epi32(idx, 2);
+        const int8_t *p3 = ptr + _mm_extract_epi32(idx, 3);
+        __m128i sample = _mm_setr_epi32(p0[0], p1[0], p2[0], p3[0]);
+        if (!fixed) {
+            __m128i next = _mm_setr_epi32(p0[1], p1[1], p2[1], p3[1]);
+            __m128i frac = _mm_and_si128(pos, fracMask);
+            __m128i diff = _mm_sub_epi32(next, sample);
+            sample = _mm_add_epi32(sample, _mm_srai_epi32(_mm_mullo_epi32(diff, frac), 23));
+        }
+        __m128i r = _mm_srai_epi32(_mm_mullo_epi32(sample, vR), 8);
+        __m128i l = _mm_srai_epi32(_mm_mullo_epi32(sample, vL), 8);
+        _mm_storeu_si128((__m128i *)(mixR + i),
+                         _mm_add_epi32(_mm_loadu_si128((const __m128i *)(mixR + i)), r));
+        _mm_storeu_si128((__m128i *)(mixL + i),
+                         _mm_add_epi32(_mm_loadu_si128((const __m128i *)(mixL + i)), l));
+
+        /* Rebase so the lane positions stay within 32 bits. */
+        uint64_t next = fw + step;
+        ptr += next >> 23;
+        fw = (uint32_t)(next & FW_MASK);
+    }
+    mix_pcm_scalar(ptr, fw, frequency, fixed, volL, volR, mixL + i, mixR + i, count - i);
+}
+
+__attribute__((target("avx2")))
+static void mix_pcm_avx2(const int8_t *ptr, uint32_t fw, uint32_t frequency, bool fixed,
+                         int32_t volL, int32_t volR, int32_t *mixL, int32_t *mixR,
+                         int count)
+{
+    const __m256i laneOffsets = _mm256_mullo_epi32(_mm256_set1_epi32((int)frequency),
+                                                   _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+    const __m256i fracMask = _mm256_set1_epi32((int)FW_MASK);
+    const __m256i vR = _mm256_set1_epi32(volR);
+    const __m256i vL = _mm256_set1_epi32(volL);
+    const uint64_t step = (uint64_t)frequency * 8;
+
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256i pos = _mm256_add_epi32(_mm256_set1_epi32((int)fw), laneOffsets);
+        __m256i idx = _mm256_srli_epi32(pos, 23);
+        /* Gather 4 bytes at each position: byte 0 is s0, byte 1 is s1.  The
+         * caller guarantees all 4 bytes are readable. */
+        __m256i raw = _mm256_i32gather_epi32((const int *)ptr, idx, 1);
+        __m256i sample = _mm256_srai_epi32(_mm256_slli_epi32(raw, 24), 24);
+        if (!fixed) {
+            __m256i next = _mm256_srai_epi32(_mm256_slli_epi32(raw, 16), 24);
+            __m256i frac = _mm256_and_si256(pos, fracMask);
+            __m256i diff = _mm256_sub_epi32(next, sample);
+            sample = _mm256_add_epi32(sample,
+                                      _mm256_srai_epi32(_mm256_mullo_epi32(diff, frac), 23));
+        }
+        __m256i r = _mm256_srai_epi32(_mm256_mullo_epi32(sample, vR), 8);
+        __m256i l = _mm256_srai_epi32(_mm256_mullo_epi32(sample, vL), 8);
+        _mm256_storeu_si256((__m256i *)(mixR + i),
+                            _mm256_add_epi32(_mm256_loadu_si256((const __m256i *)(mixR + i)), r));
+        _mm256_storeu_si256((__m256i *)(mixL + i),
+                            _mm256_add_epi32(_mm256_loadu_si256((const __m256i *)(mixL + i)), l));
+
+        uint64_t next = fw + step;
+        ptr += next >> 23;
+        fw = (uint32_t)(next & FW_MASK);
+    }
+    mix_pcm_scalar(ptr, fw, frequency, fixed, volL, volR, mixL + i, mixR + i, count - i);
+}
+
+__attribute__((target("sse4.1")))
+static void upsample_sse41(const int32_t *src, const int32_t *index, const int32_t *weight,
+                           int32_t *out, int count)
+{
+    const __m128i half = _mm_set1_epi32(0x8000);
+    int i = 0;
+    for (; i + 4 <= count; i += 4) {
+        const int32_t *p0 = src + index[i];
+        const int32_t *p1 = src + index[i + 1];
+        const int32_t *p2 = src + index[i + 2];
+        const int32_t *p3 = src + index[i + 3];
+        __m128i a = _mm_setr_epi32(p0[0], p1[0], p2[0], p3[0]);
+        __m128i b = _mm_setr_epi32(p0[1], p1[1], p2[1], p3[1]);
+        __m128i w = _mm_loadu_si128((const __m128i *)(weight + i));
+        __m128i d = _mm_srai_epi32(_mm_add_epi32(_mm_mullo_epi32(_mm_sub_epi32(b, a), w), half), 16);
+        _mm_storeu_si128((__m128i *)(out + i), _mm_add_epi32(a, d));
+    }
+    upsample_scalar(src, index + i, weight + i, out + i, count - i);
+}
+
+__attribute__((target("avx2")))
+static void upsample_avx2(const int32_t *src, const int32_t *index, const int32_t *weight,
+                          int32_t *out, int count)
+{
+    const __m256i half = _mm256_set1_epi32(0x8000);
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256i idx = _mm256_loadu_si256((const __m256i *)(index + i));
+        __m256i a = _mm256_i32gather_epi32((const int *)src, idx, 4);
+        __m256i b = _mm256_i32gather_epi32((const int *)(src + 1), idx, 4);
+        __m256i w = _mm256_loadu_si256((const __m256i *)(weight + i));
+        __m256i d = _mm256_srai_epi32(_mm256_add_epi32(_mm256_mullo_epi32(_mm256_sub_epi32(b, a), w),
+                                                       half), 16);
+        _mm256_storeu_si256((__m256i *)(out + i), _mm256_add_epi32(a, d));
+    }
+    upsample_scalar(src, index + i, weight + i, out + i, count - i);
+}
+
+#endif /* M4A_MIX_X86 */
+
+typedef void (*MixPcmKernel)(const int8_t *ptr, uint32_t fw, uint32_t frequency, bool fixed,
+                             int32_t volL, int32_t volR, int32_t *mixL, int32_t *mixR,
+                             int count);
+
+typedef void (*UpsampleKernel)(const int32_t *src, const int32_t *index, const int32_t *weight,
+                               int32_t *out, int count);
+
+static MixPcmKernel s_mixPcmKernel = mix_pcm_scalar;
+static UpsampleKernel s_upsampleKernel = upsample_scalar;
+static M4ASimdLevel s_simdLevel = M4A_SIMD_SCALAR;
+
+static M4ASimdLevel detect_simd_level(void)
+{
+#ifdef M4A_MIX_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        return M4A_SIMD_AVX2;
+    if (__builtin_cpu_supports("sse4.1"))
+        return M4A_SIMD_SSE41;
+#endif
+    return M4A_SIMD_SCALAR;
+}
+
+static M4ASimdLevel select_simd_level(M4ASimdLevel level)
+{
+    M4ASimdLevel supported = detect_simd_level();
+    if (level > supported)
+        level = supported;
+
+    switch (level) {
+#ifdef M4A_MIX_X86
+    case M4A_SIMD_AVX2:
+        s_mixPcmKernel = mix_pcm_avx2;
+        s_upsampleKernel = upsample_avx2;
+        break;
+    case M4A_SIMD_SSE41:
+        s_mixPcmKernel = mix_pcm_sse41;
+        s_upsampleKernel = upsample_sse41;
+        break;
+#endif
+    default:
+        s_mixPcmKernel = mix_pcm_scalar;
+        s_upsampleKernel = upsample_scalar;
+        level = M4A_SIMD_SCALAR;
+        break;
+    }
+    s_simdLevel = level;
+    return level;
+}
+
+/* The kernels are picked once per process, however many engines start up at
+ * once; the audio threads only ever read the pointers afterwards. */
+#ifdef _WIN32
+static INIT_ONCE s_mixOnce = INIT_ONCE_STATIC_INIT;
+
+static BOOL CALLBACK mix_init_once(PINIT_ONCE once, PVOID param, PVOID *context)
+{
+    (void)once; (void)param; (void)context;
+    select_simd_level(M4A_SIMD_AVX2);
+    return TRUE;
+}
+#else
+static pthread_once_t s_mixOnce = PTHREAD_ONCE_INIT;
+
+static void mix_init_once(void)
+{
+    select_simd_level(M4A_SIMD_AVX2);
+}
+#endif
+
+M4ASimdLevel m4a_mix_get_simd_level(void)
+{
+    return s_simdLevel;
+}
+
+void m4a_mix_init(void)
+{
+#ifdef _WIN32
+    InitOnceExecuteOnce(&s_mixOnce, mix_init_once, NULL, NULL);
+#else
+    pthread_once(&s_mixOnce, mix_init_once);
+#endif
+}
+
+M4ASimdLevel m4a_mix_set_simd_level(M4ASimdLevel level)
+{
+    /* Finish the startup selection first so it cannot overwrite this one */
+    m4a_mix_init();
+    return select_simd_level(level);
+}
+
+void m4a_mix_pcm_run(const int8_t *ptr, uint32_t fw, uint32_t frequency, bool fixed,
+                     int32_t volL, int32_t volR, int32_t *mixL, int32_t *mixR,
+                     int count, int32_t readable)
+{
+    /* The vector kernels read 4 bytes at each position; only the leading
+     * samples whose position is at least 4 bytes before the end of the
+     * readable data may use them.  The last few go through the scalar path. */
+    int vectorCount = 0;
+    if (s_mixPcmKernel != mix_pcm_scalar && frequency <= SIMD_MAX_FREQUENCY && readable >= 4) {
+        uint64_t limit = (uint64_t)(readable - 3) << 23;  /* first unsafe position */
+        if (frequency == 0) {
+            vectorCount = count;
+        } else {
+            uint64_t safe = (limit - fw + frequency - 1) / frequency;
+            vectorCount = safe < (uint64_t)count ? (int)safe : count;
+        }
+    }
+
+    if (vectorCount > 0)
+        s_mixPcmKernel(ptr, fw, frequency, fixed, volL, volR, mixL, mixR, vectorCount);
+    if (vectorCount < count) {
+        uint64_t pos = fw + (uint64_t)vectorCount * frequency;
+        mix_pcm_scalar(ptr + (pos >> 23), (uint32_t)(pos & FW_MASK), frequency, fixed,
+                       volL, volR, mixL + vectorCount, mixR + vectorCount,
+                       count - vectorCount);
+    }
+}
+
+void m4a_mix_upsample(const int32_t *src, const int32_t *index, const int32_t *weight,
+                      int32_t *out, int count)
+{
+    s_upsampleKernel(src, index, weight, out, count);
+}
@@ -0,0 +1,54 @@
+#ifndef M4A_MIX_H
+#define M4A_MIX_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * DirectSound mixing kernels.
+ *
+ * The inner loops of the PCM mixer (interpolate, scale by the envelope
+ * volumes, accumulate into the stereo mix) and of the PCM-to-host-rate
+ * upsampler have scalar, SSE4.1 and AVX2 implementations.  The best ones the
+ * CPU supports are selected at startup; all of them produce bit-identical
+ * output.
+ */
+
+typedef enum {
+    M4A_SIMD_SCALAR = 0,
+    M4A_SIMD_SSE41  = 1,
+    M4A_SIMD_AVX2   = 2,
+} M4ASimdLevel;
+
+/* Select the best kernel for this CPU.  Runs the selection once per process
+ * and is safe to call from several threads; called by m4a_engine_init. */
+void m4a_mix_init(void);
+
+/* Force a kernel level (clamped to what the CPU supports); returns the level
+ * actually selected.  Used by tests and for A/B comparisons; not to be called
+ * while another thread is mixing. */
+M4ASimdLevel m4a_mix_set_simd_level(M4ASimdLevel level);
+M4ASimdLevel m4a_mix_get_simd_level(void);
+
+/*
+ * Mix `count` output samples of one channel into mixL/mixR (accumulating).
+ * Sample k reads ptr[(fw + k*frequency) >> 23] (and the next sample when
+ * interpolating), so the caller must ensure no loop/end boundary is crossed.
+ * `readable` is the number of bytes valid from ptr onward (including the
+ * guard sample); the vector kernels only touch samples within it.
+ */
+void m4a_mix_pcm_run(const int8_t *ptr, uint32_t fw, uint32_t frequency, bool fixed,
+                     int32_t volL, int32_t volR, int32_t *mixL, int32_t *mixR,
+                     int count, int32_t readable);
+
+/*
+ * Linear-interpolation upsampler kernel:
+ *   out[i] = src[index[i]] + (((src[index[i] + 1] - src[index[i]]) * weight[i] + 0x8000) >> 16)
+ * weight is a 16-bit fraction (0-65535); the result is rounded to nearest.
+ * |src[n+1] - src[n]| must stay below 2^15 so the product fits in 32 bits
+ * (the PCM mix is far smaller).
+ */
+void m4a_mix_upsample(const int32_t *src, const int32_t *index, const int32_t *weight,
+                      int32_t *out, int count);
+
+#endif /* M4A_MIX_H */
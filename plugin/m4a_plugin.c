@@ -2,6 +2,11 @@
 #include <string.h>
 #include <stdio.h>
 #include <stdarg.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#endif
 
 #include <clap/clap.h>
 #include <clap/ext/gui.h>
@@ -99,6 +104,16 @@ static void load_config_file(M4APluginData *data)
 
         if (strcmp(key, "log") == 0) {
             s_pluginLogPath = strdup(value); /* leak is fine for a dev diagnostic */
+        } else if (strcmp(key, "index_cache") == 0) {
+            /* Project index directory, or "off"; unset = the loader's default */
+            data->loaderConfig.noIndexCache = strcmp(value, "off") == 0;
+            if (!data->loaderConfig.noIndexCache)
+                snprintf(data->loaderConfig.indexCacheDir,
+                         sizeof(data->loaderConfig.indexCacheDir), "%s", value);
+        } else if (strcmp(key, "map_samples") == 0) {
+            /* Off by default: rebuilding a mapped sample while the host is
+             * running can crash it */
+            data->loaderConfig.mapSamples = atoi(value) != 0;
         } else if (strcmp(key, "project_root") == 0) {
             snprintf(data->projectRoot, sizeof(data->projectRoot), "%s", value);
         } else if (strcmp(key, "voicegroup") == 0) {
@@ -179,6 +194,337 @@ static void load_config_file(M4APluginData *data)
     fclose(f);
 }
 
+/* ---- Background voicegroup loading ----
+ *
+ * Voicegroups are loaded on a worker thread, so activating, restoring state
+ * or clicking Reload never blocks the host, and the old voicegroup keeps
+ * playing until the new one is ready.  Each group changes hands one way:
+ *
+ *   loader thread -> main thread   VgLoadJob.result, announced with
+ *                                  host->request_callback
+ *   main thread   -> audio thread  pendingVg, switched to at the start of a
+ *                                  block (audio_switch_voicegroup)
+ *   audio thread  -> main thread   retiredVg[], once no channel plays data
+ *                                  only the group holds
+ *
+ * At most one load runs at a time.  Asking for another meanwhile queues it:
+ * the running load's result is dropped when it finishes and the queued one
+ * starts with the settings current then.
+ *
+ * Instances playing the same voicegroup share its loaded data
+ * (voicegroup_acquire); each keeps its own copy of the voices for the
+ * voice editor (PluginVoicegroup).
+ */
+
+struct VgLoadJob {
+    char projectRoot[512];
+    char voicegroupName[256];
+    VoicegroupLoaderConfig config;
+    const clap_host_t *host;
+    PluginVoicegroup *result;
+    int finished;  /* set by the loader thread once result is final */
+#ifdef _WIN32
+    HANDLE thread;
+#else
+    pthread_t thread;
+#endif
+};
+
+/* pendingVg value asking the audio thread to play no voicegroup */
+static char s_noVoicegroup;
+#define VG_NONE ((PluginVoicegroup *)&s_noVoicegroup)
+
+/* Any thread: take a reference to the shared group and copy its voices. */
+static PluginVoicegroup *plugin_voicegroup_load(const char *projectRoot, const char *voicegroupName,
+                                                const VoicegroupLoaderConfig *config)
+{
+    LoadedVoiceGroup *shared = voicegroup_acquire(projectRoot, voicegroupName, config);
+    if (!shared)
+        return NULL;
+    PluginVoicegroup *vg = malloc(sizeof(PluginVoicegroup));
+    if (!vg) {
+        voicegroup_release(shared);
+        return NULL;
+    }
+    vg->shared = shared;
+    memcpy(vg->voices, shared->voices, sizeof(vg->voices));
+    return vg;
+}
+
+static void plugin_voicegroup_free(PluginVoicegroup *vg)
+{
+    if (!vg)
+        return;
+    voicegroup_release(vg->shared);
+    free(vg);
+}
+
+static void *load_job_run(void *arg)
+{
+    VgLoadJob *job = (VgLoadJob *)arg;
+    job->result = plugin_voicegroup_load(job->projectRoot, job->voicegroupName, &job->config);
+    __atomic_store_n(&job->finished, 1, __ATOMIC_RELEASE);
+    job->host->request_callback(job->host);
+    return NULL;
+}
+
+#ifdef _WIN32
+static DWORD WINAPI load_job_thread(LPVOID arg)
+{
+    load_job_run(arg);
+    return 0;
+}
+#endif
+
+static void load_job_join(VgLoadJob *job)
+{
+#ifdef _WIN32
+    WaitForSingleObject(job->thread, INFINITE);
+    CloseHandle(job->thread);
+#else
+    pthread_join(job->thread, NULL);
+#endif
+}
+
+/* Push the plugin's settings and voicegroup into the GUI. */
+static void gui_sync(M4APluginData *data)
+{
+    if (!data->gui)
+        return;
+    M4AGuiSettings gs;
+    memset(&gs, 0, sizeof(gs));
+    snprintf(gs.projectRoot,    sizeof(gs.projectRoot),    "%s", data->projectRoot);
+    snprintf(gs.voicegroupName, sizeof(gs.voicegroupName), "%s", data->voicegroupName);
+    gs.reverbAmount       = data->reverbAmount;
+    gs.masterVolume       = data->masterVolume;
+    gs.songMasterVolume   = data->songMasterVolume;
+    gs.analogFilter       = data->analogFilter;
+    gs.maxPcmChannels     = data->maxPcmChannels;
+    gs.pcmMixRate         = data->pcmMixRate;
+    gs.respectBaseMidiKey = data->respectBaseMidiKey;
+    gs.portamentoEnabled  = data->portamentoEnabled;
+    gs.pwmEnabled         = data->pwmEnabled;
+    gs.polyDebugInvert    = data->polyDebugInvert;
+    gs.voicegroupLoaded   = (data->loadedVg != NULL);
+    m4a_gui_update_settings(data->gui, &gs);
+    if (data->loadedVg)
+        m4a_gui_set_voice_data(data->gui, data->loadedVg->voices, data->originalVoices, data->voiceOverrides, data->loadedVg->shared->voiceNames);
+    else
+        m4a_gui_set_voice_data(data->gui, NULL, NULL, NULL, NULL);
+}
+
+/*
+ * Main thread: make vg (NULL = none) the plugin's voicegroup.  While active
+ * the audio thread switches to it at the start of its next block and
+ * retires the old one; otherwise it replaces the old one at once.
+ */
+static void set_voicegroup(M4APluginData *data, PluginVoicegroup *vg)
+{
+    if (data->activated) {
+        /* A group published earlier that the audio thread never took */
+        PluginVoicegroup *skipped = __atomic_exchange_n(&data->pendingVg, vg ? vg : VG_NONE,
+                                                        __ATOMIC_ACQ_REL);
+        if (skipped && skipped != VG_NONE)
+            plugin_voicegroup_free(skipped);
+    } else {
+        if (data->loadedVg)
+            plugin_voicegroup_free(data->loadedVg);
+        data->playingVg = vg;
+    }
+    data->loadedVg = vg;
+    if (vg)
+        memcpy(data->originalVoices, vg->voices, sizeof(data->originalVoices));
+    memset(data->voiceOverrides, 0, sizeof(data->voiceOverrides));
+    gui_sync(data);
+}
+
+/* Main thread: load the configured voicegroup in the background. */
+static void start_voicegroup_load(M4APluginData *data)
+{
+    if (data->loadJob) {
+        data->loadQueued = true;
+        return;
+    }
+    if (!data->projectRoot[0] || !data->voicegroupName[0])
+        return;
+
+    VgLoadJob *job = calloc(1, sizeof(VgLoadJob));
+    if (!job)
+        return;
+    snprintf(job->projectRoot,    sizeof(job->projectRoot),    "%s", data->projectRoot);
+    snprintf(job->voicegroupName, sizeof(job->voicegroupName), "%s", data->voicegroupName);
+    job->config = data->loaderConfig;
+    job->host   = data->host;
+
+#ifdef _WIN32
+    job->thread = CreateThread(NULL, 0, load_job_thread, job, 0, NULL);
+    bool started = job->thread != NULL;
+#else
+    bool started = pthread_create(&job->thread, NULL, load_job_run, job) == 0;
+#endif
+    if (!started) {
+        /* No thread to be had: load here, as before */
+        set_voicegroup(data, plugin_voicegroup_load(job->projectRoot, job->voicegroupName, &job->config));
+        free(job);
+        return;
+    }
+    data->loadJob = job;
+}
+
+/* Main thread: take the finished load, if any. */
+static void finish_voicegroup_load(M4APluginData *data)
+{
+    VgLoadJob *job = data->loadJob;
+    if (!job || !__atomic_load_n(&job->finished, __ATOMIC_ACQUIRE))
+        return;
+    load_job_join(job);
+    data->loadJob = NULL;
+
+    if (data->loadQueued) {
+        /* Loaded from settings that have since changed */
+        data->loadQueued = false;
+        if (job->result)
+            plugin_voicegroup_free(job->result);
+        free(job);
+        start_voicegroup_load(data);
+        return;
+    }
+    set_voicegroup(data, job->result);
+    free(job);
+}
+
+/* Main thread: free the groups the audio thread is done with. */
+static void free_retired_voicegroups(M4APluginData *data)
+{
+    for (int i = 0; i < VG_RETIRE_SLOTS; i++) {
+        PluginVoicegroup *vg = __atomic_exchange_n(&data->retiredVg[i], NULL, __ATOMIC_ACQUIRE);
+        if (vg)
+            plugin_voicegroup_free(vg);
+    }
+}
+
+/*
+ * Main thread, audio thread stopped (deactivated): free every group but
+ * loadedVg, which becomes playingVg again.
+ */
+static void settle_voicegroups(M4APluginData *data)
+{
+    PluginVoicegroup *pending = __atomic_exchange_n(&data->pendingVg, NULL, __ATOMIC_ACQUIRE);
+    if (pending && pending != VG_NONE && pending != data->loadedVg)
+        plugin_voicegroup_free(pending);
+    if (data->playingVg && data->playingVg != data->loadedVg)
+        plugin_voicegroup_free(data->playingVg);
+    data->playingVg = data->loadedVg;
+    for (int i = 0; i < VG_RETIRE_SLOTS; i++) {
+        if (data->retiringVg[i])
+            plugin_voicegroup_free(data->retiringVg[i]);
+        data->retiringVg[i] = NULL;
+    }
+    free_retired_voicegroups(data);
+}
+
+static bool group_has_wave(const LoadedVoiceGroup *group, const WaveData *wav)
+{
+    for (int w = 0; w < group->waveDataCount; w++)
+        if (group->waveDatas[w] == wav)
+            return true;
+    return false;
+}
+
+static bool group_has_prog_wave(const LoadedVoiceGroup *group, const uint32_t *wave)
+{
+    for (int w = 0; w < group->progWaveCount; w++)
+        if (group->progWaves[w] == wave)
+            return true;
+    return false;
+}
+
+/*
+ * Whether any sounding channel reads sample or wave data that vg would take
+ * with it when freed.  Data the playing group holds as well stays alive
+ * through it (samples are refcounted in the sample store), so a note on a
+ * sample both groups share does not keep vg around.
+ */
+static bool engine_plays_from(const M4AEngine *engine, const PluginVoicegroup *vg,
+                              const PluginVoicegroup *playing)
+{
+    const LoadedVoiceGroup *keep = playing ? playing->shared : NULL;
+    if (keep == vg->shared)
+        return false;
+    for (int i = 0; i < TOTAL_PCM_CHANNELS; i++) {
+        const M4APCMChannel *ch = &engine->pcmChannels[i];
+        if (!(ch->status & CHN_ON))
+            continue;
+        if (group_has_wave(vg->shared, ch->wav) && !(keep && group_has_wave(keep, ch->wav)))
+            return true;
+    }
+    for (int i = 0; i < TOTAL_CGB_CHANNELS; i++) {
+        const M4ACGBChannel *ch = &engine->cgbChannels[i];
+        if (!(ch->status & CHN_ON))
+            continue;
+        if (group_has_prog_wave(vg->shared, ch->wavePointer)
+            && !(keep && group_has_prog_wave(keep, ch->wavePointer)))
+            return true;
+    }
+    return false;
+}
+
+/*
+ * Audio thread, at the start of a block: hand retired groups nothing plays
+ * from any more back to the main thread, then switch to a newly published
+ * group.  Notes already sounding finish on the old group's samples; tracks
+ * pick the same programs from the new one.
+ */
+static void audio_switch_voicegroup(M4APluginData *data)
+{
+    bool handedBack = false;
+    for (int i = 0; i < VG_RETIRE_SLOTS; i++) {
+        if (!data->retiringVg[i] || engine_plays_from(&data->engine, data->retiringVg[i], data->playingVg))
+            continue;
+        for (int j = 0; j < VG_RETIRE_SLOTS; j++) {
+            if (!__atomic_load_n(&data->retiredVg[j], __ATOMIC_ACQUIRE)) {
+                __atomic_store_n(&data->retiredVg[j], data->retiringVg[i], __ATOMIC_RELEASE);
+                data->retiringVg[i] = NULL;
+                handedBack = true;
+                break;
+            }
+        }
+    }
+    if (handedBack)
+        data->host->request_callback(data->host);
+
+    if (!__atomic_load_n(&data->pendingVg, __ATOMIC_ACQUIRE))
+        return;
+    /* With every retire slot taken, keep the current group a while longer */
+    int slot = -1;
+    for (int i = 0; i < VG_RETIRE_SLOTS && slot < 0; i++)
+        if (!data->retiringVg[i])
+            slot = i;
+    if (slot < 0 && data->playingVg)
+        return;
+
+    PluginVoicegroup *vg = __atomic_exchange_n(&data->pendingVg, NULL, __ATOMIC_ACQ_REL);
+    if (!vg)
+        return;
+    if (vg == VG_NONE)
+        vg = NULL;
+    if (data->playingVg)
+        data->retiringVg[slot] = data->playingVg;
+    data->playingVg = vg;
+
+    M4AEngine *engine = &data->engine;
+    m4a_engine_set_voicegroup(engine, vg ? vg->voices : NULL);
+    if (vg) {
+        m4a_engine_refresh_voices(engine);
+    } else {
+        for (int i = 0; i < MAX_TRACKS; i++)
+            memset(&engine->tracks[i].currentVoice, 0, sizeof(ToneData));
+    }
+    /* Wave tables are cached by wave address, which a later group may reuse */
+    for (int i = 0; i < TOTAL_CGB_CHANNELS; i++)
+        engine->cgbChannels[i].waveTablePointer = NULL;
+}
+
 /* ---- Plugin lifecycle ---- */
 
 static bool plugin_init(const clap_plugin_t *plugin)
@@ -212,8 +558,16 @@ static void plugin_destroy(const clap_plugin_t *plugin)
 {
     M4APluginData *data = (M4APluginData *)plugin->plugin_data;
     /* GUI must already be destroyed by the host (gui->destroy before plugin->destroy) */
+    if (data->loadJob) {
+        load_job_join(data->loadJob);
+        if (data->loadJob->result)
+            plugin_voicegroup_free(data->loadJob->result);
+        free(data->loadJob);
+        data->loadJob = NULL;
+    }
+    settle_voicegroups(data);
     if (data->loadedVg) {
-        voicegroup_free(data->loadedVg);
+        plugin_voicegroup_free(data->loadedVg);
         data->loadedVg = NULL;
     }
     m4a_engine_destroy(&data->engine);
@@ -239,50 +593,16 @@ static bool plugin_activate(const clap_plugin_t *plugin, double sample_rate,
     m4a_engine_set_pcm_mix_rate(&data->engine, data->pcmMixRate);
     m4a_reverb_set_amount(&data->engine.reverb, data->reverbAmount);
 
-    /* If voicegroup is configured, load it */
-    if (data->projectRoot[0] && data->voicegroupName[0]) {
-        if (data->loadedVg) {
-            voicegroup_free(data->loadedVg);
-            data->loadedVg = NULL;
-        }
-        data->loadedVg = voicegroup_load(data->projectRoot, data->voicegroupName,
-                                         &data->loaderConfig);
-        if (data->loadedVg) {
-            m4a_engine_set_voicegroup(&data->engine, data->loadedVg->voices);
-            memcpy(data->originalVoices, data->loadedVg->voices, sizeof(data->originalVoices));
-            memset(data->voiceOverrides, 0, sizeof(data->voiceOverrides));
-        }
-    }
+    if (data->playingVg)
+        m4a_engine_set_voicegroup(&data->engine, data->playingVg->voices);
 
     data->activated = true;
 
-    /* Update voice data pointers for the GUI */
-    if (data->gui) {
-        if (data->loadedVg)
-            m4a_gui_set_voice_data(data->gui, data->loadedVg->voices, data->originalVoices, data->voiceOverrides, data->loadedVg->voiceNames);
-        else
-            m4a_gui_set_voice_data(data->gui, NULL, NULL, NULL, NULL);
-    }
+    /* Load the configured voicegroup unless it is already loaded or loading */
+    if (!data->loadedVg && !data->loadJob)
+        start_voicegroup_load(data);
 
-    /* Notify GUI of current voicegroup status */
-    if (data->gui) {
-        M4AGuiSettings gs;
-        memset(&gs, 0, sizeof(gs));
-        snprintf(gs.projectRoot,    sizeof(gs.projectRoot),    "%s", data->projectRoot);
-        snprintf(gs.voicegroupName, sizeof(gs.voicegroupName), "%s", data->voicegroupName);
-        gs.reverbAmount      = data->reverbAmount;
-        gs.masterVolume      = data->masterVolume;
-        gs.songMasterVolume  = data->songMasterVolume;
-        gs.analogFilter      = data->analogFilter;
-        gs.maxPcmChannels    = data->maxPcmChannels;
-        gs.pcmMixRate        = data->pcmMixRate;
-        gs.respectBaseMidiKey = data->respectBaseMidiKey;
-        gs.portamentoEnabled = data->portamentoEnabled;
-        gs.pwmEnabled        = data->pwmEnabled;
-        gs.polyDebugInvert   = data->polyDebugInvert;
-        gs.voicegroupLoaded  = (data->loadedVg != NULL);
-        m4a_gui_update_settings(data->gui, &gs);
-    }
+    gui_sync(data);
 
     return true;
 }
@@ -294,6 +614,7 @@ static void plugin_deactivate(const clap_plugin_t *plugin)
         m4a_gui_set_voice_data(data->gui, NULL, NULL, NULL, NULL);
     m4a_engine_destroy(&data->engine);
     data->activated = false;
+    settle_voicegroups(data);
 }
 
 static bool plugin_start_processing(const clap_plugin_t *plugin)
@@ -379,6 +700,8 @@ static clap_process_status plugin_process(const clap_plugin_t *plugin,
     if (!data->activated)
         return CLAP_PROCESS_ERROR;
 
+    audio_switch_voicegroup(data);
+
     /* Read tempo from host transport (MIDI meta event tempo) */
     if (process->transport
         && (process->transport->flags & CLAP_TRANSPORT_HAS_TEMPO)) {
@@ -406,6 +729,7 @@ static clap_process_status plugin_process(const clap_plugin_t *plugin,
     /* Process with sample-accurate event handling */
     uint32_t eventIdx = 0;
     uint32_t framePos = 0;
+    bool idle = true;  /* every rendered frame came from the engine's idle path */
 
     while (framePos < numFrames) {
         /* Process all events at current position */
@@ -444,11 +768,25 @@ static clap_process_status plugin_process(const clap_plugin_t *plugin,
         if (framesToRender > 0) {
             m4a_engine_process(&data->engine, outL + framePos, outR + framePos,
                               (int)framesToRender);
+            /* Each idle call is constant, but an event in between (e.g. a
+             * reverb change) can move the level, so compare across calls. */
+            idle = idle && data->engine.outputIdle && outL[framePos] == outL[0];
         }
 
         framePos = nextEventTime;
     }
 
+    /* Nothing sounded this block: tell the host the output is constant, and
+     * when it is true silence with no tail left, let it stop calling us until
+     * the next event arrives. */
+    if (idle && numFrames > 0) {
+        process->audio_outputs[0].constant_mask = 0x3;
+        if (m4a_engine_is_silent(&data->engine))
+            return CLAP_PROCESS_SLEEP;
+    } else {
+        process->audio_outputs[0].constant_mask = 0;
+    }
+
     return CLAP_PROCESS_CONTINUE;
 }
 
@@ -584,23 +922,13 @@ static bool state_load(const clap_plugin_t *plugin, const clap_istream_t *stream
     if (pcmMixRate < 0.0f) pcmMixRate = 0.0f;
     data->pcmMixRate = pcmMixRate;
 
+    /* Only reload the voicegroup if the project root or name actually changed */
+    bool vgChanged = strcmp(data->projectRoot,    prevRoot) != 0 ||
+                     strcmp(data->voicegroupName, prevName) != 0;
+    if (vgChanged && data->projectRoot[0] && data->voicegroupName[0])
+        start_voicegroup_load(data);
+
     if (data->activated) {
-        /* Only reload voicegroup if the project root or name actually changed */
-        bool vgChanged = strcmp(data->projectRoot,    prevRoot) != 0 ||
-                         strcmp(data->voicegroupName, prevName) != 0;
-        if (vgChanged && data->projectRoot[0] && data->voicegroupName[0]) {
-            if (data->loadedVg) {
-                voicegroup_free(data->loadedVg);
-                data->loadedVg = NULL;
-            }
-            data->loadedVg = voicegroup_load(data->projectRoot, data->voicegroupName,
-                                             &data->loaderConfig);
-            if (data->loadedVg) {
-                m4a_engine_set_voicegroup(&data->engine, data->loadedVg->voices);
-                memcpy(data->originalVoices, data->loadedVg->voices, sizeof(data->originalVoices));
-                memset(data->voiceOverrides, 0, sizeof(data->voiceOverrides));
-            }
-        }
         data->engine.masterVolume = data->masterVolume;
         data->engine.songMasterVolume = data->songMasterVolume;
         data->engine.analogFilter = data->analogFilter;
@@ -613,28 +941,7 @@ static bool state_load(const clap_plugin_t *plugin, const clap_istream_t *stream
     }
 
     /* Push restored values into the GUI so it reflects the loaded state */
-    if (data->gui) {
-        M4AGuiSettings gs;
-        memset(&gs, 0, sizeof(gs));
-        snprintf(gs.projectRoot,    sizeof(gs.projectRoot),    "%s", data->projectRoot);
-        snprintf(gs.voicegroupName, sizeof(gs.voicegroupName), "%s", data->voicegroupName);
-        gs.respectBaseMidiKey = data->respectBaseMidiKey;
-        gs.portamentoEnabled  = data->portamentoEnabled;
-        gs.pwmEnabled         = data->pwmEnabled;
-        gs.polyDebugInvert    = data->polyDebugInvert;
-        gs.reverbAmount     = data->reverbAmount;
-        gs.masterVolume     = data->masterVolume;
-        gs.songMasterVolume = data->songMasterVolume;
-        gs.analogFilter     = data->analogFilter;
-        gs.maxPcmChannels   = data->maxPcmChannels;
-        gs.pcmMixRate       = data->pcmMixRate;
-        gs.voicegroupLoaded = (data->loadedVg != NULL);
-        m4a_gui_update_settings(data->gui, &gs);
-        if (data->loadedVg)
-            m4a_gui_set_voice_data(data->gui, data->loadedVg->voices, data->originalVoices, data->voiceOverrides, data->loadedVg->voiceNames);
-        else
-            m4a_gui_set_voice_data(data->gui, NULL, NULL, NULL, NULL);
-    }
+    gui_sync(data);
 
     return true;
 }
@@ -731,14 +1038,13 @@ static void timer_on_timer(const clap_plugin_t *plugin, clap_id timer_id)
     }
 
     if (reloadVoicegroup) {
-        /* Update paths, then ask the host to deactivate/reactivate so the new
-         * voicegroup is loaded cleanly from the audio thread's perspective. */
+        /* Update paths and load in the background; the current voicegroup
+         * plays until the new one is ready. */
         snprintf(data->projectRoot,    sizeof(data->projectRoot),
                  "%s", gs.projectRoot);
         snprintf(data->voicegroupName, sizeof(data->voicegroupName),
                  "%s", gs.voicegroupName);
-        data->restartRequested = true;
-        data->host->request_restart(data->host);
+        start_voicegroup_load(data);
     }
 
     /* Register this change with the host's undo stack.
@@ -762,8 +1068,8 @@ static void timer_on_timer(const clap_plugin_t *plugin, clap_id timer_id)
             hostState->mark_dirty(data->host);
     }
 
-    /* Reflect updated status back into the GUI (voicegroupLoaded may change
-     * after request_restart completes, but update the rest immediately). */
+    /* Reflect updated status back into the GUI (voicegroupLoaded changes
+     * once a reload finishes, but update the rest immediately). */
     gs.voicegroupLoaded = (data->loadedVg != NULL);
     m4a_gui_update_settings(data->gui, &gs);
 }
@@ -850,7 +1156,7 @@ static bool gui_create(const clap_plugin_t *plugin, const char *api, bool is_flo
 
     /* Wire voice data pointers if voicegroup is already loaded */
     if (data->loadedVg)
-        m4a_gui_set_voice_data(data->gui, data->loadedVg->voices, data->originalVoices, data->voiceOverrides, data->loadedVg->voiceNames);
+        m4a_gui_set_voice_data(data->gui, data->loadedVg->voices, data->originalVoices, data->voiceOverrides, data->loadedVg->shared->voiceNames);
 
     plugin_log("gui_create: success");
 
@@ -1004,16 +1310,6 @@ static const clap_plugin_timer_support_t s_timer_support = {
     .on_timer = timer_on_timer,
 };
 
-/* Standalone helper: check and clear the restart-requested flag */
-bool m4a_plugin_take_restart_request(const clap_plugin_t *plugin)
-{
-    if (!plugin) return false;
-    M4APluginData *data = (M4APluginData *)plugin->plugin_data;
-    if (!data->restartRequested) return false;
-    data->restartRequested = false;
-    return true;
-}
-
 /* Standalone helper: check if the plugin's GUI window was closed by the user */
 bool m4a_plugin_gui_was_closed(const clap_plugin_t *plugin)
 {
@@ -1035,6 +1331,9 @@ static const void *plugin_get_extension(const clap_plugin_t *plugin, const char
 
 static void plugin_on_main_thread(const clap_plugin_t *plugin)
 {
+    M4APluginData *data = (M4APluginData *)plugin->plugin_data;
+    finish_voicegroup_load(data);
+    free_retired_voicegroups(data);
 }
 
 /* ---- Factory ---- */
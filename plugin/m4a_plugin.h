@@ -6,9 +6,26 @@
 #include "m4a_gui.h"
 #include <clap/clap.h>
 
+/* Voicegroups the audio thread can have swapped out while their samples are
+ * still sounding. */
+#define VG_RETIRE_SLOTS 4
+
+typedef struct VgLoadJob VgLoadJob;
+
+/* A voicegroup as one plugin instance plays it: the loaded group, shared
+ * read-only with every other instance using it (voicegroup_acquire), and
+ * this instance's own copy of its voices, which the voice editor changes. */
+typedef struct {
+    LoadedVoiceGroup *shared;
+    ToneData voices[VOICEGROUP_SIZE];
+} PluginVoicegroup;
+
 typedef struct {
     M4AEngine engine;
-    LoadedVoiceGroup *loadedVg;
+    /* The current voicegroup, as seen by the main thread (GUI, voice editor).
+     * The audio thread plays playingVg, which catches up with it at the start
+     * of a block; see "Background voicegroup loading" in m4a_plugin.c. */
+    PluginVoicegroup *loadedVg;
     VoicegroupLoaderConfig loaderConfig;
     char projectRoot[512];
     char voicegroupName[256];
@@ -39,9 +56,13 @@ typedef struct {
     M4AGuiState *gui;
     clap_id guiTimerId;
 
-    /* Set when the plugin calls request_restart (e.g. after Reload).
-     * The standalone polls this to perform the actual restart cycle. */
-    bool restartRequested;
+    /* Background voicegroup loading */
+    VgLoadJob *loadJob;       /* load in progress, NULL if none */
+    bool loadQueued;          /* another load was asked for meanwhile */
+    PluginVoicegroup *pendingVg;                      /* main -> audio (atomic) */
+    PluginVoicegroup *playingVg;                      /* audio thread's */
+    PluginVoicegroup *retiringVg[VG_RETIRE_SLOTS];    /* audio thread's */
+    PluginVoicegroup *retiredVg[VG_RETIRE_SLOTS];     /* audio -> main (atomic) */
 } M4APluginData;
 
 #endif /* M4A_PLUGIN_H */
@@ -40,6 +40,8 @@ void m4a_reverb_init(M4AReverb *reverb, float sampleRate, uint8_t amount)
     if (reverb->frameSize < 1) reverb->frameSize = 1;
     reverb->buffer = (int8_t *)calloc(delayLen * 2, sizeof(int8_t)); /* stereo */
     reverb->pos = 0;
+    reverb->steadyCount = delayLen;  /* all zero */
+    reverb->steadyValue = 0;
     reverb->amount = amount;
 }
 
@@ -55,6 +57,8 @@ void m4a_reverb_reset(M4AReverb *reverb)
     if (reverb->buffer)
         memset(reverb->buffer, 0, reverb->bufferSize * 2 * sizeof(int8_t));
     reverb->pos = 0;
+    reverb->steadyCount = reverb->bufferSize;
+    reverb->steadyValue = 0;
 }
 
 void m4a_reverb_set_amount(M4AReverb *reverb, uint8_t amount)
@@ -106,6 +110,15 @@ void m4a_reverb_process(M4AReverb *reverb, int32_t *sampleL, int32_t *sampleR)
     if (writeR > 127) writeR = 127;
     if (writeR < -128) writeR = -128;
 
+    /* Once a full buffer's worth of writes all had the same value, the whole
+     * delay line holds it; lets m4a_reverb_is_steady avoid scanning it. */
+    if (writeL == writeR && writeL == reverb->steadyValue) {
+        if (reverb->steadyCount < reverb->bufferSize)
+            reverb->steadyCount++;
+    } else {
+        reverb->steadyValue = (int8_t)writeL;
+        reverb->steadyCount = (writeL == writeR) ? 1 : 0;
+    }
     reverb->buffer[idx] = (int8_t)writeL;
     reverb->buffer[idx + 1] = (int8_t)writeR;
 
@@ -113,3 +126,44 @@ void m4a_reverb_process(M4AReverb *reverb, int32_t *sampleL, int32_t *sampleR)
     if (reverb->pos >= reverb->bufferSize)
         reverb->pos = 0;
 }
+
+bool m4a_reverb_is_steady(const M4AReverb *reverb, int32_t *level)
+{
+    if (!reverb->buffer || reverb->amount == 0) {
+        *level = 0;
+        return true;
+    }
+    if (reverb->steadyCount < reverb->bufferSize)
+        return false;
+
+    /* A delay line uniformly holding v stays put on silent input only if the
+     * 4-tap feedback reproduces v.  Besides 0, the arithmetic >> 9 rounds a
+     * small negative tail down onto itself (e.g. v = -1 for any amount), so
+     * the hardware mix settles on a tiny DC offset rather than silence. */
+    int32_t v = reverb->steadyValue;
+    if (((v * 4 * reverb->amount) >> 9) != v)
+        return false;
+    *level = v;
+    return true;
+}
+
+void m4a_reverb_skip(M4AReverb *reverb, int count)
+{
+    /* Silent input through a steady delay line writes the same values back,
+     * so only the position moves (and only when process() would have run). */
+    if (!reverb->buffer || reverb->amount == 0 || reverb->bufferSize <= 0)
+        return;
+    reverb->pos = (int)(((int64_t)reverb->pos + count) % reverb->bufferSize);
+}
+
+int m4a_reverb_tail_length(const M4AReverb *reverb)
+{
+    if (!reverb->buffer || reverb->amount == 0)
+        return 0;
+    /* Each pass through the delay line feeds 4 equal taps back through the
+     * >> 9; the rounding makes even amount 127 lose at least 1 per pass. */
+    int passes = 0;
+    for (int32_t v = 127; v > 0; passes++)
+        v = (v * 4 * reverb->amount) >> 9;
+    return passes * reverb->bufferSize;
+}
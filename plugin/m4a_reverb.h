@@ -2,12 +2,15 @@
 #define M4A_REVERB_H
 
 #include <stdint.h>
+#include <stdbool.h>
 
 typedef struct {
     int8_t *buffer;     /* stereo interleaved: L,R,L,R,... */
     int bufferSize;     /* total buffer size in samples (per channel) */
     int frameSize;      /* samples per VBlank, scaled to DAW rate (for 2nd tap pair) */
     int pos;
+    int steadyCount;    /* consecutive L/R writes equal to steadyValue */
+    int8_t steadyValue;
     uint8_t amount;     /* 0-127 */
 } M4AReverb;
 
@@ -17,4 +20,16 @@ void m4a_reverb_reset(M4AReverb *reverb);
 void m4a_reverb_set_amount(M4AReverb *reverb, uint8_t amount);
 void m4a_reverb_process(M4AReverb *reverb, int32_t *sampleL, int32_t *sampleR);
 
+/* True when, for silent input, the reverb output is a constant (*level):
+ * 0 when it is off or its tail has died out, or the small negative DC value
+ * its rounding can settle on. */
+bool m4a_reverb_is_steady(const M4AReverb *reverb, int32_t *level);
+/* Advance the delay line by `count` samples of silent input.  Equivalent to
+ * processing `count` zero samples; only valid while m4a_reverb_is_steady. */
+void m4a_reverb_skip(M4AReverb *reverb, int count);
+/* Number of samples for a full-scale tail to die out on silent input.  A
+ * negative tail can instead settle on a DC value (see m4a_reverb_is_steady),
+ * which at high amounts may be large and never decays. */
+int m4a_reverb_tail_length(const M4AReverb *reverb);
+
 #endif /* M4A_REVERB_H */
@@ -23,7 +23,6 @@
 #include "clap_proxy.h"
 
 extern "C" bool m4a_plugin_gui_was_closed(const clap_plugin_t *plugin);
-extern "C" bool m4a_plugin_take_restart_request(const clap_plugin_t *plugin);
 
 int main(int argc, char **argv)
 {
@@ -66,17 +65,6 @@ int main(int argc, char **argv)
         if (sah->callbackRequested.exchange(false))
             plugin->_plugin->on_main_thread(plugin->_plugin);
 
-        /* Restart audio/plugin when the user clicks Reload */
-        if (m4a_plugin_take_restart_request(plugin->_plugin))
-        {
-            sah->stopAudioThread();
-            /* stopAudioThread() sets running=false; reset it so the loop
-             * keeps running and startAudioThread() processes correctly. */
-            sah->running = true;
-            sah->finishedRunning = false;
-            sah->startAudioThread();
-        }
-
         /* Exit when the user closes the GUI window */
         if (m4a_plugin_gui_was_closed(plugin->_plugin))
         {
@@ -23,7 +23,6 @@
 #include "clap_proxy.h"
 
 extern "C" bool m4a_plugin_gui_was_closed(const clap_plugin_t *plugin);
-extern "C" bool m4a_plugin_take_restart_request(const clap_plugin_t *plugin);
 
 static std::shared_ptr<Clap::Plugin> g_plugin;
 static HWND g_msgWindow = nullptr;
@@ -127,17 +126,6 @@ int main(int argc, char **argv)
             plugin->_plugin->on_main_thread(plugin->_plugin);
         }
 
-        /* Restart audio/plugin when the user clicks Reload */
-        if (m4a_plugin_take_restart_request(plugin->_plugin))
-        {
-            sah->stopAudioThread();
-            /* stopAudioThread() sets running=false; reset it so the message
-             * loop keeps running and startAudioThread() processes correctly. */
-            sah->running = true;
-            sah->finishedRunning = false;
-            sah->startAudioThread();
-        }
-
         /* Exit when the user closes the GUI window */
         if (m4a_plugin_gui_was_closed(plugin->_plugin))
         {
@@ -8,6 +8,17 @@
 #include <stdarg.h>
 #include <dirent.h>
 #include <sys/stat.h>
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#include <direct.h>
+#include <process.h>
+#else
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#endif
 
 #ifdef _WIN32
 #define PATH_SEP '\\'
@@ -19,6 +30,7 @@
 #define MAX_PATH_LEN 512
 #define MAX_SYMBOL_LEN 256
 #define INITIAL_CAPACITY 64
+#define VG_ARENA_BLOCK_SIZE 16384
 
 #define MAX_DISCOVERED_PATHS 32
 
@@ -55,6 +67,20 @@ typedef struct {
     int count;
 } PathList;
 
+/* A file or directory discovery looked at, with its state at the time;
+ * the index cache (see index_load) is valid while none of them change. */
+typedef struct {
+    char *path;
+    int64_t mtime;  /* -1 = did not exist */
+    int64_t size;
+} IndexDep;
+
+typedef struct {
+    IndexDep *items;
+    int count;
+    int capacity;
+} IndexDeps;
+
 typedef struct {
     PathList directSoundDataFiles;   /* paths to direct_sound_data.inc files */
     PathList progWaveDataFiles;      /* paths to programmable_wave_data.inc files */
@@ -62,6 +88,7 @@ typedef struct {
     PathList voicegroupDirs;         /* directories with individual .inc/.s voicegroup files */
     PathList monolithicVGFiles;      /* files containing multiple voicegroups (voice_groups.inc) */
     PathList wavSampleDirs;          /* directories with .wav sample files */
+    IndexDeps *deps;                 /* where to record what was looked at, or NULL */
 } ProjectDiscovery;
 
 typedef struct {
@@ -70,80 +97,395 @@ typedef struct {
     int found;
 } VoicegroupLocation;
 
-/* ---- Symbol maps ---- */
+/* ---- String pool and hash tables ----
+ *
+ * Symbol names, paths and keysplit tables are copied into a StrPool: an arena
+ * (a chain of large blocks freed all at once) in which each distinct string
+ * is stored only once (interned).  StrTable maps strings to pointers with open
+ * addressing and linear probing on an FNV-1a hash, so a lookup costs one hash
+ * and, almost always, one strcmp.  Keys must stay valid for the table's
+ * lifetime, so they are interned strings.
+ */
+
+#define STR_POOL_BLOCK_SIZE 65536
+
+typedef struct ArenaBlock ArenaBlock;
 
 typedef struct {
-    char symbol[MAX_SYMBOL_LEN];
-    char filePath[MAX_PATH_LEN];
-} SymbolMapping;
+    const char *key;   /* NULL = empty slot */
+    uint32_t hash;
+    void *value;
+} StrTableSlot;
 
 typedef struct {
-    SymbolMapping *entries;
+    StrTableSlot *slots;
     int count;
-    int capacity;
+    int capacity;      /* 0 or a power of two */
+} StrTable;
+
+typedef struct {
+    ArenaBlock *blocks;
+    StrTable strings;  /* the interned strings; values unused */
+} StrPool;
+
+/* ---- Symbol maps ---- */
+
+typedef struct {
+    StrTable table;    /* symbol -> sample or wave path, both interned */
+    StrPool *pool;
 } SymbolMap;
 
 typedef struct {
-    char name[MAX_SYMBOL_LEN];
+    const char *name;  /* interned */
     int startingNote;
     uint8_t table[128];
     int maxNote;
 } KeySplitDef;
 
 typedef struct {
-    KeySplitDef *entries;
-    int count;
-    int capacity;
+    StrTable table;    /* name -> KeySplitDef, allocated from the pool */
+    StrPool *pool;
 } KeySplitMap;
 
 /* Forward declarations */
-static void symbol_map_init(SymbolMap *map);
+static void symbol_map_init(SymbolMap *map, StrPool *pool);
 static void symbol_map_free(SymbolMap *map);
 static void symbol_map_add(SymbolMap *map, const char *symbol, const char *path);
 static const char *symbol_map_find(const SymbolMap *map, const char *symbol);
 
-static void keysplit_map_init(KeySplitMap *map);
+static void keysplit_map_init(KeySplitMap *map, StrPool *pool);
 static void keysplit_map_free(KeySplitMap *map);
+static KeySplitDef *keysplit_map_add(KeySplitMap *map, const char *name);
 static KeySplitDef *keysplit_map_find(const KeySplitMap *map, const char *name);
 
 static int parse_direct_sound_data_file(const char *filePath, const char *projectRoot, SymbolMap *map);
 static int parse_programmable_wave_data_file(const char *filePath, const char *projectRoot, SymbolMap *map);
 static int parse_keysplit_tables_file(const char *filePath, KeySplitMap *map);
-static WaveData *load_wave_data_from_wav(const char *projectRoot, const char *relativeBinPath);
+static WaveData *load_wave_data_from_wav(const char *projectRoot, const char *relativeBinPath,
+                                          char *loadedPath, bool mapSamples);
+static WaveData *decode_bin_file(const char *fullPath, bool mapSamples);
 static WaveData *load_wav_from_path(const char *absoluteWavPath);
-static WaveData *load_wave_data(const char *projectRoot, const char *relativePath);
-static uint32_t *load_prog_wave(const char *projectRoot, const char *relativePath);
-/* ---- WaveData deduplication cache ---- */
+static WaveData *load_wave_data(const char *projectRoot, const char *relativePath,
+                                bool mapSamples);
+static uint32_t *load_prog_wave(const char *projectRoot, const char *relativePath,
+                                LoadedVoiceGroup *vg);
+/* ---- String pool and hash table implementation ---- */
+
+static uint32_t str_hash(const char *str)
+{
+    uint32_t h = 2166136261u;
+    for (const unsigned char *p = (const unsigned char *)str; *p; p++) {
+        h ^= *p;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+/* The slot holding `key`, or the empty slot where it would go. */
+static StrTableSlot *str_table_slot(const StrTable *t, const char *key, uint32_t hash)
+{
+    uint32_t mask = (uint32_t)t->capacity - 1;
+    for (uint32_t i = hash & mask; ; i = (i + 1) & mask) {
+        StrTableSlot *slot = &t->slots[i];
+        if (!slot->key || (slot->hash == hash && strcmp(slot->key, key) == 0))
+            return slot;
+    }
+}
+
+static StrTableSlot *str_table_lookup(const StrTable *t, const char *key)
+{
+    if (t->count == 0) return NULL;
+    StrTableSlot *slot = str_table_slot(t, key, str_hash(key));
+    return slot->key ? slot : NULL;
+}
+
+static void *str_table_get(const StrTable *t, const char *key)
+{
+    StrTableSlot *slot = str_table_lookup(t, key);
+    return slot ? slot->value : NULL;
+}
+
+/*
+ * Add `key` -> `value` unless `key` is already present, in which case the
+ * first value is kept (as the linear scans this replaces found the first
+ * definition).  Returns 0, or -1 when out of memory.
+ */
+static int str_table_add(StrTable *t, const char *key, void *value)
+{
+    if ((t->count + 1) * 4 > t->capacity * 3) {
+        int capacity = t->capacity ? t->capacity * 2 : INITIAL_CAPACITY;
+        StrTableSlot *slots = calloc((size_t)capacity, sizeof(StrTableSlot));
+        if (!slots) return -1;
+        StrTable grown = { slots, t->count, capacity };
+        for (int i = 0; i < t->capacity; i++)
+            if (t->slots[i].key)
+                *str_table_slot(&grown, t->slots[i].key, t->slots[i].hash) = t->slots[i];
+        free(t->slots);
+        *t = grown;
+    }
+    uint32_t hash = str_hash(key);
+    StrTableSlot *slot = str_table_slot(t, key, hash);
+    if (!slot->key) {
+        slot->key = key;
+        slot->hash = hash;
+        slot->value = value;
+        t->count++;
+    }
+    return 0;
+}
+
+static void str_table_free(StrTable *t)
+{
+    free(t->slots);
+    t->slots = NULL;
+    t->count = 0;
+    t->capacity = 0;
+}
+
+static void str_pool_init(StrPool *pool)
+{
+    pool->blocks = NULL;
+    pool->strings = (StrTable){ 0 };
+}
+
+static void arena_free(ArenaBlock **arena)
+{
+    while (*arena) {
+        ArenaBlock *next = (*arena)->next;
+        free(*arena);
+        *arena = next;
+    }
+}
+
+/* Allocate `size` bytes (8-byte aligned, not cleared) from an arena, adding
+ * a block of at least `blockSize` bytes when the newest one is full. */
+static void *arena_alloc(ArenaBlock **arena, size_t size, size_t blockSize)
+{
+    size = (size + 7) & ~(size_t)7;
+    ArenaBlock *b = *arena;
+    if (!b || b->size - b->used < size) {
+        if (size > blockSize) blockSize = size;
+        b = malloc(sizeof(ArenaBlock) + blockSize);
+        if (!b) return NULL;
+        b->next = *arena;
+        b->used = 0;
+        b->size = blockSize;
+        *arena = b;
+    }
+    void *p = (char *)b->data + b->used;
+    b->used += size;
+    return p;
+}
+
+static void str_pool_free(StrPool *pool)
+{
+    arena_free(&pool->blocks);
+    str_table_free(&pool->strings);
+}
+
+/* Allocate `size` bytes (8-byte aligned) that live as long as the pool. */
+static void *str_pool_alloc(StrPool *pool, size_t size)
+{
+    return arena_alloc(&pool->blocks, size, STR_POOL_BLOCK_SIZE);
+}
+
+/* The pool's copy of `str`, made on first use.  NULL when out of memory. */
+static const char *str_pool_intern(StrPool *pool, const char *str)
+{
+    StrTableSlot *slot = str_table_lookup(&pool->strings, str);
+    if (slot) return slot->key;
+    size_t len = strlen(str) + 1;
+    char *copy = str_pool_alloc(pool, len);
+    if (!copy) return NULL;
+    memcpy(copy, str, len);
+    if (str_table_add(&pool->strings, copy, NULL) != 0) return NULL;
+    return copy;
+}
+
+/* ---- WaveData deduplication cache ----
+ *
+ * Each sample file is decoded at most once per load.  Samples are found by
+ * the path they were referenced as and, failing that, by the identity of the
+ * file itself (device and inode, or the canonical path on Windows), so the
+ * same file reached through different paths -- a symlink, "..", a cry and a
+ * voice naming one .bin -- is still shared.
+ *
+ * Parsing only resolves samples.  Each file that has to be read becomes a
+ * SampleJob, and the voices using it hold a placeholder for it in
+ * ToneData::wav: the job's index, tagged with the low bit, which no real
+ * WaveData pointer has.  Once the whole voicegroup has been parsed the jobs
+ * are decoded on a few threads (sample_jobs_decode) and the placeholders
+ * replaced (sample_jobs_finish).
+ */
 
-#define WAVE_CACHE_CAPACITY 128
+typedef enum {
+    SAMPLE_FROM_SYMBOL,  /* a symbol's .bin path: its .wav if that loads, else the .bin */
+    SAMPLE_BIN_FILE,     /* a .bin path, relative to the project root */
+    SAMPLE_WAV_FILE,     /* an absolute .wav path */
+} SampleSource;
 
 typedef struct {
-    char absPath[MAX_PATH_LEN];
-    WaveData *wd;
-} WaveCacheEntry;
+    SampleSource source;
+    char path[MAX_PATH_LEN];
+    char loadedPath[MAX_PATH_LEN];  /* the file actually read */
+    WaveData *wd;                   /* the result, NULL if it failed */
+    int sharedRefs;                 /* cache hits on it, for the statistics */
+    bool unused;                    /* no voice the song plays needs it: not read */
+} SampleJob;
 
 typedef struct WaveCache {
-    WaveCacheEntry entries[WAVE_CACHE_CAPACITY];
-    int count;
+    StrPool keys;
+    StrTable byPath;               /* referenced absolute path -> WaveData */
+    StrTable byFile;               /* file identity -> WaveData */
+    const LoadedVoiceGroup *prev;  /* earlier load to take unchanged samples from */
+    const char *projectRoot;
+    bool mapSamples;               /* map .bin samples (VoicegroupLoaderConfig.mapSamples) */
+    SampleJob *jobs;               /* samples to decode once parsing is done */
+    int jobCount;
+    int jobCapacity;
+    /* Statistics, logged at the end of the load */
+    int decoded;                   /* samples read from disk */
+    int skipped;                   /* samples not read because the song does not use them */
+    int reused;                    /* samples taken from prev */
+    int pathHits;                  /* references found by path */
+    int fileHits;                  /* references found by file identity */
+    size_t sharedBytes;            /* sample memory the hits did not duplicate */
 } WaveCache;
 
-static void wave_cache_init(WaveCache *cache) { cache->count = 0; }
+static WaveData *sample_placeholder(int job)
+{
+    return (WaveData *)(((uintptr_t)job << 1) | 1);
+}
 
-static WaveData *wave_cache_find(const WaveCache *cache, const char *absPath)
+/* The job a placeholder stands for, or -1 for a real WaveData (or NULL). */
+static int sample_placeholder_job(const WaveData *wd)
 {
-    for (int i = 0; i < cache->count; i++)
-        if (strcmp(cache->entries[i].absPath, absPath) == 0)
-            return cache->entries[i].wd;
-    return NULL;
+    uintptr_t v = (uintptr_t)wd;
+    return (v & 1) ? (int)(v >> 1) : -1;
+}
+
+/* A placeholder for a new job reading `path`, or NULL when out of memory. */
+static WaveData *sample_job_add(WaveCache *cache, SampleSource source, const char *path)
+{
+    if (cache->jobCount >= cache->jobCapacity) {
+        int capacity = cache->jobCapacity ? cache->jobCapacity * 2 : INITIAL_CAPACITY;
+        SampleJob *jobs = realloc(cache->jobs, sizeof(SampleJob) * capacity);
+        if (!jobs) return NULL;
+        cache->jobs = jobs;
+        cache->jobCapacity = capacity;
+    }
+    SampleJob *job = &cache->jobs[cache->jobCount];
+    memset(job, 0, sizeof(SampleJob));
+    job->source = source;
+    snprintf(job->path, sizeof(job->path), "%s", path);
+    return sample_placeholder(cache->jobCount++);
+}
+
+static void wave_cache_init(WaveCache *cache)
+{
+    memset(cache, 0, sizeof(*cache));
+    str_pool_init(&cache->keys);
+}
+
+static void wave_cache_free(WaveCache *cache)
+{
+    free(cache->jobs);
+    str_table_free(&cache->byPath);
+    str_table_free(&cache->byFile);
+    str_pool_free(&cache->keys);
+}
+
+/*
+ * A key naming the file at `path` rather than the path.  Returns false if
+ * there is no such file.
+ */
+static bool wave_file_key(const char *path, char *key, size_t keySize)
+{
+    struct stat st;
+    if (stat(path, &st) != 0) return false;
+#ifdef _WIN32
+    /* No inode numbers: use the full path, case-folded. */
+    if (!_fullpath(key, path, keySize))
+        snprintf(key, keySize, "%s", path);
+    for (char *p = key; *p; p++)
+        *p = (char)tolower((unsigned char)*p);
+#else
+    snprintf(key, keySize, "%llx:%llx",
+             (unsigned long long)st.st_dev, (unsigned long long)st.st_ino);
+#endif
+    return true;
+}
+
+static void wave_cache_hit(WaveCache *cache, const WaveData *wd)
+{
+    int job = sample_placeholder_job(wd);
+    if (job >= 0)
+        cache->jobs[job].sharedRefs++;  /* counted once it is decoded */
+    else
+        cache->sharedBytes += sizeof(WaveData) + wd->size;
+}
+
+/* The sample already loaded for `refPath`. */
+static WaveData *wave_cache_find(WaveCache *cache, const char *refPath)
+{
+    WaveData *wd = str_table_get(&cache->byPath, refPath);
+    if (wd) {
+        cache->pathHits++;
+        wave_cache_hit(cache, wd);
+    }
+    return wd;
+}
+
+/* The sample already loaded from the file at `filePath`, under any path;
+ * remembered as `refPath` too. */
+static WaveData *wave_cache_find_file(WaveCache *cache, const char *refPath,
+                                      const char *filePath)
+{
+    char key[MAX_PATH_LEN];
+    if (cache->byFile.count == 0 || !wave_file_key(filePath, key, sizeof(key)))
+        return NULL;
+    WaveData *wd = str_table_get(&cache->byFile, key);
+    if (wd) {
+        const char *ref = str_pool_intern(&cache->keys, refPath);
+        if (ref)
+            str_table_add(&cache->byPath, ref, wd);
+        cache->fileHits++;
+        wave_cache_hit(cache, wd);
+    }
+    return wd;
+}
+
+/* Remember `wd` (or a placeholder), referenced as `refPath` and read from
+ * `filePath`. */
+static void wave_cache_insert(WaveCache *cache, const char *refPath,
+                              const char *filePath, WaveData *wd)
+{
+    const char *ref = str_pool_intern(&cache->keys, refPath);
+    if (ref)
+        str_table_add(&cache->byPath, ref, wd);
+    char key[MAX_PATH_LEN];
+    if (wave_file_key(filePath, key, sizeof(key))) {
+        const char *file = str_pool_intern(&cache->keys, key);
+        if (file)
+            str_table_add(&cache->byFile, file, wd);
+    }
 }
 
-static void wave_cache_insert(WaveCache *cache, const char *absPath, WaveData *wd)
+/*
+ * The sample the previous load (voicegroup_project_reload) read from `path`,
+ * if that file has not changed since.  Reused samples stay owned by the
+ * previous load until the new one succeeds.
+ */
+static WaveData *wave_cache_reuse(const WaveCache *cache, const char *path)
 {
-    if (cache->count >= WAVE_CACHE_CAPACITY) return;
-    strncpy(cache->entries[cache->count].absPath, absPath, MAX_PATH_LEN - 1);
-    cache->entries[cache->count].absPath[MAX_PATH_LEN - 1] = '\0';
-    cache->entries[cache->count].wd = wd;
-    cache->count++;
+    const LoadedVoiceGroup *prev = cache->prev;
+    if (!prev) return NULL;
+    for (int i = 0; i < prev->sourceFileCount; i++) {
+        const VgSourceFile *src = &prev->sourceFiles[i];
+        if (src->wave && strcmp(src->path, path) == 0)
+            return src->mtime == voicegroup_file_mtime(path) ? src->wave : NULL;
+    }
+    return NULL;
 }
 
 static int parse_voicegroup_file(const char *projectRoot, const char *filePath,
@@ -179,15 +521,186 @@ static void strip_comment(char *s)
     if (p) *p = '\0';
 }
 
-/* Helper: build a path */
-static void build_path(char *dest, size_t destSize, const char *base, const char *relative)
+/* ---- Assembly source reading ----
+ *
+ * The .inc/.s files are read whole -- mapped where possible -- and split
+ * into lines with memchr, each line handed out with its comment and
+ * surrounding whitespace already removed, in a buffer that grows to fit the
+ * longest line.
+ */
+
+typedef struct {
+    const char *data;
+    size_t size;
+    size_t pos;     /* start of the next line */
+    bool mapped;    /* data is a mapping of the file, else malloc'd */
+    char *line;     /* the line last returned by text_file_line */
+    size_t lineCapacity;
+} TextFile;
+
+static bool text_file_open(TextFile *tf, const char *path)
+{
+    memset(tf, 0, sizeof(*tf));
+    FILE *f = fopen(path, "rb");
+    if (!f) return false;
+    struct stat st;
+    if (fstat(fileno(f), &st) != 0 || st.st_size < 0) {
+        fclose(f);
+        return false;
+    }
+    tf->size = (size_t)st.st_size;
+    if (tf->size == 0) {
+        fclose(f);
+        return true;
+    }
+#ifndef _WIN32
+    void *view = mmap(NULL, tf->size, PROT_READ, MAP_PRIVATE, fileno(f), 0);
+    if (view != MAP_FAILED) {
+        tf->data = view;
+        tf->mapped = true;
+        fclose(f);
+        return true;
+    }
+#endif
+    char *buf = malloc(tf->size);
+    if (!buf || fread(buf, 1, tf->size, f) != tf->size) {
+        free(buf);
+        fclose(f);
+        return false;
+    }
+    tf->data = buf;
+    fclose(f);
+    return true;
+}
+
+static void text_file_close(TextFile *tf)
+{
+    free(tf->line);
+#ifndef _WIN32
+    if (tf->mapped) {
+        munmap((void *)tf->data, tf->size);
+        return;
+    }
+#endif
+    free((void *)tf->data);
+}
+
+/*
+ * The next line of tf, without its comment (@ or //) and leading and
+ * trailing whitespace, in a buffer owned by tf that stays valid until the
+ * next call.  NULL at the end of the file.
+ */
+static char *text_file_line(TextFile *tf)
+{
+    if (tf->pos >= tf->size) return NULL;
+    const char *start = tf->data + tf->pos;
+    size_t len = tf->size - tf->pos;
+    const char *nl = memchr(start, '\n', len);
+    if (nl) len = (size_t)(nl - start);
+    tf->pos += nl ? len + 1 : len;
+
+    const char *at = memchr(start, '@', len);
+    if (at) len = (size_t)(at - start);
+    for (const char *p = start; (p = memchr(p, '/', len - (size_t)(p - start))) != NULL; p++) {
+        if ((size_t)(p - start) + 1 < len && p[1] == '/') {
+            len = (size_t)(p - start);
+            break;
+        }
+    }
+    while (len > 0 && isspace((unsigned char)start[len - 1])) len--;
+    while (len > 0 && isspace((unsigned char)*start)) {
+        start++;
+        len--;
+    }
+    if (len + 1 > tf->lineCapacity) {
+        size_t capacity = len + 1 > MAX_LINE ? len + 1 : MAX_LINE;
+        char *grown = realloc(tf->line, capacity);
+        if (!grown) {
+            vg_log("text_file_line: out of memory for a %zu-byte line", len);
+            fprintf(stderr, "voicegroup_loader: out of memory reading a %zu-byte line\n", len);
+            return NULL;
+        }
+        tf->line = grown;
+        tf->lineCapacity = capacity;
+    }
+    memcpy(tf->line, start, len);
+    tf->line[len] = '\0';
+    return tf->line;
+}
+
+/* Voicegroup macros, each recognized with one lookup in a table indexed by
+ * the low 6 bits of the name's FNV-1a hash, which differ for every name. */
+typedef enum {
+    MACRO_NONE,
+    MACRO_VOICE_GROUP,
+    MACRO_DIRECTSOUND,
+    MACRO_DIRECTSOUND_NO_RESAMPLE,
+    MACRO_DIRECTSOUND_ALT,
+    MACRO_SQUARE_1,
+    MACRO_SQUARE_1_ALT,
+    MACRO_SQUARE_2,
+    MACRO_SQUARE_2_ALT,
+    MACRO_PROGRAMMABLE_WAVE,
+    MACRO_PROGRAMMABLE_WAVE_ALT,
+    MACRO_NOISE,
+    MACRO_NOISE_ALT,
+    MACRO_KEYSPLIT,
+    MACRO_KEYSPLIT_ALL,
+    MACRO_CRY,
+    MACRO_CRY_REVERSE,
+} VoiceMacro;
+
+static const struct {
+    const char *name;
+    VoiceMacro macro;
+} s_voiceMacros[64] = {
+    [37] = { "voice_group",                   MACRO_VOICE_GROUP },
+    [18] = { "voice_directsound",             MACRO_DIRECTSOUND },
+    [6]  = { "voice_directsound_no_resample", MACRO_DIRECTSOUND_NO_RESAMPLE },
+    [26] = { "voice_directsound_alt",         MACRO_DIRECTSOUND_ALT },
+    [49] = { "voice_square_1",                MACRO_SQUARE_1 },
+    [9]  = { "voice_square_1_alt",            MACRO_SQUARE_1_ALT },
+    [56] = { "voice_square_2",                MACRO_SQUARE_2 },
+    [60] = { "voice_square_2_alt",            MACRO_SQUARE_2_ALT },
+    [31] = { "voice_programmable_wave",       MACRO_PROGRAMMABLE_WAVE },
+    [59] = { "voice_programmable_wave_alt",   MACRO_PROGRAMMABLE_WAVE_ALT },
+    [28] = { "voice_noise",                   MACRO_NOISE },
+    [8]  = { "voice_noise_alt",               MACRO_NOISE_ALT },
+    [15] = { "voice_keysplit",                MACRO_KEYSPLIT },
+    [3]  = { "voice_keysplit_all",            MACRO_KEYSPLIT_ALL },
+    [27] = { "cry",                           MACRO_CRY },
+    [10] = { "cry_reverse",                   MACRO_CRY_REVERSE },
+};
+
+/* The macro a line starts with (its name followed by a space), pointing
+ * *args just past that space. */
+static VoiceMacro voice_macro(const char *line, const char **args)
+{
+    const char *space = strchr(line, ' ');
+    if (!space) return MACRO_NONE;
+    uint32_t h = 2166136261u;
+    for (const unsigned char *p = (const unsigned char *)line; p < (const unsigned char *)space; p++) {
+        h ^= *p;
+        h *= 16777619u;
+    }
+    const char *name = s_voiceMacros[h & 63].name;
+    size_t len = (size_t)(space - line);
+    if (!name || strncmp(name, line, len) != 0 || name[len] != '\0')
+        return MACRO_NONE;
+    *args = space + 1;
+    return s_voiceMacros[h & 63].macro;
+}
+
+/* Helper: build a path.  Returns false if it didn't fit in `dest`. */
+static bool build_path(char *dest, size_t destSize, const char *base, const char *relative)
 {
-    snprintf(dest, destSize, "%s%c%s", base, PATH_SEP, relative);
+    int n = snprintf(dest, destSize, "%s%c%s", base, PATH_SEP, relative);
     /* Normalize separators */
     for (char *p = dest; *p; p++) {
         if (*p == '/' || *p == '\\')
             *p = PATH_SEP;
     }
+    return n >= 0 && n < (int)destSize;
 }
 
 /* Helper: try to open a file path, return 1 if it exists, 0 otherwise */
@@ -240,6 +753,16 @@ static void vg_register_wavedata(LoadedVoiceGroup *vg, WaveData *wd)
     vg->waveDatas[vg->waveDataCount++] = wd;
 }
 
+/* Zeroed memory from vg's arena, freed with the voicegroup.  Allocations are
+ * laid out in parse order, so a program's sub-voicegroup, keysplit table and
+ * waves sit together. */
+static void *vg_alloc(LoadedVoiceGroup *vg, size_t size)
+{
+    void *p = arena_alloc(&vg->arena, size, VG_ARENA_BLOCK_SIZE);
+    if (p) memset(p, 0, size);
+    return p;
+}
+
 static void vg_register_progwave(LoadedVoiceGroup *vg, uint32_t *pw)
 {
     if (vg->progWaveCount >= vg->progWaveCapacity) {
@@ -267,71 +790,166 @@ static void vg_register_keysplittable(LoadedVoiceGroup *vg, uint8_t *ks)
     vg->keySplitTables[vg->keySplitTableCount++] = ks;
 }
 
+/*
+ * A file's or directory's modification time in nanoseconds and its size (0
+ * for a directory).  On Windows this reads the full FILETIME: stat() there
+ * only has whole seconds, which would miss a save within the same second as
+ * the previous one.
+ */
+static bool file_stamp(const char *path, int64_t *mtime, int64_t *size)
+{
+#ifdef _WIN32
+    WIN32_FILE_ATTRIBUTE_DATA fad;
+    if (!GetFileAttributesExA(path, GetFileExInfoStandard, &fad))
+        return false;
+    /* 100 ns ticks since 1601 -> nanoseconds since 1970 */
+    uint64_t ticks = ((uint64_t)fad.ftLastWriteTime.dwHighDateTime << 32) |
+                     fad.ftLastWriteTime.dwLowDateTime;
+    *mtime = ((int64_t)ticks - 116444736000000000LL) * 100;
+    *size = (fad.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) ? 0 :
+            (int64_t)(((uint64_t)fad.nFileSizeHigh << 32) | fad.nFileSizeLow);
+#else
+    struct stat st;
+    if (stat(path, &st) != 0)
+        return false;
+#if defined(__linux__)
+    *mtime = (int64_t)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+#elif defined(__APPLE__)
+    *mtime = (int64_t)st.st_mtimespec.tv_sec * 1000000000 + st.st_mtimespec.tv_nsec;
+#else
+    *mtime = (int64_t)st.st_mtime * 1000000000;
+#endif
+    *size = S_ISDIR(st.st_mode) ? 0 : (int64_t)st.st_size;
+#endif
+    return true;
+}
+
+int64_t voicegroup_file_mtime(const char *path)
+{
+    int64_t mtime, size;
+    return file_stamp(path, &mtime, &size) ? mtime : -1;
+}
+
+/* Helper: a file's or directory's current state, for IndexDep */
+static void index_dep_stamp(const char *path, int64_t *mtime, int64_t *size)
+{
+    if (!file_stamp(path, mtime, size)) {
+        *mtime = -1;
+        *size = 0;
+    }
+}
+
+/* Helper: note that discovery looked at `path` (a no-op unless recording) */
+static void disc_depend(ProjectDiscovery *disc, const char *path)
+{
+    IndexDeps *deps = disc->deps;
+    if (!deps) return;
+    if (deps->count >= deps->capacity) {
+        int capacity = deps->capacity ? deps->capacity * 2 : INITIAL_CAPACITY;
+        IndexDep *items = realloc(deps->items, sizeof(IndexDep) * capacity);
+        if (!items) return;
+        deps->items = items;
+        deps->capacity = capacity;
+    }
+    IndexDep *dep = &deps->items[deps->count];
+    dep->path = strdup(path);
+    if (!dep->path) return;
+    index_dep_stamp(path, &dep->mtime, &dep->size);
+    deps->count++;
+}
+
+static void index_deps_free(IndexDeps *deps)
+{
+    for (int i = 0; i < deps->count; i++)
+        free(deps->items[i].path);
+    free(deps->items);
+    deps->items = NULL;
+    deps->count = 0;
+    deps->capacity = 0;
+}
+
+/* Helper: record a file the voicegroup was built from (once per path) */
+static void vg_add_source(LoadedVoiceGroup *vg, const char *path, WaveData *wave)
+{
+    for (int i = 0; i < vg->sourceFileCount; i++)
+        if (strcmp(vg->sourceFiles[i].path, path) == 0)
+            return;
+    if (vg->sourceFileCount >= vg->sourceFileCapacity) {
+        vg->sourceFileCapacity = vg->sourceFileCapacity ? vg->sourceFileCapacity * 2 : INITIAL_CAPACITY;
+        vg->sourceFiles = realloc(vg->sourceFiles, sizeof(VgSourceFile) * vg->sourceFileCapacity);
+    }
+    VgSourceFile *src = &vg->sourceFiles[vg->sourceFileCount++];
+    strncpy(src->path, path, VG_MAX_PATH_LEN - 1);
+    src->path[VG_MAX_PATH_LEN - 1] = '\0';
+    src->mtime = voicegroup_file_mtime(path);
+    src->wave = wave;
+}
+
+static void vg_add_source_rel(LoadedVoiceGroup *vg, const char *projectRoot,
+                              const char *relativePath, WaveData *wave)
+{
+    char fullPath[MAX_PATH_LEN];
+    build_path(fullPath, sizeof(fullPath), projectRoot, relativePath);
+    vg_add_source(vg, fullPath, wave);
+}
+
 /*
  * Symbol map implementation
  */
-static void symbol_map_init(SymbolMap *map)
+static void symbol_map_init(SymbolMap *map, StrPool *pool)
 {
-    map->entries = NULL;
-    map->count = 0;
-    map->capacity = 0;
+    map->table = (StrTable){ 0 };
+    map->pool = pool;
 }
 
 static void symbol_map_free(SymbolMap *map)
 {
-    free(map->entries);
-    map->entries = NULL;
-    map->count = 0;
-    map->capacity = 0;
+    str_table_free(&map->table);
 }
 
 static void symbol_map_add(SymbolMap *map, const char *symbol, const char *path)
 {
-    if (map->count >= map->capacity) {
-        map->capacity = map->capacity ? map->capacity * 2 : INITIAL_CAPACITY;
-        map->entries = realloc(map->entries, sizeof(SymbolMapping) * map->capacity);
-    }
-    strncpy(map->entries[map->count].symbol, symbol, MAX_SYMBOL_LEN - 1);
-    map->entries[map->count].symbol[MAX_SYMBOL_LEN - 1] = '\0';
-    strncpy(map->entries[map->count].filePath, path, MAX_PATH_LEN - 1);
-    map->entries[map->count].filePath[MAX_PATH_LEN - 1] = '\0';
-    map->count++;
+    const char *key = str_pool_intern(map->pool, symbol);
+    const char *value = str_pool_intern(map->pool, path);
+    if (key && value)
+        str_table_add(&map->table, key, (void *)value);
 }
 
 static const char *symbol_map_find(const SymbolMap *map, const char *symbol)
 {
-    for (int i = 0; i < map->count; i++) {
-        if (strcmp(map->entries[i].symbol, symbol) == 0)
-            return map->entries[i].filePath;
-    }
-    return NULL;
+    return str_table_get(&map->table, symbol);
 }
 
 /*
  * Keysplit map implementation
  */
-static void keysplit_map_init(KeySplitMap *map)
+static void keysplit_map_init(KeySplitMap *map, StrPool *pool)
 {
-    map->entries = NULL;
-    map->count = 0;
-    map->capacity = 0;
+    map->table = (StrTable){ 0 };
+    map->pool = pool;
 }
 
 static void keysplit_map_free(KeySplitMap *map)
 {
-    free(map->entries);
-    map->entries = NULL;
-    map->count = 0;
-    map->capacity = 0;
+    str_table_free(&map->table);
+}
+
+/* A new, zeroed table named `name`.  If the name is already taken the
+ * earlier table stays the one found. */
+static KeySplitDef *keysplit_map_add(KeySplitMap *map, const char *name)
+{
+    KeySplitDef *def = str_pool_alloc(map->pool, sizeof(KeySplitDef));
+    const char *key = str_pool_intern(map->pool, name);
+    if (!def || !key) return NULL;
+    memset(def, 0, sizeof(KeySplitDef));
+    def->name = key;
+    str_table_add(&map->table, key, def);
+    return def;
 }
 
 static KeySplitDef *keysplit_map_find(const KeySplitMap *map, const char *name)
 {
-    for (int i = 0; i < map->count; i++) {
-        if (strcmp(map->entries[i].name, name) == 0)
-            return &map->entries[i];
-    }
-    return NULL;
+    return str_table_get(&map->table, name);
 }
 
 /* ---- Directory scanning helpers ---- */
@@ -361,7 +979,7 @@ static int dir_has_files_with_ext(const char *dirPath, const char *ext)
  * with voice_directsound, voice_square, voice_keysplit, etc.).
  * Quick heuristic: check first few matching files for voice macro keywords.
  */
-static int dir_has_voice_macros(const char *dirPath)
+static int dir_has_voice_macros(const char *dirPath, ProjectDiscovery *disc)
 {
     DIR *d = opendir(dirPath);
     if (!d) return 0;
@@ -375,6 +993,7 @@ static int dir_has_voice_macros(const char *dirPath)
         snprintf(filePath, sizeof(filePath), "%s%c%s", dirPath, PATH_SEP, ent->d_name);
         FILE *f = fopen(filePath, "r");
         if (!f) continue;
+        disc_depend(disc, filePath);
         char line[MAX_LINE];
         int lineCount = 0;
         while (fgets(line, sizeof(line), f) && lineCount < 50) {
@@ -445,6 +1064,7 @@ static void probe_keysplit_data_in_dir(const char *dirPath, ProjectDiscovery *ou
     char ksDir[MAX_PATH_LEN];
     snprintf(ksDir, sizeof(ksDir), "%s%ckeysplits", dirPath, PATH_SEP);
     if (is_directory(ksDir)) {
+        disc_depend(out, ksDir);
         DIR *d = opendir(ksDir);
         if (d) {
             struct dirent *ent;
@@ -470,7 +1090,9 @@ typedef struct {
 static void visit_for_voicegroup_and_wav_dirs(const char *dirPath, void *ctx)
 {
     CombinedDirVisitorCtx *vctx = (CombinedDirVisitorCtx *)ctx;
-    if (dir_has_voice_macros(dirPath))
+    /* The directory's mtime covers its entries being added, removed or renamed. */
+    disc_depend(vctx->disc, dirPath);
+    if (dir_has_voice_macros(dirPath, vctx->disc))
         pathlist_add(&vctx->disc->voicegroupDirs, dirPath);
     if (dir_has_files_with_ext(dirPath, ".wav"))
         pathlist_add(&vctx->disc->wavSampleDirs, dirPath);
@@ -482,8 +1104,9 @@ static void visit_for_voicegroup_and_wav_dirs(const char *dirPath, void *ctx)
  * Heuristic: file has multiple `<word>::` labels AND contains voice macros,
  * but is NOT just a list of .include directives pointing to a voicegroups/ subdir.
  */
-static int is_monolithic_voicegroup_file(const char *filePath)
+static int is_monolithic_voicegroup_file(const char *filePath, ProjectDiscovery *disc)
 {
+    disc_depend(disc, filePath);
     FILE *f = fopen(filePath, "r");
     if (!f) return 0;
 
@@ -523,26 +1146,34 @@ static int is_monolithic_voicegroup_file(const char *filePath)
 
 /* ---- Project discovery ---- */
 
+/*
+ * deps: if not NULL, receives every file and directory whose state the
+ * result depends on.
+ */
 static void discover_project(const char *projectRoot,
                              const VoicegroupLoaderConfig *cfg,
-                             ProjectDiscovery *out)
+                             ProjectDiscovery *out, IndexDeps *deps)
 {
     memset(out, 0, sizeof(ProjectDiscovery));
+    out->deps = deps;
 
     char path[MAX_PATH_LEN];
     char soundDir[MAX_PATH_LEN];
     build_path(soundDir, sizeof(soundDir), projectRoot, "sound");
     vg_log("discover_project: soundDir='%s' exists=%d", soundDir, is_directory(soundDir));
+    disc_depend(out, soundDir);
 
     /* 1. Config overrides first (prepended) */
     if (cfg) {
         for (int i = 0; i < cfg->soundDataPathCount && i < 8; i++) {
             build_path(path, sizeof(path), projectRoot, cfg->soundDataPaths[i]);
+            disc_depend(out, path);
             if (file_exists(path))
                 pathlist_add(&out->directSoundDataFiles, path);
         }
         for (int i = 0; i < cfg->voicegroupPathCount && i < 8; i++) {
             build_path(path, sizeof(path), projectRoot, cfg->voicegroupPaths[i]);
+            disc_depend(out, path);
             if (is_directory(path)) {
                 /* If it's a directory, add as voicegroup dir and scan for voice macros */
                 pathlist_add(&out->voicegroupDirs, path);
@@ -555,7 +1186,7 @@ static void discover_project(const char *projectRoot,
                         if (str_ends_with_ci(ent->d_name, ".inc") || str_ends_with_ci(ent->d_name, ".s")) {
                             char fpath[MAX_PATH_LEN];
                             snprintf(fpath, sizeof(fpath), "%s%c%s", path, PATH_SEP, ent->d_name);
-                            if (is_monolithic_voicegroup_file(fpath))
+                            if (is_monolithic_voicegroup_file(fpath, out))
                                 pathlist_add(&out->monolithicVGFiles, fpath);
                         }
                     }
@@ -564,12 +1195,13 @@ static void discover_project(const char *projectRoot,
                 probe_keysplit_data_in_dir(path, out);
             } else if (file_exists(path)) {
                 /* It's a file - check if it's monolithic or a voicegroup dir entry */
-                if (is_monolithic_voicegroup_file(path))
+                if (is_monolithic_voicegroup_file(path, out))
                     pathlist_add(&out->monolithicVGFiles, path);
             }
         }
         for (int i = 0; i < cfg->sampleDirCount && i < 8; i++) {
             build_path(path, sizeof(path), projectRoot, cfg->sampleDirs[i]);
+            disc_depend(out, path);
             if (is_directory(path))
                 pathlist_add(&out->wavSampleDirs, path);
         }
@@ -577,27 +1209,33 @@ static void discover_project(const char *projectRoot,
 
     /* 2. Standard direct_sound_data.inc, programmable_wave_data.inc, keysplit_tables.inc */
     build_path(path, sizeof(path), projectRoot, "sound/direct_sound_data.inc");
+    disc_depend(out, path);
     if (file_exists(path))
         pathlist_add(&out->directSoundDataFiles, path);
 
     build_path(path, sizeof(path), projectRoot, "sound/programmable_wave_data.inc");
+    disc_depend(out, path);
     if (file_exists(path))
         pathlist_add(&out->progWaveDataFiles, path);
 
     build_path(path, sizeof(path), projectRoot, "sound/keysplit_tables.inc");
+    disc_depend(out, path);
     if (file_exists(path))
         pathlist_add(&out->keySplitTableFiles, path);
 
     /* 3. Standard voicegroup directories */
     build_path(path, sizeof(path), projectRoot, "sound/voicegroups");
+    disc_depend(out, path);
     if (is_directory(path)) {
         pathlist_add(&out->voicegroupDirs, path);
         /* Also add keysplits/ and drumsets/ subdirs */
         char subPath[MAX_PATH_LEN];
         snprintf(subPath, sizeof(subPath), "%s%ckeysplits", path, PATH_SEP);
+        disc_depend(out, subPath);
         if (is_directory(subPath))
             pathlist_add(&out->voicegroupDirs, subPath);
         snprintf(subPath, sizeof(subPath), "%s%cdrumsets", path, PATH_SEP);
+        disc_depend(out, subPath);
         if (is_directory(subPath))
             pathlist_add(&out->voicegroupDirs, subPath);
     }
@@ -613,8 +1251,9 @@ static void discover_project(const char *projectRoot,
 
     /* 5. Check for monolithic voicegroup files */
     build_path(path, sizeof(path), projectRoot, "sound/voice_groups.inc");
+    disc_depend(out, path);
     vg_log("discover_project: checking monolithic '%s' exists=%d", path, file_exists(path));
-    if (file_exists(path) && is_monolithic_voicegroup_file(path))
+    if (file_exists(path) && is_monolithic_voicegroup_file(path, out))
         pathlist_add(&out->monolithicVGFiles, path);
 }
 
@@ -627,20 +1266,16 @@ static void discover_project(const char *projectRoot,
 static int parse_direct_sound_data_file(const char *filePath, const char *projectRoot, SymbolMap *map)
 {
     (void)projectRoot; /* paths inside the file are relative to projectRoot, stored as-is */
-    FILE *f = fopen(filePath, "r");
-    if (!f) {
+    TextFile tf;
+    if (!text_file_open(&tf, filePath)) {
         fprintf(stderr, "voicegroup_loader: cannot open %s\n", filePath);
         return -1;
     }
 
-    char line[MAX_LINE];
     char currentSymbol[MAX_SYMBOL_LEN] = {0};
+    char *trimmed;
 
-    while (fgets(line, sizeof(line), f)) {
-        strip_comment(line);
-        rtrim(line);
-        char *trimmed = ltrim(line);
-
+    while ((trimmed = text_file_line(&tf))) {
         /* Look for label:: lines */
         char *colonColon = strstr(trimmed, "::");
         if (colonColon && colonColon > trimmed) {
@@ -665,7 +1300,7 @@ static int parse_direct_sound_data_file(const char *filePath, const char *projec
         }
     }
 
-    fclose(f);
+    text_file_close(&tf);
     return 0;
 }
 
@@ -675,20 +1310,16 @@ static int parse_direct_sound_data_file(const char *filePath, const char *projec
 static int parse_programmable_wave_data_file(const char *filePath, const char *projectRoot, SymbolMap *map)
 {
     (void)projectRoot;
-    FILE *f = fopen(filePath, "r");
-    if (!f) {
+    TextFile tf;
+    if (!text_file_open(&tf, filePath)) {
         fprintf(stderr, "voicegroup_loader: cannot open %s\n", filePath);
         return -1;
     }
 
-    char line[MAX_LINE];
     char currentSymbol[MAX_SYMBOL_LEN] = {0};
+    char *trimmed;
 
-    while (fgets(line, sizeof(line), f)) {
-        strip_comment(line);
-        rtrim(line);
-        char *trimmed = ltrim(line);
-
+    while ((trimmed = text_file_line(&tf))) {
         char *colonColon = strstr(trimmed, "::");
         if (colonColon && colonColon > trimmed) {
             *colonColon = '\0';
@@ -711,7 +1342,7 @@ static int parse_programmable_wave_data_file(const char *filePath, const char *p
         }
     }
 
-    fclose(f);
+    text_file_close(&tf);
     return 0;
 }
 
@@ -720,38 +1351,29 @@ static int parse_programmable_wave_data_file(const char *filePath, const char *p
  */
 static int parse_keysplit_tables_file(const char *filePath, KeySplitMap *map)
 {
-    FILE *f = fopen(filePath, "r");
-    if (!f) {
+    TextFile tf;
+    if (!text_file_open(&tf, filePath)) {
         fprintf(stderr, "voicegroup_loader: cannot open %s\n", filePath);
         return -1;
     }
 
-    char line[MAX_LINE];
     KeySplitDef *current = NULL;
     int lastNote = 0;
+    char *trimmed;
 
-    while (fgets(line, sizeof(line), f)) {
-        strip_comment(line);
-        rtrim(line);
-        char *trimmed = ltrim(line);
-
+    while ((trimmed = text_file_line(&tf))) {
         if (strncmp(trimmed, "keysplit ", 9) == 0) {
             /* pokeemerald macro format: keysplit tableName, startNote */
             char name[MAX_SYMBOL_LEN];
             int startNote = 0;
             if (sscanf(trimmed + 9, "%[^,], %d", name, &startNote) >= 1) {
                 rtrim(name);
-                if (map->count >= map->capacity) {
-                    map->capacity = map->capacity ? map->capacity * 2 : INITIAL_CAPACITY;
-                    map->entries = realloc(map->entries, sizeof(KeySplitDef) * map->capacity);
-                }
-                current = &map->entries[map->count];
-                memset(current, 0, sizeof(KeySplitDef));
-                snprintf(current->name, MAX_SYMBOL_LEN, "keysplit_%s", name);
-                current->startingNote = startNote;
-                current->maxNote = 0;
+                char fullName[MAX_SYMBOL_LEN + 9];
+                snprintf(fullName, sizeof(fullName), "keysplit_%s", name);
+                current = keysplit_map_add(map, fullName);
+                if (current)
+                    current->startingNote = startNote;
                 lastNote = startNote;
-                map->count++;
             }
         } else if (strncmp(trimmed, "split ", 6) == 0 && current) {
             int index, endNote;
@@ -769,18 +1391,10 @@ static int parse_keysplit_tables_file(const char *filePath, KeySplitMap *map)
             int startNote = 0;
             if (sscanf(trimmed + 5, "%[^,], . - %d", name, &startNote) == 2) {
                 rtrim(name);
-                if (map->count >= map->capacity) {
-                    map->capacity = map->capacity ? map->capacity * 2 : INITIAL_CAPACITY;
-                    map->entries = realloc(map->entries, sizeof(KeySplitDef) * map->capacity);
-                }
-                current = &map->entries[map->count];
-                memset(current, 0, sizeof(KeySplitDef));
-                strncpy(current->name, name, MAX_SYMBOL_LEN - 1);
-                current->name[MAX_SYMBOL_LEN - 1] = '\0';
-                current->startingNote = startNote;
-                current->maxNote = 0;
+                current = keysplit_map_add(map, name);
+                if (current)
+                    current->startingNote = startNote;
                 lastNote = startNote;
-                map->count++;
             }
         } else if (strncmp(trimmed, ".byte ", 6) == 0 && current) {
             /* raw per-note byte values; strip_comment already removed the @ note annotation */
@@ -803,7 +1417,7 @@ static int parse_keysplit_tables_file(const char *filePath, KeySplitMap *map)
         }
     }
 
-    fclose(f);
+    text_file_close(&tf);
     return 0;
 }
 
@@ -833,10 +1447,10 @@ static void parse_all_keysplit_tables(const ProjectDiscovery *disc, KeySplitMap
 /* ---- Sample loading ---- */
 
 /*
- * Load a .wav file from an absolute path.
+ * Decode a .wav file from an absolute path.
  * Parses RIFF/WAVE fmt, smpl, agbp, agbl, and data chunks.
  */
-static WaveData *load_wav_from_path(const char *absoluteWavPath)
+static WaveData *decode_wav_file(const char *absoluteWavPath)
 {
     FILE *f = fopen(absoluteWavPath, "rb");
     if (!f) return NULL;
@@ -1085,7 +1699,8 @@ static WaveData *load_wav_from_path(const char *absoluteWavPath)
  * Derives the .wav path by replacing the .bin extension in relativeBinPath.
  * Falls back to load_wave_data() if the .wav is not found.
  */
-static WaveData *load_wave_data_from_wav(const char *projectRoot, const char *relativeBinPath)
+static WaveData *load_wave_data_from_wav(const char *projectRoot, const char *relativeBinPath,
+                                          char *loadedPath, bool mapSamples)
 {
     char relativeWavPath[MAX_PATH_LEN];
     strncpy(relativeWavPath, relativeBinPath, MAX_PATH_LEN - 1);
@@ -1097,43 +1712,313 @@ static WaveData *load_wave_data_from_wav(const char *projectRoot, const char *re
         ext = relativeWavPath + pathLen - 4;
 
     if (!ext) {
-        return load_wave_data(projectRoot, relativeBinPath);
+        build_path(loadedPath, MAX_PATH_LEN, projectRoot, relativeBinPath);
+        return load_wave_data(projectRoot, relativeBinPath, mapSamples);
     }
     ext[1] = 'w'; ext[2] = 'a'; ext[3] = 'v';
 
-    char fullPath[MAX_PATH_LEN];
-    build_path(fullPath, sizeof(fullPath), projectRoot, relativeWavPath);
-
-    WaveData *wd = load_wav_from_path(fullPath);
+    build_path(loadedPath, MAX_PATH_LEN, projectRoot, relativeWavPath);
+    WaveData *wd = load_wav_from_path(loadedPath);
     if (wd) return wd;
 
     /* .wav not found or failed — fall back to .bin loader */
-    return load_wave_data(projectRoot, relativeBinPath);
+    build_path(loadedPath, MAX_PATH_LEN, projectRoot, relativeBinPath);
+    return load_wave_data(projectRoot, relativeBinPath, mapSamples);
 }
 
+/* ---- Memory-mapped .bin samples ---- */
+
+#ifndef _WIN32
+/* A WaveData whose data points into a private mapping of its .bin file
+ * rather than at the bytes following it. */
+typedef struct {
+    WaveData wd;
+    void    *view;
+    size_t   viewSize;
+} MappedWaveData;
+
 /*
- * Load a .bin sample file (DirectSound wave data).
+ * Map a .bin sample instead of reading it.  The file is already a 16-byte
+ * header followed by the PCM, so data points straight into the mapping and
+ * the pages are shared with every other process mapping or reading the file.
+ * The mapping is private: storing the guard sample after the data (when the
+ * file doesn't already hold it) copies just that one page, and the whole
+ * view is read-only afterwards.
+ *
+ * Returns NULL when the sample has to be read instead: mapping failed, the
+ * file is shorter than its header says, or the guard sample would fall on a
+ * page wholly past the end of the file (touching that faults).
  */
-static WaveData *load_wave_data(const char *projectRoot, const char *relativePath)
+static WaveData *map_wave_data(const char *fullPath)
 {
-    char fullPath[MAX_PATH_LEN];
-    build_path(fullPath, sizeof(fullPath), projectRoot, relativePath);
-
-    FILE *f = fopen(fullPath, "rb");
-    if (!f) {
-        fprintf(stderr, "voicegroup_loader: cannot open sample %s\n", fullPath);
+    int fd = open(fullPath, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return NULL;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size < 16) {
+        close(fd);
         return NULL;
     }
 
+    size_t fileSize = (size_t)st.st_size;
+    size_t pageSize = (size_t)sysconf(_SC_PAGESIZE);
     uint8_t header[16];
-    if (fread(header, 1, 16, f) != 16) {
-        fprintf(stderr, "voicegroup_loader: short read on header %s\n", fullPath);
-        fclose(f);
+    if (pread(fd, header, 16, 0) != 16) {
+        close(fd);
+        return NULL;
+    }
+    uint32_t size = header[12] | (header[13] << 8) | (header[14] << 16) | ((uint32_t)header[15] << 24);
+    size_t guard = 16 + (size_t)size;
+    if (size == 0 || fileSize < guard || (fileSize == guard && guard % pageSize == 0)) {
+        close(fd);
         return NULL;
     }
 
-    uint16_t type = header[0] | (header[1] << 8);
-    uint32_t freq = header[4] | (header[5] << 8) | (header[6] << 16) | (header[7] << 24);
+    /* Mapping one byte past a file that ends mid-page is fine: the rest of
+     * the page reads as zeroes. */
+    size_t viewSize = fileSize > guard ? fileSize : guard + 1;
+    void *view = mmap(NULL, viewSize, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (view == MAP_FAILED)
+        return NULL;
+
+    MappedWaveData *mw = malloc(sizeof(MappedWaveData));
+    if (!mw) {
+        munmap(view, viewSize);
+        return NULL;
+    }
+    mw->view     = view;
+    mw->viewSize = viewSize;
+
+    WaveData *wd  = &mw->wd;
+    wd->type      = header[0] | (header[1] << 8);
+    wd->status    = header[2] | (header[3] << 8);
+    wd->freq      = header[4] | (header[5] << 8) | (header[6] << 16) | ((uint32_t)header[7] << 24);
+    wd->loopStart = header[8] | (header[9] << 8) | (header[10] << 16) | ((uint32_t)header[11] << 24);
+    wd->size      = size;
+    wd->data      = (int8_t *)view + 16;
+    if (wd->data[size] != wd->data[size - 1])
+        wd->data[size] = wd->data[size - 1];
+    mprotect(view, viewSize, PROT_READ);
+    return wd;
+}
+#endif
+
+/* Free a WaveData from decode_bin_file() or decode_wav_file(). */
+static void wave_data_free(WaveData *wd)
+{
+    if (!wd)
+        return;
+#ifndef _WIN32
+    if (wd->data != (int8_t *)(wd + 1)) {
+        MappedWaveData *mw = (MappedWaveData *)wd;
+        munmap(mw->view, mw->viewSize);
+    }
+#endif
+    free(wd);
+}
+
+/* ---- Process-wide sample store ----
+ *
+ * Every sample is read through the store, which hands out one shared,
+ * reference-counted WaveData per file for the whole process: voicegroups
+ * loaded by different plugin instances, or different voicegroups of one
+ * project, hold the same copy of a sample they have in common.  Files are
+ * told apart by identity (see wave_file_key) plus size and modification
+ * time, so an edited sample is read again while groups still holding the
+ * old version keep it.  Loaded voicegroups own one reference to each entry
+ * of their waveDatas; voicegroup_free() drops them.
+ */
+
+typedef struct StoredSample {
+    struct StoredSample *next;        /* in its byKey bucket */
+    struct StoredSample *nextByWave;  /* in its byWave bucket */
+    WaveData *wave;
+    int refs;
+    char key[];
+} StoredSample;
+
+#define SAMPLE_STORE_BUCKETS 4096
+
+static StoredSample *s_storeByKey[SAMPLE_STORE_BUCKETS];
+static StoredSample *s_storeByWave[SAMPLE_STORE_BUCKETS];
+#ifdef _WIN32
+static SRWLOCK s_storeLock = SRWLOCK_INIT;
+#define sample_store_lock()   AcquireSRWLockExclusive(&s_storeLock)
+#define sample_store_unlock() ReleaseSRWLockExclusive(&s_storeLock)
+#else
+static pthread_mutex_t s_storeLock = PTHREAD_MUTEX_INITIALIZER;
+#define sample_store_lock()   pthread_mutex_lock(&s_storeLock)
+#define sample_store_unlock() pthread_mutex_unlock(&s_storeLock)
+#endif
+
+static uint32_t sample_store_wave_bucket(const WaveData *wd)
+{
+    uintptr_t v = (uintptr_t)wd;
+    return (uint32_t)((v >> 4) ^ (v >> 16)) % SAMPLE_STORE_BUCKETS;
+}
+
+/* The store key for the file at `path` read as `kind` ('b' for a .bin read
+ * into memory, 'm' for a mapped .bin, 'w' for .wav).  Returns false if there
+ * is no such file. */
+static bool sample_store_key(char kind, const char *path, char *key, size_t keySize)
+{
+    char file[MAX_PATH_LEN];
+    int64_t mtime, size;
+    if (!wave_file_key(path, file, sizeof(file)) || !file_stamp(path, &mtime, &size))
+        return false;
+    return snprintf(key, keySize, "%c:%s:%llx:%llx", kind, file,
+                    (unsigned long long)size, (unsigned long long)mtime) < (int)keySize;
+}
+
+/* A new reference to the stored sample for `key`, or NULL. */
+static WaveData *sample_store_get(const char *key)
+{
+    WaveData *wd = NULL;
+    sample_store_lock();
+    for (StoredSample *e = s_storeByKey[str_hash(key) % SAMPLE_STORE_BUCKETS]; e; e = e->next) {
+        if (strcmp(e->key, key) == 0) {
+            e->refs++;
+            wd = e->wave;
+            break;
+        }
+    }
+    sample_store_unlock();
+    return wd;
+}
+
+/* Store a freshly decoded `wd` under `key` and return a reference to it --
+ * or to the sample another thread stored first, freeing `wd`. */
+static WaveData *sample_store_put(const char *key, WaveData *wd)
+{
+    size_t keyLen = strlen(key);
+    StoredSample *entry = malloc(sizeof(StoredSample) + keyLen + 1);
+    uint32_t bucket = str_hash(key) % SAMPLE_STORE_BUCKETS;
+    WaveData *existing = NULL;
+
+    sample_store_lock();
+    for (StoredSample *e = s_storeByKey[bucket]; e; e = e->next) {
+        if (strcmp(e->key, key) == 0) {
+            e->refs++;
+            existing = e->wave;
+            break;
+        }
+    }
+    if (!existing && entry) {
+        memcpy(entry->key, key, keyLen + 1);
+        entry->wave = wd;
+        entry->refs = 1;
+        entry->next = s_storeByKey[bucket];
+        s_storeByKey[bucket] = entry;
+        uint32_t wb = sample_store_wave_bucket(wd);
+        entry->nextByWave = s_storeByWave[wb];
+        s_storeByWave[wb] = entry;
+        entry = NULL;
+    }
+    sample_store_unlock();
+
+    free(entry);
+    if (existing) {
+        wave_data_free(wd);
+        return existing;
+    }
+    return wd;  /* stored, or unstored if out of memory */
+}
+
+/* Drop a reference to a sample from the store (or free an unstored one). */
+static void sample_store_release(WaveData *wd)
+{
+    if (!wd)
+        return;
+    StoredSample *dead = NULL;
+    bool stored = false;
+
+    sample_store_lock();
+    StoredSample **link = &s_storeByWave[sample_store_wave_bucket(wd)];
+    for (; *link; link = &(*link)->nextByWave) {
+        if ((*link)->wave == wd) {
+            stored = true;
+            if (--(*link)->refs == 0) {
+                dead = *link;
+                *link = dead->nextByWave;
+                StoredSample **k = &s_storeByKey[str_hash(dead->key) % SAMPLE_STORE_BUCKETS];
+                while (*k != dead)
+                    k = &(*k)->next;
+                *k = dead->next;
+            }
+            break;
+        }
+    }
+    sample_store_unlock();
+
+    if (dead) {
+        wave_data_free(dead->wave);
+        free(dead);
+    } else if (!stored) {
+        wave_data_free(wd);
+    }
+}
+
+/* Load a .wav sample from an absolute path, through the store. */
+static WaveData *load_wav_from_path(const char *absoluteWavPath)
+{
+    char key[MAX_PATH_LEN + 64];
+    if (!sample_store_key('w', absoluteWavPath, key, sizeof(key)))
+        return NULL;
+    WaveData *wd = sample_store_get(key);
+    if (wd)
+        return wd;
+    wd = decode_wav_file(absoluteWavPath);
+    return wd ? sample_store_put(key, wd) : NULL;
+}
+
+/* Load a .bin sample, through the store.  Mapped and read copies of a file
+ * are stored apart, so a caller that asked not to map never gets a mapping. */
+static WaveData *load_wave_data(const char *projectRoot, const char *relativePath,
+                                bool mapSamples)
+{
+    char fullPath[MAX_PATH_LEN];
+    build_path(fullPath, sizeof(fullPath), projectRoot, relativePath);
+    char key[MAX_PATH_LEN + 64];
+    if (!sample_store_key(mapSamples ? 'm' : 'b', fullPath, key, sizeof(key))) {
+        fprintf(stderr, "voicegroup_loader: cannot open sample %s\n", fullPath);
+        return NULL;
+    }
+    WaveData *wd = sample_store_get(key);
+    if (wd)
+        return wd;
+    wd = decode_bin_file(fullPath, mapSamples);
+    return wd ? sample_store_put(key, wd) : NULL;
+}
+
+/*
+ * Decode a .bin sample file (DirectSound wave data), mapping it if asked to.
+ */
+static WaveData *decode_bin_file(const char *fullPath, bool mapSamples)
+{
+#ifndef _WIN32
+    if (mapSamples) {
+        WaveData *mapped = map_wave_data(fullPath);
+        if (mapped)
+            return mapped;
+    }
+#endif
+
+    FILE *f = fopen(fullPath, "rb");
+    if (!f) {
+        fprintf(stderr, "voicegroup_loader: cannot open sample %s\n", fullPath);
+        return NULL;
+    }
+
+    uint8_t header[16];
+    if (fread(header, 1, 16, f) != 16) {
+        fprintf(stderr, "voicegroup_loader: short read on header %s\n", fullPath);
+        fclose(f);
+        return NULL;
+    }
+
+    uint16_t type = header[0] | (header[1] << 8);
+    uint32_t freq = header[4] | (header[5] << 8) | (header[6] << 16) | (header[7] << 24);
     uint32_t loopStart = header[8] | (header[9] << 8) | (header[10] << 16) | (header[11] << 24);
     uint32_t size = header[12] | (header[13] << 8) | (header[14] << 16) | (header[15] << 24);
 
@@ -1163,9 +2048,10 @@ static WaveData *load_wave_data(const char *projectRoot, const char *relativePat
 }
 
 /*
- * Load a .pcm programmable wave file (16 bytes = 32 4-bit samples).
+ * Load a .pcm programmable wave file (16 bytes = 32 4-bit samples) into vg.
  */
-static uint32_t *load_prog_wave(const char *projectRoot, const char *relativePath)
+static uint32_t *load_prog_wave(const char *projectRoot, const char *relativePath,
+                                LoadedVoiceGroup *vg)
 {
     char fullPath[MAX_PATH_LEN];
     build_path(fullPath, sizeof(fullPath), projectRoot, relativePath);
@@ -1176,20 +2062,17 @@ static uint32_t *load_prog_wave(const char *projectRoot, const char *relativePat
         return NULL;
     }
 
-    uint32_t *data = malloc(16);
-    if (!data) {
-        fclose(f);
-        return NULL;
-    }
-
-    if (fread(data, 1, 16, f) != 16) {
+    uint32_t wave[4];
+    if (fread(wave, 1, 16, f) != 16) {
         fprintf(stderr, "voicegroup_loader: short read on wave %s\n", fullPath);
-        free(data);
         fclose(f);
         return NULL;
     }
-
     fclose(f);
+
+    uint32_t *data = vg_alloc(vg, 16);
+    if (data)
+        memcpy(data, wave, 16);
     return data;
 }
 
@@ -1212,12 +2095,13 @@ static WaveData *resolve_sample_from_wav_dirs(const char *symbol,
 
 /*
  * Unified sample resolution: try symbol map first, then fallback to wav dirs.
- * Uses waveCache to avoid loading the same file more than once.
- * Registers newly loaded WaveData with vg; cache hits are NOT re-registered.
+ * Returns the sample for the voice to hold: one already in waveCache, one
+ * reused from the previous load, or a placeholder for a new SampleJob.
+ * Nothing is read here beyond checking which files exist.
  */
-static WaveData *resolve_and_load_sample(const char *projectRoot, const char *symbol,
-                                          const SymbolMap *dsMap, const ProjectDiscovery *disc,
-                                          LoadedVoiceGroup *vg, WaveCache *waveCache)
+static WaveData *resolve_sample(const char *projectRoot, const char *symbol,
+                                const SymbolMap *dsMap, const ProjectDiscovery *disc,
+                                LoadedVoiceGroup *vg, WaveCache *waveCache)
 {
     const char *samplePath = symbol_map_find(dsMap, symbol);
     if (samplePath) {
@@ -1237,10 +2121,24 @@ static WaveData *resolve_and_load_sample(const char *projectRoot, const char *sy
         WaveData *cached = wave_cache_find(waveCache, absWavPath);
         if (cached) return cached;
 
-        WaveData *wd = load_wave_data_from_wav(projectRoot, samplePath);
-        if (wd) {
-            vg_register_wavedata(vg, wd);
-            wave_cache_insert(waveCache, absWavPath, wd);
+        /* Same preference as load_wave_data_from_wav: the .wav, else the .bin */
+        char absBinPath[MAX_PATH_LEN];
+        build_path(absBinPath, sizeof(absBinPath), projectRoot, samplePath);
+        const char *filePath = file_exists(absWavPath) ? absWavPath
+                             : file_exists(absBinPath) ? absBinPath : NULL;
+        if (filePath) {
+            cached = wave_cache_find_file(waveCache, absWavPath, filePath);
+            if (cached) return cached;
+
+            WaveData *wd = wave_cache_reuse(waveCache, filePath);
+            if (wd) {
+                waveCache->reused++;
+                vg_add_source(vg, filePath, wd);
+            } else {
+                wd = sample_job_add(waveCache, SAMPLE_FROM_SYMBOL, samplePath);
+            }
+            if (wd)
+                wave_cache_insert(waveCache, absWavPath, filePath, wd);
             return wd;
         }
     }
@@ -1251,18 +2149,230 @@ static WaveData *resolve_and_load_sample(const char *projectRoot, const char *sy
             snprintf(wavPath, sizeof(wavPath), "%s%c%s.wav",
                      disc->wavSampleDirs.paths[i], PATH_SEP, symbol);
             WaveData *cached = wave_cache_find(waveCache, wavPath);
+            if (!cached)
+                cached = wave_cache_find_file(waveCache, wavPath, wavPath);
             if (cached) return cached;
-            WaveData *wd = load_wav_from_path(wavPath);
+            if (!file_exists(wavPath))
+                continue;
+            WaveData *wd = wave_cache_reuse(waveCache, wavPath);
             if (wd) {
-                vg_register_wavedata(vg, wd);
-                wave_cache_insert(waveCache, wavPath, wd);
-                return wd;
+                waveCache->reused++;
+                vg_add_source(vg, wavPath, wd);
+            } else {
+                wd = sample_job_add(waveCache, SAMPLE_WAV_FILE, wavPath);
             }
+            if (wd)
+                wave_cache_insert(waveCache, wavPath, wavPath, wd);
+            return wd;
+        }
+    }
+    return NULL;
+}
+
+/*
+ * A cry's sample: the raw .bin at samplePath, shared with any voice that
+ * loaded the same file.
+ */
+static WaveData *resolve_cry_sample(const char *projectRoot, const char *samplePath,
+                                    LoadedVoiceGroup *vg, WaveCache *waveCache)
+{
+    char absPath[MAX_PATH_LEN];
+    build_path(absPath, sizeof(absPath), projectRoot, samplePath);
+    WaveData *wd = wave_cache_find(waveCache, absPath);
+    if (!wd)
+        wd = wave_cache_find_file(waveCache, absPath, absPath);
+    if (wd) return wd;
+
+    wd = wave_cache_reuse(waveCache, absPath);
+    if (wd) {
+        waveCache->reused++;
+        vg_add_source(vg, absPath, wd);
+    } else {
+        wd = sample_job_add(waveCache, SAMPLE_BIN_FILE, samplePath);
+    }
+    if (wd)
+        wave_cache_insert(waveCache, absPath, absPath, wd);
+    return wd;
+}
+
+/* ---- Parallel sample decoding ---- */
+
+#define MAX_DECODE_THREADS 8
+
+typedef struct {
+    WaveCache *cache;
+    volatile long next;  /* next job to claim */
+} DecodeQueue;
+
+static void sample_job_decode(const WaveCache *cache, SampleJob *job)
+{
+    const char *projectRoot = cache->projectRoot;
+    switch (job->source) {
+    case SAMPLE_FROM_SYMBOL:
+        job->wd = load_wave_data_from_wav(projectRoot, job->path, job->loadedPath,
+                                          cache->mapSamples);
+        break;
+    case SAMPLE_BIN_FILE:
+        if (!build_path(job->loadedPath, sizeof(job->loadedPath), projectRoot, job->path)) {
+            job->wd = NULL;  /* the path doesn't fit: nothing could be read */
+            break;
         }
+        job->wd = load_wave_data(projectRoot, job->path, cache->mapSamples);
+        break;
+    case SAMPLE_WAV_FILE:
+        snprintf(job->loadedPath, sizeof(job->loadedPath), "%s", job->path);
+        job->wd = load_wav_from_path(job->path);
+        break;
+    }
+}
+
+static void *decode_worker(void *arg)
+{
+    DecodeQueue *q = (DecodeQueue *)arg;
+    for (;;) {
+#ifdef _WIN32
+        long i = InterlockedIncrement(&q->next) - 1;
+#else
+        long i = __atomic_fetch_add(&q->next, 1, __ATOMIC_RELAXED);
+#endif
+        if (i >= q->cache->jobCount) break;
+        if (!q->cache->jobs[i].unused)
+            sample_job_decode(q->cache, &q->cache->jobs[i]);
     }
     return NULL;
 }
 
+#ifdef _WIN32
+static DWORD WINAPI decode_thread(LPVOID arg)
+{
+    decode_worker(arg);
+    return 0;
+}
+#endif
+
+static int online_cpu_count(void)
+{
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return (int)info.dwNumberOfProcessors;
+#else
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? (int)n : 1;
+#endif
+}
+
+/*
+ * Decode every pending sample, on up to MAX_DECODE_THREADS threads (the
+ * calling one included).  If a thread cannot be started the others, or the
+ * caller alone, take its share.
+ */
+static void sample_jobs_decode(WaveCache *cache)
+{
+    DecodeQueue q = { cache, 0 };
+    int threads = online_cpu_count();
+    if (threads > MAX_DECODE_THREADS) threads = MAX_DECODE_THREADS;
+    if (threads > cache->jobCount - cache->skipped) threads = cache->jobCount - cache->skipped;
+
+#ifdef _WIN32
+    HANDLE workers[MAX_DECODE_THREADS];
+    int started = 0;
+    for (int i = 1; i < threads; i++) {
+        workers[started] = CreateThread(NULL, 0, decode_thread, &q, 0, NULL);
+        if (workers[started]) started++;
+    }
+    decode_worker(&q);
+    for (int i = 0; i < started; i++) {
+        WaitForSingleObject(workers[i], INFINITE);
+        CloseHandle(workers[i]);
+    }
+#else
+    pthread_t workers[MAX_DECODE_THREADS];
+    int started = 0;
+    for (int i = 1; i < threads; i++)
+        if (pthread_create(&workers[started], NULL, decode_worker, &q) == 0)
+            started++;
+    decode_worker(&q);
+    for (int i = 0; i < started; i++)
+        pthread_join(workers[i], NULL);
+#endif
+    vg_log("sample_jobs_decode: %d samples on %d threads", cache->jobCount - cache->skipped,
+           started + 1);
+}
+
+/* Helper: mark the sample a voice holds a placeholder for as needed */
+static void sample_job_use(WaveCache *cache, const ToneData *td)
+{
+    if (td->type & (VOICE_TYPE_CGB_MASK | VOICE_KEYSPLIT | VOICE_KEYSPLIT_ALL))
+        return;  /* not a sample voice */
+    int job = sample_placeholder_job(td->wav);
+    if (job >= 0)
+        cache->jobs[job].unused = false;
+}
+
+/*
+ * Leave out the jobs for samples no voice in `usage` needs.  A keysplit or
+ * drumkit voice needs only the sub-voices for the keys played on it.
+ */
+static void sample_jobs_select(WaveCache *cache, const LoadedVoiceGroup *vg,
+                               const VoicegroupUsage *usage)
+{
+    for (int i = 0; i < cache->jobCount; i++)
+        cache->jobs[i].unused = true;
+    for (int p = 0; p < VOICEGROUP_SIZE; p++) {
+        const ToneData *td = &vg->voices[p];
+        const ToneData *subGroup = (const ToneData *)td->subGroup;
+        for (int key = 0; key < VOICEGROUP_SIZE; key++) {
+            if (!(usage->keys[p][key >> 3] & (1u << (key & 7))))
+                continue;
+            if (td->type & VOICE_KEYSPLIT_ALL) {
+                if (subGroup)
+                    sample_job_use(cache, &subGroup[key]);
+            } else if (td->type & VOICE_KEYSPLIT) {
+                if (subGroup && td->keySplitTable)
+                    sample_job_use(cache, &subGroup[td->keySplitTable[key]]);
+            } else {
+                sample_job_use(cache, td);
+                break;  /* the key makes no difference */
+            }
+        }
+    }
+    for (int i = 0; i < cache->jobCount; i++)
+        if (cache->jobs[i].unused)
+            cache->skipped++;
+}
+
+/* Helper: the decoded sample a voice's placeholder stands for */
+static void sample_fixup(const WaveCache *cache, ToneData *td)
+{
+    if (td->type & (VOICE_TYPE_CGB_MASK | VOICE_KEYSPLIT | VOICE_KEYSPLIT_ALL))
+        return;  /* not a sample voice */
+    int job = sample_placeholder_job(td->wav);
+    if (job >= 0)
+        td->wav = cache->jobs[job].wd;
+}
+
+/*
+ * Hand the decoded samples to vg, and point every voice and sub-voicegroup
+ * voice holding a placeholder at its sample.
+ */
+static void sample_jobs_finish(WaveCache *cache, LoadedVoiceGroup *vg)
+{
+    for (int i = 0; i < cache->jobCount; i++) {
+        SampleJob *job = &cache->jobs[i];
+        if (!job->wd) continue;
+        cache->decoded++;
+        cache->sharedBytes += (size_t)job->sharedRefs * (sizeof(WaveData) + job->wd->size);
+        vg_register_wavedata(vg, job->wd);
+        vg_add_source(vg, job->loadedPath, job->wd);
+    }
+    for (int v = 0; v < VOICEGROUP_SIZE; v++)
+        sample_fixup(cache, &vg->voices[v]);
+    for (int g = 0; g < vg->subGroupCount; g++)
+        for (int v = 0; v < VOICEGROUP_SIZE; v++)
+            sample_fixup(cache, &vg->subGroups[g][v]);
+}
+
 /* ---- Flexible voicegroup finding ---- */
 
 /* Returns 1 if the last path component of dirPath equals name. */
@@ -1432,25 +2542,24 @@ static VoicegroupLocation find_voicegroup(const char *projectRoot,
 
     /* 4. Monolithic files: scan for <name>:: label */
     for (int i = 0; i < disc->monolithicVGFiles.count; i++) {
-        FILE *f = fopen(disc->monolithicVGFiles.paths[i], "r");
-        if (!f) continue;
+        TextFile tf;
+        if (!text_file_open(&tf, disc->monolithicVGFiles.paths[i])) continue;
 
         char searchLabel[MAX_SYMBOL_LEN + 4];
         snprintf(searchLabel, sizeof(searchLabel), "%s::", vgName);
+        size_t searchLen = strlen(searchLabel);
 
-        char line[MAX_LINE];
-        while (fgets(line, sizeof(line), f)) {
-            strip_comment(line);
-            char *trimmed = ltrim(line);
-            if (strstr(trimmed, searchLabel) == trimmed) {
+        char *trimmed;
+        while ((trimmed = text_file_line(&tf))) {
+            if (strncmp(trimmed, searchLabel, searchLen) == 0) {
                 strncpy(loc.filePath, disc->monolithicVGFiles.paths[i], MAX_PATH_LEN - 1);
                 strncpy(loc.label, vgName, MAX_SYMBOL_LEN - 1);
                 loc.found = 1;
-                fclose(f);
+                text_file_close(&tf);
                 return loc;
             }
         }
-        fclose(f);
+        text_file_close(&tf);
     }
 
     return loc;
@@ -1478,7 +2587,7 @@ static ToneData *load_sub_voicegroup(const char *projectRoot, const char *vgSymb
         return NULL;
     }
 
-    ToneData *subVg = calloc(VOICEGROUP_SIZE, sizeof(ToneData));
+    ToneData *subVg = vg_alloc(vg, sizeof(ToneData) * VOICEGROUP_SIZE);
     if (!subVg) return NULL;
 
     /* The parser writes into vg->voices/voiceNames, so save the caller's
@@ -1490,7 +2599,6 @@ static ToneData *load_sub_voicegroup(const char *projectRoot, const char *vgSymb
     if (!savedVoices || !savedNames) {
         free(savedVoices);
         free(savedNames);
-        free(subVg);
         return NULL;
     }
     memcpy(savedVoices, vg->voices, sizeof(vg->voices));
@@ -1507,10 +2615,8 @@ static ToneData *load_sub_voicegroup(const char *projectRoot, const char *vgSymb
     memcpy(vg->voiceNames, savedNames, sizeof(vg->voiceNames));
     free(savedVoices);
     free(savedNames);
-    if (parseResult != 0) {
-        free(subVg);
+    if (parseResult != 0)
         return NULL;
-    }
 
     vg_register_subgroup(vg, subVg);
     return subVg;
@@ -1556,34 +2662,33 @@ static int parse_voicegroup_file(const char *projectRoot, const char *filePath,
                                   WaveCache *waveCache)
 {
     vg_log("parse_voicegroup_file: '%s' label='%s'", filePath, startLabel ? startLabel : "(none)");
-    FILE *f = fopen(filePath, "r");
-    if (!f) {
+    TextFile tf;
+    if (!text_file_open(&tf, filePath)) {
         fprintf(stderr, "voicegroup_loader: cannot open %s\n", filePath);
         return -1;
     }
+    vg_add_source(vg, filePath, NULL);
 
-    char line[MAX_LINE];
     int voiceIndex = 0;
     int inSection = (startLabel == NULL); /* if no startLabel, parse from the beginning */
     int voicesParsedInSection = 0;
 
     /* If startLabel is set, build the search string */
     char searchLabel[MAX_SYMBOL_LEN + 4];
+    size_t searchLen = 0;
     if (startLabel) {
         snprintf(searchLabel, sizeof(searchLabel), "%s::", startLabel);
+        searchLen = strlen(searchLabel);
     }
 
-    while (fgets(line, sizeof(line), f) && voiceIndex < VOICEGROUP_SIZE) {
-        strip_comment(line);
-        rtrim(line);
-        char *trimmed = ltrim(line);
-
+    char *trimmed;
+    while (voiceIndex < VOICEGROUP_SIZE && (trimmed = text_file_line(&tf))) {
         if (trimmed[0] == '\0')
             continue;
 
         /* When looking for a start label, skip until we find it */
         if (startLabel && !inSection) {
-            if (strstr(trimmed, searchLabel) == trimmed) {
+            if (strncmp(trimmed, searchLabel, searchLen) == 0) {
                 inSection = 1;
             }
             continue;
@@ -1602,11 +2707,14 @@ static int parse_voicegroup_file(const char *projectRoot, const char *filePath,
             }
         }
 
+        const char *args = NULL;
+        VoiceMacro macro = voice_macro(trimmed, &args);
+
         /* Parse voice_group declaration for starting_note offset */
-        if (strncmp(trimmed, "voice_group ", 12) == 0) {
+        if (macro == MACRO_VOICE_GROUP) {
             char vgDeclName[MAX_SYMBOL_LEN];
             int startingNote = 0;
-            if (sscanf(trimmed + 12, "%[^,\n], %d", vgDeclName, &startingNote) >= 2) {
+            if (sscanf(args, "%[^,\n], %d", vgDeclName, &startingNote) >= 2) {
                 if (startingNote > 0 && startingNote < VOICEGROUP_SIZE)
                     voiceIndex = startingNote;
             }
@@ -1614,10 +2722,10 @@ static int parse_voicegroup_file(const char *projectRoot, const char *filePath,
         }
 
         /* voice_directsound variants */
-        if (strncmp(trimmed, "voice_directsound_no_resample ", 30) == 0) {
+        if (macro == MACRO_DIRECTSOUND_NO_RESAMPLE) {
             int key, pan, attack, decay, sustain, release;
             char sampleSymbol[MAX_SYMBOL_LEN];
-            if (sscanf(trimmed + 30, "%d, %d, %[^,], %d, %d, %d, %d",
+            if (sscanf(args, "%d, %d, %[^,], %d, %d, %d, %d",
                        &key, &pan, sampleSymbol, &attack, &decay, &sustain, &release) == 7) {
                 rtrim(sampleSymbol);
                 vg_set_voice_name(vg, voiceIndex, sampleSymbol);
@@ -1630,17 +2738,17 @@ static int parse_voicegroup_file(const char *projectRoot, const char *filePath,
                 td->sustain = (uint8_t)sustain;
                 td->release = (uint8_t)release;
 
-                WaveData *wd = resolve_and_load_sample(projectRoot, sampleSymbol, dsMap, disc, vg, waveCache);
+                WaveData *wd = resolve_sample(projectRoot, sampleSymbol, dsMap, disc, vg, waveCache);
                 if (wd) {
                     td->wav = wd;
                 }
             }
             voiceIndex++;
             voicesParsedInSection++;
-        } else if (strncmp(trimmed, "voice_directsound_alt ", 22) == 0) {
+        } else if (macro == MACRO_DIRECTSOUND_ALT) {
             int key, pan, attack, decay, sustain, release;
             char sampleSymbol[MAX_SYMBOL_LEN];
-            if (sscanf(trimmed + 22, "%d, %d, %[^,], %d, %d, %d, %d",
+            if (sscanf(args, "%d, %d, %[^,], %d, %d, %d, %d",
                        &key, &pan, sampleSymbol, &attack, &decay, &sustain, &release) == 7) {
                 rtrim(sampleSymbol);
                 vg_set_voice_name(vg, voiceIndex, sampleSymbol);
@@ -1653,17 +2761,17 @@ static int parse_voicegroup_file(const char *projectRoot, const char *filePath,
                 td->sustain = (uint8_t)sustain;
                 td->release = (uint8_t)release;
 
-                WaveData *wd = resolve_and_load_sample(projectRoot, sampleSymbol, dsMap, disc, vg, waveCache);
+                WaveData *wd = resolve_sample(projectRoot, sampleSymbol, dsMap, disc, vg, waveCache);
                 if (wd) {
                     td->wav = wd;
                 }
             }
             voiceIndex++;
             voicesParsedInSection++;
-        } else if (strncmp(trimmed, "voice_directsound ", 18) == 0) {
+        } else if (macro == MACRO_DIRECTSOUND) {
             int key, pan, attack, decay, sustain, release;
             char sampleSymbol[MAX_SYMBOL_LEN];
-            if (sscanf(trimmed + 18, "%d, %d, %[^,], %d, %d, %d, %d",
+            if (sscanf(args, "%d, %d, %[^,], %d, %d, %d, %d",
                        &key, &pan, sampleSymbol, &attack, &decay, &sustain, &release) == 7) {
                 rtrim(sampleSymbol);
                 vg_set_voice_name(vg, voiceIndex, sampleSymbol);
@@ -1676,7 +2784,7 @@ static int parse_voicegroup_file(const char *projectRoot, const char *filePath,
                 td->sustain = (uint8_t)sustain;
                 td->release = (uint8_t)release;
 
-                WaveData *wd = resolve_and_load_sample(projectRoot, sampleSymbol, dsMap, disc, vg, waveCache);
+                WaveData *wd = resolve_sample(projectRoot, sampleSymbol, dsMap, disc, vg, waveCache);
                 if (wd) {
                     td->wav = wd;
                 }
@@ -1685,9 +2793,9 @@ static int parse_voicegroup_file(const char *projectRoot, const char *filePath,
             voicesParsedInSection++;
         }
         /* voice_square_1 */
-        else if (strncmp(trimmed, "voice_square_1_alt ", 19) == 0) {
+        else if (macro == MACRO_SQUARE_1_ALT) {
             int key, pan, sweep, duty, attack, decay, sustain, release;
-            if (sscanf(trimmed + 19, "%d, %d, %d, %d, %d, %d, %d, %d",
+            if (sscanf(args, "%d, %d, %d, %d, %d, %d, %d, %d",
                        &key, &pan, &sweep, &duty, &attack, &decay, &sustain, &release) == 8) {
                 ToneData *td = &vg->voices[voiceIndex];
                 td->type = VOICE_SQUARE_1_ALT;
@@ -1701,9 +2809,9 @@ static int parse_voicegroup_file(const char *projectRoot, const char *filePath,
             }
             voiceIndex++;
             voicesParsedInSection++;
-        } else if (strncmp(trimmed, "voice_square_1 ", 15) == 0) {
+        } else if (macro == MACRO_SQUARE_1) {
             int key, pan, sweep, duty, attack, decay, sustain, release;
-            if (sscanf(trimmed + 15, "%d, %d, %d, %d, %d, %d, %d, %d",
+            if (sscanf(args, "%d, %d, %d, %d, %d, %d, %d, %d",
                        &key, &pan, &sweep, &duty, &attack, &decay, &sustain, &release) == 8) {
                 ToneData *td = &vg->voices[voiceIndex];
                 td->type = VOICE_SQUARE_1;
@@ -1719,9 +2827,9 @@ static int parse_voicegroup_file(const char *projectRoot, const char *filePath,
             voicesParsedInSection++;
         }
         /* voice_square_2 */
-        else if (strncmp(trimmed, "voice_square_2_alt ", 19) == 0) {
+        else if (macro == MACRO_SQUARE_2_ALT) {
             int key, pan, duty, attack, decay, sustain, release;
-            if (sscanf(trimmed + 19, "%d, %d, %d, %d, %d, %d, %d",
+            if (sscanf(args, "%d, %d, %d, %d, %d, %d, %d",
                        &key, &pan, &duty, &attack, &decay, &sustain, &release) == 7) {
                 ToneData *td = &vg->voices[voiceIndex];
                 td->type = VOICE_SQUARE_2_ALT;
@@ -1735,9 +2843,9 @@ static int parse_voicegroup_file(const char *projectRoot, const char *filePath,
             }
             voiceIndex++;
             voicesParsedInSection++;
-        } else if (strncmp(trimmed, "voice_square_2 ", 15) == 0) {
+        } else if (macro == MACRO_SQUARE_2) {
             int key, pan, duty, attack, decay, sustain, release;
-            if (sscanf(trimmed + 15, "%d, %d, %d, %d, %d, %d, %d",
+            if (sscanf(args, "%d, %d, %d, %d, %d, %d, %d",
                        &key, &pan, &duty, &attack, &decay, &sustain, &release) == 7) {
                 ToneData *td = &vg->voices[voiceIndex];
                 td->type = VOICE_SQUARE_2;
@@ -1753,10 +2861,10 @@ static int parse_voicegroup_file(const char *projectRoot, const char *filePath,
             voicesParsedInSection++;
         }
         /* voice_programmable_wave */
-        else if (strncmp(trimmed, "voice_programmable_wave_alt ", 27) == 0) {
+        else if (macro == MACRO_PROGRAMMABLE_WAVE_ALT) {
             int key, pan, attack, decay, sustain, release;
             char waveSymbol[MAX_SYMBOL_LEN];
-            if (sscanf(trimmed + 27, "%d, %d, %[^,], %d, %d, %d, %d",
+            if (sscanf(args, "%d, %d, %[^,], %d, %d, %d, %d",
                        &key, &pan, waveSymbol, &attack, &decay, &sustain, &release) == 7) {
                 rtrim(waveSymbol);
                 vg_set_voice_name(vg, voiceIndex, waveSymbol);
@@ -1770,19 +2878,20 @@ static int parse_voicegroup_file(const char *projectRoot, const char *filePath,
 
                 const char *wavePath = symbol_map_find(pwMap, waveSymbol);
                 if (wavePath) {
-                    uint32_t *pw = load_prog_wave(projectRoot, wavePath);
+                    uint32_t *pw = load_prog_wave(projectRoot, wavePath, vg);
                     if (pw) {
                         td->wavePointer = pw;
                         vg_register_progwave(vg, pw);
+                        vg_add_source_rel(vg, projectRoot, wavePath, NULL);
                     }
                 }
             }
             voiceIndex++;
             voicesParsedInSection++;
-        } else if (strncmp(trimmed, "voice_programmable_wave ", 23) == 0) {
+        } else if (macro == MACRO_PROGRAMMABLE_WAVE) {
             int key, pan, attack, decay, sustain, release;
             char waveSymbol[MAX_SYMBOL_LEN];
-            if (sscanf(trimmed + 23, "%d, %d, %[^,], %d, %d, %d, %d",
+            if (sscanf(args, "%d, %d, %[^,], %d, %d, %d, %d",
                        &key, &pan, waveSymbol, &attack, &decay, &sustain, &release) == 7) {
                 rtrim(waveSymbol);
                 vg_set_voice_name(vg, voiceIndex, waveSymbol);
@@ -1796,10 +2905,11 @@ static int parse_voicegroup_file(const char *projectRoot, const char *filePath,
 
                 const char *wavePath = symbol_map_find(pwMap, waveSymbol);
                 if (wavePath) {
-                    uint32_t *pw = load_prog_wave(projectRoot, wavePath);
+                    uint32_t *pw = load_prog_wave(projectRoot, wavePath, vg);
                     if (pw) {
                         td->wavePointer = pw;
                         vg_register_progwave(vg, pw);
+                        vg_add_source_rel(vg, projectRoot, wavePath, NULL);
                     }
                 }
             }
@@ -1807,9 +2917,9 @@ static int parse_voicegroup_file(const char *projectRoot, const char *filePath,
             voicesParsedInSection++;
         }
         /* voice_noise */
-        else if (strncmp(trimmed, "voice_noise_alt ", 16) == 0) {
+        else if (macro == MACRO_NOISE_ALT) {
             int key, pan, period, attack, decay, sustain, release;
-            if (sscanf(trimmed + 16, "%d, %d, %d, %d, %d, %d, %d",
+            if (sscanf(args, "%d, %d, %d, %d, %d, %d, %d",
                        &key, &pan, &period, &attack, &decay, &sustain, &release) == 7) {
                 ToneData *td = &vg->voices[voiceIndex];
                 td->type = VOICE_NOISE_ALT;
@@ -1822,9 +2932,9 @@ static int parse_voicegroup_file(const char *projectRoot, const char *filePath,
             }
             voiceIndex++;
             voicesParsedInSection++;
-        } else if (strncmp(trimmed, "voice_noise ", 12) == 0) {
+        } else if (macro == MACRO_NOISE) {
             int key, pan, period, attack, decay, sustain, release;
-            if (sscanf(trimmed + 12, "%d, %d, %d, %d, %d, %d, %d",
+            if (sscanf(args, "%d, %d, %d, %d, %d, %d, %d",
                        &key, &pan, &period, &attack, &decay, &sustain, &release) == 7) {
                 ToneData *td = &vg->voices[voiceIndex];
                 td->type = VOICE_NOISE;
@@ -1839,9 +2949,9 @@ static int parse_voicegroup_file(const char *projectRoot, const char *filePath,
             voicesParsedInSection++;
         }
         /* voice_keysplit */
-        else if (strncmp(trimmed, "voice_keysplit_all ", 19) == 0) {
+        else if (macro == MACRO_KEYSPLIT_ALL) {
             char vgSymbol[MAX_SYMBOL_LEN];
-            if (sscanf(trimmed + 19, "%s", vgSymbol) == 1) {
+            if (sscanf(args, "%s", vgSymbol) == 1) {
                 rtrim(vgSymbol);
                 vg_set_voice_name(vg, voiceIndex, vgSymbol);
                 ToneData *td = &vg->voices[voiceIndex];
@@ -1853,10 +2963,10 @@ static int parse_voicegroup_file(const char *projectRoot, const char *filePath,
             }
             voiceIndex++;
             voicesParsedInSection++;
-        } else if (strncmp(trimmed, "voice_keysplit ", 15) == 0) {
+        } else if (macro == MACRO_KEYSPLIT) {
             char vgSymbol[MAX_SYMBOL_LEN];
             char ksSymbol[MAX_SYMBOL_LEN];
-            if (sscanf(trimmed + 15, "%[^,], %s", vgSymbol, ksSymbol) == 2) {
+            if (sscanf(args, "%[^,], %s", vgSymbol, ksSymbol) == 2) {
                 rtrim(vgSymbol);
                 rtrim(ksSymbol);
                 vg_set_voice_name(vg, voiceIndex, vgSymbol);
@@ -1869,19 +2979,21 @@ static int parse_voicegroup_file(const char *projectRoot, const char *filePath,
 
                 KeySplitDef *ksDef = keysplit_map_find(ksMap, ksSymbol);
                 if (ksDef) {
-                    uint8_t *table = malloc(128);
-                    memcpy(table, ksDef->table, 128);
-                    td->keySplitTable = table;
-                    vg_register_keysplittable(vg, table);
+                    uint8_t *table = vg_alloc(vg, 128);
+                    if (table) {
+                        memcpy(table, ksDef->table, 128);
+                        td->keySplitTable = table;
+                        vg_register_keysplittable(vg, table);
+                    }
                 }
             }
             voiceIndex++;
             voicesParsedInSection++;
         }
         /* cry / cry_reverse */
-        else if (strncmp(trimmed, "cry_reverse ", 12) == 0) {
+        else if (macro == MACRO_CRY_REVERSE) {
             char sampleSymbol[MAX_SYMBOL_LEN];
-            if (sscanf(trimmed + 12, "%s", sampleSymbol) == 1) {
+            if (sscanf(args, "%s", sampleSymbol) == 1) {
                 rtrim(sampleSymbol);
                 vg_set_voice_name(vg, voiceIndex, sampleSymbol);
                 ToneData *td = &vg->voices[voiceIndex];
@@ -1893,19 +3005,14 @@ static int parse_voicegroup_file(const char *projectRoot, const char *filePath,
                 td->release = 0;
 
                 const char *samplePath = symbol_map_find(dsMap, sampleSymbol);
-                if (samplePath) {
-                    WaveData *wd = load_wave_data(projectRoot, samplePath);
-                    if (wd) {
-                        td->wav = wd;
-                        vg_register_wavedata(vg, wd);
-                    }
-                }
+                if (samplePath)
+                    td->wav = resolve_cry_sample(projectRoot, samplePath, vg, waveCache);
             }
             voiceIndex++;
             voicesParsedInSection++;
-        } else if (strncmp(trimmed, "cry ", 4) == 0) {
+        } else if (macro == MACRO_CRY) {
             char sampleSymbol[MAX_SYMBOL_LEN];
-            if (sscanf(trimmed + 4, "%s", sampleSymbol) == 1) {
+            if (sscanf(args, "%s", sampleSymbol) == 1) {
                 rtrim(sampleSymbol);
                 vg_set_voice_name(vg, voiceIndex, sampleSymbol);
                 ToneData *td = &vg->voices[voiceIndex];
@@ -1917,13 +3024,8 @@ static int parse_voicegroup_file(const char *projectRoot, const char *filePath,
                 td->release = 0;
 
                 const char *samplePath = symbol_map_find(dsMap, sampleSymbol);
-                if (samplePath) {
-                    WaveData *wd = load_wave_data(projectRoot, samplePath);
-                    if (wd) {
-                        td->wav = wd;
-                        vg_register_wavedata(vg, wd);
-                    }
-                }
+                if (samplePath)
+                    td->wav = resolve_cry_sample(projectRoot, samplePath, vg, waveCache);
             }
             voiceIndex++;
             voicesParsedInSection++;
@@ -1931,89 +3033,600 @@ static int parse_voicegroup_file(const char *projectRoot, const char *filePath,
     }
 
     vg_log("parse_voicegroup_file: done, voiceIndex=%d", voiceIndex);
-    fclose(f);
+    text_file_close(&tf);
     return 0;
 }
 
+/* ---- Project index cache ----
+ *
+ * voicegroup_project_open() saves what discovery found and the symbol maps
+ * it parsed to an index file in the user's cache directory, together with
+ * the modification time and size of every file and directory discovery
+ * looked at (IndexDeps).  While none of those have changed, the next open
+ * of the same project reads the index instead of scanning and parsing: one
+ * stat per dependency instead of a directory walk and a pass over every
+ * sound data file.  A stale, unreadable or foreign index is ignored and
+ * rewritten.
+ */
+
+#define INDEX_MAGIC   "poryaaaa-index\n"   /* 16 bytes with the NUL */
+#define INDEX_VERSION 2
+/* Numbers in the index are in host byte order; this mark, written as a
+ * host-order uint32, reads back differently on a host with the other one. */
+#define INDEX_BYTE_ORDER 0x01020304u
+
+static uint64_t fnv1a64(uint64_t h, const void *data, size_t len)
+{
+    const unsigned char *p = (const unsigned char *)data;
+    for (size_t i = 0; i < len; i++) {
+        h ^= p[i];
+        h *= 1099511628211ull;
+    }
+    return h;
+}
+
+static uint64_t fnv1a64_str(uint64_t h, const char *str)
+{
+    return fnv1a64(h, str, strlen(str) + 1);
+}
+
+/* Helper: create a directory and any missing parents */
+static void make_dirs(const char *path)
+{
+    char tmp[MAX_PATH_LEN + 32];
+    snprintf(tmp, sizeof(tmp), "%s", path);
+    for (char *p = tmp + 1; ; p++) {
+        if (*p == '/' || *p == '\\' || *p == '\0') {
+            char c = *p;
+            *p = '\0';
+#ifdef _WIN32
+            _mkdir(tmp);
+#else
+            mkdir(tmp, 0755);
+#endif
+            *p = c;
+            if (!c) break;
+        }
+    }
+}
+
 /*
- * Main entry point: load a voicegroup from a project.
+ * The index file for this project root and configuration, in
+ * cfg->indexCacheDir or the platform's per-user cache directory.  Returns false
+ * if the index is turned off or there is nowhere to put it.  canonicalRoot
+ * receives the absolute project root.
  */
-LoadedVoiceGroup *voicegroup_load(const char *projectRoot, const char *voicegroupName,
-                                   const VoicegroupLoaderConfig *config)
+static bool index_cache_path(const char *projectRoot, const VoicegroupLoaderConfig *cfg,
+                             char *out, size_t outSize, char *canonicalRoot)
 {
-    vg_log("voicegroup_load: start root='%s' vg='%s'", projectRoot, voicegroupName);
+    char dir[MAX_PATH_LEN];
+    const char *env;
+    if (cfg && cfg->noIndexCache) {
+        return false;
+    } else if (cfg && cfg->indexCacheDir[0]) {
+        snprintf(dir, sizeof(dir), "%s", cfg->indexCacheDir);
+#ifdef _WIN32
+    } else if ((env = getenv("LOCALAPPDATA")) && env[0]) {
+        snprintf(dir, sizeof(dir), "%s\\poryaaaa", env);
+#else
+    } else if ((env = getenv("XDG_CACHE_HOME")) && env[0]) {
+        snprintf(dir, sizeof(dir), "%s/poryaaaa", env);
+    } else if ((env = getenv("HOME")) && env[0]) {
+#ifdef __APPLE__
+        snprintf(dir, sizeof(dir), "%s/Library/Caches/poryaaaa", env);
+#else
+        snprintf(dir, sizeof(dir), "%s/.cache/poryaaaa", env);
+#endif
+#endif
+    } else {
+        return false;
+    }
 
-    LoadedVoiceGroup *vg = calloc(1, sizeof(LoadedVoiceGroup));
-    if (!vg) return NULL;
+#ifdef _WIN32
+    if (!_fullpath(canonicalRoot, projectRoot, MAX_PATH_LEN))
+        return false;
+#else
+    char resolved[PATH_MAX];
+    if (!realpath(projectRoot, resolved) || strlen(resolved) >= MAX_PATH_LEN)
+        return false;
+    strcpy(canonicalRoot, resolved);
+#endif
 
-    /* Heap-allocate ProjectDiscovery: ~96 KB on the stack would risk overflow
-     * in Reaper's plugin-load thread (Windows default: 1 MB stack). */
-    ProjectDiscovery *disc = calloc(1, sizeof(ProjectDiscovery));
-    if (!disc) {
-        voicegroup_free(vg);
-        return NULL;
+    /* The discovered paths are spelled with projectRoot as given, so it is
+     * part of the key along with where it points and the configuration. */
+    uint64_t h = 14695981039346656037ull;
+    h = fnv1a64_str(h, canonicalRoot);
+    h = fnv1a64_str(h, projectRoot);
+    if (cfg) {
+        for (int i = 0; i < cfg->soundDataPathCount && i < 8; i++)
+            h = fnv1a64_str(fnv1a64(h, "d", 1), cfg->soundDataPaths[i]);
+        for (int i = 0; i < cfg->voicegroupPathCount && i < 8; i++)
+            h = fnv1a64_str(fnv1a64(h, "v", 1), cfg->voicegroupPaths[i]);
+        for (int i = 0; i < cfg->sampleDirCount && i < 8; i++)
+            h = fnv1a64_str(fnv1a64(h, "s", 1), cfg->sampleDirs[i]);
     }
+    return snprintf(out, outSize, "%s%cindex-%016llx.bin", dir, PATH_SEP,
+                    (unsigned long long)h) < (int)outSize;
+}
 
-    /* Discover project structure */
-    vg_log("voicegroup_load: calling discover_project");
-    discover_project(projectRoot, config, disc);
-    vg_log("voicegroup_load: discover done - dsFiles=%d pwFiles=%d ksFiles=%d vgDirs=%d monoFiles=%d wavDirs=%d",
-           disc->directSoundDataFiles.count, disc->progWaveDataFiles.count,
-           disc->keySplitTableFiles.count, disc->voicegroupDirs.count,
-           disc->monolithicVGFiles.count, disc->wavSampleDirs.count);
+/* Index writing: host byte order, strings as a 16-bit length and bytes. */
 
-    /* Per-load WaveData deduplication cache */
-    WaveCache waveCache;
-    wave_cache_init(&waveCache);
+static void index_put(FILE *f, const void *data, size_t len)
+{
+    fwrite(data, 1, len, f);
+}
+
+static void index_put_u32(FILE *f, uint32_t v) { index_put(f, &v, sizeof(v)); }
+static void index_put_i64(FILE *f, int64_t v)  { index_put(f, &v, sizeof(v)); }
+
+static void index_put_str(FILE *f, const char *str)
+{
+    size_t len = strlen(str);
+    uint16_t n = (uint16_t)(len < MAX_PATH_LEN ? len : MAX_PATH_LEN - 1);
+    index_put(f, &n, sizeof(n));
+    index_put(f, str, n);
+}
+
+static void index_put_pathlist(FILE *f, const PathList *list)
+{
+    index_put_u32(f, (uint32_t)list->count);
+    for (int i = 0; i < list->count; i++)
+        index_put_str(f, list->paths[i]);
+}
+
+static void index_put_symbols(FILE *f, const SymbolMap *map)
+{
+    index_put_u32(f, (uint32_t)map->table.count);
+    for (int i = 0; i < map->table.capacity; i++) {
+        const StrTableSlot *slot = &map->table.slots[i];
+        if (!slot->key) continue;
+        index_put_str(f, slot->key);
+        index_put_str(f, (const char *)slot->value);
+    }
+}
+
+/* Index reading: a bounds-checked cursor over the whole file. */
+
+typedef struct {
+    const unsigned char *data;
+    size_t size;
+    size_t pos;
+    bool ok;
+} IndexReader;
+
+static void index_get(IndexReader *r, void *out, size_t len)
+{
+    if (!r->ok || r->size - r->pos < len) {
+        r->ok = false;
+        memset(out, 0, len);
+        return;
+    }
+    memcpy(out, r->data + r->pos, len);
+    r->pos += len;
+}
+
+static uint32_t index_get_u32(IndexReader *r) { uint32_t v; index_get(r, &v, sizeof(v)); return v; }
+static int64_t index_get_i64(IndexReader *r)  { int64_t v;  index_get(r, &v, sizeof(v)); return v; }
+
+/* Reads a string into out (MAX_PATH_LEN bytes). */
+static void index_get_str(IndexReader *r, char *out)
+{
+    uint16_t n;
+    index_get(r, &n, sizeof(n));
+    if (n >= MAX_PATH_LEN) r->ok = false;
+    if (!r->ok) {
+        out[0] = '\0';
+        return;
+    }
+    index_get(r, out, n);
+    out[n] = '\0';
+}
 
-    /* Parse symbol maps from all discovered files */
+static void index_get_pathlist(IndexReader *r, PathList *list)
+{
+    uint32_t count = index_get_u32(r);
+    if (count > MAX_DISCOVERED_PATHS) {
+        r->ok = false;
+        return;
+    }
+    list->count = (int)count;
+    for (uint32_t i = 0; i < count; i++)
+        index_get_str(r, list->paths[i]);
+}
+
+static void index_get_symbols(IndexReader *r, SymbolMap *map)
+{
+    uint32_t count = index_get_u32(r);
+    char symbol[MAX_PATH_LEN], path[MAX_PATH_LEN];
+    for (uint32_t i = 0; i < count && r->ok; i++) {
+        index_get_str(r, symbol);
+        index_get_str(r, path);
+        if (r->ok)
+            symbol_map_add(map, symbol, path);
+    }
+}
+
+/* ---- Project handle: discovery and symbol maps, shared between loads ---- */
+
+struct VoicegroupProject {
+    char root[MAX_PATH_LEN];
+    ProjectDiscovery disc;
+    StrPool symbols;        /* the maps' names, paths and keysplit tables */
     SymbolMap dsMap, pwMap;
     KeySplitMap ksMap;
-    symbol_map_init(&dsMap);
-    symbol_map_init(&pwMap);
-    keysplit_map_init(&ksMap);
-
-    vg_log("voicegroup_load: parsing symbol maps");
-    parse_all_direct_sound_data(disc, projectRoot, &dsMap);
-    vg_log("voicegroup_load: dsMap entries=%d", dsMap.count);
-    parse_all_programmable_wave_data(disc, projectRoot, &pwMap);
-    vg_log("voicegroup_load: pwMap entries=%d", pwMap.count);
-    parse_all_keysplit_tables(disc, &ksMap);
-    vg_log("voicegroup_load: ksMap entries=%d", ksMap.count);
+    VgSourceFile files[3 * MAX_DISCOVERED_PATHS];  /* the symbol files parsed */
+    int fileCount;
+    bool mapSamples;        /* VoicegroupLoaderConfig.mapSamples */
+};
+
+static void project_add_files(VoicegroupProject *proj, const PathList *list)
+{
+    for (int i = 0; i < list->count; i++) {
+        VgSourceFile *src = &proj->files[proj->fileCount++];
+        strncpy(src->path, list->paths[i], VG_MAX_PATH_LEN - 1);
+        src->mtime = voicegroup_file_mtime(list->paths[i]);
+    }
+}
+
+static void index_save(const char *indexPath, const char *canonicalRoot,
+                       const VoicegroupProject *proj, const IndexDeps *deps)
+{
+    char dir[MAX_PATH_LEN + 32];
+    snprintf(dir, sizeof(dir), "%s", indexPath);
+    char *sep = strrchr(dir, PATH_SEP);
+    if (sep) {
+        *sep = '\0';
+        make_dirs(dir);
+    }
+
+    /* Written under a temporary name and renamed into place, so a reader
+     * never sees half an index. */
+    char tmpPath[MAX_PATH_LEN + 64];
+#ifdef _WIN32
+    int pid = _getpid();
+#else
+    int pid = (int)getpid();
+#endif
+    snprintf(tmpPath, sizeof(tmpPath), "%s.%d.%lx.tmp", indexPath, pid,
+             (unsigned long)(uintptr_t)proj);
+    FILE *f = fopen(tmpPath, "wb");
+    if (!f) {
+        vg_log("index_save: cannot write '%s'", tmpPath);
+        return;
+    }
+
+    index_put(f, INDEX_MAGIC, sizeof(INDEX_MAGIC));
+    index_put_u32(f, INDEX_VERSION);
+    index_put_u32(f, INDEX_BYTE_ORDER);
+    index_put_str(f, canonicalRoot);
+    index_put_str(f, proj->root);
+
+    index_put_u32(f, (uint32_t)deps->count);
+    for (int i = 0; i < deps->count; i++) {
+        index_put_str(f, deps->items[i].path);
+        index_put_i64(f, deps->items[i].mtime);
+        index_put_i64(f, deps->items[i].size);
+    }
+
+    const ProjectDiscovery *disc = &proj->disc;
+    index_put_pathlist(f, &disc->directSoundDataFiles);
+    index_put_pathlist(f, &disc->progWaveDataFiles);
+    index_put_pathlist(f, &disc->keySplitTableFiles);
+    index_put_pathlist(f, &disc->voicegroupDirs);
+    index_put_pathlist(f, &disc->monolithicVGFiles);
+    index_put_pathlist(f, &disc->wavSampleDirs);
+
+    index_put_symbols(f, &proj->dsMap);
+    index_put_symbols(f, &proj->pwMap);
+    index_put_u32(f, (uint32_t)proj->ksMap.table.count);
+    for (int i = 0; i < proj->ksMap.table.capacity; i++) {
+        const StrTableSlot *slot = &proj->ksMap.table.slots[i];
+        if (!slot->key) continue;
+        const KeySplitDef *def = slot->value;
+        index_put_str(f, def->name);
+        index_put_u32(f, (uint32_t)def->startingNote);
+        index_put_u32(f, (uint32_t)def->maxNote);
+        index_put(f, def->table, sizeof(def->table));
+    }
+
+    bool ok = !ferror(f);
+    if (fclose(f) != 0) ok = false;
+#ifdef _WIN32
+    if (ok) remove(indexPath);  /* rename does not replace on Windows */
+#endif
+    if (!ok || rename(tmpPath, indexPath) != 0) {
+        vg_log("index_save: cannot write '%s'", indexPath);
+        remove(tmpPath);
+        return;
+    }
+    vg_log("index_save: wrote '%s' (%d dependencies)", indexPath, deps->count);
+}
+
+/*
+ * Fill proj's discovery results and symbol maps from the index, if it is for
+ * this project and none of its dependencies changed.  Leaves them empty and
+ * returns false otherwise.
+ */
+static bool index_load(const char *indexPath, const char *canonicalRoot,
+                       VoicegroupProject *proj)
+{
+    FILE *f = fopen(indexPath, "rb");
+    if (!f) return false;
+    unsigned char *data = NULL;
+    long size = -1;
+    if (fseek(f, 0, SEEK_END) == 0)
+        size = ftell(f);
+    if (size > 0 && fseek(f, 0, SEEK_SET) == 0)
+        data = malloc((size_t)size);
+    if (data && fread(data, 1, (size_t)size, f) != (size_t)size) {
+        free(data);
+        data = NULL;
+    }
+    fclose(f);
+    if (!data) return false;
+
+    IndexReader r = { data, (size_t)size, 0, true };
+    char magic[sizeof(INDEX_MAGIC)];
+    char str[MAX_PATH_LEN];
+    index_get(&r, magic, sizeof(magic));
+    bool ok = memcmp(magic, INDEX_MAGIC, sizeof(magic)) == 0 &&
+              index_get_u32(&r) == INDEX_VERSION &&
+              index_get_u32(&r) == INDEX_BYTE_ORDER;
+    if (ok) {
+        index_get_str(&r, str);
+        ok = strcmp(str, canonicalRoot) == 0;
+    }
+    if (ok) {
+        index_get_str(&r, str);
+        ok = strcmp(str, proj->root) == 0;
+    }
+
+    /* Every file and directory discovery looked at must be as it was. */
+    uint32_t depCount = ok ? index_get_u32(&r) : 0;
+    for (uint32_t i = 0; ok && i < depCount; i++) {
+        index_get_str(&r, str);
+        int64_t mtime = index_get_i64(&r);
+        int64_t depSize = index_get_i64(&r);
+        if (!r.ok) break;
+        int64_t curMtime, curSize;
+        index_dep_stamp(str, &curMtime, &curSize);
+        if (curMtime != mtime || curSize != depSize) {
+            vg_log("index_load: '%s' changed since the index was written", str);
+            ok = false;
+        }
+    }
+
+    if (ok && r.ok) {
+        ProjectDiscovery *disc = &proj->disc;
+        index_get_pathlist(&r, &disc->directSoundDataFiles);
+        index_get_pathlist(&r, &disc->progWaveDataFiles);
+        index_get_pathlist(&r, &disc->keySplitTableFiles);
+        index_get_pathlist(&r, &disc->voicegroupDirs);
+        index_get_pathlist(&r, &disc->monolithicVGFiles);
+        index_get_pathlist(&r, &disc->wavSampleDirs);
+
+        index_get_symbols(&r, &proj->dsMap);
+        index_get_symbols(&r, &proj->pwMap);
+        uint32_t ksCount = index_get_u32(&r);
+        for (uint32_t i = 0; i < ksCount && r.ok; i++) {
+            index_get_str(&r, str);
+            int startingNote = (int)index_get_u32(&r);
+            int maxNote = (int)index_get_u32(&r);
+            uint8_t table[128];
+            index_get(&r, table, sizeof(table));
+            KeySplitDef *def = r.ok ? keysplit_map_add(&proj->ksMap, str) : NULL;
+            if (def) {
+                def->startingNote = startingNote;
+                def->maxNote = maxNote;
+                memcpy(def->table, table, sizeof(table));
+            }
+        }
+        ok = r.ok;
+        if (!ok) {
+            /* Corrupt after the header checks: drop what was read. */
+            vg_log("index_load: '%s' is truncated or corrupt", indexPath);
+            memset(disc, 0, sizeof(ProjectDiscovery));
+            symbol_map_free(&proj->dsMap);
+            symbol_map_free(&proj->pwMap);
+            keysplit_map_free(&proj->ksMap);
+            str_pool_free(&proj->symbols);
+            str_pool_init(&proj->symbols);
+        }
+    }
+    free(data);
+    return ok && r.ok;
+}
+
+VoicegroupProject *voicegroup_project_open(const char *projectRoot,
+                                           const VoicegroupLoaderConfig *config)
+{
+    vg_log("voicegroup_project_open: root='%s'", projectRoot);
+
+    /* Heap-allocated: ProjectDiscovery alone is ~96 KB, which would risk
+     * overflow in Reaper's plugin-load thread (Windows default: 1 MB stack). */
+    VoicegroupProject *proj = calloc(1, sizeof(VoicegroupProject));
+    if (!proj) return NULL;
+    strncpy(proj->root, projectRoot, MAX_PATH_LEN - 1);
+    proj->mapSamples = config && config->mapSamples;
+
+    str_pool_init(&proj->symbols);
+    symbol_map_init(&proj->dsMap, &proj->symbols);
+    symbol_map_init(&proj->pwMap, &proj->symbols);
+    keysplit_map_init(&proj->ksMap, &proj->symbols);
+
+    char indexPath[MAX_PATH_LEN + 32];
+    char canonicalRoot[MAX_PATH_LEN];
+    bool useIndex = index_cache_path(projectRoot, config, indexPath, sizeof(indexPath),
+                                     canonicalRoot);
+    if (useIndex && index_load(indexPath, canonicalRoot, proj)) {
+        vg_log("voicegroup_project_open: read index '%s' - dsMap=%d pwMap=%d ksMap=%d",
+               indexPath, proj->dsMap.table.count, proj->pwMap.table.count,
+               proj->ksMap.table.count);
+    } else {
+        IndexDeps deps = { 0 };
+
+        /* Discover project structure */
+        vg_log("voicegroup_project_open: calling discover_project");
+        discover_project(projectRoot, config, &proj->disc, useIndex ? &deps : NULL);
+        vg_log("voicegroup_project_open: discover done - dsFiles=%d pwFiles=%d ksFiles=%d vgDirs=%d monoFiles=%d wavDirs=%d",
+               proj->disc.directSoundDataFiles.count, proj->disc.progWaveDataFiles.count,
+               proj->disc.keySplitTableFiles.count, proj->disc.voicegroupDirs.count,
+               proj->disc.monolithicVGFiles.count, proj->disc.wavSampleDirs.count);
+
+        /* Parse symbol maps from all discovered files */
+        vg_log("voicegroup_project_open: parsing symbol maps");
+        parse_all_direct_sound_data(&proj->disc, projectRoot, &proj->dsMap);
+        vg_log("voicegroup_project_open: dsMap entries=%d", proj->dsMap.table.count);
+        parse_all_programmable_wave_data(&proj->disc, projectRoot, &proj->pwMap);
+        vg_log("voicegroup_project_open: pwMap entries=%d", proj->pwMap.table.count);
+        parse_all_keysplit_tables(&proj->disc, &proj->ksMap);
+        vg_log("voicegroup_project_open: ksMap entries=%d", proj->ksMap.table.count);
+
+        if (useIndex) {
+            const PathList *parsed[3] = { &proj->disc.directSoundDataFiles,
+                                          &proj->disc.progWaveDataFiles,
+                                          &proj->disc.keySplitTableFiles };
+            for (int l = 0; l < 3; l++)
+                for (int i = 0; i < parsed[l]->count; i++)
+                    disc_depend(&proj->disc, parsed[l]->paths[i]);
+            index_save(indexPath, canonicalRoot, proj, &deps);
+        }
+        proj->disc.deps = NULL;
+        index_deps_free(&deps);
+    }
+
+    project_add_files(proj, &proj->disc.directSoundDataFiles);
+    project_add_files(proj, &proj->disc.progWaveDataFiles);
+    project_add_files(proj, &proj->disc.keySplitTableFiles);
+    return proj;
+}
+
+int voicegroup_project_file_count(const VoicegroupProject *proj)
+{
+    return proj->fileCount;
+}
+
+const VgSourceFile *voicegroup_project_file(const VoicegroupProject *proj, int index)
+{
+    return &proj->files[index];
+}
+
+void voicegroup_project_close(VoicegroupProject *proj)
+{
+    if (!proj) return;
+    symbol_map_free(&proj->dsMap);
+    symbol_map_free(&proj->pwMap);
+    keysplit_map_free(&proj->ksMap);
+    str_pool_free(&proj->symbols);
+    free(proj);
+}
+
+static LoadedVoiceGroup *project_load(const VoicegroupProject *proj,
+                                      const char *voicegroupName,
+                                      const LoadedVoiceGroup *prev,
+                                      const VoicegroupUsage *usage)
+{
+    const char *projectRoot = proj->root;
+
+    LoadedVoiceGroup *vg = calloc(1, sizeof(LoadedVoiceGroup));
+    if (!vg) return NULL;
+
+    /* Per-load WaveData deduplication cache */
+    WaveCache waveCache;
+    wave_cache_init(&waveCache);
+    waveCache.prev = prev;
+    waveCache.projectRoot = projectRoot;
+    waveCache.mapSamples = proj->mapSamples;
 
     /* Find the voicegroup */
     vg_log("voicegroup_load: searching for voicegroup '%s'", voicegroupName);
-    VoicegroupLocation loc = find_voicegroup(projectRoot, voicegroupName, disc);
+    VoicegroupLocation loc = find_voicegroup(projectRoot, voicegroupName, &proj->disc);
     if (!loc.found) {
         vg_log("voicegroup_load: voicegroup '%s' not found", voicegroupName);
         fprintf(stderr, "voicegroup_loader: cannot find voicegroup '%s'\n", voicegroupName);
-        goto fail;
+        voicegroup_free(vg);
+        return NULL;
     }
     vg_log("voicegroup_load: found at '%s' label='%s'", loc.filePath, loc.label);
 
     /* Parse the voicegroup */
     const char *startLabel = loc.label[0] ? loc.label : NULL;
     vg_log("voicegroup_load: parsing voicegroup file");
-    if (parse_voicegroup_file(projectRoot, loc.filePath, startLabel,
-                               vg, &dsMap, &pwMap, &ksMap, disc, &waveCache) != 0) {
+    int rc = parse_voicegroup_file(projectRoot, loc.filePath, startLabel, vg,
+                                   &proj->dsMap, &proj->pwMap, &proj->ksMap,
+                                   &proj->disc, &waveCache);
+    if (rc == 0) {
+        if (usage)
+            sample_jobs_select(&waveCache, vg, usage);
+        sample_jobs_decode(&waveCache);
+        sample_jobs_finish(&waveCache, vg);
+    }
+    vg_log("voicegroup_load: samples: %d decoded, %d unused by the song, %d reused from the "
+           "previous load, %d shared references (%d by path, %d by file), %zu bytes not duplicated",
+           waveCache.decoded, waveCache.skipped, waveCache.reused,
+           waveCache.pathHits + waveCache.fileHits,
+           waveCache.pathHits, waveCache.fileHits, waveCache.sharedBytes);
+    wave_cache_free(&waveCache);
+    if (rc != 0) {
         vg_log("voicegroup_load: parse_voicegroup_file failed");
-        goto fail;
+        voicegroup_free(vg);
+        return NULL;
     }
     vg_log("voicegroup_load: done OK");
+    return vg;
+}
 
-    symbol_map_free(&dsMap);
-    symbol_map_free(&pwMap);
-    keysplit_map_free(&ksMap);
-    free(disc);
+LoadedVoiceGroup *voicegroup_project_load(const VoicegroupProject *proj,
+                                          const char *voicegroupName)
+{
+    return project_load(proj, voicegroupName, NULL, NULL);
+}
+
+LoadedVoiceGroup *voicegroup_project_reload(const VoicegroupProject *proj,
+                                            const char *voicegroupName,
+                                            LoadedVoiceGroup *prev)
+{
+    LoadedVoiceGroup *vg = project_load(proj, voicegroupName, prev, NULL);
+    if (!vg) return NULL;
+
+    /* Take over the samples reused from prev, then free the rest of it. */
+    int reused = 0;
+    for (int i = 0; i < prev->waveDataCount; i++) {
+        for (int j = 0; j < vg->sourceFileCount; j++) {
+            if (vg->sourceFiles[j].wave == prev->waveDatas[i]) {
+                vg_register_wavedata(vg, prev->waveDatas[i]);
+                prev->waveDatas[i] = NULL;
+                reused++;
+                break;
+            }
+        }
+    }
+    vg_log("voicegroup_project_reload: '%s' reused %d of %d samples",
+           voicegroupName, reused, vg->waveDataCount);
+    voicegroup_free(prev);
     return vg;
+}
 
-fail:
-    symbol_map_free(&dsMap);
-    symbol_map_free(&pwMap);
-    keysplit_map_free(&ksMap);
-    free(disc);
-    voicegroup_free(vg);
-    return NULL;
+/*
+ * Main entry point: load a voicegroup from a project.
+ */
+LoadedVoiceGroup *voicegroup_load(const char *projectRoot, const char *voicegroupName,
+                                   const VoicegroupLoaderConfig *config)
+{
+    return voicegroup_load_used(projectRoot, voicegroupName, config, NULL);
+}
+
+LoadedVoiceGroup *voicegroup_load_used(const char *projectRoot, const char *voicegroupName,
+                                       const VoicegroupLoaderConfig *config,
+                                       const VoicegroupUsage *usage)
+{
+    vg_log("voicegroup_load: start root='%s' vg='%s'", projectRoot, voicegroupName);
+
+    VoicegroupProject *proj = voicegroup_project_open(projectRoot, config);
+    if (!proj) return NULL;
+    LoadedVoiceGroup *vg = project_load(proj, voicegroupName, NULL, usage);
+    voicegroup_project_close(proj);
+    return vg;
 }
 
 void voicegroup_free(LoadedVoiceGroup *vg)
@@ -2021,20 +3634,190 @@ void voicegroup_free(LoadedVoiceGroup *vg)
     if (!vg) return;
 
     for (int i = 0; i < vg->waveDataCount; i++)
-        free(vg->waveDatas[i]);
+        sample_store_release(vg->waveDatas[i]);
     free(vg->waveDatas);
 
-    for (int i = 0; i < vg->progWaveCount; i++)
-        free(vg->progWaves[i]);
+    /* Programmable waves, sub-voicegroups and keysplit tables are in the arena */
     free(vg->progWaves);
-
-    for (int i = 0; i < vg->subGroupCount; i++)
-        free(vg->subGroups[i]);
     free(vg->subGroups);
-
-    for (int i = 0; i < vg->keySplitTableCount; i++)
-        free(vg->keySplitTables[i]);
     free(vg->keySplitTables);
+    arena_free(&vg->arena);
+
+    free(vg->sourceFiles);
 
     free(vg);
 }
+
+/* ---- Shared voicegroups ----
+ *
+ * voicegroup_acquire() hands every caller asking for the same voicegroup of
+ * the same project (with the same config) one loaded copy.  An entry is
+ * checked against its files on each acquire: once any of them changed it is
+ * marked stale, the next caller gets a fresh load, and the stale copy is
+ * freed when its last user releases it.
+ */
+
+typedef struct PooledVoiceGroup {
+    struct PooledVoiceGroup *next;
+    char root[MAX_PATH_LEN];
+    char name[256];
+    VoicegroupLoaderConfig config;
+    LoadedVoiceGroup *vg;
+    VgSourceFile *projectFiles;  /* the project's symbol files when loaded */
+    int projectFileCount;
+    int refs;
+    bool stale;
+} PooledVoiceGroup;
+
+static PooledVoiceGroup *s_pool;
+#ifdef _WIN32
+static SRWLOCK s_poolLock = SRWLOCK_INIT;
+#define pool_lock()   AcquireSRWLockExclusive(&s_poolLock)
+#define pool_unlock() ReleaseSRWLockExclusive(&s_poolLock)
+#else
+static pthread_mutex_t s_poolLock = PTHREAD_MUTEX_INITIALIZER;
+#define pool_lock()   pthread_mutex_lock(&s_poolLock)
+#define pool_unlock() pthread_mutex_unlock(&s_poolLock)
+#endif
+
+static bool config_paths_equal(const char (*a)[VG_MAX_PATH_LEN], int aCount,
+                               const char (*b)[VG_MAX_PATH_LEN], int bCount)
+{
+    if (aCount != bCount) return false;
+    for (int i = 0; i < aCount; i++)
+        if (strcmp(a[i], b[i]) != 0) return false;
+    return true;
+}
+
+static bool pool_entry_matches(const PooledVoiceGroup *e, const char *projectRoot,
+                               const char *voicegroupName, const VoicegroupLoaderConfig *config)
+{
+    return !e->stale && strcmp(e->root, projectRoot) == 0 &&
+           strcmp(e->name, voicegroupName) == 0 &&
+           config_paths_equal(e->config.soundDataPaths, e->config.soundDataPathCount,
+                              config->soundDataPaths, config->soundDataPathCount) &&
+           config_paths_equal(e->config.voicegroupPaths, e->config.voicegroupPathCount,
+                              config->voicegroupPaths, config->voicegroupPathCount) &&
+           config_paths_equal(e->config.sampleDirs, e->config.sampleDirCount,
+                              config->sampleDirs, config->sampleDirCount) &&
+           strcmp(e->config.indexCacheDir, config->indexCacheDir) == 0 &&
+           e->config.noIndexCache == config->noIndexCache &&
+           e->config.mapSamples == config->mapSamples;
+}
+
+/* A new reference to a current entry for the voicegroup, or NULL. */
+static PooledVoiceGroup *pool_find(const char *projectRoot, const char *voicegroupName,
+                                   const VoicegroupLoaderConfig *config)
+{
+    pool_lock();
+    PooledVoiceGroup *e = s_pool;
+    while (e && !pool_entry_matches(e, projectRoot, voicegroupName, config))
+        e = e->next;
+    if (e)
+        e->refs++;
+    pool_unlock();
+    return e;
+}
+
+/* Whether none of the files the entry was loaded from changed since. */
+static bool pool_entry_current(const PooledVoiceGroup *e)
+{
+    for (int i = 0; i < e->vg->sourceFileCount; i++)
+        if (voicegroup_file_mtime(e->vg->sourceFiles[i].path) != e->vg->sourceFiles[i].mtime)
+            return false;
+    for (int i = 0; i < e->projectFileCount; i++)
+        if (voicegroup_file_mtime(e->projectFiles[i].path) != e->projectFiles[i].mtime)
+            return false;
+    return true;
+}
+
+static void pool_entry_free(PooledVoiceGroup *e)
+{
+    voicegroup_free(e->vg);
+    free(e->projectFiles);
+    free(e);
+}
+
+LoadedVoiceGroup *voicegroup_acquire(const char *projectRoot, const char *voicegroupName,
+                                     const VoicegroupLoaderConfig *config)
+{
+    static const VoicegroupLoaderConfig noConfig;
+    if (!config) config = &noConfig;
+    if (strlen(projectRoot) >= MAX_PATH_LEN || strlen(voicegroupName) >= 256)
+        return NULL;
+
+    PooledVoiceGroup *e = pool_find(projectRoot, voicegroupName, config);
+    if (e) {
+        if (pool_entry_current(e)) {
+            vg_log("voicegroup_acquire: sharing '%s' (%d users)", voicegroupName, e->refs);
+            return e->vg;
+        }
+        vg_log("voicegroup_acquire: '%s' changed on disk; loading it again", voicegroupName);
+        pool_lock();
+        e->stale = true;
+        pool_unlock();
+        voicegroup_release(e->vg);
+    }
+
+    VoicegroupProject *proj = voicegroup_project_open(projectRoot, config);
+    if (!proj) return NULL;
+    e = calloc(1, sizeof(PooledVoiceGroup));
+    if (e) {
+        e->vg = voicegroup_project_load(proj, voicegroupName);
+        e->projectFiles = malloc(sizeof(VgSourceFile) * (proj->fileCount ? proj->fileCount : 1));
+    }
+    if (!e || !e->vg || !e->projectFiles) {
+        if (e) {
+            voicegroup_free(e->vg);
+            free(e->projectFiles);
+        }
+        free(e);
+        voicegroup_project_close(proj);
+        return NULL;
+    }
+    memcpy(e->projectFiles, proj->files, sizeof(VgSourceFile) * proj->fileCount);
+    e->projectFileCount = proj->fileCount;
+    voicegroup_project_close(proj);
+    strcpy(e->root, projectRoot);
+    strcpy(e->name, voicegroupName);
+    e->config = *config;
+    e->refs = 1;
+
+    /* Another thread may have loaded the same group meanwhile */
+    pool_lock();
+    PooledVoiceGroup *other = s_pool;
+    while (other && !pool_entry_matches(other, projectRoot, voicegroupName, config))
+        other = other->next;
+    if (other) {
+        other->refs++;
+    } else {
+        e->next = s_pool;
+        s_pool = e;
+    }
+    pool_unlock();
+
+    if (other) {
+        pool_entry_free(e);
+        return other->vg;
+    }
+    return e->vg;
+}
+
+void voicegroup_release(LoadedVoiceGroup *vg)
+{
+    if (!vg) return;
+    PooledVoiceGroup *dead = NULL;
+    pool_lock();
+    for (PooledVoiceGroup **link = &s_pool; *link; link = &(*link)->next) {
+        if ((*link)->vg == vg) {
+            if (--(*link)->refs == 0) {
+                dead = *link;
+                *link = dead->next;
+            }
+            break;
+        }
+    }
+    pool_unlock();
+    if (dead)
+        pool_entry_free(dead);
+}
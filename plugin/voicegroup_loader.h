@@ -19,8 +19,42 @@ typedef struct {
     int voicegroupPathCount;
     char sampleDirs[8][VG_MAX_PATH_LEN];        /* extra directories with .wav sample files */
     int sampleDirCount;
+
+    /* Where voicegroup_project_open() keeps its project index: the discovered
+     * file layout and parsed symbol tables, reused until a file or directory
+     * they came from changes.  Empty uses the per-user cache directory
+     * ($XDG_CACHE_HOME/poryaaaa or ~/.cache/poryaaaa; ~/Library/Caches/poryaaaa
+     * on macOS; %LOCALAPPDATA%\poryaaaa on Windows).  Unlike the paths
+     * above, it is not relative to the project root. */
+    char indexCacheDir[VG_MAX_PATH_LEN];
+    bool noIndexCache;                          /* keep no project index at all */
+
+    /* Map .bin samples into memory instead of reading them (not supported on
+     * Windows).  Mapped samples use the file's pages directly, so processes
+     * loading the same project share one copy.  A sample file must not be
+     * rewritten in place while a voicegroup using it is loaded: if it
+     * shrinks, touching the missing pages kills the process.  Leave this off
+     * where samples may be rebuilt under a long-lived voicegroup. */
+    bool mapSamples;
 } VoicegroupLoaderConfig;
 
+/*
+ * A file a voicegroup was loaded from, for noticing when it changes.
+ */
+typedef struct {
+    char      path[VG_MAX_PATH_LEN];
+    int64_t   mtime;  /* voicegroup_file_mtime() when the file was read */
+    WaveData *wave;   /* the sample read from it, NULL for other files */
+} VgSourceFile;
+
+/* One block of an arena; the arena is the chain, newest block first. */
+struct ArenaBlock {
+    struct ArenaBlock *next;
+    size_t used;
+    size_t size;
+    uint64_t data[];   /* 8-byte aligned storage */
+};
+
 /*
  * Loaded voicegroup data - holds all allocated resources.
  * Must be freed with voicegroup_free() when done.
@@ -35,7 +69,8 @@ typedef struct {
      * when no meaningful symbol exists (e.g. square/noise voices). */
     char voiceNames[VOICEGROUP_SIZE][VG_VOICE_NAME_LEN];
 
-    /* Loaded wave data (samples) */
+    /* Loaded wave data (samples), each a reference into the process-wide
+     * sample store */
     WaveData **waveDatas;
     int waveDataCount;
     int waveDataCapacity;
@@ -54,6 +89,16 @@ typedef struct {
     uint8_t **keySplitTables;
     int keySplitTableCount;
     int keySplitTableCapacity;
+
+    /* Every file read for this voicegroup: voicegroup files (including
+     * keysplit/drumkit sub-voicegroups), samples and programmable waves. */
+    VgSourceFile *sourceFiles;
+    int sourceFileCount;
+    int sourceFileCapacity;
+
+    /* Arena holding the programmable waves, sub-voicegroups and keysplit
+     * tables listed above, in the order they were parsed */
+    struct ArenaBlock *arena;
 } LoadedVoiceGroup;
 
 /*
@@ -73,11 +118,84 @@ typedef struct {
 LoadedVoiceGroup *voicegroup_load(const char *projectRoot, const char *voicegroupName,
                                    const VoicegroupLoaderConfig *config);
 
+/*
+ * The programs a song plays and the keys it plays on each: bit (key & 7) of
+ * keys[program][key >> 3].
+ */
+typedef struct {
+    uint8_t keys[VOICEGROUP_SIZE][VOICEGROUP_SIZE / 8];
+} VoicegroupUsage;
+
+/*
+ * voicegroup_load(), reading only the samples the voices in `usage` need:
+ * the sample of each program played and, for keysplits and drumkits, those
+ * of the sub-voices for the keys played.  Every voice is still parsed; a
+ * voice whose sample was left out has none (wav == NULL) and stays silent.
+ * NULL usage loads everything.
+ */
+LoadedVoiceGroup *voicegroup_load_used(const char *projectRoot, const char *voicegroupName,
+                                       const VoicegroupLoaderConfig *config,
+                                       const VoicegroupUsage *usage);
+
+/*
+ * A project whose structure has been discovered and whose sample, wave and
+ * keysplit symbol tables have been parsed, for loading several voicegroups
+ * without redoing that work each time.
+ *
+ * voicegroup_project_load() only reads the project, so it may be called from
+ * several threads at once.  Voicegroups loaded from a project stay valid
+ * after it is closed.
+ */
+typedef struct VoicegroupProject VoicegroupProject;
+
+VoicegroupProject *voicegroup_project_open(const char *projectRoot,
+                                           const VoicegroupLoaderConfig *config);
+LoadedVoiceGroup *voicegroup_project_load(const VoicegroupProject *proj,
+                                          const char *voicegroupName);
+void voicegroup_project_close(VoicegroupProject *proj);
+
+/*
+ * Load a voicegroup again after some of its files changed.  Samples whose
+ * file is unchanged since `prev` was loaded are moved over instead of being
+ * read again; everything else is re-parsed.  On success `prev` is freed; on
+ * failure NULL is returned and `prev` is left intact.
+ */
+LoadedVoiceGroup *voicegroup_project_reload(const VoicegroupProject *proj,
+                                            const char *voicegroupName,
+                                            LoadedVoiceGroup *prev);
+
+/* The project-wide symbol files (direct_sound_data.inc and friends) parsed
+ * by voicegroup_project_open, with their modification times at the time;
+ * if any changes, the project must be opened again. */
+int voicegroup_project_file_count(const VoicegroupProject *proj);
+const VgSourceFile *voicegroup_project_file(const VoicegroupProject *proj, int index);
+
+/* Modification time of a file in nanoseconds (at the file system's
+ * resolution: 100 ns on NTFS), or -1 if it does not exist. */
+int64_t voicegroup_file_mtime(const char *path);
+
 /*
  * Free all resources associated with a loaded voicegroup.
  */
 void voicegroup_free(LoadedVoiceGroup *vg);
 
+/*
+ * Load a voicegroup like voicegroup_load(), or share one loaded before.
+ *
+ * Every caller asking for the same voicegroup of the same project and config
+ * gets the same LoadedVoiceGroup, loaded once, until one of the files it was
+ * read from changes; after that the next caller gets a fresh copy.  The
+ * result must be treated as read-only and handed back with
+ * voicegroup_release() (never voicegroup_free()); the last release frees it.
+ * Safe to call from any thread.
+ *
+ * Samples are shared more widely still: every loaded voicegroup, however it
+ * was loaded, uses one copy of each sample file per process.
+ */
+LoadedVoiceGroup *voicegroup_acquire(const char *projectRoot, const char *voicegroupName,
+                                     const VoicegroupLoaderConfig *config);
+void voicegroup_release(LoadedVoiceGroup *vg);
+
 /*
  * Set an optional file path for diagnostic logging inside the voicegroup loader.
  * Pass NULL to disable. The same path used by the plugin's "log=" config key works.
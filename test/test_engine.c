@@ -2,8 +2,20 @@
 #include <stdlib.h>
 #include <string.h>
 #include <math.h>
+#include <stdint.h>
+#include <time.h>
+#ifdef _WIN32
+#include <sys/utime.h>
+#else
+#include <unistd.h>
+#include <utime.h>
+#endif
 #include "m4a_engine.h"
+#include "m4a_channel.h"
+#include "m4a_mix.h"
 #include "m4a_tables.h"
+#include "voicegroup_loader.h"
+#include "test_fixtures.h"
 
 /*
  * Unit tests for the m4a engine.
@@ -256,6 +268,586 @@ static void test_basic_audio(void)
     free(wd);
 }
 
+/* Test the idle fast path: an idle engine renders silence and reports it, and
+ * a released note's tails (reverb, analog filter) settle back to a constant. */
+static void test_idle_silence(void)
+{
+    printf("Testing idle silence detection...\n");
+
+    M4AEngine engine;
+    m4a_engine_init(&engine, 44100.0f);
+    engine.analogFilter = true;
+
+    static float outL[1024], outR[1024];
+    for (int i = 0; i < 1024; i++)
+        outL[i] = outR[i] = 1.0f;
+    m4a_engine_process(&engine, outL, outR, 1024);
+    bool allZero = true;
+    for (int i = 0; i < 1024; i++)
+        if (outL[i] != 0.0f || outR[i] != 0.0f)
+            allZero = false;
+    ASSERT(allZero, "idle engine renders silence");
+    ASSERT(engine.outputIdle && m4a_engine_is_silent(&engine), "idle engine reports silence");
+
+    int dataSize = 64;
+    WaveData *wd = calloc(1, sizeof(WaveData) + dataSize + 1);
+    wd->freq = 0x01000000;
+    wd->status = 0x4000;
+    wd->size = dataSize;
+    wd->data = (int8_t *)((uint8_t *)wd + sizeof(WaveData));
+    for (int i = 0; i < dataSize; i++)
+        wd->data[i] = (int8_t)(127.0 * sin(2.0 * 3.14159265 * i / dataSize));
+    wd->data[dataSize] = wd->data[0];
+
+    ToneData voices[128];
+    memset(voices, 0, sizeof(voices));
+    voices[0].type = VOICE_DIRECTSOUND;
+    voices[0].key = 60;
+    voices[0].wav = wd;
+    voices[0].attack = 0xFF;
+    voices[0].sustain = 0xFF;
+    voices[0].release = 200;
+    m4a_engine_set_voicegroup(&engine, voices);
+    m4a_engine_program_change(&engine, 0, 0);
+    m4a_engine_cc(&engine, 0, 7, 127);
+    m4a_reverb_set_amount(&engine.reverb, 50);
+
+    m4a_engine_note_on(&engine, 0, 60, 100);
+    m4a_engine_process(&engine, outL, outR, 1024);
+    ASSERT(!engine.outputIdle && !m4a_engine_is_silent(&engine), "sounding engine is not idle");
+    m4a_engine_note_off(&engine, 0, 60);
+
+    /* The reverb tail rounds down onto a small DC offset rather than zero. */
+    int blocks = 0;
+    do {
+        m4a_engine_process(&engine, outL, outR, 1024);
+    } while (!engine.outputIdle && ++blocks < 430);  /* ~10 s */
+    bool constant = true;
+    for (int i = 0; i < 1024; i++)
+        if (outL[i] != outL[0] || outR[i] != outL[0])
+            constant = false;
+    ASSERT(engine.outputIdle && constant, "released note settles to a constant");
+
+    /* Switching the reverb off lets the residue drain to true silence. */
+    m4a_reverb_set_amount(&engine.reverb, 0);
+    m4a_engine_process(&engine, outL, outR, 1024);
+    m4a_engine_process(&engine, outL, outR, 1024);
+    allZero = true;
+    for (int i = 0; i < 1024; i++)
+        if (outL[i] != 0.0f || outR[i] != 0.0f)
+            allZero = false;
+    ASSERT(allZero && m4a_engine_is_silent(&engine), "drained engine renders silence");
+
+    m4a_engine_destroy(&engine);
+    free(wd);
+}
+
+/* Build a small voicegroup (into voices/drums/wd/wave) exercising every kind
+ * of voice data reference: DirectSound samples, CGB duty/period values, a
+ * programmable wave and a drumset subgroup. */
+static void build_snapshot_voices(ToneData *voices, ToneData *drums, WaveData *wd,
+                                  int dataSize, uint32_t *wave)
+{
+    wd->freq = 0x01000000;
+    wd->status = 0x4000;
+    wd->loopStart = 10;
+    wd->size = dataSize;
+    wd->data = (int8_t *)((uint8_t *)wd + sizeof(WaveData));
+    for (int i = 0; i < dataSize; i++)
+        wd->data[i] = (int8_t)(100.0 * sin(2.0 * 3.14159265 * i / 23.0));
+    wd->data[dataSize] = wd->data[dataSize - 1];
+    wave[0] = 0x01234567; wave[1] = 0x89ABCDEF; wave[2] = 0xFEDCBA98; wave[3] = 0x76543210;
+
+    memset(voices, 0, 128 * sizeof(ToneData));
+    memset(drums, 0, 128 * sizeof(ToneData));
+    voices[0] = (ToneData){ .type = VOICE_DIRECTSOUND, .key = 60, .wav = wd,
+                            .attack = 0xFF, .sustain = 0xFF, .release = 200 };
+    voices[1] = (ToneData){ .type = VOICE_SQUARE_1, .key = 60, .wavePointer = (uint32_t *)2,
+                            .attack = 0, .decay = 2, .sustain = 10, .release = 3 };
+    voices[2] = (ToneData){ .type = VOICE_PROGRAMMABLE_WAVE, .key = 60, .wavePointer = wave,
+                            .attack = 0, .decay = 1, .sustain = 8, .release = 4 };
+    voices[3] = (ToneData){ .type = VOICE_NOISE, .key = 60, .wavePointer = (uint32_t *)1,
+                            .attack = 0, .decay = 3, .sustain = 5, .release = 1 };
+    drums[40] = voices[0];
+    voices[4] = (ToneData){ .type = VOICE_KEYSPLIT_ALL, .subGroup = drums };
+}
+
+/* Test that restoring a snapshot -- into a fresh engine whose voice data
+ * lives at different addresses -- continues playback bit-identically. */
+static void test_snapshot_restore(void)
+{
+    printf("Testing engine snapshot/restore...\n");
+
+    int dataSize = 200;
+    WaveData *wdA = calloc(1, sizeof(WaveData) + dataSize + 1);
+    WaveData *wdB = calloc(1, sizeof(WaveData) + dataSize + 1);
+    static ToneData voicesA[128], drumsA[128], voicesB[128], drumsB[128];
+    static uint32_t waveA[4], waveB[4];
+    build_snapshot_voices(voicesA, drumsA, wdA, dataSize, waveA);
+    build_snapshot_voices(voicesB, drumsB, wdB, dataSize, waveB);
+
+    M4AEngine a, b;
+    m4a_engine_init(&a, 48000.0f);
+    m4a_engine_init(&b, 48000.0f);
+    m4a_engine_set_voicegroup(&a, voicesA);
+    m4a_engine_set_voicegroup(&b, voicesB);
+    m4a_reverb_set_amount(&a.reverb, 40);
+    m4a_reverb_set_amount(&b.reverb, 40);
+    a.analogFilter = b.analogFilter = true;
+
+    for (int t = 0; t < 5; t++) {
+        m4a_engine_program_change(&a, t, (uint8_t)t);
+        m4a_engine_cc(&a, t, 7, 127);
+        m4a_engine_cc(&a, t, 1, 40);  /* LFO */
+        m4a_engine_note_on(&a, t, (uint8_t)(t == 4 ? 40 : 55 + t), 110);
+    }
+    static float outL[20000], outR[20000], refL[20000], refR[20000];
+    m4a_engine_process(&a, outL, outR, 1777);
+
+    size_t size = m4a_engine_snapshot(&a, NULL, 0);
+    uint8_t *blob = malloc(size);
+    ASSERT(m4a_engine_snapshot(&a, blob, size) == size, "snapshot written");
+    ASSERT(m4a_engine_restore(&b, blob, size), "snapshot restored");
+
+    m4a_engine_note_off(&a, 0, 55);
+    m4a_engine_note_off(&b, 0, 55);
+    m4a_engine_process(&a, refL, refR, 20000);
+    m4a_engine_process(&b, outL, outR, 20000);
+    ASSERT(memcmp(refL, outL, sizeof(refL)) == 0 && memcmp(refR, outR, sizeof(refR)) == 0,
+           "restored engine continues identically");
+
+    /* Channel state that would send mixing outside its sample is rejected:
+     * a count running past the sample's end, and a sample reference naming
+     * voice data that is not a DirectSound sample (the drumset subgroup). */
+    int on = -1;
+    for (int i = 0; i < TOTAL_PCM_CHANNELS && on < 0; i++)
+        if (a.pcmChannels[i].status & CHN_ON)
+            on = i;
+    ASSERT(on >= 0, "a PCM channel is sounding");
+    if (on >= 0) {
+        M4APCMChannel saved = a.pcmChannels[on];
+        a.pcmChannels[on].count = dataSize * 4;
+        ASSERT(m4a_engine_snapshot(&a, blob, size) == size, "snapshot with bad count written");
+        ASSERT(!m4a_engine_restore(&b, blob, size), "count past the sample's end rejected");
+        a.pcmChannels[on] = saved;
+
+        a.pcmChannels[on].wav = (WaveData *)drumsA;
+        ASSERT(m4a_engine_snapshot(&a, blob, size) == size, "snapshot with bad sample written");
+        ASSERT(!m4a_engine_restore(&b, blob, size), "sample naming a non-PCM slot rejected");
+        a.pcmChannels[on] = saved;
+
+        ASSERT(m4a_engine_snapshot(&a, blob, size) == size &&
+               m4a_engine_restore(&b, blob, size), "repaired snapshot restores");
+    }
+
+    /* Incompatible targets are rejected and left untouched. */
+    M4AEngine c;
+    m4a_engine_init(&c, 44100.0f);
+    m4a_engine_set_voicegroup(&c, voicesB);
+    ASSERT(!m4a_engine_restore(&c, blob, size), "sample rate mismatch rejected");
+    ASSERT(!m4a_engine_restore(&b, blob, size - 1), "truncated snapshot rejected");
+    blob[0] ^= 0xFF;
+    ASSERT(!m4a_engine_restore(&b, blob, size), "corrupt snapshot rejected");
+
+    free(blob);
+    m4a_engine_destroy(&a);
+    m4a_engine_destroy(&b);
+    m4a_engine_destroy(&c);
+    free(wdA);
+    free(wdB);
+}
+
+/* Test that skipping ahead leaves tracks and channels exactly where rendering
+ * would, and that only the resampler history is lost. */
+static void test_engine_skip(void)
+{
+    printf("Testing engine skip...\n");
+
+    int dataSize = 200;
+    WaveData *wd = calloc(1, sizeof(WaveData) + dataSize + 1);
+    static ToneData voices[128], drums[128];
+    static uint32_t wave[4];
+    build_snapshot_voices(voices, drums, wd, dataSize, wave);
+
+    M4AEngine a, b;
+    m4a_engine_init(&a, 48000.0f);
+    m4a_engine_init(&b, 48000.0f);
+    M4AEngine *engines[2] = { &a, &b };
+    for (int e = 0; e < 2; e++) {
+        m4a_engine_set_voicegroup(engines[e], voices);
+        for (int t = 0; t < 5; t++) {
+            m4a_engine_program_change(engines[e], t, (uint8_t)t);
+            m4a_engine_cc(engines[e], t, 7, 127);
+            m4a_engine_cc(engines[e], t, 1, 40);  /* LFO */
+            m4a_engine_note_on(engines[e], t, (uint8_t)(t == 4 ? 40 : 55 + t), 110);
+        }
+    }
+
+    static float refL[20000], refR[20000], outL[20000], outR[20000];
+    m4a_engine_process(&a, refL, refR, 12345);
+    m4a_engine_note_off(&a, 2, 57);
+    m4a_engine_process(&a, refL, refR, 4000);
+    m4a_engine_skip(&b, 12345);
+    m4a_engine_note_off(&b, 2, 57);
+    m4a_engine_skip(&b, 4000);
+
+    ASSERT(memcmp(a.tracks, b.tracks, sizeof(a.tracks)) == 0, "skip: tracks match");
+    ASSERT(memcmp(a.pcmChannels, b.pcmChannels, sizeof(a.pcmChannels)) == 0,
+           "skip: PCM channels match");
+    ASSERT(memcmp(a.cgbChannels, b.cgbChannels, sizeof(a.cgbChannels)) == 0,
+           "skip: CGB channels match");
+    ASSERT(a.tickPhase == b.tickPhase && a.pcmPhase == b.pcmPhase, "skip: clocks match");
+
+    /* Without reverb, output converges once the resampler has seen two PCM
+     * samples (about 8 host samples at 13379 Hz). */
+    m4a_engine_process(&a, refL, refR, 20000);
+    m4a_engine_process(&b, outL, outR, 20000);
+    ASSERT(memcmp(refL + 16, outL + 16, sizeof(float) * (20000 - 16)) == 0 &&
+           memcmp(refR + 16, outR + 16, sizeof(float) * (20000 - 16)) == 0,
+           "skip: output converges after the resampler refills");
+
+    m4a_engine_destroy(&a);
+    m4a_engine_destroy(&b);
+    free(wd);
+}
+
+/* Test that per-track stems (every other track muted) sum to the full mix,
+ * including when notes steal channels. */
+static void test_track_mute_stems(void)
+{
+    printf("Testing track mute stems...\n");
+
+    int dataSize = 200;
+    WaveData *wd = calloc(1, sizeof(WaveData) + dataSize + 1);
+    static ToneData voices[128], drums[128];
+    static uint32_t wave[4];
+    build_snapshot_voices(voices, drums, wd, dataSize, wave);
+
+    /* Full mix, track 0 alone, track 1 alone.  At a PCM mix rate equal to
+     * the host rate there is no resampling rounding, so the sum is exact. */
+    M4AEngine e[3];
+    static float outL[3][8000], outR[3][8000];
+    for (int i = 0; i < 3; i++) {
+        m4a_engine_init(&e[i], 48000.0f);
+        m4a_engine_set_pcm_mix_rate(&e[i], 0.0f);
+        m4a_engine_set_voicegroup(&e[i], voices);
+        e[i].maxPcmChannels = 2;
+        e[i].mutedTracks = (uint16_t)(i == 0 ? 0 : ~(1u << (i - 1)));
+        for (int t = 0; t < 2; t++) {
+            m4a_engine_cc(&e[i], t, 7, 127);
+            m4a_engine_cc(&e[i], t, 10, t ? 100 : 20);
+        }
+        m4a_engine_program_change(&e[i], 0, 0);  /* DirectSound on track 0 */
+        m4a_engine_program_change(&e[i], 1, 1);  /* square on track 1 */
+        for (int n = 0; n < 4; n++) {
+            m4a_engine_note_on(&e[i], 0, (uint8_t)(50 + 3 * n), 100);  /* steals */
+            m4a_engine_note_on(&e[i], 1, (uint8_t)(60 + n), 90);
+            m4a_engine_process(&e[i], outL[i] + n * 2000, outR[i] + n * 2000, 2000);
+        }
+    }
+
+    bool sums = true, heard[3] = { false, false, false };
+    for (int s = 0; s < 8000; s++) {
+        if (outL[1][s] + outL[2][s] != outL[0][s] || outR[1][s] + outR[2][s] != outR[0][s])
+            sums = false;
+        for (int i = 1; i < 3; i++)
+            if (outL[i][s] != 0.0f || outR[i][s] != 0.0f)
+                heard[i] = true;
+    }
+    ASSERT(heard[1] && heard[2], "stems: each track is audible in its own stem");
+    ASSERT(sums, "stems: stems sum to the full mix");
+
+    for (int i = 0; i < 3; i++)
+        m4a_engine_destroy(&e[i]);
+    free(wd);
+}
+
+/* Test that block (span) PCM mixing matches sample-by-sample mixing, across
+ * loop wraps, one-shot sample ends, and the fixed-frequency path. */
+static void test_pcm_span_render(void)
+{
+    printf("Testing PCM span rendering...\n");
+
+    int dataSize = 100;
+    WaveData *wd = calloc(1, sizeof(WaveData) + dataSize + 1);
+    wd->freq = 0x01000000;
+    wd->size = dataSize;
+    wd->data = (int8_t *)((uint8_t *)wd + sizeof(WaveData));
+    for (int i = 0; i < dataSize; i++)
+        wd->data[i] = (int8_t)(100.0 * sin(2.0 * 3.14159265 * i / 37.0));
+    wd->data[dataSize] = wd->data[dataSize - 1];
+
+    /* looped / one-shot, interpolating / fixed-frequency */
+    for (int variant = 0; variant < 4; variant++) {
+        wd->status = (variant & 1) ? 0x4000 : 0;
+        wd->loopStart = 30;
+        uint8_t type = (variant & 2) ? VOICE_DIRECTSOUND_NO_RESAMPLE : VOICE_DIRECTSOUND;
+
+        M4APCMChannel a, b;
+        memset(&a, 0, sizeof(a));
+        a.attack = 0xFF;
+        m4a_pcm_channel_start(&a, wd, type);
+        a.frequency = (variant & 2) ? 0x800000 : 0x01A3C5F1;  /* ~3.3 samples/step */
+        a.envelopeVolumeRight = 200;
+        a.envelopeVolumeLeft = 77;
+        b = a;
+
+        int32_t spanL[300] = {0}, spanR[300] = {0};
+        int32_t oneL[300] = {0}, oneR[300] = {0};
+        /* Uneven spans exercise resuming mid-sample. */
+        m4a_pcm_channel_render_span(&a, spanL, spanR, 17);
+        m4a_pcm_channel_render_span(&a, spanL + 17, spanR + 17, 283);
+        for (int i = 0; i < 300; i++)
+            m4a_pcm_channel_render(&b, &oneL[i], &oneR[i]);
+
+        ASSERT(memcmp(spanL, oneL, sizeof(spanL)) == 0, "span render: left matches per-sample");
+        ASSERT(memcmp(spanR, oneR, sizeof(spanR)) == 0, "span render: right matches per-sample");
+        ASSERT_EQ(a.status, b.status, "span render: status matches");
+        ASSERT(a.currentPointer == b.currentPointer, "span render: position matches");
+        ASSERT_EQ(a.count, b.count, "span render: count matches");
+        ASSERT_EQ(a.fw, b.fw, "span render: fw matches");
+        ASSERT_EQ((a.status & CHN_ON) != 0, (variant & 1) != 0,
+                  "span render: one-shot ends, loop keeps playing");
+    }
+
+    free(wd);
+}
+
+/* Test that block (span) CGB synthesis matches sample-by-sample synthesis for
+ * square, programmable wave and noise channels, including the wave declick. */
+static void test_cgb_span_render(void)
+{
+    printf("Testing CGB span rendering...\n");
+
+    static uint32_t wave[4] = { 0x01234567, 0x89ABCDEF, 0xFEDCBA98, 0x76543211 };
+    static const uint32_t freqs[] = { 1750, 2000, 1024, 0x35, 0x0B };
+    bool allMatch = true;
+    for (int type = 1; type <= 4; type++) {
+        for (size_t f = 0; f < sizeof(freqs) / sizeof(freqs[0]); f++) {
+            M4ACGBChannel a;
+            memset(&a, 0, sizeof(a));
+            a.type = (uint8_t)type;
+            a.status = CHN_ENV_SUSTAIN;
+            a.envelopeVolume = 11;
+            a.dutyCycle = (uint8_t)f;
+            a.pan = (f & 1) ? 0xF0 : 0xFF;
+            a.frequency = (type == 4) ? (freqs[f] & 0xFF) : freqs[f];
+            a.phaseIncFreq = 0xFFFFFFFFu;
+            a.lfsr = (a.frequency & 0x08) ? 0x40 : 0x4000;
+            a.wavePointer = wave;
+            M4ACGBChannel b = a;
+
+            int32_t spanL[600] = {0}, spanR[600] = {0};
+            int32_t oneL[600] = {0}, oneR[600] = {0};
+            m4a_cgb_channel_render_span(&a, spanL, spanR, 13, 44100.0f);
+            m4a_cgb_channel_render_span(&a, spanL + 13, spanR + 13, 287, 44100.0f);
+            for (int i = 0; i < 300; i++)
+                m4a_cgb_channel_render(&b, &oneL[i], &oneR[i], 44100.0f);
+
+            /* Note off mid-stream: the wave channel fades out. */
+            a.status = 0;
+            a.declickSamplesRemaining = 256;
+            b.status = 0;
+            b.declickSamplesRemaining = 256;
+            m4a_cgb_channel_render_span(&a, spanL + 300, spanR + 300, 300, 44100.0f);
+            for (int i = 300; i < 600; i++)
+                m4a_cgb_channel_render(&b, &oneL[i], &oneR[i], 44100.0f);
+
+            if (memcmp(spanL, oneL, sizeof(spanL)) != 0 || memcmp(spanR, oneR, sizeof(spanR)) != 0
+                || a.phase != b.phase || a.lfsr != b.lfsr || a.declickSample != b.declickSample)
+                allMatch = false;
+        }
+    }
+    ASSERT(allMatch, "cgb span render matches per-sample output and state");
+}
+
+/* Test that fast-forwarding a muted channel leaves it in exactly the state
+ * rendering the same number of samples would. */
+static void test_channel_skip(void)
+{
+    printf("Testing muted channel fast-forward...\n");
+
+    int dataSize = 100;
+    WaveData *wd = calloc(1, sizeof(WaveData) + dataSize + 1);
+    wd->size = dataSize;
+    wd->data = (int8_t *)((uint8_t *)wd + sizeof(WaveData));
+    for (int i = 0; i <= dataSize; i++)
+        wd->data[i] = (int8_t)(i * 7);
+
+    static const uint32_t pcmFreqs[] = { 0x123456, 0x800000, 0x01A3C5F1, 0x0FFFFFFF };
+    static const int counts[] = { 1, 7, 64, 300, 511 };
+    int32_t scratchL[512], scratchR[512];
+    bool pcmMatch = true;
+    for (int variant = 0; variant < 4; variant++) {
+        for (size_t f = 0; f < sizeof(pcmFreqs) / sizeof(pcmFreqs[0]); f++) {
+            wd->status = (variant & 1) ? 0x4000 : 0;
+            wd->loopStart = (variant & 2) ? 97 : 30;  /* short and long loops */
+
+            M4APCMChannel a, b;
+            memset(&a, 0, sizeof(a));
+            a.attack = 0xFF;
+            m4a_pcm_channel_start(&a, wd, VOICE_DIRECTSOUND);
+            a.frequency = pcmFreqs[f];
+            b = a;
+            for (int k = 0; k < 12; k++) {
+                int n = counts[(k * 3 + f) % 5];
+                m4a_pcm_channel_render_span(&a, scratchL, scratchR, n);
+                m4a_pcm_channel_skip(&b, n);
+                if (a.status != b.status || a.currentPointer != b.currentPointer
+                    || a.count != b.count || a.fw != b.fw)
+                    pcmMatch = false;
+            }
+        }
+    }
+    ASSERT(pcmMatch, "pcm skip matches render state");
+
+    static uint32_t wave[4] = { 0x01234567, 0x89ABCDEF, 0xFEDCBA98, 0x76543211 };
+    static const uint32_t cgbFreqs[] = { 1750, 2000, 0x35, 0x0B, 0x00 };
+    bool cgbMatch = true;
+    for (int type = 1; type <= 4; type++) {
+        for (size_t f = 0; f < sizeof(cgbFreqs) / sizeof(cgbFreqs[0]); f++) {
+            M4ACGBChannel a;
+            memset(&a, 0, sizeof(a));
+            a.type = (uint8_t)type;
+            a.status = CHN_ENV_SUSTAIN;
+            a.envelopeVolume = 9;
+            a.pan = 0xFF;
+            a.frequency = cgbFreqs[f];
+            a.phaseIncFreq = 0xFFFFFFFFu;
+            a.lfsr = (a.frequency & 0x08) ? 0x40 : 0x4000;
+            a.wavePointer = wave;
+            M4ACGBChannel b = a;
+            for (int k = 0; k < 12; k++) {
+                int n = counts[(k + f) % 5];
+                if (k == 8) {  /* note off: the wave declick counts down */
+                    a.status = b.status = 0;
+                    a.declickSamplesRemaining = b.declickSamplesRemaining = 256;
+                }
+                memset(scratchL, 0, sizeof(scratchL));
+                memset(scratchR, 0, sizeof(scratchR));
+                m4a_cgb_channel_render_span(&a, scratchL, scratchR, n, 48000.0f);
+                m4a_cgb_channel_skip(&b, n, 48000.0f);
+                if (a.phase != b.phase || a.lfsr != b.lfsr || a.declickSample != b.declickSample
+                    || a.declickSamplesRemaining != b.declickSamplesRemaining)
+                    cgbMatch = false;
+            }
+        }
+    }
+    ASSERT(cgbMatch, "cgb skip matches render state");
+
+    free(wd);
+}
+
+/* Test that every available SIMD mixing kernel is bit-exact with scalar. */
+static void test_simd_mix_kernels(void)
+{
+    printf("Testing SIMD mixing kernels...\n");
+
+    int dataSize = 777;
+    WaveData *wd = calloc(1, sizeof(WaveData) + dataSize + 1);
+    wd->size = dataSize;
+    wd->loopStart = 123;
+    wd->data = (int8_t *)((uint8_t *)wd + sizeof(WaveData));
+    uint32_t seed = 12345;
+    for (int i = 0; i < dataSize; i++) {
+        seed = seed * 1103515245 + 12345;
+        wd->data[i] = (int8_t)(seed >> 16);  /* full-range noise: worst case diffs */
+    }
+    wd->data[dataSize] = wd->data[dataSize - 1];
+
+    M4ASimdLevel best = m4a_mix_set_simd_level(M4A_SIMD_AVX2);
+    printf("  best kernel level: %d\n", (int)best);
+
+    static const uint32_t freqs[] = { 0x400000, 0x800000, 0x123456, 0x01A3C5F1, 0x07FFFFFF, 0x3000000 };
+    for (int level = M4A_SIMD_SCALAR + 1; level <= (int)best; level++) {
+        bool allMatch = true;
+        for (int variant = 0; variant < 4; variant++) {
+            for (size_t f = 0; f < sizeof(freqs) / sizeof(freqs[0]); f++) {
+                wd->status = (variant & 1) ? 0x4000 : 0;
+                uint8_t type = (variant & 2) ? VOICE_DIRECTSOUND_NO_RESAMPLE : VOICE_DIRECTSOUND;
+
+                M4APCMChannel ref, vec;
+                memset(&ref, 0, sizeof(ref));
+                ref.attack = 0xFF;
+                m4a_pcm_channel_start(&ref, wd, type);
+                ref.frequency = freqs[f];
+                ref.envelopeVolumeRight = 255;
+                ref.envelopeVolumeLeft = 13;
+                vec = ref;
+
+                int32_t refL[1000] = {0}, refR[1000] = {0};
+                int32_t vecL[1000] = {0}, vecR[1000] = {0};
+                m4a_mix_set_simd_level(M4A_SIMD_SCALAR);
+                m4a_pcm_channel_render_span(&ref, refL, refR, 1000);
+                m4a_mix_set_simd_level((M4ASimdLevel)level);
+                m4a_pcm_channel_render_span(&vec, vecL, vecR, 1000);
+
+                if (memcmp(refL, vecL, sizeof(refL)) != 0 || memcmp(refR, vecR, sizeof(refR)) != 0
+                    || ref.currentPointer != vec.currentPointer || ref.fw != vec.fw
+                    || ref.count != vec.count || ref.status != vec.status)
+                    allMatch = false;
+            }
+        }
+        ASSERT(allMatch, "simd kernel matches scalar output and channel state");
+    }
+
+    /* Upsampler: random source, monotonic indices, arbitrary weights */
+    int32_t src[300], index[257], weight[257], refOut[257], vecOut[257];
+    for (int i = 0; i < 300; i++) {
+        seed = seed * 1103515245 + 12345;
+        src[i] = (int32_t)((seed >> 8) & 0x7FFF) - 0x4000;
+    }
+    for (int i = 0; i < 257; i++) {
+        seed = seed * 1103515245 + 12345;
+        index[i] = i + (int32_t)((seed >> 20) & 15) / 8;
+        weight[i] = (int32_t)((seed >> 4) & 0xFFFF);
+    }
+    m4a_mix_set_simd_level(M4A_SIMD_SCALAR);
+    m4a_mix_upsample(src, index, weight, refOut, 257);
+    ASSERT_EQ(refOut[0], src[index[0]] + (((src[index[0] + 1] - src[index[0]]) * weight[0] + 0x8000) >> 16),
+              "upsample: scalar matches formula");
+    for (int level = M4A_SIMD_SCALAR + 1; level <= (int)best; level++) {
+        m4a_mix_set_simd_level((M4ASimdLevel)level);
+        m4a_mix_upsample(src, index, weight, vecOut, 257);
+        ASSERT(memcmp(refOut, vecOut, sizeof(refOut)) == 0, "simd upsampler matches scalar");
+    }
+
+    m4a_mix_set_simd_level(best);
+    free(wd);
+}
+
+/* Test that the VBlank tick clock is exact over a long render (no drift). */
+static void test_tick_clock_exact(void)
+{
+    printf("Testing tick clock exactness...\n");
+
+    M4AEngine engine;
+    m4a_engine_init(&engine, 44100.0f);
+    m4a_engine_set_tempo_bpm(&engine, 1.0);  /* tempoC counts ticks mod 150 */
+
+    /* Ten minutes in uneven host blocks. */
+    static float outL[1024], outR[1024];
+    const uint64_t total = 44100ull * 600;
+    uint64_t done = 0;
+    int block = 1;
+    while (done < total) {
+        int n = block;
+        if ((uint64_t)n > total - done)
+            n = (int)(total - done);
+        m4a_engine_process(&engine, outL, outR, n);
+        done += (uint64_t)n;
+        block = block * 7 % 1021 + 1;
+    }
+
+    uint64_t period = 44100ull * M4A_RATE_SCALE;
+    uint64_t expectedTicks = total * VBLANK_RATE_SCALED / period;
+    ASSERT(engine.tickPhase == total * VBLANK_RATE_SCALED % period,
+           "tick clock phase is exact after ten minutes");
+    ASSERT_EQ(engine.tempoC, (int)(expectedTicks % 150), "tick count is exact after ten minutes");
+
+    m4a_engine_destroy(&engine);
+}
+
 /* Test PCM channel stealing / polyphony behavior */
 static void test_polyphony_stealing(void)
 {
@@ -1079,6 +1671,686 @@ static void test_lfo_tempo_scaling(void)
     m4a_engine_destroy(&off);
 }
 
+/* ---- Voicegroup loader: small projects built on disk ---- */
+
+static void tmp_set_mtime(const char *rel, time_t t)
+{
+    char path[1024];
+    tmp_path(path, sizeof(path), rel);
+    struct utimbuf times = { t, t };
+    utime(path, &times);
+}
+
+static void put_le32(uint8_t *p, uint32_t v)
+{
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+    p[2] = (uint8_t)(v >> 16);
+    p[3] = (uint8_t)(v >> 24);
+}
+
+/* The i-th sample byte of the test samples written with `seed` */
+static int8_t test_sample_byte(uint8_t seed, uint32_t i)
+{
+    return (int8_t)(uint8_t)(seed + i * 37u + (i >> 3));
+}
+
+/*
+ * Write a .bin sample: the 16-byte header, `size` bytes of data, then
+ * `extra` trailing bytes that are not part of the sample.
+ */
+static void tmp_write_bin(const char *rel, uint32_t freq, uint32_t loopStart,
+                          uint32_t size, uint8_t seed, uint32_t extra)
+{
+    uint8_t *buf = calloc(1, 16 + size + extra);
+    put_le32(buf + 4, freq);
+    put_le32(buf + 8, loopStart);
+    put_le32(buf + 12, size);
+    for (uint32_t i = 0; i < size; i++)
+        buf[16 + i] = (uint8_t)test_sample_byte(seed, i);
+    for (uint32_t i = 0; i < extra; i++)
+        buf[16 + size + i] = (uint8_t)(buf[16 + size - (size ? 1 : 0)] ^ 0x5A);
+    tmp_write(rel, buf, 16 + size + extra);
+    free(buf);
+}
+
+/* Write a mono 8-bit .wav sample holding the same bytes as tmp_write_bin(). */
+static void tmp_write_wav(const char *rel, uint32_t rate, uint32_t count, uint8_t seed)
+{
+    uint32_t len = 44 + count + (count & 1);
+    uint8_t *buf = calloc(1, len);
+    memcpy(buf, "RIFF", 4);
+    put_le32(buf + 4, len - 8);
+    memcpy(buf + 8, "WAVEfmt ", 8);
+    put_le32(buf + 16, 16);
+    buf[20] = 1;                    /* PCM */
+    buf[22] = 1;                    /* mono */
+    put_le32(buf + 24, rate);
+    put_le32(buf + 28, rate);
+    buf[32] = 1;                    /* block align */
+    buf[34] = 8;                    /* bits per sample */
+    memcpy(buf + 36, "data", 4);
+    put_le32(buf + 40, count);
+    for (uint32_t i = 0; i < count; i++)
+        buf[44 + i] = (uint8_t)(test_sample_byte(seed, i) + 128);
+    tmp_write(rel, buf, len);
+    free(buf);
+}
+
+static void test_loader_config(VoicegroupLoaderConfig *cfg)
+{
+    memset(cfg, 0, sizeof(*cfg));
+    cfg->noIndexCache = true;
+}
+
+/* Whether a loaded sample holds the bytes tmp_write_bin() wrote with `seed`. */
+static int wave_matches(const WaveData *wd, uint32_t size, uint8_t seed)
+{
+    if (!wd || wd->size != size) return 0;
+    for (uint32_t i = 0; i < size; i++)
+        if (wd->data[i] != test_sample_byte(seed, i)) return 0;
+    return 1;
+}
+
+/* Symbol lookups stay right as the tables grow past their first size. */
+static void test_loader_symbol_tables(void)
+{
+    printf("Testing loader symbol tables...\n");
+    tmp_project_begin("symbols");
+
+    enum { SAMPLES = 300 };
+    size_t cap = SAMPLES * 96 + 256;
+    char *ds = malloc(cap);
+    size_t n = 0;
+    for (int i = 0; i < SAMPLES; i++) {
+        char rel[64];
+        snprintf(rel, sizeof(rel), "sound/direct_sound_samples/s%03d.bin", i);
+        tmp_write_bin(rel, 8000 + i, 0, 16 + i % 7, (uint8_t)i, 0);
+        n += snprintf(ds + n, cap - n, "Sample%03d::\n\t.incbin \"%s\"\n", i, rel);
+    }
+    /* A second definition of a symbol: the first one wins */
+    tmp_write_bin("sound/direct_sound_samples/dup.bin", 7777, 0, 16, 99, 0);
+    snprintf(ds + n, cap - n, "Sample000::\n\t.incbin \"sound/direct_sound_samples/dup.bin\"\n");
+    tmp_write_text("sound/direct_sound_data.inc", ds);
+    free(ds);
+
+    /* Voice v plays sample 2v; the last one the last sample, and one an
+     * undefined symbol. */
+    char vg[VOICEGROUP_SIZE * 64 + 64];
+    n = snprintf(vg, sizeof(vg), "voicegroup_symbols::\n");
+    for (int v = 0; v < VOICEGROUP_SIZE; v++) {
+        if (v == 126)
+            n += snprintf(vg + n, sizeof(vg) - n, "\tvoice_directsound 60, 0, SampleNone, 255, 0, 255, 165\n");
+        else
+            n += snprintf(vg + n, sizeof(vg) - n, "\tvoice_directsound 60, 0, Sample%03d, 255, 0, 255, 165\n",
+                          v == 127 ? SAMPLES - 1 : v * 2);
+    }
+    tmp_write_text("sound/voicegroups/symbols.inc", vg);
+
+    VoicegroupLoaderConfig cfg;
+    test_loader_config(&cfg);
+    LoadedVoiceGroup *lvg = voicegroup_load(s_tmpProject, "symbols", &cfg);
+    ASSERT(lvg != NULL, "symbols: voicegroup loads");
+    if (lvg) {
+        int right = 0;
+        for (int v = 0; v < VOICEGROUP_SIZE; v++) {
+            if (v == 126) continue;
+            int s = v == 127 ? SAMPLES - 1 : v * 2;
+            const WaveData *wd = lvg->voices[v].wav;
+            if (wd && wd->freq == (uint32_t)(8000 + s) && wave_matches(wd, 16 + s % 7, (uint8_t)s))
+                right++;
+        }
+        ASSERT_EQ(right, VOICEGROUP_SIZE - 1, "symbols: every voice gets its own sample");
+        ASSERT(lvg->voices[0].wav && lvg->voices[0].wav->freq == 8000,
+               "symbols: first definition of a symbol wins");
+        ASSERT(lvg->voices[126].wav == NULL, "symbols: undefined symbol has no sample");
+        ASSERT_EQ(lvg->waveDataCount, VOICEGROUP_SIZE - 1, "symbols: one sample per symbol");
+        voicegroup_free(lvg);
+    }
+    tmp_project_end();
+}
+
+/* One sample file reached through different paths is loaded once. */
+static void test_loader_shared_sample_files(void)
+{
+    printf("Testing loader shares sample files reached by several paths...\n");
+    tmp_project_begin("shared");
+
+    tmp_write_wav("sound/direct_sound_samples/w.wav", 13379, 100, 5);
+    tmp_write_bin("sound/direct_sound_samples/c.bin", 8000, 0, 64, 6, 0);
+    const char *ds =
+        "SampleW::\n\t.incbin \"sound/direct_sound_samples/w.bin\"\n"
+        "SampleW2::\n\t.incbin \"sound/direct_sound_samples/../direct_sound_samples/w.bin\"\n"
+        "SampleC::\n\t.incbin \"sound/direct_sound_samples/c.bin\"\n"
+        "SampleC2::\n\t.incbin \"sound/./direct_sound_samples/c.bin\"\n"
+        "SampleLink::\n\t.incbin \"sound/direct_sound_samples/wlink.bin\"\n";
+    tmp_write_text("sound/direct_sound_data.inc", ds);
+    tmp_write_text("sound/voicegroups/shared.inc",
+        "voicegroup_shared::\n"
+        "\tvoice_directsound 60, 0, SampleW, 255, 0, 255, 165\n"
+        "\tvoice_directsound 60, 0, SampleW2, 255, 0, 255, 165\n"
+        "\tvoice_directsound 60, 0, SampleC, 255, 0, 255, 165\n"
+        "\tvoice_directsound 60, 0, SampleC2, 255, 0, 255, 165\n"
+        "\tvoice_directsound 60, 0, SampleLink, 255, 0, 255, 165\n");
+#ifndef _WIN32
+    char link[1024];
+    tmp_path(link, sizeof(link), "sound/direct_sound_samples/wlink.wav");
+    int linked = symlink("w.wav", link) == 0;
+#endif
+
+    VoicegroupLoaderConfig cfg;
+    test_loader_config(&cfg);
+    LoadedVoiceGroup *vg = voicegroup_load(s_tmpProject, "shared", &cfg);
+    ASSERT(vg != NULL, "shared: voicegroup loads");
+    if (vg) {
+        const ToneData *v = vg->voices;
+        ASSERT(v[0].wav && wave_matches(v[0].wav, 100, 5), "shared: .wav sample decoded");
+        ASSERT(v[2].wav && wave_matches(v[2].wav, 64, 6), "shared: .bin sample decoded");
+        ASSERT(v[0].wav == v[1].wav, "shared: .wav through two paths is one WaveData");
+        ASSERT(v[2].wav == v[3].wav, "shared: .bin through two paths is one WaveData");
+        ASSERT(v[0].wav != v[2].wav, "shared: different files stay apart");
+#ifndef _WIN32
+        if (linked) {
+            ASSERT(v[4].wav == v[0].wav, "shared: .wav through a symlink is one WaveData");
+            ASSERT_EQ(vg->waveDataCount, 2, "shared: two files, two samples");
+        }
+#endif
+        voicegroup_free(vg);
+    }
+    tmp_project_end();
+}
+
+/* Open the "index" test project: voice 0's sample rate, and its file count */
+static uint32_t index_project_freq(const VoicegroupLoaderConfig *cfg, int *fileCount)
+{
+    uint32_t freq = 0;
+    *fileCount = -1;
+    VoicegroupProject *proj = voicegroup_project_open(s_tmpProject, cfg);
+    if (!proj) return 0;
+    *fileCount = voicegroup_project_file_count(proj);
+    LoadedVoiceGroup *vg = voicegroup_project_load(proj, "index");
+    if (vg && vg->voices[0].wav)
+        freq = vg->voices[0].wav->freq;
+    voicegroup_free(vg);
+    voicegroup_project_close(proj);
+    return freq;
+}
+
+/*
+ * The project index is reused while nothing it was built from changed, and
+ * rebuilt once a symbol file's mtime or size changes or a file is added to a
+ * directory that was scanned.
+ */
+static void test_loader_index_cache(void)
+{
+    printf("Testing loader project index...\n");
+    tmp_project_begin("index");
+
+    time_t t0 = time(NULL) - 1000;
+    tmp_write_bin("sound/direct_sound_samples/a.bin", 1111, 0, 32, 1, 0);
+    tmp_write_bin("sound/direct_sound_samples/b.bin", 2222, 0, 32, 2, 0);
+    tmp_write_text("sound/direct_sound_data.inc",
+                   "SampleX::\n\t.incbin \"sound/direct_sound_samples/a.bin\"\n");
+    tmp_write_text("sound/voicegroups/index.inc",
+                   "voicegroup_index::\n\tvoice_directsound 60, 0, SampleX, 255, 0, 255, 165\n");
+    tmp_write_text("sound/keysplits/one.inc", "\tkeysplit one, 0\n\tsplit 0, 128\n");
+    tmp_set_mtime("sound/direct_sound_data.inc", t0);
+    tmp_set_mtime("sound/keysplits", t0);
+
+    VoicegroupLoaderConfig cfg;
+    memset(&cfg, 0, sizeof(cfg));
+    snprintf(cfg.indexCacheDir, sizeof(cfg.indexCacheDir), "%s/index", s_tmpProject);
+    tmp_mkdir(cfg.indexCacheDir);
+
+    int files, firstFiles;
+    ASSERT_EQ(index_project_freq(&cfg, &firstFiles), 1111, "index: first open reads the project");
+    ASSERT_EQ(firstFiles, 2, "index: symbol and keysplit files found");
+
+    /* Same size, same mtime: the index still stands, so the old mapping is
+     * what comes back -- which is how we see it was reused. */
+    tmp_write_text("sound/direct_sound_data.inc",
+                   "SampleX::\n\t.incbin \"sound/direct_sound_samples/b.bin\"\n");
+    tmp_set_mtime("sound/direct_sound_data.inc", t0);
+    ASSERT_EQ(index_project_freq(&cfg, &files), 1111, "index: reused while nothing changed");
+
+    tmp_set_mtime("sound/direct_sound_data.inc", t0 + 10);
+    ASSERT_EQ(index_project_freq(&cfg, &files), 2222, "index: rebuilt when an mtime changes");
+
+    tmp_write_text("sound/direct_sound_data.inc",
+                   "SampleX:: @ a\n\t.incbin \"sound/direct_sound_samples/a.bin\"\n");
+    tmp_set_mtime("sound/direct_sound_data.inc", t0 + 10);
+    ASSERT_EQ(index_project_freq(&cfg, &files), 1111, "index: rebuilt when a size changes");
+    ASSERT_EQ(files, firstFiles, "index: no files added yet");
+
+    tmp_write_text("sound/keysplits/two.inc", "\tkeysplit two, 0\n\tsplit 0, 128\n");
+    ASSERT_EQ(index_project_freq(&cfg, &files), 1111, "index: still loads after a file is added");
+    ASSERT_EQ(files, firstFiles + 1, "index: rebuilt when a scanned directory gains a file");
+
+    tmp_project_end();
+}
+
+/*
+ * Samples decoded in parallel for a voicegroup match the ones decoded alone
+ * (on the calling thread) byte for byte.
+ */
+static void test_loader_parallel_decode(void)
+{
+    printf("Testing loader parallel sample decoding...\n");
+    tmp_project_begin("parallel");
+
+    enum { SAMPLES = 64 };
+    char ds[SAMPLES * 96];
+    char vg[SAMPLES * 64 + 64];
+    size_t dn = 0, vn = snprintf(vg, sizeof(vg), "voicegroup_parallel::\n");
+    for (int i = 0; i < SAMPLES; i++) {
+        char rel[64], one[64], line[96];
+        uint32_t size = 1 + (uint32_t)i * 131;
+        if (i & 1) {
+            snprintf(rel, sizeof(rel), "sound/direct_sound_samples/w%02d.wav", i);
+            tmp_write_wav(rel, 8000 + i, size, (uint8_t)i);
+            rel[strlen(rel) - 3] = '\0';
+            strcat(rel, "bin");
+        } else {
+            snprintf(rel, sizeof(rel), "sound/direct_sound_samples/b%02d.bin", i);
+            tmp_write_bin(rel, 8000 + i, size / 2, size, (uint8_t)i, 0);
+        }
+        dn += snprintf(ds + dn, sizeof(ds) - dn, "Sample%02d::\n\t.incbin \"%s\"\n", i, rel);
+        snprintf(line, sizeof(line), "\tvoice_directsound 60, 0, Sample%02d, 255, 0, 255, 165\n", i);
+        vn += snprintf(vg + vn, sizeof(vg) - vn, "%s", line);
+        snprintf(one, sizeof(one), "sound/voicegroups/one%02d.inc", i);
+        char oneText[160];
+        snprintf(oneText, sizeof(oneText), "voicegroup_one%02d::\n%s", i, line);
+        tmp_write_text(one, oneText);
+    }
+    tmp_write_text("sound/direct_sound_data.inc", ds);
+    tmp_write_text("sound/voicegroups/parallel.inc", vg);
+
+    VoicegroupLoaderConfig cfg;
+    test_loader_config(&cfg);
+
+    /* Copy the samples out and free them, so the single loads below decode
+     * their files again rather than share these. */
+    WaveData copies[SAMPLES];
+    int8_t *bytes[SAMPLES];
+    int loaded = 0;
+    LoadedVoiceGroup *all = voicegroup_load(s_tmpProject, "parallel", &cfg);
+    ASSERT(all != NULL, "parallel: voicegroup loads");
+    for (int i = 0; i < SAMPLES; i++) {
+        const WaveData *wd = all ? all->voices[i].wav : NULL;
+        bytes[i] = NULL;
+        if (!wd) continue;
+        copies[i] = *wd;
+        bytes[i] = malloc(wd->size + 1);
+        memcpy(bytes[i], wd->data, wd->size + 1);  /* with the guard byte */
+        loaded++;
+    }
+    ASSERT_EQ(loaded, SAMPLES, "parallel: every sample decoded");
+    voicegroup_free(all);
+
+    int same = 0;
+    for (int i = 0; i < SAMPLES; i++) {
+        char name[16];
+        snprintf(name, sizeof(name), "one%02d", i);
+        LoadedVoiceGroup *one = voicegroup_load(s_tmpProject, name, &cfg);
+        const WaveData *wd = one ? one->voices[0].wav : NULL;
+        if (wd && bytes[i] && wd->type == copies[i].type && wd->status == copies[i].status &&
+            wd->freq == copies[i].freq && wd->loopStart == copies[i].loopStart &&
+            wd->size == copies[i].size && memcmp(wd->data, bytes[i], wd->size + 1) == 0)
+            same++;
+        voicegroup_free(one);
+        free(bytes[i]);
+    }
+    ASSERT_EQ(same, SAMPLES, "parallel: samples match the ones decoded alone");
+    tmp_project_end();
+}
+
+/*
+ * Mapped samples hold the same header and bytes as read ones, including the
+ * guard byte past the end, which repeats the last sample byte whatever
+ * follows it in the file.
+ */
+static void test_loader_mapped_samples(void)
+{
+    printf("Testing loader mapped samples...\n");
+    tmp_project_begin("mapped");
+
+    static const struct { uint32_t size, extra; } files[] = {
+        { 1000, 0 },    /* ends mid-page */
+        { 1000, 3 },    /* followed by bytes that are not the guard */
+        { 4080, 0 },    /* ends at a page boundary */
+        { 4079, 1 },    /* guard is the file's last byte */
+        { 1, 0 },
+        { 0, 0 },
+    };
+    enum { FILES = sizeof(files) / sizeof(files[0]) };
+    char ds[FILES * 80 + 80];
+    char vg[FILES * 64 + 64];
+    size_t dn = 0, vn = snprintf(vg, sizeof(vg), "voicegroup_mapped::\n");
+    for (int i = 0; i < FILES; i++) {
+        char rel[64];
+        snprintf(rel, sizeof(rel), "sound/direct_sound_samples/m%d.bin", i);
+        tmp_write_bin(rel, 9000 + i, files[i].size / 3, files[i].size, (uint8_t)(i * 40),
+                      files[i].extra);
+        dn += snprintf(ds + dn, sizeof(ds) - dn, "Sample%d::\n\t.incbin \"%s\"\n", i, rel);
+        vn += snprintf(vg + vn, sizeof(vg) - vn,
+                       "\tvoice_directsound 60, 0, Sample%d, 255, 0, 255, 165\n", i);
+    }
+    /* A file shorter than its header says */
+    uint8_t shortFile[16 + 500] = { 0 };
+    put_le32(shortFile + 12, 2000);
+    tmp_write("sound/direct_sound_samples/short.bin", shortFile, sizeof(shortFile));
+    snprintf(ds + dn, sizeof(ds) - dn, "SampleShort::\n\t.incbin \"sound/direct_sound_samples/short.bin\"\n");
+    snprintf(vg + vn, sizeof(vg) - vn, "\tvoice_directsound 60, 0, SampleShort, 255, 0, 255, 165\n");
+    tmp_write_text("sound/direct_sound_data.inc", ds);
+    tmp_write_text("sound/voicegroups/mapped.inc", vg);
+
+    VoicegroupLoaderConfig cfg;
+    test_loader_config(&cfg);
+
+    /* Read first and copy out, then free so the mapped load maps the files
+     * rather than share the read samples. */
+    WaveData copies[FILES + 1];
+    int8_t *bytes[FILES + 1];
+    LoadedVoiceGroup *vg1 = voicegroup_load(s_tmpProject, "mapped", &cfg);
+    ASSERT(vg1 != NULL, "mapped: voicegroup reads");
+    for (int i = 0; i <= FILES; i++) {
+        const WaveData *wd = vg1 ? vg1->voices[i].wav : NULL;
+        bytes[i] = NULL;
+        if (!wd) continue;
+        copies[i] = *wd;
+        bytes[i] = malloc(wd->size + 1);
+        memcpy(bytes[i], wd->data, wd->size + (wd->size ? 1 : 0));
+    }
+    voicegroup_free(vg1);
+
+    int guards = 0;
+    for (int i = 0; i < FILES; i++)
+        if (bytes[i] && (files[i].size == 0 || bytes[i][files[i].size] == bytes[i][files[i].size - 1]))
+            guards++;
+    ASSERT_EQ(guards, FILES, "mapped: read samples end with the guard byte");
+
+    cfg.mapSamples = true;
+    LoadedVoiceGroup *vg2 = voicegroup_load(s_tmpProject, "mapped", &cfg);
+    ASSERT(vg2 != NULL, "mapped: voicegroup maps");
+    int same = 0;
+    for (int i = 0; i <= FILES; i++) {
+        const WaveData *wd = vg2 ? vg2->voices[i].wav : NULL;
+        if (!wd || !bytes[i]) {
+            if (!wd && !bytes[i]) same++;
+        } else if (wd->type == copies[i].type && wd->status == copies[i].status &&
+                   wd->freq == copies[i].freq && wd->loopStart == copies[i].loopStart &&
+                   wd->size == copies[i].size &&
+                   memcmp(wd->data, bytes[i], wd->size + (wd->size ? 1 : 0)) == 0) {
+            same++;
+        }
+        free(bytes[i]);
+    }
+    ASSERT_EQ(same, FILES + 1, "mapped: mapped samples match read ones");
+    voicegroup_free(vg2);
+    tmp_project_end();
+}
+
+/*
+ * voicegroup_acquire() shares one copy until a file it came from changes;
+ * the stale copy stays usable until its last user releases it.
+ */
+static void test_loader_shared_voicegroups(void)
+{
+    printf("Testing loader shared voicegroups...\n");
+    tmp_project_begin("acquire");
+
+    time_t t0 = time(NULL) - 1000;
+    tmp_write_bin("sound/direct_sound_samples/a.bin", 1111, 0, 32, 1, 0);
+    tmp_write_text("sound/direct_sound_data.inc",
+                   "SampleA::\n\t.incbin \"sound/direct_sound_samples/a.bin\"\n");
+    tmp_write_text("sound/voicegroups/acquire.inc",
+                   "voicegroup_acquire::\n\tvoice_directsound 60, 0, SampleA, 255, 0, 255, 165\n");
+    tmp_set_mtime("sound/direct_sound_samples/a.bin", t0);
+
+    VoicegroupLoaderConfig cfg;
+    test_loader_config(&cfg);
+    LoadedVoiceGroup *a = voicegroup_acquire(s_tmpProject, "acquire", &cfg);
+    LoadedVoiceGroup *b = voicegroup_acquire(s_tmpProject, "acquire", &cfg);
+    ASSERT(a != NULL, "acquire: voicegroup loads");
+    ASSERT(a == b, "acquire: second acquire shares the first copy");
+
+    tmp_write_bin("sound/direct_sound_samples/a.bin", 2222, 0, 32, 2, 0);
+    tmp_set_mtime("sound/direct_sound_samples/a.bin", t0 + 10);
+    LoadedVoiceGroup *c = voicegroup_acquire(s_tmpProject, "acquire", &cfg);
+    ASSERT(c != NULL && c != a, "acquire: a changed file gives a fresh copy");
+    ASSERT(c && c->voices[0].wav && c->voices[0].wav->freq == 2222,
+           "acquire: fresh copy has the new sample");
+    ASSERT(a && a->voices[0].wav && wave_matches(a->voices[0].wav, 32, 1),
+           "acquire: stale copy still usable by its holders");
+
+    LoadedVoiceGroup *d = voicegroup_acquire(s_tmpProject, "acquire", &cfg);
+    ASSERT(d == c, "acquire: fresh copy is shared in turn");
+
+    voicegroup_release(a);
+    ASSERT(b->voices[0].wav && wave_matches(b->voices[0].wav, 32, 1),
+           "acquire: stale copy lives until its last release");
+    voicegroup_release(b);
+    ASSERT(c->voices[0].wav && c->voices[0].wav->freq == 2222,
+           "acquire: releasing the stale copy leaves the fresh one");
+
+    /* A change that keeps the mtime goes unnoticed while the copy is held,
+     * but once the last user released it the next acquire loads anew. */
+    tmp_write_bin("sound/direct_sound_samples/a.bin", 3333, 0, 32, 3, 0);
+    tmp_set_mtime("sound/direct_sound_samples/a.bin", t0 + 10);
+    LoadedVoiceGroup *e = voicegroup_acquire(s_tmpProject, "acquire", &cfg);
+    ASSERT(e == c, "acquire: held copy is shared while its files look unchanged");
+    voicegroup_release(c);
+    voicegroup_release(d);
+    voicegroup_release(e);
+    LoadedVoiceGroup *f = voicegroup_acquire(s_tmpProject, "acquire", &cfg);
+    ASSERT(f && f->voices[0].wav && f->voices[0].wav->freq == 3333,
+           "acquire: last release freed the copy");
+    voicegroup_release(f);
+    tmp_project_end();
+}
+
+/*
+ * A project with a keysplit (program 0: three sub-voices split at keys 60
+ * and 84), a drumkit (program 1: three drums) and two plain voices, every
+ * voice on its own sample, sample i written with seed i.
+ */
+static void tmp_write_keysplit_project(void)
+{
+    char ds[8 * 80];
+    size_t n = 0;
+    for (int i = 0; i < 8; i++) {
+        char rel[64];
+        snprintf(rel, sizeof(rel), "sound/direct_sound_samples/k%d.bin", i);
+        tmp_write_bin(rel, 8000 + i, 0, 48, (uint8_t)i, 0);
+        n += snprintf(ds + n, sizeof(ds) - n, "Sample%d::\n\t.incbin \"%s\"\n", i, rel);
+    }
+    tmp_write_text("sound/direct_sound_data.inc", ds);
+    static const uint8_t wave[16] = { 0x01, 0x23, 0x45, 0x67, 0x89, 0xAB, 0xCD, 0xEF,
+                                      0xFE, 0xDC, 0xBA, 0x98, 0x76, 0x54, 0x32, 0x10 };
+    tmp_write("sound/programmable_wave_samples/w1.pcm", wave, sizeof(wave));
+    tmp_write_text("sound/programmable_wave_data.inc",
+                   "Wave1::\n\t.incbin \"sound/programmable_wave_samples/w1.pcm\"\n");
+    tmp_write_text("sound/keysplit_tables.inc",
+                   "\tkeysplit piano, 36\n\tsplit 0, 60\n\tsplit 1, 84\n\tsplit 2, 128\n");
+    tmp_write_text("sound/voicegroups/piano.inc",
+                   "voicegroup_piano::\n"
+                   "\tvoice_directsound 60, 0, Sample0, 255, 0, 255, 165\n"
+                   "\tvoice_directsound 60, 0, Sample1, 255, 0, 255, 165\n"
+                   "\tvoice_directsound 60, 0, Sample2, 255, 0, 255, 165\n");
+    tmp_write_text("sound/voicegroups/drums.inc",
+                   "voicegroup_drums::\n"
+                   "\tvoice_directsound 60, 0, Sample3, 255, 0, 255, 165\n"
+                   "\tvoice_directsound 60, 0, Sample4, 255, 0, 255, 165\n"
+                   "\tvoice_directsound 60, 0, Sample5, 255, 0, 255, 165\n");
+    tmp_write_text("sound/voicegroups/split.inc",
+                   "voicegroup_split::\n"
+                   "\tvoice_keysplit voicegroup_piano, keysplit_piano\n"
+                   "\tvoice_keysplit_all voicegroup_drums\n"
+                   "\tvoice_directsound 60, 0, Sample6, 255, 0, 255, 165\n"
+                   "\tvoice_directsound 60, 0, Sample7, 255, 0, 255, 165\n"
+                   "\tvoice_programmable_wave 60, 0, Wave1, 0, 1, 8, 4\n");
+}
+
+static void usage_play(VoicegroupUsage *usage, int program, int key)
+{
+    usage->keys[program][key >> 3] |= (uint8_t)(1u << (key & 7));
+}
+
+/* voicegroup_load_used() reads only the samples of the sub-voices played. */
+static void test_loader_used_samples(void)
+{
+    printf("Testing loader loads only the samples a song uses...\n");
+    tmp_project_begin("used");
+    tmp_write_keysplit_project();
+
+    VoicegroupLoaderConfig cfg;
+    test_loader_config(&cfg);
+    VoicegroupUsage usage;
+    memset(&usage, 0, sizeof(usage));
+    usage_play(&usage, 0, 70);   /* piano, middle split */
+    usage_play(&usage, 1, 2);    /* drum 2 */
+    usage_play(&usage, 3, 40);   /* plain voice 3; voice 2 is not played */
+
+    LoadedVoiceGroup *vg = voicegroup_load_used(s_tmpProject, "split", &cfg, &usage);
+    ASSERT(vg != NULL, "used: voicegroup loads");
+    if (vg) {
+        const ToneData *piano = (const ToneData *)vg->voices[0].subGroup;
+        const ToneData *drums = (const ToneData *)vg->voices[1].subGroup;
+        ASSERT(piano && drums, "used: keysplit and drumkit parsed");
+        if (piano && drums) {
+            ASSERT(piano[0].wav == NULL, "used: piano split below not loaded");
+            ASSERT(wave_matches(piano[1].wav, 48, 1), "used: played piano split loaded");
+            ASSERT(piano[2].wav == NULL, "used: piano split above not loaded");
+            ASSERT(drums[0].wav == NULL && drums[1].wav == NULL, "used: unplayed drums not loaded");
+            ASSERT(wave_matches(drums[2].wav, 48, 5), "used: played drum loaded");
+        }
+        ASSERT(vg->voices[2].wav == NULL, "used: unplayed voice not loaded");
+        ASSERT(wave_matches(vg->voices[3].wav, 48, 7), "used: played voice loaded");
+        ASSERT(vg->voices[4].wavePointer != NULL, "used: programmable wave still loaded");
+        ASSERT_EQ(vg->waveDataCount, 3, "used: three samples read");
+        voicegroup_free(vg);
+    }
+
+    vg = voicegroup_load_used(s_tmpProject, "split", &cfg, NULL);
+    ASSERT(vg && vg->waveDataCount == 8, "used: no usage loads every sample");
+    voicegroup_free(vg);
+    tmp_project_end();
+}
+
+/* Whether p points into the used part of one of vg's arena blocks. */
+static bool in_arena(const LoadedVoiceGroup *vg, const void *p)
+{
+    for (const struct ArenaBlock *b = vg->arena; b; b = b->next) {
+        const char *start = (const char *)b->data;
+        if ((const char *)p >= start && (const char *)p < start + b->used)
+            return true;
+    }
+    return false;
+}
+
+/*
+ * Sub-voicegroups, keysplit tables and programmable waves come from the
+ * voicegroup's arena, and voicegroup_free() hands the arena back (a leak
+ * shows up when run under ASan/LSan).
+ */
+static void test_loader_arena(void)
+{
+    printf("Testing loader arena...\n");
+    tmp_project_begin("arena");
+    tmp_write_keysplit_project();
+
+    VoicegroupLoaderConfig cfg;
+    test_loader_config(&cfg);
+    LoadedVoiceGroup *vg = voicegroup_load(s_tmpProject, "split", &cfg);
+    ASSERT(vg != NULL, "arena: voicegroup loads");
+    if (vg) {
+        ASSERT(vg->arena != NULL, "arena: voicegroup has an arena");
+        ASSERT_EQ(vg->subGroupCount, 2, "arena: keysplit and drumkit sub-voicegroups");
+        ASSERT_EQ(vg->keySplitTableCount, 1, "arena: one keysplit table");
+        ASSERT_EQ(vg->progWaveCount, 1, "arena: one programmable wave");
+        for (int i = 0; i < vg->subGroupCount; i++)
+            ASSERT(in_arena(vg, vg->subGroups[i]), "arena: sub-voicegroup allocated from the arena");
+        for (int i = 0; i < vg->keySplitTableCount; i++)
+            ASSERT(in_arena(vg, vg->keySplitTables[i]), "arena: keysplit table allocated from the arena");
+        for (int i = 0; i < vg->progWaveCount; i++)
+            ASSERT(in_arena(vg, vg->progWaves[i]), "arena: programmable wave allocated from the arena");
+        ASSERT(vg->voices[0].subGroup == vg->subGroups[0] &&
+               vg->voices[0].keySplitTable == vg->keySplitTables[0] &&
+               vg->voices[1].subGroup == vg->subGroups[1] &&
+               vg->voices[4].wavePointer == vg->progWaves[0],
+               "arena: voices point at the arena copies");
+        ASSERT(!in_arena(vg, vg), "arena: check rejects memory outside the arena");
+    }
+    voicegroup_free(vg);
+    tmp_project_end();
+}
+
+/*
+ * Project files are read line by line whatever their line endings,
+ * comments, final newline or line length.
+ */
+static void test_loader_text_files(void)
+{
+    printf("Testing loader reading project text files...\n");
+    tmp_project_begin("text");
+
+    tmp_write_bin("sound/direct_sound_samples/a.bin", 1111, 0, 32, 1, 0);
+    tmp_write_bin("sound/direct_sound_samples/b.bin", 2222, 0, 32, 2, 0);
+
+    /* Lines longer than any fixed buffer, in both kinds of file */
+    char pad[3000];
+    memset(pad, ' ', sizeof(pad) - 1);
+    pad[sizeof(pad) - 1] = '\0';
+
+    char ds[4096];
+    snprintf(ds, sizeof(ds),
+             "\t.align 2\r\n"
+             "SampleA:: @ first sample\r\n"
+             "\t.incbin \"sound/direct_sound_samples/a.bin\" // trailing comment\r\n"
+             "\r\n"
+             "// SampleA::\r\n"
+             "@ \t.incbin \"sound/direct_sound_samples/b.bin\"\r\n"
+             "SampleB::\r\n"
+             "\t.incbin%s\"sound/direct_sound_samples/b.bin\"", pad);  /* no final newline */
+    tmp_write_text("sound/direct_sound_data.inc", ds);
+
+    char vg[4096];
+    snprintf(vg, sizeof(vg),
+             "\t.align 2\r\n"
+             "voicegroup_text:: @ label comment\r\n"
+             "\tvoice_directsound 60, 0, SampleA, 255, 0, 255, 165 @ comment\r\n"
+             "@\tvoice_noise 1, 0, 0, 0, 3, 5, 1\r\n"
+             "// \tvoice_noise 2, 0, 0, 0, 3, 5, 1\r\n"
+             "\tvoice_square_1 61, 0, 0, 2, 0, 2, 10, 3 // comment\r\n"
+             "\tvoice_directsound 48, 0, SampleB, 1,%s 2, 3, 4\r\n"
+             "\tvoice_noise 62, 0, 0, 0, 3, 5, 1", pad);  /* no final newline */
+    tmp_write_text("sound/voicegroups/text.inc", vg);
+
+    VoicegroupLoaderConfig cfg;
+    test_loader_config(&cfg);
+    LoadedVoiceGroup *lvg = voicegroup_load(s_tmpProject, "text", &cfg);
+    ASSERT(lvg != NULL, "text: voicegroup loads");
+    if (lvg) {
+        const ToneData *v = lvg->voices;
+        ASSERT_EQ(v[0].type, VOICE_DIRECTSOUND, "text: voice 0 type");
+        ASSERT_EQ(v[0].key, 60, "text: voice 0 key");
+        ASSERT_EQ(v[0].release, 165, "text: voice 0 release before a comment");
+        ASSERT(v[0].wav && v[0].wav->freq == 1111, "text: commented-out symbol ignored");
+        ASSERT_EQ(v[1].type, VOICE_SQUARE_1, "text: commented-out voices skipped");
+        ASSERT_EQ(v[1].key, 61, "text: voice 1 key");
+        ASSERT_EQ(v[2].key, 48, "text: long line key");
+        ASSERT_EQ(v[2].attack, 1, "text: long line attack");
+        ASSERT_EQ(v[2].decay, 2, "text: long line decay");
+        ASSERT_EQ(v[2].sustain, 3, "text: long line sustain");
+        ASSERT_EQ(v[2].release, 4, "text: long line release");
+        ASSERT(v[2].wav && v[2].wav->freq == 2222, "text: long .incbin line, no final newline");
+        ASSERT_EQ(v[3].type, VOICE_NOISE, "text: last line without a newline");
+        ASSERT_EQ(v[3].key, 62, "text: last line key");
+        voicegroup_free(lvg);
+    }
+    tmp_project_end();
+}
+
 int main(void)
 {
     printf("=== M4A Engine Unit Tests ===\n\n");
@@ -1090,12 +2362,30 @@ int main(void)
     test_trk_vol_pit_set();
     test_engine_init();
     test_basic_audio();
+    test_idle_silence();
+    test_snapshot_restore();
+    test_engine_skip();
+    test_track_mute_stems();
+    test_pcm_span_render();
+    test_cgb_span_render();
+    test_channel_skip();
+    test_simd_mix_kernels();
+    test_tick_clock_exact();
     test_polyphony_stealing();
     test_poly_overflow_debug();
     test_portamento();
     test_portamento_prev_key_tracking();
     test_pwm();
     test_lfo_tempo_scaling();
+    test_loader_symbol_tables();
+    test_loader_shared_sample_files();
+    test_loader_index_cache();
+    test_loader_parallel_decode();
+    test_loader_mapped_samples();
+    test_loader_shared_voicegroups();
+    test_loader_used_samples();
+    test_loader_arena();
+    test_loader_text_files();
 
     printf("\n=== Results: %d/%d tests passed ===\n", tests_passed, tests_run);
     return (tests_passed == tests_run) ? 0 : 1;
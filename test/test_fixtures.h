@@ -0,0 +1,105 @@
+/*
+ * Scratch projects on disk for the unit tests: a directory per test under
+ * the temp directory, with files written into it by project-relative path.
+ */
+#ifndef TEST_FIXTURES_H
+#define TEST_FIXTURES_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <direct.h>
+#include <process.h>
+#else
+#include <unistd.h>
+#endif
+
+static char s_tmpProject[256];
+
+static void tmp_remove_tree(const char *path)
+{
+    struct stat st;
+    if (stat(path, &st) == 0 && S_ISDIR(st.st_mode)) {
+        DIR *d = opendir(path);
+        if (d) {
+            struct dirent *ent;
+            while ((ent = readdir(d)) != NULL) {
+                if (strcmp(ent->d_name, ".") == 0 || strcmp(ent->d_name, "..") == 0)
+                    continue;
+                char sub[1024];
+                snprintf(sub, sizeof(sub), "%s/%s", path, ent->d_name);
+                tmp_remove_tree(sub);
+            }
+            closedir(d);
+        }
+        rmdir(path);
+    } else {
+        remove(path);
+    }
+}
+
+static void tmp_mkdir(const char *path)
+{
+#ifdef _WIN32
+    _mkdir(path);
+#else
+    mkdir(path, 0755);
+#endif
+}
+
+/* Start an empty project directory for a test. */
+static void tmp_project_begin(const char *name)
+{
+    const char *base = getenv("TMPDIR");
+    if (!base || !base[0]) base = getenv("TEMP");
+    if (!base || !base[0]) base = "/tmp";
+#ifdef _WIN32
+    int pid = _getpid();
+#else
+    int pid = (int)getpid();
+#endif
+    snprintf(s_tmpProject, sizeof(s_tmpProject), "%s/poryaaaa_test_%d_%s", base, pid, name);
+    tmp_remove_tree(s_tmpProject);
+    tmp_mkdir(s_tmpProject);
+}
+
+static void tmp_project_end(void)
+{
+    tmp_remove_tree(s_tmpProject);
+}
+
+static void tmp_path(char *out, size_t outSize, const char *rel)
+{
+    snprintf(out, outSize, "%s/%s", s_tmpProject, rel);
+}
+
+/* Write a file under the project, creating its directories. */
+static void tmp_write(const char *rel, const void *data, size_t len)
+{
+    char path[1024];
+    tmp_path(path, sizeof(path), rel);
+    for (char *p = path + strlen(s_tmpProject) + 1; *p; p++) {
+        if (*p == '/') {
+            *p = '\0';
+            tmp_mkdir(path);
+            *p = '/';
+        }
+    }
+    FILE *f = fopen(path, "wb");
+    if (!f) {
+        fprintf(stderr, "cannot write %s\n", path);
+        return;
+    }
+    fwrite(data, 1, len, f);
+    fclose(f);
+}
+
+static void tmp_write_text(const char *rel, const char *text)
+{
+    tmp_write(rel, text, strlen(text));
+}
+
+#endif /* TEST_FIXTURES_H */
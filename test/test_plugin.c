@@ -0,0 +1,403 @@
+/*
+ * Unit tests for the CLAP plugin.
+ *
+ * The test plays the host: it drives the plugin through its CLAP entry
+ * point, acting as both the main thread and the audio thread, and looks at
+ * M4APluginData to see which voicegroup each thread holds.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+#include <clap/clap.h>
+#include "m4a_plugin.h"
+#include "test_fixtures.h"
+
+static int tests_run = 0;
+static int tests_passed = 0;
+
+#define ASSERT(cond, msg) do { \
+    tests_run++; \
+    if (!(cond)) { \
+        fprintf(stderr, "FAIL: %s (line %d)\n", msg, __LINE__); \
+    } else { \
+        tests_passed++; \
+    } \
+} while(0)
+
+/* ---- A project built on disk ---- */
+
+/* Write a looping .bin sample, so a note on it sounds until released. */
+static void tmp_write_loop_bin(const char *rel, uint8_t seed)
+{
+    uint8_t buf[16 + 64];
+    memset(buf, 0, sizeof(buf));
+    buf[3] = 0x40;                  /* status: loop */
+    buf[4] = 0x44;                  /* freq 0xAC44 = 44100 */
+    buf[5] = 0xAC;
+    buf[12] = 64;                   /* size */
+    for (int i = 0; i < 64; i++)
+        buf[16 + i] = (uint8_t)(seed + i * 37);
+    tmp_write(rel, buf, sizeof(buf));
+}
+
+/* ---- The host ---- */
+
+static int s_callbackRequested;
+
+static const void *host_get_extension(const clap_host_t *host, const char *id)
+{
+    return NULL;
+}
+
+static void host_request_restart(const clap_host_t *host)
+{
+}
+
+static void host_request_process(const clap_host_t *host)
+{
+}
+
+static void host_request_callback(const clap_host_t *host)
+{
+    __atomic_store_n(&s_callbackRequested, 1, __ATOMIC_RELEASE);
+}
+
+static const clap_host_t s_host = {
+    .clap_version = CLAP_VERSION_INIT,
+    .host_data = NULL,
+    .name = "poryaaaa_plugin_tests",
+    .vendor = "",
+    .url = "",
+    .version = "1.0",
+    .get_extension = host_get_extension,
+    .request_restart = host_request_restart,
+    .request_process = host_request_process,
+    .request_callback = host_request_callback,
+};
+
+/* Main thread: wait for the plugin to ask for a callback, then run it. */
+static int host_run_callback(const clap_plugin_t *plugin)
+{
+    for (int i = 0; i < 5000; i++) {
+        if (__atomic_exchange_n(&s_callbackRequested, 0, __ATOMIC_ACQ_REL)) {
+            plugin->on_main_thread(plugin);
+            return 1;
+        }
+#ifdef _WIN32
+        Sleep(1);
+#else
+        usleep(1000);
+#endif
+    }
+    return 0;
+}
+
+typedef struct {
+    const uint8_t *data;
+    size_t len, pos;
+} StateReader;
+
+static int64_t state_read(const clap_istream_t *stream, void *buffer, uint64_t size)
+{
+    StateReader *r = (StateReader *)stream->ctx;
+    size_t n = r->len - r->pos;
+    if (n > size) n = (size_t)size;
+    memcpy(buffer, r->data + r->pos, n);
+    r->pos += n;
+    return (int64_t)n;
+}
+
+/* Main thread: restore a state naming a voicegroup of the test project. */
+static bool host_load_state(const clap_plugin_t *plugin, const char *voicegroupName)
+{
+    uint8_t buf[1024];
+    uint32_t rootLen = (uint32_t)strlen(s_tmpProject);
+    uint32_t nameLen = (uint32_t)strlen(voicegroupName);
+    size_t len = 0;
+    memcpy(buf + len, &rootLen, 4);             len += 4;
+    memcpy(buf + len, s_tmpProject, rootLen);   len += rootLen;
+    memcpy(buf + len, &nameLen, 4);             len += 4;
+    memcpy(buf + len, voicegroupName, nameLen); len += nameLen;
+    buf[len++] = 0;                             /* reverb */
+    buf[len++] = 15;                            /* master volume */
+    buf[len++] = 127;                           /* song master volume */
+
+    StateReader reader = { buf, len, 0 };
+    clap_istream_t stream = { .ctx = &reader, .read = state_read };
+    const clap_plugin_state_t *state = plugin->get_extension(plugin, CLAP_EXT_STATE);
+    return state && state->load(plugin, &stream);
+}
+
+typedef struct {
+    clap_event_midi_t events[1];
+    uint32_t count;
+} EventList;
+
+static uint32_t events_size(const clap_input_events_t *list)
+{
+    return ((const EventList *)list->ctx)->count;
+}
+
+static const clap_event_header_t *events_get(const clap_input_events_t *list, uint32_t index)
+{
+    const EventList *ev = (const EventList *)list->ctx;
+    return index < ev->count ? &ev->events[index].header : NULL;
+}
+
+static bool events_try_push(const clap_output_events_t *list, const clap_event_header_t *event)
+{
+    return true;
+}
+
+/* Audio thread: process one 256-frame block, sending the MIDI message
+ * (status, key, velocity) at its start unless status is 0. */
+static void host_process(const clap_plugin_t *plugin, uint8_t status, uint8_t key, uint8_t velocity)
+{
+    static float left[256], right[256];
+    float *channels[2] = { left, right };
+    clap_audio_buffer_t out;
+    memset(&out, 0, sizeof(out));
+    out.data32 = channels;
+    out.channel_count = 2;
+
+    EventList ev;
+    memset(&ev, 0, sizeof(ev));
+    if (status) {
+        clap_event_midi_t *m = &ev.events[ev.count++];
+        m->header.size = sizeof(*m);
+        m->header.time = 0;
+        m->header.space_id = CLAP_CORE_EVENT_SPACE_ID;
+        m->header.type = CLAP_EVENT_MIDI;
+        m->data[0] = status;
+        m->data[1] = key;
+        m->data[2] = velocity;
+    }
+    clap_input_events_t in = { .ctx = &ev, .size = events_size, .get = events_get };
+    clap_output_events_t outEvents = { .ctx = NULL, .try_push = events_try_push };
+
+    clap_process_t process;
+    memset(&process, 0, sizeof(process));
+    process.frames_count = 256;
+    process.audio_outputs = &out;
+    process.audio_outputs_count = 1;
+    process.in_events = &in;
+    process.out_events = &outEvents;
+    plugin->process(plugin, &process);
+}
+
+static bool is_retiring(const M4APluginData *data, const PluginVoicegroup *vg)
+{
+    for (int i = 0; i < VG_RETIRE_SLOTS; i++)
+        if (data->retiringVg[i] == vg)
+            return true;
+    return false;
+}
+
+static bool is_retired(const M4APluginData *data, const PluginVoicegroup *vg)
+{
+    for (int i = 0; i < VG_RETIRE_SLOTS; i++)
+        if (data->retiredVg[i] == vg)
+            return true;
+    return false;
+}
+
+static int count_slots(PluginVoicegroup *const *slots)
+{
+    int n = 0;
+    for (int i = 0; i < VG_RETIRE_SLOTS; i++)
+        if (slots[i])
+            n++;
+    return n;
+}
+
+/* Whether a sounding PCM channel plays the sample of vg's voice 0. */
+static bool sounds_from(const M4APluginData *data, const PluginVoicegroup *vg)
+{
+    for (int i = 0; i < TOTAL_PCM_CHANNELS; i++) {
+        const M4APCMChannel *ch = &data->engine.pcmChannels[i];
+        if ((ch->status & CHN_ON) && ch->wav == vg->voices[0].wav)
+            return true;
+    }
+    return false;
+}
+
+/*
+ * A voicegroup swapped out while one of its notes still sounds stays alive
+ * until that note ends: the audio thread retires it, hands it back once no
+ * channel plays from it, and only then does the main thread free it.
+ */
+static void test_voicegroup_swap(void)
+{
+    printf("Testing voicegroup swap...\n");
+    tmp_project_begin("swap");
+    tmp_write_loop_bin("sound/direct_sound_samples/one.bin", 1);
+    tmp_write_loop_bin("sound/direct_sound_samples/two.bin", 2);
+    tmp_write_text("sound/direct_sound_data.inc",
+                   "SampleOne::\n\t.incbin \"sound/direct_sound_samples/one.bin\"\n"
+                   "SampleTwo::\n\t.incbin \"sound/direct_sound_samples/two.bin\"\n");
+    tmp_write_text("sound/voicegroups/one.inc",
+                   "voicegroup_one::\n\tvoice_directsound 60, 0, SampleOne, 255, 0, 255, 0\n");
+    tmp_write_text("sound/voicegroups/two.inc",
+                   "voicegroup_two::\n\tvoice_directsound 60, 0, SampleTwo, 255, 0, 255, 0\n");
+
+    clap_entry.init("");
+    const clap_plugin_factory_t *factory = clap_entry.get_factory(CLAP_PLUGIN_FACTORY_ID);
+    const clap_plugin_t *plugin = factory->create_plugin(factory, &s_host, "com.huderlem.poryaaaa");
+    ASSERT(plugin != NULL, "swap: plugin created");
+    if (!plugin) {
+        tmp_project_end();
+        return;
+    }
+    plugin->init(plugin);
+    M4APluginData *data = (M4APluginData *)plugin->plugin_data;
+    data->loaderConfig.noIndexCache = true;
+    plugin->activate(plugin, 44100.0, 256, 256);
+
+    /* Load "one" and start a note on it */
+    ASSERT(host_load_state(plugin, "one"), "swap: state loads");
+    ASSERT(host_run_callback(plugin), "swap: load of one finishes");
+    PluginVoicegroup *one = data->loadedVg;
+    ASSERT(one != NULL, "swap: one loaded");
+    ASSERT(data->pendingVg == one && data->playingVg == NULL,
+           "swap: one waits for the audio thread");
+    host_process(plugin, 0, 0, 0);
+    ASSERT(data->playingVg == one && data->pendingVg == NULL, "swap: audio thread plays one");
+    host_process(plugin, 0x90, 60, 127);
+    ASSERT(one && sounds_from(data, one), "swap: note sounds from one");
+
+    /* Load "two" while the note holds */
+    ASSERT(host_load_state(plugin, "two"), "swap: state loads again");
+    ASSERT(host_run_callback(plugin), "swap: load of two finishes");
+    PluginVoicegroup *two = data->loadedVg;
+    ASSERT(two != NULL && two != one, "swap: two loaded");
+    ASSERT(data->pendingVg == two && data->playingVg == one,
+           "swap: audio thread still plays one until its next block");
+
+    host_process(plugin, 0, 0, 0);
+    ASSERT(data->playingVg == two && data->pendingVg == NULL, "swap: audio thread plays two");
+    ASSERT(is_retiring(data, one), "swap: one retires");
+    ASSERT(count_slots(data->retiredVg) == 0, "swap: one not handed back while its note sounds");
+    for (int i = 0; i < 8; i++)
+        host_process(plugin, 0, 0, 0);
+    plugin->on_main_thread(plugin);
+    ASSERT(is_retiring(data, one) && sounds_from(data, one),
+           "swap: one kept while its note sounds");
+
+    host_process(plugin, 0x90, 72, 127);
+    ASSERT(two && sounds_from(data, two), "swap: new note sounds from two");
+
+    /* Release the note on one; the next blocks hand one back */
+    __atomic_store_n(&s_callbackRequested, 0, __ATOMIC_RELEASE);
+    host_process(plugin, 0x80, 60, 0);
+    int blocks = 0;
+    while (is_retiring(data, one) && blocks < 200) {
+        host_process(plugin, 0, 0, 0);
+        blocks++;
+    }
+    ASSERT(!is_retiring(data, one) && is_retired(data, one),
+           "swap: one handed back once its note ended");
+    ASSERT(!sounds_from(data, one), "swap: nothing plays from one when handed back");
+    ASSERT(__atomic_load_n(&s_callbackRequested, __ATOMIC_ACQUIRE),
+           "swap: hand-back asks for a main-thread callback");
+    ASSERT(host_run_callback(plugin), "swap: callback runs");
+    ASSERT(count_slots(data->retiredVg) == 0, "swap: main thread frees one");
+    ASSERT(data->playingVg == two && sounds_from(data, two), "swap: two keeps playing");
+
+    /* Swap back while two still sounds, then deactivate */
+    ASSERT(host_load_state(plugin, "one"), "swap: state loads a third time");
+    ASSERT(host_run_callback(plugin), "swap: reload of one finishes");
+    PluginVoicegroup *again = data->loadedVg;
+    host_process(plugin, 0, 0, 0);
+    ASSERT(data->playingVg == again && is_retiring(data, two), "swap: two retires");
+
+    plugin->deactivate(plugin);
+    ASSERT(count_slots(data->retiringVg) == 0 && count_slots(data->retiredVg) == 0,
+           "swap: deactivate frees retiring groups");
+    ASSERT(data->pendingVg == NULL && data->playingVg == data->loadedVg && data->loadedVg == again,
+           "swap: deactivate leaves only the loaded group");
+
+    plugin->destroy(plugin);
+    clap_entry.deinit();
+    tmp_project_end();
+}
+
+/*
+ * Reloading a voicegroup whose files have not changed gives a group sharing
+ * the playing one's data, so a note held across reloads keeps none of the
+ * old groups around and every reload takes over at the next block.
+ */
+static void test_voicegroup_reload_held(void)
+{
+    printf("Testing voicegroup reload under a held note...\n");
+    tmp_project_begin("reload");
+    tmp_write_loop_bin("sound/direct_sound_samples/one.bin", 1);
+    tmp_write_text("sound/direct_sound_data.inc",
+                   "SampleOne::\n\t.incbin \"sound/direct_sound_samples/one.bin\"\n");
+    tmp_write_text("sound/voicegroups/one.inc",
+                   "voicegroup_one::\n\tvoice_directsound 60, 0, SampleOne, 255, 0, 255, 0\n");
+
+    clap_entry.init("");
+    const clap_plugin_factory_t *factory = clap_entry.get_factory(CLAP_PLUGIN_FACTORY_ID);
+    const clap_plugin_t *plugin = factory->create_plugin(factory, &s_host, "com.huderlem.poryaaaa");
+    ASSERT(plugin != NULL, "reload: plugin created");
+    if (!plugin) {
+        tmp_project_end();
+        return;
+    }
+    plugin->init(plugin);
+    M4APluginData *data = (M4APluginData *)plugin->plugin_data;
+    data->loaderConfig.noIndexCache = true;
+    plugin->activate(plugin, 44100.0, 256, 256);
+
+    ASSERT(host_load_state(plugin, "one"), "reload: state loads");
+    ASSERT(host_run_callback(plugin), "reload: load finishes");
+    host_process(plugin, 0, 0, 0);
+    ASSERT(data->playingVg != NULL && data->playingVg == data->loadedVg, "reload: one plays");
+    host_process(plugin, 0x90, 60, 127);
+    ASSERT(data->playingVg && sounds_from(data, data->playingVg), "reload: note sounds");
+
+    /* One more reload than there are retire slots */
+    int tookOver = 0;
+    for (int i = 0; i < VG_RETIRE_SLOTS + 1; i++) {
+        __atomic_store_n(&s_callbackRequested, 0, __ATOMIC_RELEASE);
+        plugin->on_main_thread(plugin);
+        /* A cleared name makes the state load count as a change, which
+         * reloads the voicegroup like the GUI's Reload button */
+        data->voicegroupName[0] = '\0';
+        if (!host_load_state(plugin, "one") || !host_run_callback(plugin))
+            break;
+        PluginVoicegroup *reloaded = data->loadedVg;
+        host_process(plugin, 0, 0, 0);
+        if (reloaded && data->playingVg == reloaded && data->pendingVg == NULL)
+            tookOver++;
+    }
+    ASSERT(tookOver == VG_RETIRE_SLOTS + 1, "reload: every reload takes over at the next block");
+    ASSERT(data->playingVg && sounds_from(data, data->playingVg), "reload: note still sounds");
+
+    host_process(plugin, 0, 0, 0);
+    ASSERT(count_slots(data->retiringVg) == 0, "reload: no group kept by the held note");
+    plugin->on_main_thread(plugin);
+    ASSERT(count_slots(data->retiredVg) == 0, "reload: main thread frees the old groups");
+
+    plugin->deactivate(plugin);
+    plugin->destroy(plugin);
+    clap_entry.deinit();
+    tmp_project_end();
+}
+
+int main(void)
+{
+    printf("=== poryaaaa Plugin Unit Tests ===\n\n");
+
+    test_voicegroup_swap();
+    test_voicegroup_reload_held();
+
+    printf("\n=== Results: %d/%d tests passed ===\n", tests_passed, tests_run);
+    return (tests_passed == tests_run) ? 0 : 1;
+}
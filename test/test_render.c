@@ -0,0 +1,821 @@
+/*
+ * Unit tests for poryaaaa_render.
+ *
+ * The renderer is a single translation unit with static helpers, so it is
+ * included here whole, its main() renamed out of the way.
+ */
+#define main poryaaaa_render_main
+#include "../cmd/poryaaaa_render.c"
+#undef main
+#include "test_fixtures.h"
+
+#ifdef __linux__
+#include <utime.h>
+#endif
+
+static int tests_run = 0;
+static int tests_passed = 0;
+
+#define ASSERT(cond, msg) do { \
+    tests_run++; \
+    if (!(cond)) { \
+        fprintf(stderr, "FAIL: %s (line %d)\n", msg, __LINE__); \
+    } else { \
+        tests_passed++; \
+    } \
+} while(0)
+
+#define ASSERT_EQ(a, b, msg) do { \
+    tests_run++; \
+    if ((a) != (b)) { \
+        fprintf(stderr, "FAIL: %s: expected %d, got %d (line %d)\n", \
+                msg, (int)(b), (int)(a), __LINE__); \
+    } else { \
+        tests_passed++; \
+    } \
+} while(0)
+
+#define ASSERT_STR(a, b, msg) ASSERT((a) && strcmp((a), (b)) == 0, msg)
+
+/* Read a whole file; *size gets its length. */
+static uint8_t *read_file(const char *path, size_t *size)
+{
+    FILE *f = fopen(path, "rb");
+    if (!f) return NULL;
+    fseek(f, 0, SEEK_END);
+    long len = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    uint8_t *buf = malloc(len > 0 ? (size_t)len : 1);
+    *size = buf ? fread(buf, 1, (size_t)len, f) : 0;
+    fclose(f);
+    return buf;
+}
+
+static uint32_t get_le32(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+/* A project under `dir` whose voicegroup "one" has two DirectSound voices
+ * (programs 0 and 1) playing the same looping sample. */
+static void tmp_write_song_project(const char *dir)
+{
+    static const uint8_t sample[16 + 64] = {
+        [3] = 0x40,                         /* status: loop */
+        [4] = 0x44, [5] = 0xAC,             /* freq 0xAC44 = 44100 */
+        [12] = 64,                          /* size */
+        [16] = 0x40, 0x60, 0x7F, 0x60, 0x40, 0x00, 0xC0, 0xA0,
+        0x81, 0xA0, 0xC0, 0x00,
+    };
+    char rel[256];
+    snprintf(rel, sizeof(rel), "%s/sound/direct_sound_samples/one.bin", dir);
+    tmp_write(rel, sample, sizeof(sample));
+    snprintf(rel, sizeof(rel), "%s/sound/direct_sound_data.inc", dir);
+    tmp_write_text(rel, "SampleOne::\n\t.incbin \"sound/direct_sound_samples/one.bin\"\n");
+    snprintf(rel, sizeof(rel), "%s/sound/voicegroups/one.inc", dir);
+    tmp_write_text(rel, "voicegroup_one::\n"
+                        "\tvoice_directsound 60, 0, SampleOne, 255, 0, 255, 0\n"
+                        "\tvoice_directsound 60, 0, SampleOne, 255, 0, 128, 0\n");
+}
+
+/* Append a MIDI channel event after `delta` ticks (at most 16383). */
+static size_t put_midi_event(uint8_t *buf, size_t n, uint32_t delta,
+                             uint8_t status, uint8_t data0, uint8_t data1)
+{
+    if (delta > 127)
+        buf[n++] = (uint8_t)(0x80 | (delta >> 7));
+    buf[n++] = (uint8_t)(delta & 0x7F);
+    buf[n++] = status;
+    buf[n++] = data0;
+    if ((status & 0xF0) != 0xC0)
+        buf[n++] = data1;
+    return n;
+}
+
+/* Write a format 0 MIDI file at 120 BPM (96 ticks per beat): a note starts
+ * every second for `seconds` seconds, alternating between channel 0
+ * (program 0) and channel 1 (program 1), and is held for two seconds, so
+ * the channels overlap; the first note is `key`. */
+static void tmp_write_song(const char *rel, int seconds, uint8_t key)
+{
+    uint8_t buf[64 + 64 * 10];
+    memcpy(buf, "MThd\0\0\0\6\0\0\0\1\0\140MTrk\0\0\0\0", 22);
+    size_t n = 22;
+    n = put_midi_event(buf, n, 0, 0xC0, 0, 0);
+    n = put_midi_event(buf, n, 0, 0xC1, 1, 0);
+    if (seconds > 64)
+        seconds = 64;
+    for (int i = 0; i < seconds + 2; i++) {
+        uint32_t delta = i ? 192 : 0;
+        if (i >= 2) {
+            n = put_midi_event(buf, n, delta, (uint8_t)(0x80 | ((i - 2) & 1)),
+                               (uint8_t)(key + (i - 2) % 12), 0);
+            delta = 0;
+        }
+        if (i < seconds)
+            n = put_midi_event(buf, n, delta, (uint8_t)(0x90 | (i & 1)),
+                               (uint8_t)(key + i % 12), 100);
+    }
+    static const uint8_t end[] = { 0x00, 0xFF, 0x2F, 0x00 };
+    memcpy(buf + n, end, sizeof(end));
+    n += sizeof(end);
+    uint32_t trackLen = (uint32_t)(n - 22);
+    buf[18] = (uint8_t)(trackLen >> 24);
+    buf[19] = (uint8_t)(trackLen >> 16);
+    buf[20] = (uint8_t)(trackLen >> 8);
+    buf[21] = (uint8_t)trackLen;
+    tmp_write(rel, buf, n);
+}
+
+/* Read the 16-bit stereo samples of a WAV written by the renderer;
+ * *count gets the number of samples (two per frame). */
+static int16_t *read_wav_samples(const char *path, size_t *count)
+{
+    size_t size = 0;
+    uint8_t *data = read_file(path, &size);
+    *count = 0;
+    if (!data || size < 44) {
+        free(data);
+        return NULL;
+    }
+    *count = (size - 44) / 2;
+    int16_t *samples = malloc(*count ? *count * sizeof(int16_t) : 1);
+    for (size_t i = 0; samples && i < *count; i++)
+        samples[i] = (int16_t)(data[44 + i * 2] | (data[45 + i * 2] << 8));
+    free(data);
+    return samples;
+}
+
+/* The test signal: a ramp well past full scale at both ends, so clipping is
+ * covered, in both the vector and the scalar part of each block. */
+static float test_signal(uint32_t i, int channel)
+{
+    return (float)((int)((i * 7 + (uint32_t)channel * 3) % 2001) - 1000) / 800.0f;
+}
+
+static int16_t expected_s16(float v)
+{
+    float s = v * 32767.0f;
+    s = s > -32768.0f ? s : -32768.0f;
+    s = s < 32767.0f ? s : 32767.0f;
+    return (int16_t)s;
+}
+
+/* Streamed WAV output: blocks of any size across the write buffer, sizes
+ * patched on close, or written up front for a stream. */
+static void test_wav_writer(void)
+{
+    printf("Testing streamed WAV output...\n");
+
+    /* More frames than the write buffer holds, in blocks that do not divide it */
+    const uint32_t frames = WAV_WRITE_BUFFER / 4 + 12345;
+    const uint32_t block = 4097;
+    float *left = malloc(block * sizeof(float));
+    float *right = malloc(block * sizeof(float));
+
+    char path[512];
+    tmp_path(path, sizeof(path), "out.wav");
+    for (int stream = 0; stream < 2; stream++) {
+        WavWriter w;
+        int rc;
+        if (stream) {
+            FILE *f = fopen(path, "wb");
+            rc = f ? wav_open_stream(&w, f, 22050, frames) : -1;
+        } else {
+            rc = wav_open(&w, path, 22050);
+        }
+        ASSERT_EQ(rc, 0, "wav: opens");
+        if (rc != 0) continue;
+        for (uint32_t done = 0; done < frames; ) {
+            uint32_t n = frames - done < block ? frames - done : block;
+            for (uint32_t i = 0; i < n; i++) {
+                left[i] = test_signal(done + i, 0);
+                right[i] = test_signal(done + i, 1);
+            }
+            wav_write(&w, left, right, n);
+            done += n;
+        }
+        ASSERT_EQ(wav_close(&w), 0, "wav: closes");
+
+        size_t size = 0;
+        uint8_t *data = read_file(path, &size);
+        ASSERT(data && size == 44 + (size_t)frames * 4, "wav: file holds header and every frame");
+        if (data && size == 44 + (size_t)frames * 4) {
+            ASSERT(memcmp(data, "RIFF", 4) == 0 && memcmp(data + 8, "WAVEfmt ", 8) == 0 &&
+                   memcmp(data + 36, "data", 4) == 0, "wav: chunk layout");
+            ASSERT_EQ(get_le32(data + 4), 36 + frames * 4, "wav: RIFF size");
+            ASSERT_EQ(get_le32(data + 24), 22050, "wav: sample rate");
+            ASSERT_EQ(get_le32(data + 40), frames * 4, "wav: data size");
+            uint32_t wrong = 0;
+            for (uint32_t i = 0; i < frames; i++) {
+                const uint8_t *p = data + 44 + (size_t)i * 4;
+                if ((int16_t)(p[0] | (p[1] << 8)) != expected_s16(test_signal(i, 0)) ||
+                    (int16_t)(p[2] | (p[3] << 8)) != expected_s16(test_signal(i, 1)))
+                    wrong++;
+            }
+            ASSERT_EQ(wrong, 0, "wav: every frame converted and clipped");
+        }
+        free(data);
+        remove(path);
+    }
+    free(left);
+    free(right);
+}
+
+/*
+ * --play's ring buffer, without an audio device: the callback is driven from
+ * a thread standing in for the device's, while the render side queues more
+ * than the ring holds.  Every frame must come out once, in order; when the
+ * ring runs dry the callback pads with silence.
+ */
+typedef struct {
+    ma_device device;   /* only pUserData is used by playback_callback */
+    float    *got;      /* left channel of every frame played */
+    uint32_t  gotCount;
+    uint32_t  want;
+} PlaybackTestSink;
+
+static void *playback_test_device(void *arg)
+{
+    PlaybackTestSink *sink = (PlaybackTestSink *)arg;
+    float buf[480 * 2];
+    while (sink->gotCount < sink->want) {
+        playback_callback(&sink->device, buf, NULL, 480);
+        /* Frames are 1-based, so the silence padding an underrun ends with
+         * is told apart from audio. */
+        for (int i = 0; i < 480 && buf[i * 2] != 0.0f && sink->gotCount < sink->want; i++) {
+            sink->got[sink->gotCount] = buf[i * 2];
+            if (buf[i * 2 + 1] != -buf[i * 2])
+                sink->got[sink->gotCount] = -1.0f;   /* channels swapped or torn */
+            sink->gotCount++;
+        }
+        ma_sleep(1);
+    }
+    return NULL;
+}
+
+static void test_playback_ring(void)
+{
+    printf("Testing --play ring buffer...\n");
+
+    PlaybackCtx ctx;
+    memset(&ctx, 0, sizeof(ctx));
+    ma_uint32 ringFrames = 2 * PLAYBACK_PREFILL_FRAMES;
+    ASSERT(ma_pcm_rb_init(ma_format_f32, 2, ringFrames, NULL, NULL, &ctx.rb) == MA_SUCCESS,
+           "ring: allocated");
+    ctx.started = true;   /* no device to start */
+
+    static PlaybackTestSink sink;
+    memset(&sink, 0, sizeof(sink));
+    sink.device.pUserData = &ctx;
+    sink.want = ringFrames * 3 + 123;
+    sink.got = malloc(sink.want * sizeof(float));
+
+    pthread_t device;
+    pthread_create(&device, NULL, playback_test_device, &sink);
+    float left[1000], right[1000];
+    int rc = 0;
+    for (uint32_t done = 0; done < sink.want && rc == 0; ) {
+        uint32_t n = sink.want - done < 1000 ? sink.want - done : 1000;
+        for (uint32_t i = 0; i < n; i++) {
+            left[i] = (float)(done + i + 1);
+            right[i] = -left[i];
+        }
+        rc = playback_write(&ctx, left, right, (int)n);
+        done += n;
+    }
+    pthread_join(device, NULL);
+    ASSERT_EQ(rc, 0, "ring: every block queued");
+
+    uint32_t wrong = 0;
+    for (uint32_t i = 0; i < sink.gotCount; i++)
+        if (sink.got[i] != (float)(i + 1))
+            wrong++;
+    ASSERT_EQ(sink.gotCount, sink.want, "ring: every frame played");
+    ASSERT_EQ(wrong, 0, "ring: frames played once each, in order");
+
+    float tail[64 * 2];
+    for (int i = 0; i < 64 * 2; i++) tail[i] = 1.0f;
+    playback_callback(&sink.device, tail, NULL, 64);
+    int silent = 1;
+    for (int i = 0; i < 64 * 2; i++)
+        if (tail[i] != 0.0f) silent = 0;
+    ASSERT(silent, "ring: underrun plays silence");
+
+    free(sink.got);
+    ma_pcm_rb_uninit(&ctx.rb);
+}
+
+/* Read `text` as a manifest; returns batch_read_manifest()'s result. */
+static int read_manifest(BatchRun *run, const char *text, const RenderOptions *defaults)
+{
+    char path[512];
+    tmp_path(path, sizeof(path), "manifest.txt");
+    tmp_write_text("manifest.txt", text);
+    memset(run, 0, sizeof(*run));
+    int rc = batch_read_manifest(run, path, defaults);
+    remove(path);
+    return rc;
+}
+
+static void test_batch_manifest(void)
+{
+    printf("Testing --batch manifest parsing...\n");
+
+    RenderOptions defaults = s_defaultRenderOptions;
+    defaults.es.reverbAmount = 20;
+
+    /* Paths are kept as written: relative ones are relative to the working
+     * directory the renderer runs in, not to the manifest. */
+    BatchRun run;
+    int rc = read_manifest(&run,
+        "# soundtrack\n"
+        "songs/a.mid  petalburg  out/a.wav\n"
+        "\"songs/b c.mid\" petalburg \"out/b c.wav\" --reverb 50   # comment\n"
+        "\n"
+        "   \t\n"
+        "../c.mid route101 /abs/c.wav --polyphony 3 --reverb 10\r\n",
+        &defaults);
+    ASSERT_EQ(rc, 0, "manifest: reads");
+    ASSERT_EQ(run.jobCount, 3, "manifest: one job per non-blank line");
+    ASSERT_EQ(run.vgCount, 2, "manifest: voicegroups collected once each");
+    if (rc == 0 && run.jobCount == 3 && run.vgCount == 2) {
+        ASSERT_STR(run.vgNames[0], "petalburg", "manifest: first voicegroup");
+        ASSERT_STR(run.vgNames[1], "route101", "manifest: second voicegroup");
+
+        ASSERT_STR(run.jobs[0].midiPath, "songs/a.mid", "manifest: relative MIDI path as written");
+        ASSERT_STR(run.jobs[0].outputPath, "out/a.wav", "manifest: relative output path as written");
+        ASSERT_EQ(run.jobs[0].voicegroup, 0, "manifest: job 0 voicegroup");
+        ASSERT_EQ(run.jobs[0].line, 2, "manifest: job 0 line");
+        ASSERT_EQ(run.jobs[0].opts.es.reverbAmount, 20, "manifest: command-line option applies");
+
+        ASSERT_STR(run.jobs[1].midiPath, "songs/b c.mid", "manifest: quoted path");
+        ASSERT_STR(run.jobs[1].outputPath, "out/b c.wav", "manifest: quoted output path");
+        ASSERT_EQ(run.jobs[1].voicegroup, 0, "manifest: job 1 shares job 0's voicegroup");
+        ASSERT_EQ(run.jobs[1].opts.es.reverbAmount, 50, "manifest: line option overrides");
+
+        ASSERT_STR(run.jobs[2].midiPath, "../c.mid", "manifest: parent-relative path as written");
+        ASSERT_STR(run.jobs[2].outputPath, "/abs/c.wav", "manifest: absolute path");
+        ASSERT_EQ(run.jobs[2].voicegroup, 1, "manifest: job 2 voicegroup");
+        ASSERT_EQ(run.jobs[2].line, 6, "manifest: line numbers count blank lines");
+        ASSERT_EQ(run.jobs[2].opts.es.reverbAmount, 10, "manifest: job 2 reverb");
+        ASSERT_EQ(run.jobs[2].opts.es.maxChannels, 3, "manifest: job 2 polyphony");
+        ASSERT_EQ(run.jobs[0].opts.es.maxChannels, defaults.es.maxChannels,
+                  "manifest: a line's options stay on its job");
+    }
+    batch_free(&run);
+
+    static const struct { const char *text, *what; } bad[] = {
+        { "a.mid petalburg\n",                          "manifest: missing output rejected" },
+        { "a.mid petalburg a.wav --bogus\n",            "manifest: unknown option rejected" },
+        { "a.mid petalburg a.wav --reverb\n",           "manifest: option without value rejected" },
+        { "\"a.mid petalburg a.wav\n",                  "manifest: unterminated quote rejected" },
+        { "a.mid petalburg a.wav\nb.mid petalburg\n",   "manifest: bad later line rejected" },
+    };
+    for (size_t i = 0; i < sizeof(bad) / sizeof(bad[0]); i++) {
+        ASSERT_EQ(read_manifest(&run, bad[i].text, &defaults), -1, bad[i].what);
+        batch_free(&run);
+    }
+
+    char missing[512];
+    tmp_path(missing, sizeof(missing), "no-such-manifest.txt");
+    memset(&run, 0, sizeof(run));
+    ASSERT_EQ(batch_read_manifest(&run, missing, &defaults), -1, "manifest: missing file rejected");
+    batch_free(&run);
+}
+
+/* Render `midi` to `out` the way a --batch job does, through the same
+ * plan, cursor and .ckpt handling as a single render. */
+static int render_song(const char *midi, const char *out, const RenderOptions *opts,
+                       LoadedVoiceGroup *vg)
+{
+    BatchJob job = { .midiPath = (char *)midi, .outputPath = (char *)out, .opts = *opts };
+    return batch_render_job(&job, vg);
+}
+
+/* Where checkpoints_begin() would resume a render of `midi` from `ckpt`
+ * (0 = the beginning). */
+static uint64_t checkpoint_resume_pos(const char *midi, const char *ckpt, const RenderOptions *opts,
+                                      LoadedVoiceGroup *vg)
+{
+    RenderPlan plan;
+    if (plan_render(&plan, midi, NULL, 0, opts, false) != 0)
+        return UINT64_MAX;
+    RenderState *r = calloc(1, sizeof(RenderState));
+    uint64_t pos = UINT64_MAX;
+    if (r) {
+        engine_setup(&r->engine, &opts->es, vg);
+        cursor_init(&r->cursor, &r->engine, &plan, &opts->es);
+        checkpoints_begin(&r->cursor, &r->checkpoints, ckpt, &plan, &opts->es, vg, false);
+        pos = r->cursor.pos;
+        checkpoints_free(&r->checkpoints);
+        m4a_engine_destroy(&r->engine);
+        free(r);
+    }
+    plan_free(&plan);
+    return pos;
+}
+
+static int peak_sample(const int16_t *s, size_t count)
+{
+    int peak = 0;
+    for (size_t i = 0; s && i < count; i++)
+        if (abs(s[i]) > peak)
+            peak = abs(s[i]);
+    return peak;
+}
+
+/* Largest difference between two runs of samples; INT_MAX if either is
+ * missing or too short. */
+static int max_sample_diff(const int16_t *a, size_t aCount, const int16_t *b, size_t bCount,
+                           size_t count)
+{
+    if (!a || !b || aCount < count || bCount < count)
+        return INT_MAX;
+    int worst = 0;
+    for (size_t i = 0; i < count; i++) {
+        int d = abs((int)a[i] - (int)b[i]);
+        if (d > worst)
+            worst = d;
+    }
+    return worst;
+}
+
+/*
+ * --start/--end with --checkpoints: a render resumed from a saved checkpoint
+ * gives the same samples as one fast-forwarded from the beginning, both
+ * match that range of a full render, and a checkpoint file made for other
+ * events or settings is ignored.  Reverb is off: with it, a partial render
+ * can differ from the full one by the small DC offset a reverb tail holds.
+ */
+static void test_checkpoint_render(void)
+{
+    printf("Testing --start/--end rendering with checkpoints...\n");
+
+    tmp_write_song_project("ckpt");
+    tmp_write_song("ckpt/song.mid", 24, 60);
+    tmp_write_song("ckpt/other.mid", 24, 62);
+    char root[512], song[512], other[512], full[512], part[512], ck[512], ckpt[520];
+    tmp_path(root, sizeof(root), "ckpt");
+    tmp_path(song, sizeof(song), "ckpt/song.mid");
+    tmp_path(other, sizeof(other), "ckpt/other.mid");
+    tmp_path(full, sizeof(full), "ckpt/full.wav");
+    tmp_path(part, sizeof(part), "ckpt/part.wav");
+    tmp_path(ck, sizeof(ck), "ckpt/ck.wav");
+    snprintf(ckpt, sizeof(ckpt), "%s.ckpt", ck);
+
+    VoicegroupLoaderConfig cfg = { .noIndexCache = true };
+    LoadedVoiceGroup *vg = voicegroup_load(root, "one", &cfg);
+    ASSERT(vg != NULL, "ckpt: voicegroup loads");
+    if (!vg)
+        return;
+
+    RenderOptions opts = s_defaultRenderOptions;
+    opts.es.sampleRateHz = 8000;
+    opts.tailSeconds = 0.5;
+    ASSERT_EQ(render_song(song, full, &opts, vg), 0, "ckpt: full render");
+
+    opts.startSeconds = 15.0;
+    opts.endSeconds = 20.0;
+    ASSERT_EQ(render_song(song, part, &opts, vg), 0, "ckpt: partial render");
+    opts.useCheckpoints = true;
+    remove(ckpt);
+    ASSERT_EQ(render_song(song, ck, &opts, vg), 0, "ckpt: render saving checkpoints");
+    size_t ckptSize = 0;
+    uint8_t *ckptData = read_file(ckpt, &ckptSize);
+    ASSERT(ckptData && ckptSize > 0, "ckpt: checkpoint file written");
+    free(ckptData);
+
+    size_t fullCount, partCount, firstCount, resumedCount;
+    int16_t *fullS = read_wav_samples(full, &fullCount);
+    int16_t *partS = read_wav_samples(part, &partCount);
+    int16_t *firstS = read_wav_samples(ck, &firstCount);
+    ASSERT(checkpoint_resume_pos(song, ckpt, &opts, vg) == 10 * 8000,
+           "ckpt: next render resumes from the checkpoint at 10 s");
+    ASSERT_EQ(render_song(song, ck, &opts, vg), 0, "ckpt: render resuming from a checkpoint");
+    int16_t *resumedS = read_wav_samples(ck, &resumedCount);
+
+    size_t count = 5 * 8000 * 2;
+    ASSERT_EQ(partCount, count, "ckpt: partial render covers --start to --end");
+    ASSERT(peak_sample(partS, partCount) > 1000, "ckpt: partial render has sound");
+    ASSERT_EQ(max_sample_diff(firstS, firstCount, partS, partCount, count), 0,
+              "ckpt: saving checkpoints leaves the output alone");
+    ASSERT_EQ(max_sample_diff(resumedS, resumedCount, partS, partCount, count), 0,
+              "ckpt: resumed render matches the one from the beginning");
+    ASSERT(fullCount >= 20 * 8000 * 2, "ckpt: full render covers the range");
+    if (fullCount >= 20 * 8000 * 2)
+        ASSERT_EQ(max_sample_diff(partS, partCount, fullS + 15 * 8000 * 2, count, count), 0,
+                  "ckpt: partial render matches the range of the full one");
+    free(fullS);
+    free(partS);
+    free(firstS);
+    free(resumedS);
+
+    /* Other events or other settings key a different render */
+    ASSERT(checkpoint_resume_pos(other, ckpt, &opts, vg) == 0,
+           "ckpt: checkpoint for other events ignored");
+    RenderOptions louder = opts;
+    louder.es.songVolume = 100;
+    ASSERT(checkpoint_resume_pos(song, ckpt, &louder, vg) == 0,
+           "ckpt: checkpoint for other settings ignored");
+
+    /* ...and a render with the stale file matches one without it */
+    ASSERT_EQ(render_song(other, ck, &opts, vg), 0, "ckpt: render over a stale checkpoint");
+    opts.useCheckpoints = false;
+    ASSERT_EQ(render_song(other, part, &opts, vg), 0, "ckpt: render without checkpoints");
+    int16_t *staleS = read_wav_samples(ck, &firstCount);
+    partS = read_wav_samples(part, &partCount);
+    ASSERT_EQ(max_sample_diff(staleS, firstCount, partS, partCount, count), 0,
+              "ckpt: stale checkpoint does not change the output");
+    free(staleS);
+    free(partS);
+
+    voicegroup_free(vg);
+}
+
+/*
+ * --stems writes one file per track that plays notes, and without reverb
+ * the stems sum to the full mix: up to output rounding at a PCM mix rate
+ * equal to the host rate, and within one PCM mix step per stem (128 in
+ * 16-bit output) at the GBA rate, where the upsampler rounds each stem on
+ * its own.
+ */
+static void test_stems_render(void)
+{
+    printf("Testing --stems rendering...\n");
+
+    tmp_write_song_project("stems");
+    tmp_write_song("stems/song.mid", 6, 60);
+    char root[512], song[512], mix[512], dir[512];
+    tmp_path(root, sizeof(root), "stems");
+    tmp_path(song, sizeof(song), "stems/song.mid");
+    tmp_path(mix, sizeof(mix), "stems/mix.wav");
+    tmp_path(dir, sizeof(dir), "stems/out");
+
+    static const struct { const char *mixRate; int tolerance; const char *what; } runs[] = {
+        { "0",     2,           "stems: sum to the mix up to output rounding at the host rate" },
+        { "13379", 2 * 128 + 2, "stems: sum to the mix within a PCM step each at the GBA rate" },
+    };
+    for (size_t r = 0; r < sizeof(runs) / sizeof(runs[0]); r++) {
+        char *argv[] = { "poryaaaa_render", root, "one", "--midi", song, "--output", mix,
+                         "--stems", dir, "--sample-rate", "44100", "--tail", "0.5",
+                         "--pcm-mix-rate", (char *)runs[r].mixRate, "--jobs", "2", NULL };
+        ASSERT_EQ(poryaaaa_render_main((int)(sizeof(argv) / sizeof(argv[0])) - 1, argv), 0,
+                  "stems: render succeeds");
+
+        int files = 0;
+        DIR *d = opendir(dir);
+        for (struct dirent *ent; d && (ent = readdir(d)) != NULL; )
+            if (ent->d_name[0] != '.')
+                files++;
+        if (d)
+            closedir(d);
+        ASSERT_EQ(files, 2, "stems: one file per track that plays");
+
+        char path0[600], path1[600];
+        snprintf(path0, sizeof(path0), "%s/track00.wav", dir);
+        snprintf(path1, sizeof(path1), "%s/track01.wav", dir);
+        size_t mixCount, count0, count1;
+        int16_t *mixS = read_wav_samples(mix, &mixCount);
+        int16_t *s0 = read_wav_samples(path0, &count0);
+        int16_t *s1 = read_wav_samples(path1, &count1);
+        ASSERT(mixS && s0 && s1 && count0 == mixCount && count1 == mixCount && mixCount > 0,
+               "stems: every stem as long as the mix");
+        ASSERT(peak_sample(s0, count0) > 1000 && peak_sample(s1, count1) > 1000,
+               "stems: each stem has its track");
+        int worst = mixS && s0 && s1 ? 0 : INT_MAX;
+        for (size_t i = 0; worst != INT_MAX && i < mixCount && i < count0 && i < count1; i++) {
+            int d = abs((int)s0[i] + (int)s1[i] - (int)mixS[i]);
+            if (d > worst)
+                worst = d;
+        }
+        ASSERT(worst <= runs[r].tolerance, runs[r].what);
+        free(mixS);
+        free(s0);
+        free(s1);
+        tmp_remove_tree(dir);
+    }
+}
+
+#ifdef __linux__
+static void test_watcher_changes(void)
+{
+    printf("Testing --watch change detection...\n");
+
+    char midi[512], symbols[512], sample[512];
+    tmp_path(midi, sizeof(midi), "song.mid");
+    tmp_path(symbols, sizeof(symbols), "direct_sound_data.inc");
+    tmp_path(sample, sizeof(sample), "sample.bin");
+    tmp_write_text("song.mid", "MThd");
+    tmp_write_text("direct_sound_data.inc", "Sample::\n");
+    tmp_write_text("sample.bin", "bin");
+
+    Watcher w = { .fd = -1 };
+    watcher_add(&w, midi, voicegroup_file_mtime(midi), WATCH_MIDI);
+    watcher_add(&w, symbols, voicegroup_file_mtime(symbols), WATCH_PROJECT);
+    watcher_add(&w, sample, voicegroup_file_mtime(sample), WATCH_VOICEGROUP);
+    watcher_add(&w, sample, voicegroup_file_mtime(sample), WATCH_PROJECT);
+    ASSERT_EQ(w.count, 3, "watch: a file is watched once");
+    ASSERT_EQ(watcher_changes(&w), 0, "watch: nothing changed yet");
+
+    /* Modification times are compared for equality, so moving one back
+     * counts as a change as much as moving it forward. */
+    time_t past = time(NULL) - 1000;
+    struct utimbuf times = { past, past };
+    utime(sample, &times);
+    ASSERT_EQ(watcher_changes(&w), WATCH_VOICEGROUP, "watch: sample change reloads the voicegroup");
+
+    utime(midi, &times);
+    ASSERT_EQ(watcher_changes(&w), WATCH_MIDI | WATCH_VOICEGROUP, "watch: changes add up");
+
+    remove(symbols);
+    ASSERT_EQ(watcher_changes(&w), WATCH_MIDI | WATCH_PROJECT | WATCH_VOICEGROUP,
+              "watch: a deleted file is a change");
+
+    for (int i = 0; i < w.count; i++)
+        w.files[i].mtime = voicegroup_file_mtime(w.files[i].path);
+    ASSERT_EQ(watcher_changes(&w), 0, "watch: caught up after re-reading");
+
+    free(w.files);
+    remove(midi);
+    remove(sample);
+}
+#endif
+
+#ifndef _WIN32
+/*
+ * --serve, without a listening socket: each request goes to serve_connection
+ * over a socket pair, written whole before the server thread starts so it
+ * never waits on the test.
+ */
+static size_t serve_test_request(const char *head, const uint8_t *midi, size_t midiSize,
+                                 uint8_t **reply)
+{
+    *reply = NULL;
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0)
+        return 0;
+    if (write(fds[0], head, strlen(head)) < 0 ||
+        (midi && write(fds[0], midi, midiSize) < 0)) {
+        close(fds[0]);
+        close(fds[1]);
+        return 0;
+    }
+    shutdown(fds[0], SHUT_WR);
+
+    pthread_t server;
+    if (pthread_create(&server, NULL, serve_connection, (void *)(intptr_t)fds[1]) != 0) {
+        close(fds[0]);
+        close(fds[1]);
+        return 0;
+    }
+    size_t len = 0, cap = 0;
+    uint8_t buf[1 << 14];
+    ssize_t n;
+    while ((n = read(fds[0], buf, sizeof(buf))) > 0) {
+        if (len + (size_t)n + 1 > cap) {
+            cap = (len + (size_t)n + 1) * 2;
+            *reply = realloc(*reply, cap);
+        }
+        memcpy(*reply + len, buf, (size_t)n);
+        len += (size_t)n;
+        (*reply)[len] = '\0';
+    }
+    pthread_join(server, NULL);
+    close(fds[0]);
+    return len;
+}
+
+/* The cached entry for a voicegroup of a served project, if any. */
+static ServedVoicegroup *serve_test_cached(const char *root, const char *name)
+{
+    for (ServedProject *sp = s_servedProjects; sp; sp = sp->next) {
+        if (strcmp(sp->root, root) != 0)
+            continue;
+        for (ServedVoicegroup *sv = sp->vgs; sv; sv = sv->next)
+            if (strcmp(sv->name, name) == 0)
+                return sv;
+    }
+    return NULL;
+}
+
+/* Whether a reply is "ok" followed by a whole WAV with some sound in it. */
+static bool serve_test_rendered(const uint8_t *reply, size_t len)
+{
+    if (len < 3 + 44 || memcmp(reply, "ok\n", 3) != 0 || memcmp(reply + 3, "RIFF", 4) != 0)
+        return false;
+    if (len != 3 + 8 + (size_t)get_le32(reply + 7))
+        return false;
+    for (size_t i = 3 + 44; i < len; i++)
+        if (reply[i])
+            return true;
+    return false;
+}
+
+static void test_serve_requests(void)
+{
+    printf("Testing --serve requests...\n");
+
+    tmp_write_song_project("serve");
+    char root[512], cache[512];
+    tmp_path(root, sizeof(root), "serve");
+    tmp_path(cache, sizeof(cache), "cache");
+    /* Keep the project index out of the user's cache directory */
+    const char *oldCache = getenv("XDG_CACHE_HOME");
+    char *savedCache = oldCache ? str_dup(oldCache) : NULL;
+    setenv("XDG_CACHE_HOME", cache, 1);
+
+    /* One quarter note of middle C at 120 BPM */
+    static const uint8_t midi[] = {
+        'M', 'T', 'h', 'd', 0, 0, 0, 6, 0, 0, 0, 1, 0, 96,
+        'M', 'T', 'r', 'k', 0, 0, 0, 16,
+        0x00, 0xC0, 0x00,
+        0x00, 0x90, 0x3C, 0x64,
+        0x60, 0x80, 0x3C, 0x00,
+        0x00, 0xFF, 0x2F, 0x00,
+    };
+    char head[1024];
+    uint8_t *reply;
+    size_t len;
+
+    snprintf(head, sizeof(head), "%s\nproject %s\nvoicegroup one\noption --tail\noption 0.25\n"
+             "midi %d\n", SERVE_PROTOCOL, root, (int)sizeof(midi));
+    len = serve_test_request(head, midi, sizeof(midi), &reply);
+    ASSERT(serve_test_rendered(reply, len), "serve: request renders a whole WAV");
+    ServedVoicegroup *first = serve_test_cached(root, "one");
+    ASSERT(first && first->state == SERVE_READY && first->refs == 1,
+           "serve: voicegroup stays cached once the render is done");
+    free(reply);
+
+    len = serve_test_request("poryaaaa-render 0\nproject x\nvoicegroup y\nmidi 4\nMThd",
+                             NULL, 0, &reply);
+    ASSERT_STR((char *)reply, "error unsupported protocol\n", "serve: bad protocol line rejected");
+    free(reply);
+
+    snprintf(head, sizeof(head), "%s\nproject %s\nvoicegroup one\nmidi %d\n",
+             SERVE_PROTOCOL, root, SERVE_MAX_MIDI + 1);
+    len = serve_test_request(head, NULL, 0, &reply);
+    ASSERT_STR((char *)reply, "error bad MIDI size\n", "serve: MIDI over the size limit rejected");
+    free(reply);
+
+    /* A voicegroup that fails to load is not cached, so each request tries again */
+    snprintf(head, sizeof(head), "%s\nproject %s\nvoicegroup missing\nmidi %d\n",
+             SERVE_PROTOCOL, root, (int)sizeof(midi));
+    for (int i = 0; i < 2; i++) {
+        len = serve_test_request(head, midi, sizeof(midi), &reply);
+        ASSERT_STR((char *)reply, "error cannot load the voicegroup\n",
+                   "serve: missing voicegroup rejected");
+        ASSERT(serve_test_cached(root, "missing") == NULL, "serve: failed voicegroup not cached");
+        free(reply);
+    }
+    ASSERT(serve_test_cached(root, "one") == first, "serve: failure leaves other voicegroups cached");
+
+    /* A reload while a render holds the voicegroup: the holder keeps its copy,
+     * the cache gets a fresh one */
+    ServedVoicegroup *held = serve_acquire(root, "one", false);
+    ASSERT(held == first, "serve: acquire shares the cached voicegroup");
+    snprintf(head, sizeof(head), "%s\nproject %s\nvoicegroup one\noption --tail\noption 0.25\n"
+             "reload\nmidi %d\n", SERVE_PROTOCOL, root, (int)sizeof(midi));
+    len = serve_test_request(head, midi, sizeof(midi), &reply);
+    ASSERT(serve_test_rendered(reply, len), "serve: reload renders");
+    free(reply);
+    ServedVoicegroup *fresh = serve_test_cached(root, "one");
+    ASSERT(fresh && fresh != held && fresh->vg != held->vg, "serve: reload caches a new copy");
+    ASSERT(held->vg && held->state == SERVE_READY && held->refs == 1,
+           "serve: held copy outlives the reload, dropped from the cache");
+    serve_release(held);
+
+    pthread_mutex_lock(&s_serveLock);
+    while (s_servedProjects)
+        served_project_drop(&s_servedProjects);
+    pthread_mutex_unlock(&s_serveLock);
+    if (savedCache) {
+        setenv("XDG_CACHE_HOME", savedCache, 1);
+        free(savedCache);
+    } else {
+        unsetenv("XDG_CACHE_HOME");
+    }
+}
+#endif
+
+int main(void)
+{
+    printf("=== poryaaaa_render Unit Tests ===\n\n");
+
+    tmp_project_begin("render");
+    test_wav_writer();
+    test_playback_ring();
+    test_batch_manifest();
+    test_checkpoint_render();
+    test_stems_render();
+#ifndef _WIN32
+    test_serve_requests();
+#endif
+#ifdef __linux__
+    test_watcher_changes();
+#endif
+    tmp_project_end();
+
+    printf("\n=== Results: %d/%d tests passed ===\n", tests_passed, tests_run);
+    return (tests_passed == tests_run) ? 0 : 1;
+}